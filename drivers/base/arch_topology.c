@@ -114,6 +114,49 @@ void topology_set_cpu_scale(unsigned int cpu, unsigned long capacity)
 	per_cpu(cpu_scale, cpu) = capacity;
 }
 
+/**
+ * topology_lowest_capacity_cpus - find the most efficient CPUs
+ * @mask: filled with the possible CPUs of the lowest cpu_scale
+ *
+ * With symmetric (or not yet known) capacities that is every possible CPU.
+ */
+void topology_lowest_capacity_cpus(struct cpumask *mask)
+{
+	unsigned long min_cap = ULONG_MAX;
+	int cpu;
+
+	mutex_lock(&cpu_scale_mutex);
+	for_each_possible_cpu(cpu)
+		min_cap = min(min_cap, topology_get_cpu_scale(NULL, cpu));
+	cpumask_clear(mask);
+	for_each_possible_cpu(cpu)
+		if (topology_get_cpu_scale(NULL, cpu) == min_cap)
+			cpumask_set_cpu(cpu, mask);
+	mutex_unlock(&cpu_scale_mutex);
+}
+
+static BLOCKING_NOTIFIER_HEAD(cpu_scale_notifier_list);
+
+/**
+ * topology_register_cpu_scale_notifier - get told about cpu_scale changes
+ * @nb: called in process context after the capacities of the CPUs changed
+ *
+ * Capacities change when cpufreq brings up the last policy of a system
+ * with capacity-dmips-mhz in its DT, which can be any time during or after
+ * boot, and on writes to the cpu_capacity sysfs files.
+ */
+int topology_register_cpu_scale_notifier(struct notifier_block *nb)
+{
+	return blocking_notifier_chain_register(&cpu_scale_notifier_list, nb);
+}
+
+/* Run the notifiers outside of the cpufreq and cpu_scale locking. */
+static void cpu_scale_notify_workfn(struct work_struct *work)
+{
+	blocking_notifier_call_chain(&cpu_scale_notifier_list, 0, NULL);
+}
+static DECLARE_WORK(cpu_scale_notify_work, cpu_scale_notify_workfn);
+
 static ssize_t cpu_capacity_show(struct device *dev,
 				 struct device_attribute *attr,
 				 char *buf)
@@ -180,6 +223,8 @@ static ssize_t cpu_capacity_store(struct device *dev,
 		topology_set_cpu_scale(i, new_capacity);
 	mutex_unlock(&cpu_scale_mutex);
 
+	schedule_work(&cpu_scale_notify_work);
+
 	if (topology_detect_flags())
 		schedule_work(&update_topology_flags_work);
 
@@ -421,6 +466,8 @@ void topology_normalize_cpu_scale(void)
 			raw_capacity[cpu]);
 	}
 	mutex_unlock(&cpu_scale_mutex);
+
+	schedule_work(&cpu_scale_notify_work);
 }
 
 bool __init topology_parse_cpu_capacity(struct device_node *cpu_node, int cpu)
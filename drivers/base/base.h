@@ -75,6 +75,11 @@ struct device_private {
 	struct klist_node knode_driver;
 	struct klist_node knode_bus;
 	struct list_head deferred_probe;
+	struct list_head boot_probe_parked;
+	struct boot_probe_sups *boot_probe_sups;
+	bool boot_probe_released;
+	unsigned int probe_defers;
+	int probe_rec;
 	struct device *device;
 };
 #define to_device_private_parent(obj)	\
@@ -115,6 +120,7 @@ extern void device_release_driver_internal(struct device *dev,
 extern void driver_detach(struct device_driver *drv);
 extern int driver_probe_device(struct device_driver *drv, struct device *dev);
 extern void driver_deferred_probe_del(struct device *dev);
+extern void driver_boot_probe_del(struct device *dev);
 static inline int driver_match_device(struct device_driver *drv,
 				      struct device *dev)
 {
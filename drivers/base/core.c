@@ -1792,6 +1792,8 @@ int device_private_init(struct device *dev)
 	klist_init(&dev->p->klist_children, klist_children_get,
 		   klist_children_put);
 	INIT_LIST_HEAD(&dev->p->deferred_probe);
+	INIT_LIST_HEAD(&dev->p->boot_probe_parked);
+	dev->p->probe_rec = -1;
 	return 0;
 }
 
@@ -2072,6 +2074,7 @@ void device_del(struct device *dev)
 	bus_remove_device(dev);
 	device_pm_remove(dev);
 	driver_deferred_probe_del(dev);
+	driver_boot_probe_del(dev);
 	device_remove_properties(dev);
 	device_links_purge(dev);
 
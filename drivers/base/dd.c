@@ -27,6 +27,10 @@
 #include <linux/async.h>
 #include <linux/pm_runtime.h>
 #include <linux/pinctrl/devinfo.h>
+#include <linux/of.h>
+#include <linux/of_platform.h>
+#include <linux/platform_device.h>
+#include <linux/slab.h>
 
 #include "base.h"
 #include "power/power.h"
@@ -59,6 +63,7 @@ static bool initcalls_done;
 /* Save the async probe drivers' name from kernel cmdline */
 #define ASYNC_DRV_NAMES_MAX_LEN	256
 static char async_probe_drv_names[ASYNC_DRV_NAMES_MAX_LEN];
+static bool async_probe_default;
 
 /*
  * In some cases, like suspend to RAM or hibernation, It might be reasonable
@@ -242,6 +247,397 @@ static void enable_trigger_defer_cycle(void)
 	flush_work(&deferred_probe_work);
 }
 
+/*
+ * Boot-time probe tracking and dependency-aware async probing.
+ *
+ * With CONFIG_DRIVER_PROBE_STATS, every probe attempt until late_initcall
+ * is recorded along with the dependency it had to wait for, so the chain of
+ * probes that bounds driver initialisation can be reconstructed; see
+ * driver_probe_stat().
+ *
+ * With "driver_async_probe=*" every driver that does not force synchronous
+ * probing is probed from the async pool.  An async probe whose device link
+ * or DT suppliers are not bound yet is parked rather than run only to return
+ * -EPROBE_DEFER, and is rescheduled as soon as the last of them binds.
+ * Anything still parked is released into normal probing by the next
+ * deferred_probe_initcall(), run at the end of the arch, subsys, fs and
+ * device initcall levels, and is not parked again.  A supplier that never
+ * binds thus costs at most the rest of one level.
+ *
+ * Neither is done otherwise.  The DT suppliers of a device are resolved
+ * once, since each phandle costs a walk of the platform bus, and are kept
+ * until late_initcall_sync or until the device is deleted.
+ */
+#define BOOT_PROBE_MAX_RECS	1024
+
+struct boot_probe_sups {
+	struct list_head node;
+	struct device *dev;
+	unsigned int nr;
+	unsigned int max;
+	struct device *sup[];
+};
+
+static DEFINE_MUTEX(boot_probe_mutex);
+static LIST_HEAD(boot_probe_parked);
+static LIST_HEAD(boot_probe_sups_list);
+static struct driver_probe_stat *boot_probe_recs;
+static unsigned int boot_probe_nr;
+static bool boot_probe_done;
+
+static void __device_attach_async_helper(void *_dev, async_cookie_t cookie);
+
+#ifdef CONFIG_OF
+static bool device_is_ancestor(struct device *anc, struct device *dev)
+{
+	for (dev = dev->parent; dev; dev = dev->parent)
+		if (dev == anc)
+			return true;
+	return false;
+}
+
+static const struct {
+	const char *list;
+	const char *cells;
+} boot_probe_of_deps[] = {
+	{ "clocks",		"#clock-cells" },
+	{ "power-domains",	"#power-domain-cells" },
+	{ "iommus",		"#iommu-cells" },
+	{ "resets",		"#reset-cells" },
+	{ "interconnects",	"#interconnect-cells" },
+	{ "mboxes",		"#mbox-cells" },
+	{ "dmas",		"#dma-cells" },
+	{ "phys",		"#phy-cells" },
+};
+
+/*
+ * Providers are frequently subnodes of the device that registers them
+ * (regulators under a PMIC, clocks under a clock controller), so walk up
+ * until a node with a platform device is found.  Returns a reference.
+ */
+static struct device *of_supplier_device(struct device_node *np)
+{
+	struct platform_device *pdev;
+
+	for (np = of_node_get(np); np; np = of_get_next_parent(np)) {
+		pdev = of_find_device_by_node(np);
+		if (pdev) {
+			of_node_put(np);
+			return &pdev->dev;
+		}
+	}
+	return NULL;
+}
+
+static bool of_supplier_call(struct device *dev, struct device_node *np,
+			     bool (*fn)(struct device *, void *), void *data)
+{
+	struct device *sup;
+	bool stop = false;
+
+	sup = of_supplier_device(np);
+	of_node_put(np);
+	if (!sup)
+		return false;
+
+	if (sup != dev && !device_is_ancestor(sup, dev))
+		stop = fn(sup, data);
+	put_device(sup);
+	return stop;
+}
+
+/*
+ * Call @fn for the providers of the DT clocks, supplies, power domains and
+ * friends of @dev.  Returns true as soon as @fn does.
+ */
+static bool device_for_each_of_dep(struct device *dev,
+				   bool (*fn)(struct device *, void *),
+				   void *data)
+{
+	struct device_node *np = dev->of_node;
+	struct of_phandle_args args;
+	struct property *prop;
+	int i, idx;
+
+	if (!np)
+		return false;
+
+	for (i = 0; i < ARRAY_SIZE(boot_probe_of_deps); i++) {
+		for (idx = 0; !of_parse_phandle_with_args(np,
+				boot_probe_of_deps[i].list,
+				boot_probe_of_deps[i].cells, idx, &args); idx++)
+			if (of_supplier_call(dev, args.np, fn, data))
+				return true;
+	}
+
+	for_each_property_of_node(np, prop) {
+		size_t len = strlen(prop->name);
+		struct device_node *sup_np;
+
+		if (len <= 7 || strcmp(prop->name + len - 7, "-supply"))
+			continue;
+		sup_np = of_parse_phandle(np, prop->name, 0);
+		if (sup_np && of_supplier_call(dev, sup_np, fn, data))
+			return true;
+	}
+
+	return false;
+}
+#else
+static inline bool device_for_each_of_dep(struct device *dev,
+				bool (*fn)(struct device *, void *),
+				void *data)
+{
+	return false;
+}
+#endif
+
+static bool boot_probe_sups_add(struct device *sup, void *data)
+{
+	struct boot_probe_sups **sups = data, *s = *sups, *n;
+	unsigned int max;
+
+	if (!s || s->nr == s->max) {
+		max = s ? 2 * s->max : 8;
+		n = krealloc(s, sizeof(*n) + max * sizeof(n->sup[0]),
+			     GFP_KERNEL);
+		if (!n)
+			return true;
+		if (!s)
+			n->nr = 0;
+		n->max = max;
+		*sups = s = n;
+	}
+	s->sup[s->nr++] = get_device(sup);
+	return false;
+}
+
+/* DT suppliers of @dev, resolved on first use.  Caller holds the mutex. */
+static struct boot_probe_sups *boot_probe_of_sups(struct device *dev)
+{
+	struct boot_probe_sups *sups = dev->p->boot_probe_sups;
+
+	if (sups)
+		return sups;
+
+	device_for_each_of_dep(dev, boot_probe_sups_add, &sups);
+	/* an empty entry still saves resolving a device without suppliers */
+	if (!sups)
+		sups = kzalloc(sizeof(*sups), GFP_KERNEL);
+	if (sups) {
+		sups->dev = dev;
+		list_add(&sups->node, &boot_probe_sups_list);
+		dev->p->boot_probe_sups = sups;
+	}
+	return sups;
+}
+
+static void boot_probe_sups_free(struct boot_probe_sups *sups)
+{
+	unsigned int i;
+
+	list_del(&sups->node);
+	sups->dev->p->boot_probe_sups = NULL;
+	for (i = 0; i < sups->nr; i++)
+		put_device(sups->sup[i]);
+	kfree(sups);
+}
+
+/*
+ * Call @fn for the devices @dev depends on: device link suppliers, DT
+ * providers and, if @parent is set, its parent.  Returns true as soon as
+ * @fn does.  Caller holds boot_probe_mutex.
+ */
+static bool device_for_each_dep(struct device *dev, bool parent,
+				bool (*fn)(struct device *, void *),
+				void *data)
+{
+	struct boot_probe_sups *sups;
+	struct device_link *link;
+	unsigned int i;
+	int idx;
+
+	if (parent && dev->parent && fn(dev->parent, data))
+		return true;
+
+	idx = device_links_read_lock();
+	list_for_each_entry_rcu(link, &dev->links.suppliers, c_node) {
+		if (fn(link->supplier, data)) {
+			device_links_read_unlock(idx);
+			return true;
+		}
+	}
+	device_links_read_unlock(idx);
+
+	sups = boot_probe_of_sups(dev);
+	for (i = 0; sups && i < sups->nr; i++)
+		if (fn(sups->sup[i], data))
+			return true;
+	return false;
+}
+
+/* Racy by design: a stale answer only parks or probes one device early. */
+static bool boot_probe_sup_pending(struct device *sup, void *data)
+{
+	return !device_is_bound(sup);
+}
+
+static bool boot_probe_latest_dep(struct device *sup, void *data)
+{
+	int *dep = data;
+	int rec = READ_ONCE(sup->p->probe_rec);
+
+	if (rec < 0 || !READ_ONCE(boot_probe_recs[rec].end_ns))
+		return false;
+	if (*dep < 0 ||
+	    boot_probe_recs[rec].end_ns > boot_probe_recs[*dep].end_ns)
+		*dep = rec;
+	return false;
+}
+
+static int boot_probe_begin(struct device *dev, struct device_driver *drv)
+{
+	struct driver_probe_stat *rec;
+	int idx;
+
+	if (!IS_ENABLED(CONFIG_DRIVER_PROBE_STATS) ||
+	    READ_ONCE(boot_probe_done))
+		return -1;
+
+	mutex_lock(&boot_probe_mutex);
+	if (!boot_probe_recs)
+		boot_probe_recs = kcalloc(BOOT_PROBE_MAX_RECS,
+					  sizeof(*boot_probe_recs), GFP_KERNEL);
+	if (boot_probe_done || !boot_probe_recs ||
+	    boot_probe_nr == BOOT_PROBE_MAX_RECS) {
+		mutex_unlock(&boot_probe_mutex);
+		return -1;
+	}
+	idx = boot_probe_nr;
+	rec = &boot_probe_recs[idx];
+	rec->dep = -1;
+	device_for_each_dep(dev, true, boot_probe_latest_dep, &rec->dep);
+	strlcpy(rec->dev_name, dev_name(dev), sizeof(rec->dev_name));
+	strlcpy(rec->drv_name, drv->name, sizeof(rec->drv_name));
+	rec->defers = dev->p->probe_defers;
+	rec->async = current_is_async();
+	rec->start_ns = ktime_get_ns();
+	/* driver_probe_stat() reads the records without the mutex */
+	smp_store_release(&boot_probe_nr, idx + 1);
+	mutex_unlock(&boot_probe_mutex);
+
+	return idx;
+}
+
+static void boot_probe_end(struct device *dev, int idx, int ret)
+{
+	struct driver_probe_stat *rec;
+
+	if (idx < 0)
+		return;
+
+	rec = &boot_probe_recs[idx];
+	rec->ret = ret;
+	/* pairs with the smp_rmb() in driver_probe_stat() */
+	smp_wmb();
+	WRITE_ONCE(rec->end_ns, ktime_get_ns());
+	if (!ret)
+		WRITE_ONCE(dev->p->probe_rec, idx);
+}
+
+/**
+ * driver_probe_stat() - Read back a boot-time probe record
+ * @idx: record index, in order of probe start
+ * @stat: filled in on success
+ *
+ * Returns 0, or -ENOENT once @idx is past the last record.  @stat->end_ns
+ * is 0 while the probe is still running, @stat->ret is only valid after.
+ */
+int driver_probe_stat(unsigned int idx, struct driver_probe_stat *stat)
+{
+	u64 end_ns;
+
+	if (idx >= smp_load_acquire(&boot_probe_nr))
+		return -ENOENT;
+
+	end_ns = READ_ONCE(boot_probe_recs[idx].end_ns);
+	smp_rmb();
+	*stat = boot_probe_recs[idx];
+	stat->end_ns = end_ns;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(driver_probe_stat);
+
+/*
+ * Called with the device lock held from async probing of @dev, either by
+ * the async attach helper or by a driver attached from the async pool.
+ * Returns true if the device was parked; the parked list then holds a
+ * reference to it.
+ */
+static bool boot_probe_park(struct device *dev)
+{
+	bool parked = false;
+
+	if (!async_probe_default || READ_ONCE(boot_probe_done) || dev->driver)
+		return false;
+
+	/*
+	 * Check and queue under the mutex so a supplier binding concurrently
+	 * either is seen as bound here or finds us on the list.
+	 */
+	mutex_lock(&boot_probe_mutex);
+	if (!boot_probe_done && !dev->p->boot_probe_released &&
+	    list_empty(&dev->p->boot_probe_parked) &&
+	    device_for_each_dep(dev, false, boot_probe_sup_pending, NULL)) {
+		get_device(dev);
+		list_add_tail(&dev->p->boot_probe_parked, &boot_probe_parked);
+		parked = true;
+	}
+	mutex_unlock(&boot_probe_mutex);
+
+	if (parked)
+		dev_dbg(dev, "suppliers not bound, parking async probe\n");
+	return parked;
+}
+
+static void boot_probe_unpark(bool all)
+{
+	struct device_private *p, *n;
+
+	mutex_lock(&boot_probe_mutex);
+	list_for_each_entry_safe(p, n, &boot_probe_parked, boot_probe_parked) {
+		if (!all && device_for_each_dep(p->device, false,
+						boot_probe_sup_pending, NULL))
+			continue;
+		list_del_init(&p->boot_probe_parked);
+		p->boot_probe_released = true;
+		async_schedule(__device_attach_async_helper, p->device);
+	}
+	mutex_unlock(&boot_probe_mutex);
+}
+
+/* Called from device_del() */
+void driver_boot_probe_del(struct device *dev)
+{
+	bool parked = false;
+
+	if (!dev->p->boot_probe_sups &&
+	    list_empty_careful(&dev->p->boot_probe_parked))
+		return;
+
+	mutex_lock(&boot_probe_mutex);
+	if (dev->p->boot_probe_sups)
+		boot_probe_sups_free(dev->p->boot_probe_sups);
+	if (!list_empty(&dev->p->boot_probe_parked)) {
+		list_del_init(&dev->p->boot_probe_parked);
+		parked = true;
+	}
+	mutex_unlock(&boot_probe_mutex);
+
+	if (parked)
+		put_device(dev);
+}
+
 /**
  * deferred_probe_initcall() - Enable probing of deferred devices
  *
@@ -252,6 +648,7 @@ static void enable_trigger_defer_cycle(void)
  */
 static int deferred_probe_initcall(void)
 {
+	boot_probe_unpark(true);
 	enable_trigger_defer_cycle();
 	driver_deferred_probe_enable = false;
 	return 0;
@@ -264,12 +661,28 @@ device_initcall_sync(deferred_probe_initcall);
 static int deferred_probe_enable_fn(void)
 {
 	/* Enable deferred probing for all time */
+	boot_probe_unpark(true);
 	enable_trigger_defer_cycle();
 	initcalls_done = true;
 	return 0;
 }
 late_initcall(deferred_probe_enable_fn);
 
+static int boot_probe_done_fn(void)
+{
+	struct boot_probe_sups *sups, *n;
+
+	WRITE_ONCE(boot_probe_done, true);
+	boot_probe_unpark(true);
+
+	mutex_lock(&boot_probe_mutex);
+	list_for_each_entry_safe(sups, n, &boot_probe_sups_list, node)
+		boot_probe_sups_free(sups);
+	mutex_unlock(&boot_probe_mutex);
+	return 0;
+}
+late_initcall_sync(boot_probe_done_fn);
+
 /**
  * device_is_bound() - Check if device is bound to a driver
  * @dev: device to check
@@ -298,6 +711,9 @@ static void driver_bound(struct device *dev)
 	klist_add_tail(&dev->p->knode_driver, &dev->driver->p->klist_devices);
 	device_links_driver_bound(dev);
 
+	if (async_probe_default && !list_empty_careful(&boot_probe_parked))
+		boot_probe_unpark(false);
+
 	device_pm_check_callbacks(dev);
 
 	/*
@@ -379,6 +795,7 @@ static int really_probe(struct device *dev, struct device_driver *drv)
 {
 	int ret = -EPROBE_DEFER;
 	int local_trigger_count = atomic_read(&deferred_trigger_count);
+	int rec;
 	bool test_remove = IS_ENABLED(CONFIG_DEBUG_TEST_DRIVER_REMOVE) &&
 			   !drv->suppress_bind_attrs;
 
@@ -404,6 +821,7 @@ static int really_probe(struct device *dev, struct device_driver *drv)
 		dev_crit(dev, "Resources present before probing\n");
 		return -EBUSY;
 	}
+	rec = boot_probe_begin(dev, drv);
 
 re_probe:
 	dev->driver = drv;
@@ -464,6 +882,7 @@ static int really_probe(struct device *dev, struct device_driver *drv)
 		dev->pm_domain->sync(dev);
 
 	driver_bound(dev);
+	boot_probe_end(dev, rec, 0);
 	ret = 1;
 	pr_debug("bus: '%s': %s: bound device %s to driver %s\n",
 		 drv->bus->name, __func__, dev_name(dev), drv->name);
@@ -483,11 +902,13 @@ static int really_probe(struct device *dev, struct device_driver *drv)
 	if (dev->pm_domain && dev->pm_domain->dismiss)
 		dev->pm_domain->dismiss(dev);
 	pm_runtime_reinit(dev);
+	boot_probe_end(dev, rec, ret);
 
 	switch (ret) {
 	case -EPROBE_DEFER:
 		/* Driver requested deferred probing */
 		dev_dbg(dev, "Driver %s requests probe deferral\n", drv->name);
+		dev->p->probe_defers++;
 		driver_deferred_probe_add(dev);
 		/* Did a trigger occur while probing? Need to re-trigger if yes */
 		if (local_trigger_count != atomic_read(&deferred_trigger_count))
@@ -588,7 +1009,10 @@ static inline bool cmdline_requested_async_probing(const char *drv_name)
 	return parse_option_str(async_probe_drv_names, drv_name);
 }
 
-/* The option format is "driver_async_probe=drv_name1,drv_name2,..." */
+/*
+ * The option format is "driver_async_probe=drv_name1,drv_name2,...".
+ * A "*" entry makes asynchronous probing the default for all drivers.
+ */
 static int __init save_async_options(char *buf)
 {
 	if (strlen(buf) >= ASYNC_DRV_NAMES_MAX_LEN)
@@ -596,6 +1020,7 @@ static int __init save_async_options(char *buf)
 			"Too long list of driver names for 'driver_async_probe'!\n");
 
 	strlcpy(async_probe_drv_names, buf, ASYNC_DRV_NAMES_MAX_LEN);
+	async_probe_default = parse_option_str(async_probe_drv_names, "*");
 	return 0;
 }
 __setup("driver_async_probe=", save_async_options);
@@ -610,7 +1035,8 @@ bool driver_allows_async_probing(struct device_driver *drv)
 		return false;
 
 	default:
-		if (cmdline_requested_async_probing(drv->name))
+		if (async_probe_default ||
+		    cmdline_requested_async_probing(drv->name))
 			return true;
 
 #ifdef CONFIG_BUILTINS_ASYNC_PROBE
@@ -710,6 +1136,12 @@ static void __device_attach_async_helper(void *_dev, async_cookie_t cookie)
 
 	device_lock(dev);
 
+	if (boot_probe_park(dev)) {
+		device_unlock(dev);
+		put_device(dev);
+		return;
+	}
+
 	if (dev->parent)
 		pm_runtime_get_sync(dev->parent);
 
@@ -833,7 +1265,14 @@ static int __driver_attach(struct device *dev, void *data)
 	if (dev->parent)	/* Needed for USB */
 		device_lock(dev->parent);
 	device_lock(dev);
-	if (!dev->driver)
+	/*
+	 * A driver registered after its devices is attached here rather than
+	 * through the async attach helper; at boot this is where most DT
+	 * platform devices are probed.
+	 */
+	if (!dev->driver && !(current_is_async() &&
+			      driver_allows_async_probing(drv) &&
+			      boot_probe_park(dev)))
 		driver_probe_device(drv, dev);
 	device_unlock(dev);
 	if (dev->parent)
@@ -101,6 +101,9 @@ void device_pm_sleep_init(struct device *dev)
 	complete_all(&dev->power.completion);
 	dev->power.wakeup = NULL;
 	INIT_LIST_HEAD(&dev->power.entry);
+#ifdef CONFIG_PM_SLEEP_DEBUG
+	dev->power.prof_slot = -1;
+#endif
 }
 
 /**
@@ -245,15 +248,38 @@ static void dpm_wait(struct device *dev, bool async)
 		wait_for_completion(&dev->power.completion);
 }
 
-static int dpm_wait_fn(struct device *dev, void *async_ptr)
+/**
+ * dpm_wait_dep - Wait for a device @dev depends on, recording the wait.
+ * @dev: Device that is waiting.
+ * @dep: Device to wait for.
+ * @async: If unset, wait only if @dep's power.async_suspend flag is set.
+ */
+static void dpm_wait_dep(struct device *dev, struct device *dep, bool async)
 {
-	dpm_wait(dev, *((bool *)async_ptr));
+	ktime_t start = dpm_profile_wait_begin();
+
+	dpm_wait(dep, async);
+	dpm_profile_wait_end(dev, dep, start);
+}
+
+struct dpm_wait_data {
+	struct device *dev;
+	bool async;
+};
+
+static int dpm_wait_fn(struct device *child, void *data)
+{
+	struct dpm_wait_data *wd = data;
+
+	dpm_wait_dep(wd->dev, child, wd->async);
 	return 0;
 }
 
 static void dpm_wait_for_children(struct device *dev, bool async)
 {
-       device_for_each_child(dev, &async, dpm_wait_fn);
+	struct dpm_wait_data wd = { .dev = dev, .async = async };
+
+	device_for_each_child(dev, &wd, dpm_wait_fn);
 }
 
 static void dpm_wait_for_suppliers(struct device *dev, bool async)
@@ -272,7 +298,7 @@ static void dpm_wait_for_suppliers(struct device *dev, bool async)
 	 */
 	list_for_each_entry_rcu(link, &dev->links.suppliers, c_node)
 		if (READ_ONCE(link->status) != DL_STATE_DORMANT)
-			dpm_wait(link->supplier, async);
+			dpm_wait_dep(dev, link->supplier, async);
 
 	device_links_read_unlock(idx);
 }
@@ -299,7 +325,7 @@ static bool dpm_wait_for_superior(struct device *dev, bool async)
 
 	mutex_unlock(&dpm_list_mtx);
 
-	dpm_wait(parent, async);
+	dpm_wait_dep(dev, parent, async);
 	put_device(parent);
 
 	dpm_wait_for_suppliers(dev, async);
@@ -329,7 +355,7 @@ static void dpm_wait_for_consumers(struct device *dev, bool async)
 	 */
 	list_for_each_entry_rcu(link, &dev->links.consumers, s_node)
 		if (READ_ONCE(link->status) != DL_STATE_DORMANT)
-			dpm_wait(link->consumer, async);
+			dpm_wait_dep(dev, link->consumer, async);
 
 	device_links_read_unlock(idx);
 }
@@ -580,6 +606,7 @@ static int device_resume_noirq(struct device *dev, pm_message_t state, bool asyn
 
 	TRACE_DEVICE(dev);
 	TRACE_RESUME(0);
+	dpm_profile_dev_begin(dev, async);
 
 	if (dev->power.syscore || dev->power.direct_complete)
 		goto Out;
@@ -613,6 +640,7 @@ static int device_resume_noirq(struct device *dev, pm_message_t state, bool asyn
 	dev->power.is_noirq_suspended = false;
 
  Out:
+	dpm_profile_dev_end(dev);
 	complete_all(&dev->power.completion);
 	TRACE_RESUME(error);
 	return error;
@@ -642,6 +670,7 @@ void dpm_noirq_resume_devices(pm_message_t state)
 	ktime_t starttime = ktime_get();
 
 	trace_suspend_resume(TPS("dpm_resume_noirq"), state.event, true);
+	dpm_profile_phase_begin(DPM_PROF_RESUME_NOIRQ);
 	mutex_lock(&dpm_list_mtx);
 	pm_transition = state;
 
@@ -681,6 +710,7 @@ void dpm_noirq_resume_devices(pm_message_t state)
 	}
 	mutex_unlock(&dpm_list_mtx);
 	async_synchronize_full();
+	dpm_profile_phase_end(DPM_PROF_RESUME_NOIRQ);
 	dpm_show_time(starttime, state, 0, "noirq");
 	trace_suspend_resume(TPS("dpm_resume_noirq"), state.event, false);
 }
@@ -721,6 +751,7 @@ static int device_resume_early(struct device *dev, pm_message_t state, bool asyn
 
 	TRACE_DEVICE(dev);
 	TRACE_RESUME(0);
+	dpm_profile_dev_begin(dev, async);
 
 	if (dev->power.syscore || dev->power.direct_complete)
 		goto Out;
@@ -757,6 +788,7 @@ static int device_resume_early(struct device *dev, pm_message_t state, bool asyn
 	TRACE_RESUME(error);
 
 	pm_runtime_enable(dev);
+	dpm_profile_dev_end(dev);
 	complete_all(&dev->power.completion);
 	return error;
 }
@@ -783,6 +815,7 @@ void dpm_resume_early(pm_message_t state)
 	ktime_t starttime = ktime_get();
 
 	trace_suspend_resume(TPS("dpm_resume_early"), state.event, true);
+	dpm_profile_phase_begin(DPM_PROF_RESUME_EARLY);
 	mutex_lock(&dpm_list_mtx);
 	pm_transition = state;
 
@@ -821,6 +854,7 @@ void dpm_resume_early(pm_message_t state)
 	}
 	mutex_unlock(&dpm_list_mtx);
 	async_synchronize_full();
+	dpm_profile_phase_end(DPM_PROF_RESUME_EARLY);
 	dpm_show_time(starttime, state, 0, "early");
 	trace_suspend_resume(TPS("dpm_resume_early"), state.event, false);
 }
@@ -851,6 +885,7 @@ static int device_resume(struct device *dev, pm_message_t state, bool async)
 
 	TRACE_DEVICE(dev);
 	TRACE_RESUME(0);
+	dpm_profile_dev_begin(dev, async);
 
 	if (dev->power.syscore)
 		goto Complete;
@@ -926,6 +961,7 @@ static int device_resume(struct device *dev, pm_message_t state, bool async)
 	dpm_watchdog_clear(&wd);
 
  Complete:
+	dpm_profile_dev_end(dev);
 	complete_all(&dev->power.completion);
 
 	TRACE_RESUME(error);
@@ -957,6 +993,7 @@ void dpm_resume(pm_message_t state)
 	ktime_t starttime = ktime_get();
 
 	trace_suspend_resume(TPS("dpm_resume"), state.event, true);
+	dpm_profile_phase_begin(DPM_PROF_RESUME);
 	might_sleep();
 
 	mutex_lock(&dpm_list_mtx);
@@ -995,6 +1032,7 @@ void dpm_resume(pm_message_t state)
 	}
 	mutex_unlock(&dpm_list_mtx);
 	async_synchronize_full();
+	dpm_profile_phase_end(DPM_PROF_RESUME);
 	dpm_show_time(starttime, state, 0, NULL);
 
 	cpufreq_resume();
@@ -1042,6 +1080,11 @@ static void device_complete(struct device *dev, pm_message_t state)
 
 	device_unlock(dev);
 
+	if (dev->power.async_auto) {
+		dev->power.async_suspend = false;
+		dev->power.async_auto = false;
+	}
+
 	pm_runtime_put(dev);
 }
 
@@ -1139,6 +1182,7 @@ static int __device_suspend_noirq(struct device *dev, pm_message_t state, bool a
 
 	TRACE_DEVICE(dev);
 	TRACE_SUSPEND(0);
+	dpm_profile_dev_begin(dev, async);
 
 	dpm_wait_for_subordinate(dev, async);
 
@@ -1179,6 +1223,7 @@ static int __device_suspend_noirq(struct device *dev, pm_message_t state, bool a
 		async_error = error;
 
 Complete:
+	dpm_profile_dev_end(dev);
 	complete_all(&dev->power.completion);
 	TRACE_SUSPEND(error);
 	return error;
@@ -1223,6 +1268,7 @@ int dpm_noirq_suspend_devices(pm_message_t state)
 	int error = 0;
 
 	trace_suspend_resume(TPS("dpm_suspend_noirq"), state.event, true);
+	dpm_profile_phase_begin(DPM_PROF_SUSPEND_NOIRQ);
 	mutex_lock(&dpm_list_mtx);
 	pm_transition = state;
 	async_error = 0;
@@ -1251,6 +1297,7 @@ int dpm_noirq_suspend_devices(pm_message_t state)
 	}
 	mutex_unlock(&dpm_list_mtx);
 	async_synchronize_full();
+	dpm_profile_phase_end(DPM_PROF_SUSPEND_NOIRQ);
 	if (!error)
 		error = async_error;
 
@@ -1298,6 +1345,7 @@ static int __device_suspend_late(struct device *dev, pm_message_t state, bool as
 
 	TRACE_DEVICE(dev);
 	TRACE_SUSPEND(0);
+	dpm_profile_dev_begin(dev, async);
 
 	__pm_runtime_disable(dev, false);
 
@@ -1341,6 +1389,7 @@ static int __device_suspend_late(struct device *dev, pm_message_t state, bool as
 
 Complete:
 	TRACE_SUSPEND(error);
+	dpm_profile_dev_end(dev);
 	complete_all(&dev->power.completion);
 	return error;
 }
@@ -1381,6 +1430,7 @@ int dpm_suspend_late(pm_message_t state)
 	int error = 0;
 
 	trace_suspend_resume(TPS("dpm_suspend_late"), state.event, true);
+	dpm_profile_phase_begin(DPM_PROF_SUSPEND_LATE);
 	mutex_lock(&dpm_list_mtx);
 	pm_transition = state;
 	async_error = 0;
@@ -1410,6 +1460,7 @@ int dpm_suspend_late(pm_message_t state)
 	}
 	mutex_unlock(&dpm_list_mtx);
 	async_synchronize_full();
+	dpm_profile_phase_end(DPM_PROF_SUSPEND_LATE);
 	if (!error)
 		error = async_error;
 	if (error) {
@@ -1500,6 +1551,7 @@ static int __device_suspend(struct device *dev, pm_message_t state, bool async)
 
 	TRACE_DEVICE(dev);
 	TRACE_SUSPEND(0);
+	dpm_profile_dev_begin(dev, async);
 
 	dpm_wait_for_subordinate(dev, async);
 
@@ -1617,6 +1669,7 @@ static int __device_suspend(struct device *dev, pm_message_t state, bool async)
 	if (error)
 		async_error = error;
 
+	dpm_profile_dev_end(dev);
 	complete_all(&dev->power.completion);
 	TRACE_SUSPEND(error);
 	return error;
@@ -1659,6 +1712,7 @@ int dpm_suspend(pm_message_t state)
 	int error = 0;
 
 	trace_suspend_resume(TPS("dpm_suspend"), state.event, true);
+	dpm_profile_phase_begin(DPM_PROF_SUSPEND);
 	might_sleep();
 
 	cpufreq_suspend();
@@ -1689,6 +1743,7 @@ int dpm_suspend(pm_message_t state)
 	}
 	mutex_unlock(&dpm_list_mtx);
 	async_synchronize_full();
+	dpm_profile_phase_end(DPM_PROF_SUSPEND);
 	if (!error)
 		error = async_error;
 	if (error) {
@@ -1700,6 +1755,30 @@ int dpm_suspend(pm_message_t state)
 	return error;
 }
 
+/**
+ * dpm_auto_async - Handle a device asynchronously if that is known to be safe.
+ * @dev: Device to check.
+ *
+ * With /sys/power/pm_auto_async set, a device that did not opt in to
+ * asynchronous suspend/resume is made asynchronous for the duration of the
+ * transition if its ordering constraints are all visible to the PM core,
+ * i.e. it has a parent that is itself a bound device or it has suppliers
+ * linked to it.  dpm_wait_for_superior() and dpm_wait_for_subordinate()
+ * then enforce the same ordering the dpm_list walk would.
+ */
+static void dpm_auto_async(struct device *dev)
+{
+	if (!pm_auto_async_enabled || dev->power.async_suspend || !dev->driver)
+		return;
+
+	if (!(dev->parent && dev->parent->driver) &&
+	    list_empty(&dev->links.suppliers))
+		return;
+
+	dev->power.async_suspend = true;
+	dev->power.async_auto = true;
+}
+
 /**
  * device_prepare - Prepare a device for system power transition.
  * @dev: Device to handle.
@@ -1766,6 +1845,8 @@ static int device_prepare(struct device *dev, pm_message_t state)
 	spin_lock_irq(&dev->power.lock);
 	dev->power.direct_complete = ret > 0 && state.event == PM_EVENT_SUSPEND;
 	spin_unlock_irq(&dev->power.lock);
+
+	dpm_auto_async(dev);
 	return 0;
 }
 
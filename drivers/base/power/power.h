@@ -128,6 +128,7 @@ static inline void dev_pm_disable_wake_irq_check(struct device *dev)
 
 /* kernel/power/main.c */
 extern int pm_async_enabled;
+extern int pm_auto_async_enabled;
 
 /* drivers/base/power/main.c */
 extern struct list_head dpm_list;	/* The active device list */
@@ -206,3 +207,39 @@ static inline int pm_wakeup_source_sysfs_add(struct device *parent)
 }
 
 #endif /* CONFIG_PM_SLEEP */
+
+enum dpm_profile_phase {
+	DPM_PROF_SUSPEND,
+	DPM_PROF_SUSPEND_LATE,
+	DPM_PROF_SUSPEND_NOIRQ,
+	DPM_PROF_RESUME_NOIRQ,
+	DPM_PROF_RESUME_EARLY,
+	DPM_PROF_RESUME,
+	DPM_PROF_NR_PHASES,
+};
+
+#ifdef CONFIG_PM_SLEEP_DEBUG
+
+/* drivers/base/power/profile.c */
+extern void dpm_profile_phase_begin(int phase);
+extern void dpm_profile_phase_end(int phase);
+extern void dpm_profile_dev_begin(struct device *dev, bool async);
+extern void dpm_profile_dev_end(struct device *dev);
+extern ktime_t dpm_profile_wait_begin(void);
+extern void dpm_profile_wait_end(struct device *dev, struct device *dep,
+				 ktime_t start);
+
+#else /* !CONFIG_PM_SLEEP_DEBUG */
+
+static inline void dpm_profile_phase_begin(int phase) {}
+static inline void dpm_profile_phase_end(int phase) {}
+static inline void dpm_profile_dev_begin(struct device *dev, bool async) {}
+static inline void dpm_profile_dev_end(struct device *dev) {}
+static inline ktime_t dpm_profile_wait_begin(void)
+{
+	return 0;
+}
+static inline void dpm_profile_wait_end(struct device *dev,
+					struct device *dep, ktime_t start) {}
+
+#endif /* CONFIG_PM_SLEEP_DEBUG */
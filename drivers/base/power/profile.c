@@ -0,0 +1,438 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * drivers/base/power/profile.c - System suspend/resume critical path profiler.
+ *
+ * For every device handled in a suspend or resume phase this records when
+ * its callback started and finished and which devices it had to wait for
+ * in dpm_wait_for_superior() and dpm_wait_for_subordinate().  The resulting
+ * dependency graph of the last transition and the critical path through
+ * each phase are exported in debugfs under pm_profile/.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/device.h>
+#include <linux/init.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/suspend.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+
+#include "power.h"
+
+#define DPM_PROF_MAX_RECS	4096
+#define DPM_PROF_MAX_EDGES	8192
+/* Waits shorter than this are on devices that were already done */
+#define DPM_PROF_MIN_WAIT_NS	(10 * NSEC_PER_USEC)
+
+struct dpm_prof_rec {
+	struct device	*dev;	/* Identity only, not dereferenced */
+	char		name[32];
+	int		phase;
+	bool		async;
+	int		wait_pred;	/* Last dependency that blocked us */
+	int		serial_pred;	/* Sync device handled before us */
+	u64		start_ns;
+	u64		wait_ns;
+	u64		end_ns;
+};
+
+struct dpm_prof_edge {
+	int		waiter;
+	int		dep;
+	u64		wait_ns;
+};
+
+struct dpm_prof_phase {
+	int		first;
+	int		last;
+	u64		start_ns;
+	u64		end_ns;
+};
+
+static const char * const dpm_prof_phase_names[DPM_PROF_NR_PHASES] = {
+	[DPM_PROF_SUSPEND]	= "suspend",
+	[DPM_PROF_SUSPEND_LATE]	= "suspend_late",
+	[DPM_PROF_SUSPEND_NOIRQ] = "suspend_noirq",
+	[DPM_PROF_RESUME_NOIRQ]	= "resume_noirq",
+	[DPM_PROF_RESUME_EARLY]	= "resume_early",
+	[DPM_PROF_RESUME]	= "resume",
+};
+
+static bool dpm_prof_enabled;
+static struct dpm_prof_rec *dpm_prof_recs;
+static struct dpm_prof_edge *dpm_prof_edges;
+static atomic_t dpm_prof_nr_recs;
+static atomic_t dpm_prof_nr_edges;
+static struct dpm_prof_phase dpm_prof_phases[DPM_PROF_NR_PHASES];
+static int dpm_prof_cur = -1;
+static int dpm_prof_last_sync = -1;
+static DEFINE_MUTEX(dpm_prof_mtx);
+
+static int dpm_prof_nr(atomic_t *nr, int max)
+{
+	return min(atomic_read(nr), max);
+}
+
+static struct dpm_prof_rec *dpm_prof_rec(struct device *dev)
+{
+	int slot = dev->power.prof_slot;
+	struct dpm_prof_rec *rec;
+
+	if (slot < 0 || slot >= dpm_prof_nr(&dpm_prof_nr_recs,
+					     DPM_PROF_MAX_RECS))
+		return NULL;
+
+	rec = &dpm_prof_recs[slot];
+	if (rec->dev != dev || rec->phase != READ_ONCE(dpm_prof_cur))
+		return NULL;
+
+	return rec;
+}
+
+/**
+ * dpm_profile_phase_begin - Start recording a suspend/resume phase.
+ * @phase: Phase being started.
+ *
+ * The records of the previous transition are dropped when a new suspend
+ * starts, so the graph always covers one suspend/resume cycle.
+ */
+void dpm_profile_phase_begin(int phase)
+{
+	if (!dpm_prof_enabled)
+		return;
+
+	mutex_lock(&dpm_prof_mtx);
+	if (phase == DPM_PROF_SUSPEND) {
+		atomic_set(&dpm_prof_nr_recs, 0);
+		atomic_set(&dpm_prof_nr_edges, 0);
+		memset(dpm_prof_phases, 0, sizeof(dpm_prof_phases));
+	}
+	dpm_prof_phases[phase].first = dpm_prof_nr(&dpm_prof_nr_recs,
+						   DPM_PROF_MAX_RECS);
+	dpm_prof_phases[phase].last = dpm_prof_phases[phase].first;
+	dpm_prof_phases[phase].start_ns = ktime_get_ns();
+	dpm_prof_last_sync = -1;
+	WRITE_ONCE(dpm_prof_cur, phase);
+	mutex_unlock(&dpm_prof_mtx);
+}
+
+/**
+ * dpm_profile_phase_end - Stop recording a suspend/resume phase.
+ * @phase: Phase being finished.
+ *
+ * Must be called after all asynchronous callbacks of @phase are done.
+ */
+void dpm_profile_phase_end(int phase)
+{
+	if (!dpm_prof_enabled)
+		return;
+
+	mutex_lock(&dpm_prof_mtx);
+	dpm_prof_phases[phase].last = dpm_prof_nr(&dpm_prof_nr_recs,
+						  DPM_PROF_MAX_RECS);
+	dpm_prof_phases[phase].end_ns = ktime_get_ns();
+	WRITE_ONCE(dpm_prof_cur, -1);
+	mutex_unlock(&dpm_prof_mtx);
+}
+
+/**
+ * dpm_profile_dev_begin - Record the start of a device's suspend/resume.
+ * @dev: Device being handled.
+ * @async: Whether @dev is handled asynchronously.
+ */
+void dpm_profile_dev_begin(struct device *dev, bool async)
+{
+	struct dpm_prof_rec *rec;
+	int phase = READ_ONCE(dpm_prof_cur);
+	int slot;
+
+	dev->power.prof_slot = -1;
+	if (!dpm_prof_enabled || phase < 0)
+		return;
+
+	slot = atomic_inc_return(&dpm_prof_nr_recs) - 1;
+	if (slot >= DPM_PROF_MAX_RECS)
+		return;
+
+	rec = &dpm_prof_recs[slot];
+	rec->dev = dev;
+	strlcpy(rec->name, dev_name(dev), sizeof(rec->name));
+	rec->phase = phase;
+	rec->async = async;
+	rec->wait_pred = -1;
+	rec->serial_pred = READ_ONCE(dpm_prof_last_sync);
+	rec->wait_ns = 0;
+	rec->end_ns = 0;
+	rec->start_ns = ktime_get_ns();
+
+	/* Publish the record before other devices can look it up */
+	smp_wmb();
+	dev->power.prof_slot = slot;
+}
+
+/**
+ * dpm_profile_dev_end - Record the end of a device's suspend/resume.
+ * @dev: Device being handled.
+ */
+void dpm_profile_dev_end(struct device *dev)
+{
+	struct dpm_prof_rec *rec;
+
+	if (!dpm_prof_enabled)
+		return;
+
+	rec = dpm_prof_rec(dev);
+	if (!rec)
+		return;
+
+	rec->end_ns = ktime_get_ns();
+	if (!rec->async)
+		WRITE_ONCE(dpm_prof_last_sync, dev->power.prof_slot);
+}
+
+/**
+ * dpm_profile_wait_begin - Timestamp the start of a dependency wait.
+ *
+ * Returns 0 if the profiler is off, which dpm_profile_wait_end() ignores.
+ */
+ktime_t dpm_profile_wait_begin(void)
+{
+	return dpm_prof_enabled ? ktime_get() : 0;
+}
+
+/**
+ * dpm_profile_wait_end - Record a dependency wait.
+ * @dev: Device that waited.
+ * @dep: Device @dev waited for.
+ * @start: Value returned by dpm_profile_wait_begin().
+ *
+ * Only waits that actually blocked become edges of the graph.  Waits are
+ * done one after another, so the last blocking one is what @dev's start
+ * was bound by.
+ */
+void dpm_profile_wait_end(struct device *dev, struct device *dep,
+			  ktime_t start)
+{
+	struct dpm_prof_rec *rec, *dep_rec;
+	struct dpm_prof_edge *edge;
+	u64 wait_ns;
+	int idx;
+
+	if (!start || !dep)
+		return;
+
+	wait_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	if (wait_ns < DPM_PROF_MIN_WAIT_NS)
+		return;
+
+	rec = dpm_prof_rec(dev);
+	dep_rec = dpm_prof_rec(dep);
+	if (!rec || !dep_rec)
+		return;
+
+	smp_rmb();
+	rec->wait_ns += wait_ns;
+	rec->wait_pred = dep->power.prof_slot;
+
+	idx = atomic_inc_return(&dpm_prof_nr_edges) - 1;
+	if (idx >= DPM_PROF_MAX_EDGES)
+		return;
+
+	edge = &dpm_prof_edges[idx];
+	edge->waiter = dev->power.prof_slot;
+	edge->dep = dep->power.prof_slot;
+	edge->wait_ns = wait_ns;
+}
+
+static u64 dpm_prof_us(u64 ns)
+{
+	return div_u64(ns, NSEC_PER_USEC);
+}
+
+static int dpm_prof_graph_show(struct seq_file *s, void *unused)
+{
+	int nr_edges = dpm_prof_nr(&dpm_prof_nr_edges, DPM_PROF_MAX_EDGES);
+	int phase, i;
+
+	mutex_lock(&dpm_prof_mtx);
+	for (phase = 0; phase < DPM_PROF_NR_PHASES; phase++) {
+		struct dpm_prof_phase *p = &dpm_prof_phases[phase];
+
+		if (p->first == p->last)
+			continue;
+
+		seq_printf(s, "phase %s: %llu us, %d devices\n",
+			   dpm_prof_phase_names[phase],
+			   dpm_prof_us(p->end_ns - p->start_ns),
+			   p->last - p->first);
+
+		for (i = p->first; i < p->last; i++) {
+			struct dpm_prof_rec *rec = &dpm_prof_recs[i];
+
+			seq_printf(s, "  dev %d %s%s start %llu end %llu wait %llu\n",
+				   i, rec->name, rec->async ? " async" : "",
+				   dpm_prof_us(rec->start_ns - p->start_ns),
+				   rec->end_ns ?
+				   dpm_prof_us(rec->end_ns - p->start_ns) : 0,
+				   dpm_prof_us(rec->wait_ns));
+		}
+
+		for (i = 0; i < nr_edges; i++) {
+			struct dpm_prof_edge *edge = &dpm_prof_edges[i];
+
+			if (edge->waiter < p->first || edge->waiter >= p->last)
+				continue;
+
+			seq_printf(s, "  edge %d -> %d wait %llu\n",
+				   edge->waiter, edge->dep,
+				   dpm_prof_us(edge->wait_ns));
+		}
+	}
+	mutex_unlock(&dpm_prof_mtx);
+
+	return 0;
+}
+
+/*
+ * The critical path of a phase ends at the device that finished last and
+ * follows, for each device, the dependency it was last blocked on, or the
+ * synchronous device handled before it if it did not have to wait.
+ */
+static int dpm_prof_critical_path_show(struct seq_file *s, void *unused)
+{
+	int phase;
+
+	mutex_lock(&dpm_prof_mtx);
+	for (phase = 0; phase < DPM_PROF_NR_PHASES; phase++) {
+		struct dpm_prof_phase *p = &dpm_prof_phases[phase];
+		u64 cb_ns = 0, wait_ns = 0;
+		int i, last = -1, depth = 0;
+
+		if (p->first == p->last)
+			continue;
+
+		for (i = p->first; i < p->last; i++)
+			if (last < 0 ||
+			    dpm_prof_recs[i].end_ns > dpm_prof_recs[last].end_ns)
+				last = i;
+
+		seq_printf(s, "phase %s: %llu us\n",
+			   dpm_prof_phase_names[phase],
+			   dpm_prof_us(p->end_ns - p->start_ns));
+
+		for (i = last; i >= p->first && i < p->last &&
+		     depth < p->last - p->first; depth++) {
+			struct dpm_prof_rec *rec = &dpm_prof_recs[i];
+			u64 busy = rec->end_ns > rec->start_ns ?
+				   rec->end_ns - rec->start_ns : 0;
+
+			busy -= min(busy, rec->wait_ns);
+			cb_ns += busy;
+			wait_ns += rec->wait_ns;
+
+			seq_printf(s, "  %s%s callback %llu us wait %llu us\n",
+				   rec->name, rec->async ? " async" : "",
+				   dpm_prof_us(busy), dpm_prof_us(rec->wait_ns));
+
+			i = rec->wait_pred >= 0 ? rec->wait_pred :
+						  rec->serial_pred;
+		}
+
+		seq_printf(s, "  total: %d devices, callbacks %llu us, waits %llu us\n",
+			   depth, dpm_prof_us(cb_ns), dpm_prof_us(wait_ns));
+	}
+	mutex_unlock(&dpm_prof_mtx);
+
+	return 0;
+}
+
+static int dpm_prof_graph_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, dpm_prof_graph_show, NULL);
+}
+
+static const struct file_operations dpm_prof_graph_fops = {
+	.open		= dpm_prof_graph_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int dpm_prof_critical_path_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, dpm_prof_critical_path_show, NULL);
+}
+
+static const struct file_operations dpm_prof_critical_path_fops = {
+	.open		= dpm_prof_critical_path_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static ssize_t dpm_prof_enable_read(struct file *file, char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	char val[3] = { dpm_prof_enabled ? '1' : '0', '\n', '\0' };
+
+	return simple_read_from_buffer(buf, count, ppos, val, 2);
+}
+
+static ssize_t dpm_prof_enable_write(struct file *file,
+				     const char __user *buf,
+				     size_t count, loff_t *ppos)
+{
+	bool enable;
+	int ret;
+
+	ret = kstrtobool_from_user(buf, count, &enable);
+	if (ret)
+		return ret;
+
+	lock_system_sleep();
+	mutex_lock(&dpm_prof_mtx);
+	if (enable && !dpm_prof_recs) {
+		dpm_prof_recs = vzalloc(DPM_PROF_MAX_RECS *
+					sizeof(*dpm_prof_recs));
+		dpm_prof_edges = vzalloc(DPM_PROF_MAX_EDGES *
+					 sizeof(*dpm_prof_edges));
+		if (!dpm_prof_recs || !dpm_prof_edges) {
+			vfree(dpm_prof_recs);
+			vfree(dpm_prof_edges);
+			dpm_prof_recs = NULL;
+			dpm_prof_edges = NULL;
+			ret = -ENOMEM;
+		}
+	}
+	if (!ret)
+		dpm_prof_enabled = enable;
+	mutex_unlock(&dpm_prof_mtx);
+	unlock_system_sleep();
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations dpm_prof_enable_fops = {
+	.read		= dpm_prof_enable_read,
+	.write		= dpm_prof_enable_write,
+	.llseek		= default_llseek,
+};
+
+static int __init dpm_profile_init(void)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("pm_profile", NULL);
+	if (IS_ERR_OR_NULL(dir))
+		return 0;
+
+	debugfs_create_file("enable", 0644, dir, NULL, &dpm_prof_enable_fops);
+	debugfs_create_file("graph", 0444, dir, NULL, &dpm_prof_graph_fops);
+	debugfs_create_file("critical_path", 0444, dir, NULL,
+			    &dpm_prof_critical_path_fops);
+
+	return 0;
+}
+late_initcall(dpm_profile_init);
@@ -508,6 +508,12 @@ static int mhi_init_debugfs_mhi_event_open(struct inode *inode, struct file *fp)
 	return single_open(fp, mhi_debugfs_mhi_event_show, inode->i_private);
 }
 
+static int mhi_init_debugfs_mhi_ev_stats_open(struct inode *inode,
+					      struct file *fp)
+{
+	return single_open(fp, mhi_debugfs_mhi_ev_stats_show, inode->i_private);
+}
+
 static int mhi_init_debugfs_mhi_chan_open(struct inode *inode, struct file *fp)
 {
 	return single_open(fp, mhi_debugfs_mhi_chan_show, inode->i_private);
@@ -530,6 +536,12 @@ static const struct file_operations debugfs_ev_ops = {
 	.read = seq_read,
 };
 
+static const struct file_operations debugfs_ev_stats_ops = {
+	.open = mhi_init_debugfs_mhi_ev_stats_open,
+	.release = single_release,
+	.read = seq_read,
+};
+
 static const struct file_operations debugfs_chan_ops = {
 	.open = mhi_init_debugfs_mhi_chan_open,
 	.release = single_release,
@@ -565,6 +577,8 @@ void mhi_init_debugfs(struct mhi_controller *mhi_cntrl)
 			    &debugfs_state_ops);
 	debugfs_create_file("events", 0444, dentry, mhi_cntrl,
 			    &debugfs_ev_ops);
+	debugfs_create_file("ev_stats", 0444, dentry, mhi_cntrl,
+			    &debugfs_ev_stats_ops);
 	debugfs_create_file("chan", 0444, dentry, mhi_cntrl, &debugfs_chan_ops);
 	debugfs_create_file("vote", 0444, dentry, mhi_cntrl,
 			    &debugfs_vote_ops);
@@ -652,6 +666,7 @@ int mhi_init_dev_ctxt(struct mhi_controller *mhi_cntrl)
 			goto error_alloc_er;
 
 		ring->rp = ring->wp = ring->base;
+		mhi_event->db_pending = 0;
 		er_ctxt->rbase = ring->iommu_base;
 		er_ctxt->rp = er_ctxt->wp = er_ctxt->rbase;
 		er_ctxt->rlen = ring->len;
@@ -1162,6 +1177,14 @@ static int of_parse_ev_cfg(struct mhi_controller *mhi_cntrl,
 		if (ret)
 			goto error_ev_cfg;
 
+		/* adaptive moderation needs the device side timer configured */
+		mhi_event->intmod_adaptive = mhi_event->intmod &&
+			of_property_read_bool(child, "mhi,intmod-adaptive");
+		mhi_event->intmod_active = !!mhi_event->intmod;
+
+		/* report freed elements to the device once a quarter ring */
+		mhi_event->db_batch = max_t(u32, mhi_event->ring.elements / 4, 1);
+
 		ret = of_property_read_u32(child, "mhi,msi",
 					   &mhi_event->msi);
 		if (ret)
@@ -647,10 +647,44 @@ struct mhi_buf_info {
 	enum dma_data_direction dir;
 };
 
+/*
+ * data event ring accounting, all fields except irqs are updated by the
+ * event processing path under mhi_event->lock. irqs is only written by
+ * the ring's own MSI handler.
+ */
+struct mhi_ev_stats {
+	u64 irqs;
+	u64 events;
+	u64 polls;
+	u64 doorbells;
+	u64 db_coalesced;
+	u64 mod_switches;
+	/* rate estimation window for adaptive moderation */
+	unsigned long win_start;
+	u64 win_irqs;
+	u64 win_events;
+	u64 win_doorbells;
+	u32 irq_rate;
+	u32 ev_rate;
+	u32 db_rate;
+};
+
+/* events processed per tasklet run before yielding and rescheduling */
+#define MHI_EV_TASK_BUDGET (256)
+/* adaptive moderation sampling window and thresholds (events/s) */
+#define MHI_INTMOD_WINDOW (HZ / 10)
+#define MHI_INTMOD_HIGH_RATE (20000)
+#define MHI_INTMOD_LOW_RATE (4000)
+
 struct mhi_event {
 	struct list_head node;
 	u32 er_index;
 	u32 intmod;
+	bool intmod_adaptive; /* toggle BEI based on event rate */
+	bool intmod_active; /* BEI currently set on ring channels */
+	u32 db_batch; /* recycled elements allowed before ringing db */
+	u32 db_pending; /* recycled elements not yet reported to device */
+	struct mhi_ev_stats stats;
 	u32 msi;
 	int chan; /* this event ring is dedicated to a channel */
 	enum mhi_er_priority priority;
@@ -755,6 +789,7 @@ struct mhi_controller *find_mhi_controller_by_name(const char *name);
 int mhi_debugfs_mhi_vote_show(struct seq_file *m, void *d);
 int mhi_debugfs_mhi_chan_show(struct seq_file *m, void *d);
 int mhi_debugfs_mhi_event_show(struct seq_file *m, void *d);
+int mhi_debugfs_mhi_ev_stats_show(struct seq_file *m, void *d);
 int mhi_debugfs_mhi_states_show(struct seq_file *m, void *d);
 int mhi_debugfs_trigger_reset(void *data, u64 val);
 
@@ -16,6 +16,7 @@
 #include <linux/dma-mapping.h>
 #include <linux/interrupt.h>
 #include <linux/list.h>
+#include <linux/math64.h>
 #include <linux/of.h>
 #include <linux/module.h>
 #include <linux/skbuff.h>
@@ -1286,6 +1287,63 @@ int mhi_process_ctrl_ev_ring(struct mhi_controller *mhi_cntrl,
 	return count;
 }
 
+/*
+ * Sample event, interrupt and doorbell rates once per MHI_INTMOD_WINDOW
+ * and, for rings with adaptive moderation, move the ring's channels
+ * between per-completion interrupts (low latency) and BEI, where the
+ * device only interrupts on the intmod timer (low overhead). Hysteresis
+ * between the low and high thresholds avoids flapping.
+ */
+static void mhi_ev_update_moderation(struct mhi_controller *mhi_cntrl,
+				     struct mhi_event *mhi_event)
+{
+	struct mhi_ev_stats *stats = &mhi_event->stats;
+	unsigned long elapsed = jiffies - stats->win_start;
+	u64 irqs = READ_ONCE(stats->irqs);
+	struct mhi_chan *mhi_chan;
+	bool moderate;
+	int i;
+
+	if (elapsed < MHI_INTMOD_WINDOW)
+		return;
+
+	stats->irq_rate = div64_u64((irqs - stats->win_irqs) * HZ, elapsed);
+	stats->ev_rate = div64_u64((stats->events - stats->win_events) * HZ,
+				   elapsed);
+	stats->db_rate = div64_u64((stats->doorbells - stats->win_doorbells) *
+				   HZ, elapsed);
+	stats->win_start = jiffies;
+	stats->win_irqs = irqs;
+	stats->win_events = stats->events;
+	stats->win_doorbells = stats->doorbells;
+
+	if (!mhi_event->intmod_adaptive)
+		return;
+
+	if (!mhi_event->intmod_active &&
+	    stats->ev_rate >= MHI_INTMOD_HIGH_RATE)
+		moderate = true;
+	else if (mhi_event->intmod_active &&
+		 stats->ev_rate <= MHI_INTMOD_LOW_RATE)
+		moderate = false;
+	else
+		return;
+
+	mhi_event->intmod_active = moderate;
+	stats->mod_switches++;
+
+	mhi_chan = mhi_cntrl->mhi_chan;
+	for (i = 0; i < mhi_cntrl->max_chan; i++, mhi_chan++) {
+		if (mhi_chan->er_index != mhi_event->er_index)
+			continue;
+		WRITE_ONCE(mhi_chan->bei, moderate);
+	}
+
+	MHI_VERB("er_index:%u ev_rate:%u moderation:%s\n",
+		 mhi_event->er_index, stats->ev_rate,
+		 moderate ? "on" : "off");
+}
+
 int mhi_process_data_event_ring(struct mhi_controller *mhi_cntrl,
 				struct mhi_event *mhi_event,
 				u32 event_quota)
@@ -1334,10 +1392,31 @@ int mhi_process_data_event_ring(struct mhi_controller *mhi_cntrl,
 		dev_rp = mhi_to_virtual(ev_ring, er_ctxt->rp);
 		count++;
 	}
-	read_lock_bh(&mhi_cntrl->pm_lock);
-	if (likely(MHI_DB_ACCESS_VALID(mhi_cntrl)))
-		mhi_ring_er_db(mhi_event);
-	read_unlock_bh(&mhi_cntrl->pm_lock);
+
+	mhi_event->stats.polls++;
+	mhi_event->stats.events += count;
+	mhi_event->db_pending += count;
+
+	/*
+	 * Only tell the device about recycled elements once the ring is
+	 * drained or a batch worth has built up. If the quota ran out the
+	 * caller polls again shortly and the device still has at least
+	 * three quarters of the ring to write into.
+	 */
+	if (mhi_event->db_pending &&
+	    (dev_rp == local_rp ||
+	     mhi_event->db_pending >= mhi_event->db_batch)) {
+		read_lock_bh(&mhi_cntrl->pm_lock);
+		if (likely(MHI_DB_ACCESS_VALID(mhi_cntrl)))
+			mhi_ring_er_db(mhi_event);
+		read_unlock_bh(&mhi_cntrl->pm_lock);
+		mhi_event->db_pending = 0;
+		mhi_event->stats.doorbells++;
+	} else if (count) {
+		mhi_event->stats.db_coalesced++;
+	}
+
+	mhi_ev_update_moderation(mhi_cntrl, mhi_event);
 
 	MHI_VERB("exit er_index:%u\n", mhi_event->er_index);
 
@@ -1516,13 +1595,26 @@ void mhi_ev_task(unsigned long data)
 {
 	struct mhi_event *mhi_event = (struct mhi_event *)data;
 	struct mhi_controller *mhi_cntrl = mhi_event->mhi_cntrl;
+	int ret;
 
 	MHI_VERB("Enter for ev_index:%d\n", mhi_event->er_index);
 
-	/* process all pending events */
+	/* process pending events up to budget */
 	spin_lock_bh(&mhi_event->lock);
-	mhi_event->process_event(mhi_cntrl, mhi_event, U32_MAX);
+	ret = mhi_event->process_event(mhi_cntrl, mhi_event,
+				       MHI_EV_TASK_BUDGET);
 	spin_unlock_bh(&mhi_event->lock);
+
+	/*
+	 * more events may be pending, yield and come back for them rather
+	 * than holding the cpu in softirq context for the whole ring
+	 */
+	if (ret >= MHI_EV_TASK_BUDGET) {
+		if (IS_MHI_ER_PRIORITY_HIGH(mhi_event))
+			tasklet_hi_schedule(&mhi_event->task);
+		else
+			tasklet_schedule(&mhi_event->task);
+	}
 }
 
 void mhi_ctrl_ev_task(unsigned long data)
@@ -1580,6 +1672,8 @@ irqreturn_t mhi_msi_handlr(int irq_number, void *dev)
 	struct mhi_ring *ev_ring = &mhi_event->ring;
 	void *dev_rp = mhi_to_virtual(ev_ring, er_ctxt->rp);
 
+	mhi_event->stats.irqs++;
+
 	/* confirm ER has pending events to process before scheduling work */
 	if (ev_ring->rp == dev_rp)
 		return IRQ_HANDLED;
@@ -2138,6 +2232,39 @@ int mhi_debugfs_mhi_event_show(struct seq_file *m, void *d)
 	return 0;
 }
 
+int mhi_debugfs_mhi_ev_stats_show(struct seq_file *m, void *d)
+{
+	struct mhi_controller *mhi_cntrl = m->private;
+	struct mhi_event *mhi_event;
+	int i;
+
+	seq_printf(m, "[%llu ns]:\n", sched_clock());
+
+	mhi_event = mhi_cntrl->mhi_event;
+	for (i = 0; i < mhi_cntrl->total_ev_rings; i++, mhi_event++) {
+		struct mhi_ev_stats *stats = &mhi_event->stats;
+
+		if (mhi_event->offload_ev ||
+		    mhi_event->data_type != MHI_ER_DATA_ELEMENT_TYPE)
+			continue;
+
+		seq_printf(m,
+			   "Index:%d irqs:%llu events:%llu ev/irq:%llu polls:%llu",
+			   i, stats->irqs, stats->events,
+			   stats->irqs ? div64_u64(stats->events, stats->irqs) :
+			   0, stats->polls);
+		seq_printf(m,
+			   " db:%llu db_coalesced:%llu irq/s:%u ev/s:%u db/s:%u",
+			   stats->doorbells, stats->db_coalesced,
+			   stats->irq_rate, stats->ev_rate, stats->db_rate);
+		seq_printf(m, " modt:%u adaptive:%d moderated:%d switches:%llu\n",
+			   mhi_event->intmod, mhi_event->intmod_adaptive,
+			   mhi_event->intmod_active, stats->mod_switches);
+	}
+
+	return 0;
+}
+
 int mhi_debugfs_mhi_chan_show(struct seq_file *m, void *d)
 {
 	struct mhi_controller *mhi_cntrl = m->private;
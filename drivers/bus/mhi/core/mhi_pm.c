@@ -314,6 +314,7 @@ int mhi_ready_state_transition(struct mhi_controller *mhi_cntrl)
 
 		/* ring the db for event rings */
 		spin_lock_irq(&mhi_event->lock);
+		mhi_event->db_pending = 0;
 		mhi_ring_er_db(mhi_event);
 		spin_unlock_irq(&mhi_event->lock);
 	}
@@ -516,6 +517,7 @@ static int mhi_pm_mission_mode_transition(struct mhi_controller *mhi_cntrl)
 		smp_wmb();
 
 		spin_lock_irq(&mhi_event->lock);
+		mhi_event->db_pending = 0;
 		if (MHI_DB_ACCESS_VALID(mhi_cntrl))
 			mhi_ring_er_db(mhi_event);
 		spin_unlock_irq(&mhi_event->lock);
@@ -690,6 +692,7 @@ static void mhi_pm_disable_transition(struct mhi_controller *mhi_cntrl,
 
 		ring->rp = ring->base;
 		ring->wp = ring->base;
+		mhi_event->db_pending = 0;
 		er_ctxt->rp = er_ctxt->rbase;
 		er_ctxt->wp = er_ctxt->rbase;
 	}
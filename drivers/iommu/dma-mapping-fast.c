@@ -20,6 +20,10 @@
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
 #include <linux/pci.h>
+#include <linux/debugfs.h>
+#include <linux/percpu.h>
+#include <linux/sched/clock.h>
+#include <linux/seq_file.h>
 #include <trace/events/iommu.h>
 
 #include <soc/qcom/secure_buffer.h>
@@ -68,6 +72,27 @@ static void fast_dmac_clean_range(struct dma_fast_smmu_mapping *mapping,
 		dmac_clean_range(start, end);
 }
 
+static void fast_smmu_tlbiall(void *cookie)
+{
+	struct dma_fast_smmu_mapping *mapping = cookie;
+
+	iommu_tlbiall(mapping->domain);
+}
+
+/*
+ * Unmaps @len bytes at @ptep.  A range that cuts a contiguous group has the
+ * group split first, with a full TLB invalidate for the break-before-make.
+ */
+static void fast_smmu_unmap_ptes(struct dma_fast_smmu_mapping *mapping,
+				 av8l_fast_iopte *ptep, size_t len)
+{
+	if (av8l_fast_unmap_public(ptep, len) != -EBUSY)
+		return;
+
+	av8l_fast_split_cont_public(ptep, len, fast_smmu_tlbiall, mapping);
+	WARN_ON(av8l_fast_unmap_public(ptep, len));
+}
+
 static bool __fast_is_pte_coherent(av8l_fast_iopte *ptep)
 {
 	int attr_idx = (*ptep & (FAST_PTE_ATTRINDX_MASK <<
@@ -332,6 +357,185 @@ static void __fast_smmu_free_iova(struct dma_fast_smmu_mapping *mapping,
 	mapping->have_stale_tlbs = true;
 }
 
+/*
+ * With CONFIG_IOMMU_IO_PGTABLE_FAST_PROVE_TLB a full TLB invalidate
+ * rewrites every vacant PTE in the table, so PTE updates for IOVAs taken
+ * from a per-CPU cache still have to be serialized with mapping->lock.
+ */
+#define FAST_PTE_NEEDS_LOCK IS_ENABLED(CONFIG_IOMMU_IO_PGTABLE_FAST_PROVE_TLB)
+
+/*
+ * Returns the magazine index for an IOVA of @len bytes, or -1 if IOVAs of
+ * that size are not cached.  Mappings with guard pages always go through
+ * the bitmap since the guard page mapping is tied to the allocation.
+ */
+static int fast_iova_cache_order(struct dma_fast_smmu_mapping *mapping,
+				 size_t len)
+{
+	unsigned int order;
+
+	if (mapping->min_iova_align || !is_power_of_2(len))
+		return -1;
+
+	order = ilog2(len) - FAST_PAGE_SHIFT;
+	return order < FAST_IOVA_CACHE_ORDERS ? order : -1;
+}
+
+static dma_addr_t fast_smmu_cache_alloc(struct dma_fast_smmu_mapping *mapping,
+					size_t len)
+{
+	struct fast_smmu_cpu_cache *cache;
+	dma_addr_t iova = DMA_ERROR_CODE;
+	unsigned long flags;
+	int order;
+
+	order = fast_iova_cache_order(mapping, len);
+	if (order < 0)
+		return DMA_ERROR_CODE;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(mapping->cpu_cache);
+	spin_lock(&cache->lock);
+	if (cache->mag_nr[order]) {
+		iova = cache->mag[order][--cache->mag_nr[order]];
+		cache->cache_hits++;
+	} else {
+		cache->cache_misses++;
+	}
+	spin_unlock(&cache->lock);
+	local_irq_restore(flags);
+
+	return iova;
+}
+
+/*
+ * Invalidates the TLB for every IOVA parked in @cache->deferred and moves
+ * them to the magazines.  IOVAs which do not fit are handed back to the
+ * bitmap; their TLB entries are already gone so they are not stale.
+ * Called with @cache->lock held.
+ */
+static void __fast_smmu_flush_deferred(struct dma_fast_smmu_mapping *mapping,
+				       struct fast_smmu_cpu_cache *cache)
+{
+	struct iommu_domain *domain = mapping->domain;
+	unsigned int i;
+
+	if (!cache->nr_deferred)
+		return;
+
+	/*
+	 * One invalidate for the whole batch.  arm-smmu has no range
+	 * invalidate, in which case a single TLBIALL covers everything.
+	 */
+	if (domain->ops->iotlb_range_add) {
+		for (i = 0; i < cache->nr_deferred; i++)
+			iommu_tlb_range_add(domain, cache->deferred[i],
+				FAST_PAGE_SIZE << cache->deferred_order[i]);
+		iommu_tlb_sync(domain);
+	} else {
+		iommu_tlbiall(domain);
+	}
+	cache->tlbi_batches++;
+
+	spin_lock(&mapping->lock);
+	for (i = 0; i < cache->nr_deferred; i++) {
+		dma_addr_t iova = cache->deferred[i];
+		unsigned int order = cache->deferred_order[i];
+
+		if (FAST_PTE_NEEDS_LOCK) {
+			av8l_fast_iopte *pmd =
+				iopte_pmd_offset(mapping->pgtbl_pmds, iova);
+
+			memset(pmd, 0, sizeof(*pmd) << order);
+			fast_dmac_clean_range(mapping, pmd, pmd + (1 << order));
+		}
+
+		if (cache->mag_nr[order] < FAST_IOVA_MAG_SIZE)
+			cache->mag[order][cache->mag_nr[order]++] = iova;
+		else
+			bitmap_clear(mapping->bitmap,
+				     (iova - mapping->base) >> FAST_PAGE_SHIFT,
+				     1 << order);
+	}
+	spin_unlock(&mapping->lock);
+
+	cache->nr_deferred = 0;
+}
+
+/*
+ * Unmaps @len bytes at @iova and queues the IOVA for a batched TLB
+ * invalidate.  Returns false if IOVAs of this size are not cached, in
+ * which case the caller falls back to the bitmap.
+ */
+static bool fast_smmu_cache_free(struct dma_fast_smmu_mapping *mapping,
+				 dma_addr_t iova, size_t len)
+{
+	av8l_fast_iopte *pmd = iopte_pmd_offset(mapping->pgtbl_pmds, iova);
+	int nptes = len >> FAST_PAGE_SHIFT;
+	struct fast_smmu_cpu_cache *cache;
+	unsigned long flags;
+	int order;
+
+	order = fast_iova_cache_order(mapping, len);
+	if (order < 0)
+		return false;
+
+	local_irq_save(flags);
+	if (FAST_PTE_NEEDS_LOCK)
+		spin_lock(&mapping->lock);
+	fast_smmu_unmap_ptes(mapping, pmd, len);
+	fast_dmac_clean_range(mapping, pmd, pmd + nptes);
+	if (FAST_PTE_NEEDS_LOCK)
+		spin_unlock(&mapping->lock);
+
+	cache = this_cpu_ptr(mapping->cpu_cache);
+	spin_lock(&cache->lock);
+	cache->deferred[cache->nr_deferred] = iova;
+	cache->deferred_order[cache->nr_deferred] = order;
+	if (++cache->nr_deferred == FAST_IOVA_DEFER_BATCH)
+		__fast_smmu_flush_deferred(mapping, cache);
+	spin_unlock(&cache->lock);
+	local_irq_restore(flags);
+
+	return true;
+}
+
+/*
+ * Returns every cached IOVA on every CPU to the bitmap.  Used when the
+ * bitmap runs dry so that IOVAs parked on idle CPUs are not lost to the
+ * allocator.  Returns true if anything was released.
+ */
+static bool fast_smmu_cache_drain(struct dma_fast_smmu_mapping *mapping)
+{
+	struct fast_smmu_cpu_cache *cache;
+	unsigned long flags;
+	bool released = false;
+	unsigned int order, i;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		cache = per_cpu_ptr(mapping->cpu_cache, cpu);
+
+		spin_lock_irqsave(&cache->lock, flags);
+		__fast_smmu_flush_deferred(mapping, cache);
+
+		spin_lock(&mapping->lock);
+		for (order = 0; order < FAST_IOVA_CACHE_ORDERS; order++) {
+			for (i = 0; i < cache->mag_nr[order]; i++)
+				bitmap_clear(mapping->bitmap,
+					     (cache->mag[order][i] -
+					      mapping->base) >> FAST_PAGE_SHIFT,
+					     1 << order);
+			released |= cache->mag_nr[order] != 0;
+			cache->mag_nr[order] = 0;
+		}
+		spin_unlock(&mapping->lock);
+		spin_unlock_irqrestore(&cache->lock, flags);
+	}
+
+	return released;
+}
+
 
 static void __fast_dma_page_cpu_to_dev(struct page *page, unsigned long off,
 				       size_t size, enum dma_data_direction dir)
@@ -383,6 +587,8 @@ static dma_addr_t fast_smmu_map_page(struct device *dev, struct page *page,
 	bool skip_sync = (attrs & DMA_ATTR_SKIP_CPU_SYNC);
 	int prot = __fast_dma_direction_to_prot(dir);
 	bool is_coherent = is_dma_coherent(dev, attrs);
+	bool drained = false;
+	u64 start = local_clock();
 
 	prot = __get_iommu_pgprot(attrs, prot, is_coherent);
 
@@ -390,12 +596,34 @@ static dma_addr_t fast_smmu_map_page(struct device *dev, struct page *page,
 		__fast_dma_page_cpu_to_dev(phys_to_page(phys_to_map),
 					   offset_from_phys_to_map, size, dir);
 
+	iova = fast_smmu_cache_alloc(mapping, len);
+	if (iova != DMA_ERROR_CODE && !FAST_PTE_NEEDS_LOCK) {
+		/* a cached IOVA is owned by us, no need for mapping->lock */
+		pmd = iopte_pmd_offset(mapping->pgtbl_pmds, iova);
+		if (unlikely(av8l_fast_map_public(pmd, phys_to_map, len,
+						  prot))) {
+			spin_lock_irqsave(&mapping->lock, flags);
+			goto fail_free_iova;
+		}
+		fast_dmac_clean_range(mapping, pmd, pmd + nptes);
+		goto mapped;
+	}
+
+retry:
 	spin_lock_irqsave(&mapping->lock, flags);
 
-	iova = __fast_smmu_alloc_iova(mapping, attrs, len);
+	if (iova == DMA_ERROR_CODE)
+		iova = __fast_smmu_alloc_iova(mapping, attrs, len);
 
-	if (unlikely(iova == DMA_ERROR_CODE))
-		goto fail;
+	if (unlikely(iova == DMA_ERROR_CODE)) {
+		if (drained)
+			goto fail;
+		spin_unlock_irqrestore(&mapping->lock, flags);
+		drained = true;
+		if (fast_smmu_cache_drain(mapping))
+			goto retry;
+		return DMA_ERROR_CODE;
+	}
 
 	pmd = iopte_pmd_offset(mapping->pgtbl_pmds, iova);
 
@@ -406,6 +634,10 @@ static dma_addr_t fast_smmu_map_page(struct device *dev, struct page *page,
 
 	spin_unlock_irqrestore(&mapping->lock, flags);
 
+mapped:
+	this_cpu_inc(mapping->stats->map_count);
+	this_cpu_add(mapping->stats->map_ns, local_clock() - start);
+
 	trace_map(mapping->domain, iova, phys_to_map, len, prot);
 	return iova + offset_from_phys_to_map;
 
@@ -429,15 +661,21 @@ static void fast_smmu_unmap_page(struct device *dev, dma_addr_t iova,
 	struct page *page = phys_to_page((*pmd & FAST_PTE_ADDR_MASK));
 	bool skip_sync = (attrs & DMA_ATTR_SKIP_CPU_SYNC);
 	bool is_coherent = is_dma_coherent(dev, attrs);
+	u64 start = local_clock();
 
 	if (!skip_sync && !is_coherent)
 		__fast_dma_page_dev_to_cpu(page, offset, size, dir);
 
-	spin_lock_irqsave(&mapping->lock, flags);
-	av8l_fast_unmap_public(pmd, len);
-	fast_dmac_clean_range(mapping, pmd, pmd + nptes);
-	__fast_smmu_free_iova(mapping, iova - offset, len);
-	spin_unlock_irqrestore(&mapping->lock, flags);
+	if (!fast_smmu_cache_free(mapping, iova - offset, len)) {
+		spin_lock_irqsave(&mapping->lock, flags);
+		fast_smmu_unmap_ptes(mapping, pmd, len);
+		fast_dmac_clean_range(mapping, pmd, pmd + nptes);
+		__fast_smmu_free_iova(mapping, iova - offset, len);
+		spin_unlock_irqrestore(&mapping->lock, flags);
+	}
+
+	this_cpu_inc(mapping->stats->unmap_count);
+	this_cpu_add(mapping->stats->unmap_ns, local_clock() - start);
 
 	trace_unmap(mapping->domain, iova - offset, len, len);
 }
@@ -627,7 +865,7 @@ static void *fast_smmu_alloc(struct device *dev, size_t size,
 	/* need to take the lock again for page tables and iova */
 	spin_lock_irqsave(&mapping->lock, flags);
 	ptep = iopte_pmd_offset(mapping->pgtbl_pmds, dma_addr);
-	av8l_fast_unmap_public(ptep, size);
+	fast_smmu_unmap_ptes(mapping, ptep, size);
 	fast_dmac_clean_range(mapping, ptep, ptep + count);
 out_free_iova:
 	__fast_smmu_free_iova(mapping, dma_addr, size);
@@ -660,7 +898,7 @@ static void fast_smmu_free(struct device *dev, size_t size,
 	dma_common_free_remap(vaddr, size, VM_USERMAP, false);
 	ptep = iopte_pmd_offset(mapping->pgtbl_pmds, dma_handle);
 	spin_lock_irqsave(&mapping->lock, flags);
-	av8l_fast_unmap_public(ptep, size);
+	fast_smmu_unmap_ptes(mapping, ptep, size);
 	fast_dmac_clean_range(mapping, ptep, ptep + count);
 	__fast_smmu_free_iova(mapping, dma_handle, size);
 	spin_unlock_irqrestore(&mapping->lock, flags);
@@ -797,6 +1035,76 @@ static int fast_smmu_notify(struct notifier_block *self,
 	}
 }
 
+static struct dentry *fast_smmu_debugfs_top;
+static DEFINE_MUTEX(fast_smmu_debugfs_lock);
+
+static int fast_smmu_stats_show(struct seq_file *s, void *unused)
+{
+	struct dma_fast_smmu_mapping *fast = s->private;
+	struct fast_smmu_stats sum = {0};
+	u64 hits = 0, misses = 0, batches = 0;
+	unsigned int cached = 0, deferred = 0;
+	unsigned int order;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct fast_smmu_stats *stats = per_cpu_ptr(fast->stats, cpu);
+		struct fast_smmu_cpu_cache *cache =
+			per_cpu_ptr(fast->cpu_cache, cpu);
+
+		sum.map_count += stats->map_count;
+		sum.map_ns += stats->map_ns;
+		sum.unmap_count += stats->unmap_count;
+		sum.unmap_ns += stats->unmap_ns;
+		hits += cache->cache_hits;
+		misses += cache->cache_misses;
+		batches += cache->tlbi_batches;
+		deferred += cache->nr_deferred;
+		for (order = 0; order < FAST_IOVA_CACHE_ORDERS; order++)
+			cached += cache->mag_nr[order];
+	}
+
+	seq_printf(s, "maps:         %llu (avg %llu ns)\n", sum.map_count,
+		   sum.map_count ? div64_u64(sum.map_ns, sum.map_count) : 0);
+	seq_printf(s, "unmaps:       %llu (avg %llu ns)\n", sum.unmap_count,
+		   sum.unmap_count ?
+		   div64_u64(sum.unmap_ns, sum.unmap_count) : 0);
+	seq_printf(s, "cache hits:   %llu\n", hits);
+	seq_printf(s, "cache misses: %llu\n", misses);
+	seq_printf(s, "tlbi batches: %llu\n", batches);
+	seq_printf(s, "cached iovas: %u\n", cached);
+	seq_printf(s, "deferred:     %u\n", deferred);
+	return 0;
+}
+
+static int fast_smmu_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, fast_smmu_stats_show, inode->i_private);
+}
+
+static const struct file_operations fast_smmu_stats_fops = {
+	.open		= fast_smmu_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void fast_smmu_debugfs_init(struct dma_fast_smmu_mapping *fast)
+{
+	mutex_lock(&fast_smmu_debugfs_lock);
+	if (!fast_smmu_debugfs_top)
+		fast_smmu_debugfs_top = debugfs_create_dir("fast_smmu",
+							   iommu_debugfs_top);
+	mutex_unlock(&fast_smmu_debugfs_lock);
+
+	if (IS_ERR_OR_NULL(fast_smmu_debugfs_top))
+		return;
+
+	fast->debugfs = debugfs_create_file(dev_name(fast->dev), 0400,
+					    fast_smmu_debugfs_top, fast,
+					    &fast_smmu_stats_fops);
+}
+
 static const struct dma_map_ops fast_smmu_dma_ops = {
 	.alloc = fast_smmu_alloc,
 	.free = fast_smmu_free,
@@ -831,6 +1139,7 @@ static struct dma_fast_smmu_mapping *__fast_smmu_create_mapping_sized(
 	dma_addr_t base, u64 size)
 {
 	struct dma_fast_smmu_mapping *fast;
+	int cpu;
 
 	fast = kzalloc(sizeof(struct dma_fast_smmu_mapping), GFP_KERNEL);
 	if (!fast)
@@ -849,9 +1158,24 @@ static struct dma_fast_smmu_mapping *__fast_smmu_create_mapping_sized(
 	if (!fast->bitmap)
 		goto err2;
 
+	fast->cpu_cache = alloc_percpu(struct fast_smmu_cpu_cache);
+	if (!fast->cpu_cache)
+		goto err3;
+
+	fast->stats = alloc_percpu(struct fast_smmu_stats);
+	if (!fast->stats)
+		goto err4;
+
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu_ptr(fast->cpu_cache, cpu)->lock);
+
 	spin_lock_init(&fast->lock);
 
 	return fast;
+err4:
+	free_percpu(fast->cpu_cache);
+err3:
+	kvfree(fast->bitmap);
 err2:
 	kfree(fast);
 err:
@@ -974,11 +1298,15 @@ int fast_smmu_init_mapping(struct device *dev,
 	mapping->fast->notifier.notifier_call = fast_smmu_notify;
 	av8l_register_notify(&mapping->fast->notifier);
 
+	fast_smmu_debugfs_init(mapping->fast);
+
 	mapping->ops = &fast_smmu_dma_ops;
 	return 0;
 
 release_mapping:
-	kfree(mapping->fast->bitmap);
+	free_percpu(mapping->fast->stats);
+	free_percpu(mapping->fast->cpu_cache);
+	kvfree(mapping->fast->bitmap);
 	kfree(mapping->fast);
 	return err;
 }
@@ -994,6 +1322,9 @@ void fast_smmu_release_mapping(struct kref *kref)
 	struct dma_iommu_mapping *mapping =
 		container_of(kref, struct dma_iommu_mapping, kref);
 
+	debugfs_remove(mapping->fast->debugfs);
+	free_percpu(mapping->fast->stats);
+	free_percpu(mapping->fast->cpu_cache);
 	kvfree(mapping->fast->bitmap);
 	kfree(mapping->fast);
 	iommu_domain_free(mapping->domain);
@@ -99,6 +99,15 @@
 #define ARM_LPAE_PTE_SH_IS		(((arm_lpae_iopte)3) << 8)
 #define ARM_LPAE_PTE_NS			(((arm_lpae_iopte)1) << 5)
 #define ARM_LPAE_PTE_VALID		(((arm_lpae_iopte)1) << 0)
+#define ARM_LPAE_PTE_CONT		(((arm_lpae_iopte)1) << 52)
+
+/*
+ * Contiguous hint: with a 4K granule, 16 adjacent level 3 PTEs mapping a
+ * naturally aligned 64K range can be cached as a single TLB entry.
+ */
+#define ARM_LPAE_CONT_PTES		16
+#define ARM_LPAE_CONT_SIZE		SZ_64K
+#define ARM_LPAE_HAS_CONT(d)		((d)->pg_shift == 12)
 
 #define ARM_LPAE_PTE_ATTR_LO_MASK	(((arm_lpae_iopte)0x3ff) << 2)
 /* Ignore the contiguous bit for block splitting */
@@ -638,6 +647,7 @@ static int arm_lpae_map_sg(struct io_pgtable_ops *ops, unsigned long iova,
 	unsigned int min_pagesz;
 	struct io_pgtable_cfg *cfg = &data->iop.cfg;
 	struct map_state ms;
+	unsigned long cont_end = 0;
 
 	/* If no access, then nothing to do */
 	if (!(iommu_prot & (IOMMU_READ | IOMMU_WRITE)))
@@ -662,21 +672,46 @@ static int arm_lpae_map_sg(struct io_pgtable_ops *ops, unsigned long iova,
 		if (!IS_ALIGNED(s->offset, min_pagesz))
 			goto out_err;
 
+		/*
+		 * Merge physically contiguous entries, so that buffers built
+		 * from high-order chunks (e.g. ION order-4/order-8 pools) can
+		 * use block mappings even when no single entry is big enough.
+		 */
+		while (i + 1 < nents && IS_ALIGNED(phys + size, min_pagesz) &&
+		       page_to_phys(sg_page(sg_next(s))) + sg_next(s)->offset ==
+		       phys + size) {
+			s = sg_next(s);
+			size += s->length;
+			i++;
+		}
+
 		while (size) {
 			size_t pgsize = iommu_pgsize(
 				cfg->pgsize_bitmap, iova | phys, size);
+			arm_lpae_iopte pte_prot = prot;
+
+			if (pgsize == ARM_LPAE_GRANULE(data) &&
+			    ARM_LPAE_HAS_CONT(data)) {
+				if (iova >= cont_end &&
+				    size >= ARM_LPAE_CONT_SIZE &&
+				    IS_ALIGNED(iova | phys, ARM_LPAE_CONT_SIZE))
+					cont_end = iova + ARM_LPAE_CONT_SIZE;
+				if (iova < cont_end)
+					pte_prot |= ARM_LPAE_PTE_CONT;
+			}
 
 			if (ms.pgtable && (iova < ms.iova_end)) {
 				arm_lpae_iopte *ptep = ms.pgtable +
 					ARM_LPAE_LVL_IDX(iova, MAP_STATE_LVL,
 							 data);
 				arm_lpae_init_pte(
-					data, iova, phys, prot, MAP_STATE_LVL,
-					ptep, ms.prev_pgtable, false);
+					data, iova, phys, pte_prot,
+					MAP_STATE_LVL, ptep, ms.prev_pgtable,
+					false);
 				ms.num_pte++;
 			} else {
 				ret = __arm_lpae_map(data, iova, phys, pgsize,
-						prot, lvl, ptep, NULL, &ms);
+						pte_prot, lvl, ptep, NULL, &ms);
 				if (ret)
 					goto out_err;
 			}
@@ -809,6 +844,65 @@ static int arm_lpae_split_blk_unmap(struct arm_lpae_io_pgtable *data,
 	return __arm_lpae_unmap(data, iova, size, lvl, tablep);
 }
 
+/*
+ * Drops the contiguous hint from the group of last level PTEs starting at
+ * @idx, mapping @iova.  All entries of a contiguous range must stay valid
+ * and identical, so this is required before any of them is unmapped on its
+ * own.  Changing the hint needs break-before-make: the group is made
+ * invalid and flushed from the TLB before it is rewritten without it.
+ */
+static void arm_lpae_clear_cont(struct arm_lpae_io_pgtable *data,
+				arm_lpae_iopte *table, int idx,
+				unsigned long iova)
+{
+	arm_lpae_iopte old[ARM_LPAE_CONT_PTES];
+	arm_lpae_iopte *ptep = table + idx;
+	struct io_pgtable_cfg *cfg = &data->iop.cfg;
+	size_t len = sizeof(old);
+	int i;
+
+	if (!(ptep[0] & ARM_LPAE_PTE_CONT))
+		return;
+
+	memcpy(old, ptep, len);
+	memset(ptep, 0, len);
+	pgtable_dma_sync_single_for_device(cfg, __arm_lpae_dma_addr(ptep),
+					   len, DMA_TO_DEVICE);
+	io_pgtable_tlb_add_flush(&data->iop, iova, ARM_LPAE_CONT_SIZE,
+				 ARM_LPAE_GRANULE(data), true);
+	io_pgtable_tlb_sync(&data->iop);
+
+	for (i = 0; i < ARM_LPAE_CONT_PTES; i++)
+		ptep[i] = old[i] & ~ARM_LPAE_PTE_CONT;
+	pgtable_dma_sync_single_for_device(cfg, __arm_lpae_dma_addr(ptep),
+					   len, DMA_TO_DEVICE);
+}
+
+/*
+ * Before unmapping [start, end) of @table, which maps from @base, split the
+ * groups cut by either edge.
+ */
+static void arm_lpae_split_cont(struct arm_lpae_io_pgtable *data,
+				arm_lpae_iopte *table, unsigned long base,
+				int start, int end)
+{
+	int idx;
+
+	if (!ARM_LPAE_HAS_CONT(data))
+		return;
+
+	if (start % ARM_LPAE_CONT_PTES) {
+		idx = round_down(start, ARM_LPAE_CONT_PTES);
+		arm_lpae_clear_cont(data, table, idx,
+				    base + ((unsigned long)idx << data->pg_shift));
+	}
+	if (end % ARM_LPAE_CONT_PTES) {
+		idx = round_down(end, ARM_LPAE_CONT_PTES);
+		arm_lpae_clear_cont(data, table, idx,
+				    base + ((unsigned long)idx << data->pg_shift));
+	}
+}
+
 static int __arm_lpae_unmap(struct arm_lpae_io_pgtable *data,
 			    unsigned long iova, size_t size, int lvl,
 			    arm_lpae_iopte *ptep)
@@ -854,6 +948,11 @@ static int __arm_lpae_unmap(struct arm_lpae_io_pgtable *data,
 		 * swoop.
 		 */
 
+		arm_lpae_split_cont(data, table,
+				    round_down(iova,
+					       ARM_LPAE_BLOCK_SIZE(lvl, data)),
+				    tl_offset, tl_offset + entries);
+
 		table += tl_offset;
 
 		memset(table, 0, table_len);
@@ -1461,6 +1560,123 @@ static bool arm_lpae_range_has_specific_mapping(struct io_pgtable_ops *ops,
 	return true;
 }
 
+/*
+ * Returns the number of TLB entries needed to cover the iova range, i.e.
+ * the number of leaf entries with contiguous ranges counted once.
+ */
+static unsigned long __init arm_lpae_count_tlb_entries(
+	struct io_pgtable_ops *ops, unsigned long iova_start, size_t size)
+{
+	struct arm_lpae_io_pgtable *data = io_pgtable_ops_to_data(ops);
+	unsigned long iova = iova_start;
+	unsigned long count = 0;
+	arm_lpae_iopte pte;
+	size_t step;
+	int lvl;
+
+	while (iova < iova_start + size) {
+		if (arm_lpae_iova_to_pte(data, iova, &lvl, &pte)) {
+			iova += ARM_LPAE_GRANULE(data);
+			continue;
+		}
+
+		step = ARM_LPAE_BLOCK_SIZE(lvl, data);
+		if (lvl == ARM_LPAE_MAX_LEVELS - 1 &&
+		    (pte & ARM_LPAE_PTE_CONT))
+			step = ARM_LPAE_CONT_SIZE;
+		iova = round_down(iova, step) + step;
+		count++;
+	}
+	return count;
+}
+
+/*
+ * Maps a physically contiguous 2M buffer split into 64K sg entries, first
+ * at a 2M aligned iova (one block) and then at an iova that is only 64K
+ * aligned (contiguous 4K pages), and checks that a partial unmap of a
+ * contiguous range leaves its neighbours intact.
+ */
+static int __init arm_lpae_test_contig_sg(struct io_pgtable_ops *ops)
+{
+	static const unsigned long iovas[] __initconst = {
+		SZ_1G, SZ_1G + SZ_64K,
+	};
+	static const unsigned long expected[] __initconst = {
+		1, SZ_2M / SZ_64K,
+	};
+	struct arm_lpae_io_pgtable *data = io_pgtable_ops_to_data(ops);
+	int nents = SZ_2M / SZ_64K;
+	struct sg_table table;
+	struct scatterlist *sg;
+	unsigned long iova, entries;
+	phys_addr_t phys;
+	struct page *page;
+	size_t mapped, unused;
+	int i, k, ret = 0;
+
+	if (!ARM_LPAE_HAS_CONT(data) ||
+	    !(data->iop.cfg.pgsize_bitmap & SZ_2M))
+		return 0;
+
+	page = alloc_pages(GFP_KERNEL, get_order(SZ_2M));
+	if (!page)
+		return 0;
+	phys = page_to_phys(page);
+	if (!IS_ALIGNED(phys, SZ_2M))
+		goto out_free_pages;
+
+	if (sg_alloc_table(&table, nents, GFP_KERNEL))
+		goto out_free_pages;
+	for_each_sg(table.sgl, sg, table.nents, k)
+		sg_set_page(sg, nth_page(page, k * (SZ_64K >> PAGE_SHIFT)),
+			    SZ_64K, 0);
+
+	for (i = 0; i < ARRAY_SIZE(iovas); i++) {
+		iova = iovas[i];
+		mapped = ops->map_sg(ops, iova, table.sgl, table.nents,
+				     IOMMU_READ | IOMMU_WRITE, &unused);
+		if (mapped != SZ_2M ||
+		    !arm_lpae_range_has_specific_mapping(ops, iova, phys,
+							 SZ_2M)) {
+			ret = -EFAULT;
+			break;
+		}
+
+		entries = arm_lpae_count_tlb_entries(ops, iova, SZ_2M);
+		pr_info("selftest: 2M buffer at iova 0x%lx: %lu TLB entries (%lu with 4K pages)\n",
+			iova, entries, SZ_2M / SZ_4K);
+		if (entries != expected[i]) {
+			ret = -EFAULT;
+			break;
+		}
+
+		/* punch a hole into the second contiguous range */
+		if (ops->unmap(ops, iova + SZ_64K + SZ_4K, SZ_4K) != SZ_4K ||
+		    ops->iova_to_phys(ops, iova + SZ_64K + SZ_4K) ||
+		    !arm_lpae_range_has_specific_mapping(ops, iova + SZ_64K,
+						phys + SZ_64K, SZ_4K) ||
+		    !arm_lpae_range_has_specific_mapping(ops,
+						iova + SZ_64K + SZ_8K,
+						phys + SZ_64K + SZ_8K,
+						SZ_64K - SZ_8K)) {
+			ret = -EFAULT;
+			break;
+		}
+
+		ops->unmap(ops, iova, SZ_64K + SZ_4K);
+		ops->unmap(ops, iova + SZ_64K + SZ_8K, SZ_2M - SZ_64K - SZ_8K);
+		if (arm_lpae_range_has_mapping(ops, iova, SZ_2M)) {
+			ret = -EFAULT;
+			break;
+		}
+	}
+
+	sg_free_table(&table);
+out_free_pages:
+	__free_pages(page, get_order(SZ_2M));
+	return ret;
+}
+
 static int __init arm_lpae_run_tests(struct io_pgtable_cfg *cfg)
 {
 	static const enum io_pgtable_fmt fmts[] = {
@@ -1651,6 +1867,10 @@ static int __init arm_lpae_run_tests(struct io_pgtable_cfg *cfg)
 			__free_pages(page, get_order(chunk_size));
 		}
 
+		/* map_sg of physically contiguous chunks */
+		if (arm_lpae_test_contig_sg(ops))
+			return __FAIL(ops, i);
+
 		if (arm_lpae_range_has_mapping(ops, 0, SZ_2G))
 			return __FAIL(ops, i);
 
@@ -60,6 +60,7 @@ struct av8l_fast_io_pgtable {
 #define AV8L_FAST_PTE_SH_IS		(((av8l_fast_iopte)3) << 8)
 #define AV8L_FAST_PTE_NS		(((av8l_fast_iopte)1) << 5)
 #define AV8L_FAST_PTE_VALID		(((av8l_fast_iopte)1) << 0)
+#define AV8L_FAST_PTE_CONT		(((av8l_fast_iopte)1) << 52)
 
 #define AV8L_FAST_PTE_ATTR_LO_MASK	(((av8l_fast_iopte)0x3ff) << 2)
 /* Ignore the contiguous bit for block splitting */
@@ -142,6 +143,13 @@ struct av8l_fast_io_pgtable {
 
 #define AV8L_FAST_PAGE_SHIFT		12
 
+/* 16 adjacent PTEs mapping an aligned 64K range share one TLB entry */
+#define AV8L_FAST_CONT_PTES		16
+#define AV8L_FAST_CONT_SIZE		SZ_64K
+#define av8l_fast_cont_aligned(ptep)					\
+	IS_ALIGNED((unsigned long)(ptep),				\
+		   AV8L_FAST_CONT_PTES * sizeof(av8l_fast_iopte))
+
 
 #ifdef CONFIG_IOMMU_IO_PGTABLE_FAST_PROVE_TLB
 
@@ -195,6 +203,7 @@ int av8l_fast_map_public(av8l_fast_iopte *ptep, phys_addr_t paddr, size_t size,
 			 int prot)
 {
 	int i, nptes = size >> AV8L_FAST_PAGE_SHIFT;
+	int cont_end = 0;
 	av8l_fast_iopte pte = AV8L_FAST_PTE_XN
 		| AV8L_FAST_PTE_TYPE_PAGE
 		| AV8L_FAST_PTE_AF
@@ -218,8 +227,18 @@ int av8l_fast_map_public(av8l_fast_iopte *ptep, phys_addr_t paddr, size_t size,
 
 	paddr &= AV8L_FAST_PTE_ADDR_MASK;
 	for (i = 0; i < nptes; i++, paddr += SZ_4K) {
+		/*
+		 * The pmds are the last level tables laid out back to back,
+		 * so an aligned ptep means an aligned iova.
+		 */
+		if (i >= cont_end && nptes - i >= AV8L_FAST_CONT_PTES &&
+		    IS_ALIGNED(paddr, AV8L_FAST_CONT_SIZE) &&
+		    av8l_fast_cont_aligned(ptep + i))
+			cont_end = i + AV8L_FAST_CONT_PTES;
+
 		__av8l_check_for_stale_tlb(ptep + i);
-		*(ptep + i) = pte | paddr;
+		*(ptep + i) = pte | paddr |
+			(i < cont_end ? AV8L_FAST_PTE_CONT : 0);
 	}
 
 	return 0;
@@ -238,6 +257,49 @@ static int av8l_fast_map(struct io_pgtable_ops *ops, unsigned long iova,
 	return 0;
 }
 
+static av8l_fast_iopte *av8l_fast_cont_group(av8l_fast_iopte *ptep)
+{
+	return (av8l_fast_iopte *)round_down((unsigned long)ptep,
+				AV8L_FAST_CONT_PTES * sizeof(*ptep));
+}
+
+/* Whether unmapping @nptes entries from @ptep leaves part of a group mapped */
+static bool av8l_fast_cuts_cont(av8l_fast_iopte *ptep, unsigned long nptes)
+{
+	return (!av8l_fast_cont_aligned(ptep) &&
+		(*av8l_fast_cont_group(ptep) & AV8L_FAST_PTE_CONT)) ||
+	       (!av8l_fast_cont_aligned(ptep + nptes) &&
+		(*av8l_fast_cont_group(ptep + nptes) & AV8L_FAST_PTE_CONT));
+}
+
+/*
+ * Drops the contiguous hint from the group containing @ptep, so that the
+ * entries left mapped around a partial unmap stay architecturally valid.
+ * Changing the hint needs break-before-make: the group is made invalid and
+ * flushed from the TLB with @tlb_flush_all before it is rewritten without
+ * it.
+ */
+static void av8l_fast_clear_cont(av8l_fast_iopte *ptep,
+				 void (*tlb_flush_all)(void *cookie),
+				 void *cookie)
+{
+	av8l_fast_iopte *group = av8l_fast_cont_group(ptep);
+	av8l_fast_iopte old[AV8L_FAST_CONT_PTES];
+	int i;
+
+	if (!(*group & AV8L_FAST_PTE_CONT))
+		return;
+
+	memcpy(old, group, sizeof(old));
+	memset(group, 0, sizeof(old));
+	dmac_clean_range(group, group + AV8L_FAST_CONT_PTES);
+	tlb_flush_all(cookie);
+
+	for (i = 0; i < AV8L_FAST_CONT_PTES; i++)
+		group[i] = old[i] & ~AV8L_FAST_PTE_CONT;
+	dmac_clean_range(group, group + AV8L_FAST_CONT_PTES);
+}
+
 static void __av8l_fast_unmap(av8l_fast_iopte *ptep, size_t size,
 			      bool need_stale_tlb_tracking)
 {
@@ -249,10 +311,36 @@ static void __av8l_fast_unmap(av8l_fast_iopte *ptep, size_t size,
 	memset(ptep, val, sizeof(*ptep) * nptes);
 }
 
-/* caller must take care of cache maintenance on *ptep */
-void av8l_fast_unmap_public(av8l_fast_iopte *ptep, size_t size)
+/*
+ * caller must take care of cache maintenance on *ptep.  Contiguous groups
+ * never extend past a single av8l_fast_map_public() call, so unmapping what
+ * was mapped never cuts one.  Anything else needs a TLB invalidate, which
+ * cannot be done from here: -EBUSY is returned without unmapping anything,
+ * and the caller has to av8l_fast_split_cont_public() first.
+ */
+int av8l_fast_unmap_public(av8l_fast_iopte *ptep, size_t size)
 {
+	if (av8l_fast_cuts_cont(ptep, size >> AV8L_FAST_PAGE_SHIFT))
+		return -EBUSY;
+
 	__av8l_fast_unmap(ptep, size, true);
+	return 0;
+}
+
+/*
+ * Drops the contiguous hint from the groups that unmapping @size bytes at
+ * @ptep would cut, using @tlb_flush_all for the break-before-make.
+ */
+void av8l_fast_split_cont_public(av8l_fast_iopte *ptep, size_t size,
+				 void (*tlb_flush_all)(void *cookie),
+				 void *cookie)
+{
+	unsigned long nptes = size >> AV8L_FAST_PAGE_SHIFT;
+
+	if (!av8l_fast_cont_aligned(ptep))
+		av8l_fast_clear_cont(ptep, tlb_flush_all, cookie);
+	if (!av8l_fast_cont_aligned(ptep + nptes))
+		av8l_fast_clear_cont(ptep + nptes, tlb_flush_all, cookie);
 }
 
 static size_t av8l_fast_unmap(struct io_pgtable_ops *ops, unsigned long iova,
@@ -263,6 +351,8 @@ static size_t av8l_fast_unmap(struct io_pgtable_ops *ops, unsigned long iova,
 	av8l_fast_iopte *ptep = iopte_pmd_offset(data->pmds, iova);
 	unsigned long nptes = size >> AV8L_FAST_PAGE_SHIFT;
 
+	av8l_fast_split_cont_public(ptep, size, iop->cfg.tlb->tlb_flush_all,
+				    iop->cookie);
 	__av8l_fast_unmap(ptep, size, false);
 	dmac_clean_range(ptep, ptep + nptes);
 	io_pgtable_tlb_flush_all(iop);
@@ -316,7 +406,42 @@ static int av8l_fast_map_sg(struct io_pgtable_ops *ops, unsigned long iova,
 			    struct scatterlist *sg, unsigned int nents,
 			    int prot, size_t *size)
 {
-	return -ENODEV;
+	struct av8l_fast_io_pgtable *data = iof_pgtable_ops_to_data(ops);
+	struct scatterlist *s;
+	av8l_fast_iopte *ptep;
+	size_t mapped = 0;
+	int i;
+
+	for_each_sg(sg, s, nents, i) {
+		phys_addr_t phys = page_to_phys(sg_page(s)) + s->offset;
+		size_t len = s->length;
+
+		/*
+		 * Map physically contiguous entries in one go so that they
+		 * can use the contiguous hint across sg boundaries.
+		 */
+		while (i + 1 < nents &&
+		       page_to_phys(sg_page(sg_next(s))) + sg_next(s)->offset ==
+		       phys + len) {
+			s = sg_next(s);
+			len += s->length;
+			i++;
+		}
+
+		if (!IS_ALIGNED(phys | len | iova, SZ_4K)) {
+			*size = mapped;
+			return 0;
+		}
+
+		ptep = iopte_pmd_offset(data->pmds, iova);
+		av8l_fast_map_public(ptep, phys, len, prot);
+		dmac_clean_range(ptep, ptep + (len >> AV8L_FAST_PAGE_SHIFT));
+
+		iova += len;
+		mapped += len;
+	}
+
+	return mapped;
 }
 
 static struct av8l_fast_io_pgtable *
@@ -548,6 +673,7 @@ struct io_pgtable_init_fns io_pgtable_av8l_fast_init_fns = {
 #ifdef CONFIG_IOMMU_IO_PGTABLE_FAST_SELFTEST
 
 #include <linux/dma-contiguous.h>
+#include <linux/ktime.h>
 
 static struct io_pgtable_cfg *cfg_cookie;
 
@@ -705,11 +831,205 @@ static int __init av8l_fast_positive_testing(void)
 	return failed;
 }
 
+/*
+ * Returns the number of TLB entries needed to cover the iova range, with
+ * each contiguous range counted once.
+ */
+static unsigned long __init av8l_fast_count_tlb_entries(av8l_fast_iopte *pmds,
+							unsigned long iova,
+							size_t size)
+{
+	av8l_fast_iopte *ptep = iopte_pmd_offset(pmds, iova);
+	unsigned long i, nptes = size >> AV8L_FAST_PAGE_SHIFT;
+	unsigned long count = 0;
+
+	for (i = 0; i < nptes; i++) {
+		if (!(ptep[i] & AV8L_FAST_PTE_VALID))
+			continue;
+		if ((ptep[i] & AV8L_FAST_PTE_CONT) &&
+		    !av8l_fast_cont_aligned(ptep + i))
+			continue;
+		count++;
+	}
+	return count;
+}
+
+static int __init av8l_fast_contig_testing(void)
+{
+	int failed = 0;
+	struct io_pgtable_ops *ops;
+	struct io_pgtable_cfg cfg;
+	struct av8l_fast_io_pgtable *data;
+	struct sg_table table;
+	struct scatterlist *sg;
+	struct page *page;
+	phys_addr_t phys;
+	unsigned long entries;
+	size_t unused;
+	u64 iova = SZ_1M;
+	int k;
+
+	cfg = (struct io_pgtable_cfg) {
+		.quirks = 0,
+		.tlb = &dummy_tlb_ops,
+		.ias = 32,
+		.oas = 32,
+		.pgsize_bitmap = SZ_4K,
+	};
+
+	cfg_cookie = &cfg;
+	ops = alloc_io_pgtable_ops(ARM_V8L_FAST, &cfg, &cfg);
+
+	if (WARN_ON(!ops))
+		return 1;
+
+	data = iof_pgtable_ops_to_data(ops);
+
+	/* an aligned 1M mapping needs one TLB entry per 64K */
+	if (WARN_ON(ops->map(ops, iova, iova, SZ_1M, IOMMU_READ)))
+		failed++;
+	entries = av8l_fast_count_tlb_entries(data->pmds, iova, SZ_1M);
+	pr_err("selftest: 1M map: %lu TLB entries (%lu with 4K pages)\n",
+	       entries, SZ_1M / SZ_4K);
+	if (WARN_ON(entries != SZ_1M / SZ_64K))
+		failed++;
+
+	/* a partial unmap must only split the contiguous range it hits */
+	if (WARN_ON(ops->unmap(ops, iova + SZ_4K, SZ_4K) != SZ_4K))
+		failed++;
+	if (WARN_ON(av8l_fast_count_tlb_entries(data->pmds, iova, SZ_1M) !=
+		    SZ_1M / SZ_64K - 1 + AV8L_FAST_CONT_PTES - 1))
+		failed++;
+	if (WARN_ON(!av8l_fast_range_has_specific_mapping(ops, iova, iova,
+							  SZ_4K)) ||
+	    WARN_ON(!av8l_fast_range_has_specific_mapping(ops, iova + SZ_8K,
+					iova + SZ_8K, SZ_1M - SZ_8K)))
+		failed++;
+	ops->unmap(ops, iova, SZ_4K);
+	ops->unmap(ops, iova + SZ_8K, SZ_1M - SZ_8K);
+
+	/* map_sg of 64K chunks of one physically contiguous buffer */
+	page = alloc_pages(GFP_KERNEL, get_order(SZ_1M));
+	if (!page)
+		goto out;
+	phys = page_to_phys(page);
+
+	if (sg_alloc_table(&table, SZ_1M / SZ_64K, GFP_KERNEL))
+		goto out_free_pages;
+	for_each_sg(table.sgl, sg, table.nents, k)
+		sg_set_page(sg, nth_page(page, k * (SZ_64K >> PAGE_SHIFT)),
+			    SZ_64K, 0);
+
+	if (WARN_ON(ops->map_sg(ops, iova, table.sgl, table.nents,
+				IOMMU_READ, &unused) != SZ_1M))
+		failed++;
+	if (WARN_ON(!av8l_fast_range_has_specific_mapping(ops, iova, phys,
+							  SZ_1M)))
+		failed++;
+	entries = av8l_fast_count_tlb_entries(data->pmds, iova, SZ_1M);
+	pr_err("selftest: 1M map_sg: %lu TLB entries\n", entries);
+	if (WARN_ON(IS_ALIGNED(phys, SZ_64K) &&
+		    entries != SZ_1M / SZ_64K))
+		failed++;
+	ops->unmap(ops, iova, SZ_1M);
+
+	sg_free_table(&table);
+out_free_pages:
+	__free_pages(page, get_order(SZ_1M));
+out:
+	free_io_pgtable_ops(ops);
+	return failed;
+}
+
+#define AV8L_FAST_BENCH_ITERS	(1 << 16)
+#define AV8L_FAST_BENCH_WINDOW	SZ_16M
+#define AV8L_FAST_BENCH_BATCH	32
+
+/*
+ * Map/unmap throughput with the dummy TLB ops, so only page table and
+ * cache maintenance cost is measured.  "sync" flushes the TLB on every
+ * unmap like ops->unmap; "batched" defers the flush and issues one per
+ * AV8L_FAST_BENCH_BATCH unmaps, the way dma-mapping-fast does.
+ */
+static int __init av8l_fast_benchmark(void)
+{
+	static const size_t sizes[] __initconst = { SZ_4K, SZ_16K, SZ_64K };
+	struct av8l_fast_io_pgtable *data;
+	struct io_pgtable_ops *ops;
+	struct io_pgtable_cfg cfg;
+	av8l_fast_iopte *ptep;
+	unsigned long iova;
+	u64 sync_ns, batch_ns;
+	ktime_t start;
+	int failed = 0;
+	int i, j;
+
+	cfg = (struct io_pgtable_cfg) {
+		.quirks = 0,
+		.tlb = &dummy_tlb_ops,
+		.ias = 32,
+		.oas = 32,
+		.pgsize_bitmap = SZ_4K,
+	};
+
+	cfg_cookie = &cfg;
+	ops = alloc_io_pgtable_ops(ARM_V8L_FAST, &cfg, &cfg);
+
+	if (WARN_ON(!ops))
+		return 1;
+
+	data = iof_pgtable_ops_to_data(ops);
+
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		size_t size = sizes[i];
+		unsigned long nptes = size >> AV8L_FAST_PAGE_SHIFT;
+
+		start = ktime_get();
+		for (j = 0, iova = 0; j < AV8L_FAST_BENCH_ITERS; j++) {
+			if (WARN_ON(ops->map(ops, iova, iova, size,
+					     IOMMU_READ))) {
+				failed++;
+				break;
+			}
+			ops->unmap(ops, iova, size);
+			iova = (iova + size) % AV8L_FAST_BENCH_WINDOW;
+		}
+		sync_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		start = ktime_get();
+		for (j = 0, iova = 0; j < AV8L_FAST_BENCH_ITERS; j++) {
+			ptep = iopte_pmd_offset(data->pmds, iova);
+			if (WARN_ON(av8l_fast_map_public(ptep, iova, size,
+							 IOMMU_READ))) {
+				failed++;
+				break;
+			}
+			dmac_clean_range(ptep, ptep + nptes);
+			__av8l_fast_unmap(ptep, size, false);
+			dmac_clean_range(ptep, ptep + nptes);
+			if ((j % AV8L_FAST_BENCH_BATCH) ==
+			    AV8L_FAST_BENCH_BATCH - 1)
+				io_pgtable_tlb_flush_all(&data->iop);
+			iova = (iova + size) % AV8L_FAST_BENCH_WINDOW;
+		}
+		batch_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		pr_info("selftest: %zuK map+unmap: sync %llu ns/op, batched %llu ns/op\n",
+			size >> 10, div_u64(sync_ns, AV8L_FAST_BENCH_ITERS),
+			div_u64(batch_ns, AV8L_FAST_BENCH_ITERS));
+	}
+
+	free_io_pgtable_ops(ops);
+	return failed;
+}
+
 static int __init av8l_fast_do_selftests(void)
 {
 	int failed = 0;
 
 	failed += av8l_fast_positive_testing();
+	failed += av8l_fast_contig_testing();
+	failed += av8l_fast_benchmark();
 
 	pr_err("selftest: completed with %d failures\n", failed);
 
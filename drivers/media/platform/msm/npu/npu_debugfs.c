@@ -27,6 +27,7 @@
  * -------------------------------------------------------------------------
  */
 #define NPU_LOG_BUF_SIZE 4096
+#define NPU_EXEC_LAT_BUF_SIZE 8192
 
 /* -------------------------------------------------------------------------
  * Function Prototypes
@@ -46,6 +47,8 @@ static ssize_t npu_debug_log_read(struct file *file,
 		char __user *user_buf, size_t count, loff_t *ppos);
 static ssize_t npu_debug_ctrl_write(struct file *file,
 		const char __user *user_buf, size_t count, loff_t *ppos);
+static ssize_t npu_debug_exec_lat_read(struct file *file,
+		char __user *user_buf, size_t count, loff_t *ppos);
 
 /* -------------------------------------------------------------------------
  * Variables
@@ -80,6 +83,13 @@ static const struct file_operations npu_ctrl_fops = {
 	.write = npu_debug_ctrl_write,
 };
 
+static const struct file_operations npu_exec_lat_fops = {
+	.open = npu_debug_open,
+	.release = npu_debug_release,
+	.read = npu_debug_exec_lat_read,
+	.write = NULL,
+};
+
 /* -------------------------------------------------------------------------
  * Function Implementations
  * -------------------------------------------------------------------------
@@ -362,6 +372,60 @@ static ssize_t npu_debug_ctrl_write(struct file *file,
 
 	return count;
 }
+/* -------------------------------------------------------------------------
+ * Function Implementations - Execution Latency
+ * -------------------------------------------------------------------------
+ */
+static ssize_t npu_debug_exec_lat_read(struct file *file,
+		char __user *user_buf, size_t count, loff_t *ppos)
+{
+	struct npu_device *npu_dev = file->private_data;
+	struct npu_host_ctx *host_ctx = &npu_dev->host_ctx;
+	struct npu_network *network;
+	char *buf;
+	size_t len = 0;
+	ssize_t ret;
+	int i, j;
+
+	buf = kzalloc(NPU_EXEC_LAT_BUF_SIZE, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	mutex_lock(&host_ctx->lock);
+	for (i = 0; i < MAX_LOADED_NETWORK; i++) {
+		network = &host_ctx->networks[i];
+		if (!network->is_valid || !network->exec_cnt)
+			continue;
+
+		len += scnprintf(buf + len, NPU_EXEC_LAT_BUF_SIZE - len,
+			"network %llu: exec %llu polled %llu avg %uus max %uus\n",
+			network->id, network->exec_cnt,
+			network->exec_polled_cnt, network->exec_lat_avg_us,
+			network->exec_lat_max_us);
+		for (j = 0; j < NPU_EXEC_LAT_BUCKETS; j++) {
+			if (!network->exec_lat_hist[j])
+				continue;
+			/* the last bucket has no upper bound */
+			if (j == NPU_EXEC_LAT_BUCKETS - 1)
+				len += scnprintf(buf + len,
+					NPU_EXEC_LAT_BUF_SIZE - len,
+					" >= %8uus: %u\n", 1U << (j - 1),
+					network->exec_lat_hist[j]);
+			else
+				len += scnprintf(buf + len,
+					NPU_EXEC_LAT_BUF_SIZE - len,
+					"  < %8uus: %u\n", 1U << j,
+					network->exec_lat_hist[j]);
+		}
+	}
+	mutex_unlock(&host_ctx->lock);
+
+	ret = simple_read_from_buffer(user_buf, count, ppos, buf, len);
+	kfree(buf);
+
+	return ret;
+}
+
 /* -------------------------------------------------------------------------
  * Function Implementations - DebugFS
  * -------------------------------------------------------------------------
@@ -435,6 +499,18 @@ int npu_debugfs_init(struct npu_device *npu_dev)
 		goto err;
 	}
 
+	if (!debugfs_create_u32("exec_poll_us", 0644,
+		debugfs->root, &(host_ctx->exec_poll_us))) {
+		pr_err("debugfs_create_u32 fail for exec_poll_us\n");
+		goto err;
+	}
+
+	if (!debugfs_create_file("exec_latency", 0444, debugfs->root,
+		npu_dev, &npu_exec_lat_fops)) {
+		pr_err("debugfs_create_file exec_latency fail\n");
+		goto err;
+	}
+
 	debugfs->log_num_bytes_buffered = 0;
 	debugfs->log_read_index = 0;
 	debugfs->log_write_index = 0;
@@ -35,6 +35,9 @@
 #define NPU_FW_TIMEOUT_POLL_INTERVAL_MS  20
 #define NPU_FW_TIMEOUT_MS                1000
 
+/* upper bound for the adaptive execute completion poll window */
+#define NPU_EXEC_POLL_MAX_US             2000
+
 /* -------------------------------------------------------------------------
  * File Scope Function Prototypes
  * -------------------------------------------------------------------------
@@ -61,6 +64,9 @@ static void host_session_log_hdlr(struct npu_device *npu_dev);
 static int host_error_hdlr(struct npu_device *npu_dev, bool force);
 static int npu_send_network_cmd(struct npu_device *npu_dev,
 	struct npu_network *network, void *cmd_ptr, bool async);
+static void network_exec_done(struct npu_network *network);
+static long npu_wait_exec_done(struct npu_device *npu_dev,
+	struct npu_network *network);
 static int npu_send_misc_cmd(struct npu_device *npu_dev, uint32_t q_idx,
 	void *cmd_ptr);
 static int npu_queue_event(struct npu_client *client, struct npu_kevent *evt);
@@ -313,15 +319,29 @@ int npu_host_init(struct npu_device *npu_dev)
 	host_ctx->prop_buf = kzalloc(sizeof(struct msm_npu_property),
 		GFP_KERNEL);
 	if (!host_ctx->prop_buf)
-		return -ENOMEM;
+		goto fail_destroy_wq;
+
+	/* shared by the irq work and execute pollers under host_ctx->lock */
+	host_ctx->ipc_msg_buf = kzalloc(sizeof(uint32_t) * NPU_IPC_BUF_LENGTH,
+		GFP_KERNEL);
+	if (!host_ctx->ipc_msg_buf)
+		goto fail_free_prop_buf;
 
 	return 0;
+
+fail_free_prop_buf:
+	kfree(host_ctx->prop_buf);
+	host_ctx->prop_buf = NULL;
+fail_destroy_wq:
+	npu_destroy_wq(host_ctx);
+	return -ENOMEM;
 }
 
 void npu_host_deinit(struct npu_device *npu_dev)
 {
 	struct npu_host_ctx *host_ctx = &npu_dev->host_ctx;
 
+	kfree(host_ctx->ipc_msg_buf);
 	kfree(host_ctx->prop_buf);
 	npu_destroy_wq(host_ctx);
 	mutex_destroy(&host_ctx->lock);
@@ -751,6 +771,7 @@ static void app_msg_proc(struct npu_host_ctx *host_ctx, uint32_t *msg)
 
 		network->cmd_pending = false;
 		network->cmd_ret_status = exe_rsp_pkt->header.status;
+		network_exec_done(network);
 
 		if (!network->cmd_async) {
 			complete(&network->cmd_done);
@@ -807,6 +828,7 @@ static void app_msg_proc(struct npu_host_ctx *host_ctx, uint32_t *msg)
 		network->stats_buf_size = stats_size;
 		network->cmd_pending = false;
 		network->cmd_ret_status = exe_rsp_pkt->header.status;
+		network_exec_done(network);
 
 		if (network->cmd_async) {
 			pr_debug("async cmd, queue event\n");
@@ -997,13 +1019,11 @@ static void host_session_msg_hdlr(struct npu_device *npu_dev)
 	uint32_t *msg;
 	struct npu_host_ctx *host_ctx = &npu_dev->host_ctx;
 
-	msg = kzalloc(sizeof(uint32_t) * NPU_IPC_BUF_LENGTH, GFP_KERNEL);
-	if (!msg)
-		return;
-
 	mutex_lock(&host_ctx->lock);
+	msg = host_ctx->ipc_msg_buf;
 	if (host_ctx->fw_state == FW_DISABLED) {
-		pr_warn("handle npu session msg when FW is disabled\n");
+		/* execute pollers come through here too, keep it quiet */
+		pr_warn_ratelimited("handle npu session msg when FW is disabled\n");
 		goto skip_read_msg;
 	}
 
@@ -1014,7 +1034,6 @@ static void host_session_msg_hdlr(struct npu_device *npu_dev)
 
 skip_read_msg:
 	mutex_unlock(&host_ctx->lock);
-	kfree(msg);
 }
 
 static void log_msg_proc(struct npu_device *npu_dev, uint32_t *msg)
@@ -1134,6 +1153,7 @@ static int npu_send_network_cmd(struct npu_device *npu_dev,
 		network->cmd_ret_status = 0;
 		network->cmd_pending = true;
 		network->trans_id = atomic_read(&host_ctx->ipc_trans_id);
+		network->cmd_start = ktime_get();
 		ret = npu_host_ipc_send_cmd(npu_dev,
 			IPC_QUEUE_APPS_EXEC, cmd_ptr);
 		if (ret)
@@ -1143,6 +1163,67 @@ static int npu_send_network_cmd(struct npu_device *npu_dev,
 	return ret;
 }
 
+/*
+ * Account an execute completion against the network: latency histogram
+ * plus the moving average which sizes the completion poll window.
+ */
+static void network_exec_done(struct npu_network *network)
+{
+	uint32_t lat_us, bucket;
+
+	lat_us = (uint32_t)ktime_us_delta(ktime_get(), network->cmd_start);
+	bucket = lat_us ? min_t(uint32_t, ilog2(lat_us) + 1,
+		NPU_EXEC_LAT_BUCKETS - 1) : 0;
+
+	network->exec_lat_hist[bucket]++;
+	network->exec_cnt++;
+	network->exec_lat_max_us = max(network->exec_lat_max_us, lat_us);
+	if (!network->exec_lat_avg_us)
+		network->exec_lat_avg_us = lat_us;
+	else
+		network->exec_lat_avg_us =
+			(network->exec_lat_avg_us * 7 + lat_us) >> 3;
+}
+
+/*
+ * Wait for a synchronous execute to complete. When exec_poll_us is set,
+ * networks whose recent latency fits in the poll window drain the response
+ * queue directly instead of waiting for the irq and the worker wakeup.
+ * Called without host_ctx->lock held.
+ */
+static long npu_wait_exec_done(struct npu_device *npu_dev,
+	struct npu_network *network)
+{
+	struct npu_host_ctx *host_ctx = &npu_dev->host_ctx;
+	uint32_t poll_us = min_t(uint32_t, READ_ONCE(host_ctx->exec_poll_us),
+		NPU_EXEC_POLL_MAX_US);
+	uint32_t avg_us = network->exec_lat_avg_us;
+	ktime_t deadline;
+
+	if (poll_us && avg_us <= poll_us) {
+		/* allow some jitter over the average before giving up */
+		if (avg_us)
+			poll_us = min(poll_us, avg_us * 2);
+		deadline = ktime_add_us(ktime_get(), poll_us);
+		while (!completion_done(&network->cmd_done)) {
+			host_session_msg_hdlr(npu_dev);
+			if (completion_done(&network->cmd_done)) {
+				network->exec_polled_cnt++;
+				break;
+			}
+			if (ktime_after(ktime_get(), deadline) ||
+				need_resched())
+				break;
+			cpu_relax();
+		}
+	}
+
+	return wait_for_completion_interruptible_timeout(
+		&network->cmd_done,
+		(host_ctx->fw_dbg_mode & FW_DBG_MODE_INC_TIMEOUT) ?
+		NW_DEBUG_TIMEOUT : NW_CMD_TIMEOUT);
+}
+
 static int npu_send_misc_cmd(struct npu_device *npu_dev, uint32_t q_idx,
 	void *cmd_ptr)
 {
@@ -1837,10 +1918,7 @@ int32_t npu_host_exec_network(struct npu_client *client,
 
 	mutex_unlock(&host_ctx->lock);
 
-	ret = wait_for_completion_interruptible_timeout(
-		&network->cmd_done,
-		(host_ctx->fw_dbg_mode & FW_DBG_MODE_INC_TIMEOUT) ?
-		NW_DEBUG_TIMEOUT : NW_CMD_TIMEOUT);
+	ret = npu_wait_exec_done(npu_dev, network);
 
 	mutex_lock(&host_ctx->lock);
 	if (!ret) {
@@ -1982,10 +2060,7 @@ int32_t npu_host_exec_network_v2(struct npu_client *client,
 
 	mutex_unlock(&host_ctx->lock);
 
-	ret = wait_for_completion_interruptible_timeout(
-		&network->cmd_done,
-		(host_ctx->fw_dbg_mode & FW_DBG_MODE_INC_TIMEOUT) ?
-		NW_DEBUG_TIMEOUT : NW_CMD_TIMEOUT);
+	ret = npu_wait_exec_done(npu_dev, network);
 
 	mutex_lock(&host_ctx->lock);
 	if (!ret) {
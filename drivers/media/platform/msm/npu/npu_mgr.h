@@ -32,6 +32,8 @@
 #define FIRMWARE_VERSION 0x00001000
 #define MAX_LOADED_NETWORK 32
 #define NPU_IPC_BUF_LENGTH 512
+/* log2(usec) buckets for the per network execution latency histogram */
+#define NPU_EXEC_LAT_BUCKETS 24
 
 #define FW_DBG_MODE_PAUSE        (1 << 0)
 #define FW_DBG_MODE_INC_TIMEOUT  (1 << 1)
@@ -65,6 +67,12 @@ struct npu_network {
 	int cmd_ret_status;
 	struct completion cmd_done;
 	struct npu_client *client;
+	ktime_t cmd_start;
+	uint32_t exec_lat_avg_us;
+	uint32_t exec_lat_max_us;
+	uint64_t exec_cnt;
+	uint64_t exec_polled_cnt;
+	uint32_t exec_lat_hist[NPU_EXEC_LAT_BUCKETS];
 };
 
 enum fw_state {
@@ -97,6 +105,8 @@ struct npu_host_ctx {
 	atomic_t ipc_trans_id;
 	atomic_t network_execute_cnt;
 	int cmd_ret_status;
+	uint32_t *ipc_msg_buf;
+	uint32_t exec_poll_us;
 
 	uint32_t err_irq_sts;
 	uint32_t wdg_irq_sts;
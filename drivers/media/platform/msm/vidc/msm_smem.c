@@ -14,6 +14,7 @@
 #include <asm/dma-iommu.h>
 #include <linux/dma-buf.h>
 #include <linux/dma-direction.h>
+#include <linux/fs.h>
 #include <linux/iommu.h>
 #include <linux/msm_dma_iommu_mapping.h>
 #include <linux/msm_ion.h>
@@ -24,6 +25,24 @@
 #include "msm_vidc_debug.h"
 #include "msm_vidc_resources.h"
 
+/*
+ * Number and total size of dma_buf mappings kept per instance after the
+ * last unmap so that buffers which the client keeps re-queuing skip
+ * attach/map on every qbuf. An entry also goes away as soon as the pool
+ * holds the last reference to its dma_buf.
+ */
+#define MSM_SMEM_RECYCLE_MAX 32
+#define MSM_SMEM_RECYCLE_MAX_BYTES SZ_64M
+
+struct msm_smem_recycle_entry {
+	struct list_head list;
+	struct dma_buf *dma_buf;
+	size_t size;
+	unsigned long flags;
+	enum hal_buffer buffer_type;
+	u32 device_addr;
+	struct dma_mapping_info mapping_info;
+};
 
 static int msm_dma_get_device_address(struct dma_buf *dbuf, unsigned long align,
 	dma_addr_t *iova, unsigned long *buffer_size,
@@ -194,6 +213,164 @@ void msm_smem_put_dma_buf(void *dma_buf)
 	return;
 }
 
+static void msm_smem_recycle_release(struct msm_smem_recycle_entry *entry)
+{
+	if (msm_dma_put_device_address(entry->flags, &entry->mapping_info,
+			entry->buffer_type))
+		dprintk(VIDC_ERR, "%s: Failed to put device address\n",
+			__func__);
+	msm_smem_put_dma_buf(entry->dma_buf);
+	kfree(entry);
+}
+
+static void msm_smem_recycle_del(struct msm_vidc_inst *inst,
+		struct msm_smem_recycle_entry *entry, struct list_head *release)
+{
+	list_move_tail(&entry->list, release);
+	inst->smem_recycle_count--;
+	inst->smem_recycle_bytes -= entry->size;
+}
+
+/*
+ * msm_smem_recycle_reap - move the entries whose dma_buf the client has
+ *              closed, so that only the pool keeps it alive, to @release.
+ *              Called with the pool lock held.
+ */
+static void msm_smem_recycle_reap(struct msm_vidc_inst *inst,
+		struct list_head *release)
+{
+	struct msm_smem_recycle_entry *entry, *temp;
+
+	list_for_each_entry_safe(entry, temp, &inst->smem_recycle.list, list) {
+		if (file_count(entry->dma_buf->file) <= 1)
+			msm_smem_recycle_del(inst, entry, release);
+	}
+}
+
+static void msm_smem_recycle_release_list(struct list_head *release)
+{
+	struct msm_smem_recycle_entry *entry, *temp;
+
+	list_for_each_entry_safe(entry, temp, release, list) {
+		list_del(&entry->list);
+		msm_smem_recycle_release(entry);
+	}
+}
+
+/*
+ * msm_smem_recycle_get - reuse a mapping left behind by an earlier unmap of
+ *              the same dma_buf on this instance. On success smem owns the
+ *              mapping and the dma_buf reference held by the pool.
+ */
+static bool msm_smem_recycle_get(struct msm_vidc_inst *inst,
+		struct dma_buf *dbuf, struct msm_smem *smem)
+{
+	struct msm_smem_recycle_entry *entry, *found = NULL;
+	LIST_HEAD(release);
+
+	if (!msm_vidc_smem_recycle)
+		return false;
+
+	mutex_lock(&inst->smem_recycle.lock);
+	msm_smem_recycle_reap(inst, &release);
+	list_for_each_entry(entry, &inst->smem_recycle.list, list) {
+		if (entry->dma_buf == dbuf &&
+			entry->buffer_type == smem->buffer_type) {
+			found = entry;
+			break;
+		}
+	}
+	if (found && dbuf->size < smem->size) {
+		/* keep the entry, the regular path reports the mismatch */
+		found = NULL;
+	}
+	if (found) {
+		list_del(&found->list);
+		inst->smem_recycle_count--;
+		inst->smem_recycle_bytes -= found->size;
+	}
+	mutex_unlock(&inst->smem_recycle.lock);
+
+	msm_smem_recycle_release_list(&release);
+
+	if (!found) {
+		inst->debug.cpu_stats.recycle_misses++;
+		return false;
+	}
+
+	smem->dma_buf = found->dma_buf;
+	smem->flags = found->flags;
+	smem->mapping_info = found->mapping_info;
+	smem->device_addr = found->device_addr + smem->offset;
+	inst->debug.cpu_stats.recycle_hits++;
+	kfree(found);
+
+	return true;
+}
+
+/*
+ * msm_smem_recycle_put - park the mapping of a fully unmapped smem on the
+ *              instance instead of tearing it down. The oldest entries are
+ *              released while the pool is over its count or size limit.
+ */
+static bool msm_smem_recycle_put(struct msm_vidc_inst *inst,
+		struct msm_smem *smem)
+{
+	struct msm_smem_recycle_entry *entry;
+	LIST_HEAD(release);
+
+	if (!msm_vidc_smem_recycle || !smem->dma_buf ||
+			!smem->mapping_info.attach)
+		return false;
+
+	entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+	if (!entry)
+		return false;
+
+	entry->dma_buf = smem->dma_buf;
+	entry->size = smem->dma_buf->size;
+	entry->flags = smem->flags;
+	entry->buffer_type = smem->buffer_type;
+	entry->device_addr = smem->device_addr - smem->offset;
+	entry->mapping_info = smem->mapping_info;
+	memset(&smem->mapping_info, 0, sizeof(smem->mapping_info));
+
+	mutex_lock(&inst->smem_recycle.lock);
+	list_add(&entry->list, &inst->smem_recycle.list);
+	inst->smem_recycle_count++;
+	inst->smem_recycle_bytes += entry->size;
+	msm_smem_recycle_reap(inst, &release);
+	while (inst->smem_recycle_count > MSM_SMEM_RECYCLE_MAX ||
+		inst->smem_recycle_bytes > MSM_SMEM_RECYCLE_MAX_BYTES)
+		msm_smem_recycle_del(inst,
+			list_last_entry(&inst->smem_recycle.list,
+				struct msm_smem_recycle_entry, list),
+			&release);
+	mutex_unlock(&inst->smem_recycle.lock);
+
+	msm_smem_recycle_release_list(&release);
+
+	return true;
+}
+
+void msm_smem_recycle_flush(struct msm_vidc_inst *inst)
+{
+	LIST_HEAD(release);
+
+	if (!inst) {
+		dprintk(VIDC_ERR, "%s: Invalid params\n", __func__);
+		return;
+	}
+
+	mutex_lock(&inst->smem_recycle.lock);
+	list_splice_init(&inst->smem_recycle.list, &release);
+	inst->smem_recycle_count = 0;
+	inst->smem_recycle_bytes = 0;
+	mutex_unlock(&inst->smem_recycle.lock);
+
+	msm_smem_recycle_release_list(&release);
+}
+
 int msm_smem_map_dma_buf(struct msm_vidc_inst *inst, struct msm_smem *smem)
 {
 	int rc = 0;
@@ -223,6 +400,13 @@ int msm_smem_map_dma_buf(struct msm_vidc_inst *inst, struct msm_smem *smem)
 		goto exit;
 	}
 
+	if (msm_smem_recycle_get(inst, dbuf, smem)) {
+		/* the recycled entry already holds a dma_buf reference */
+		msm_smem_put_dma_buf(dbuf);
+		smem->refcount++;
+		goto exit;
+	}
+
 	smem->dma_buf = dbuf;
 
 	rc = dma_buf_get_flags(dbuf, &ion_flags);
@@ -281,6 +465,12 @@ int msm_smem_unmap_dma_buf(struct msm_vidc_inst *inst, struct msm_smem *smem)
 	if (smem->refcount)
 		goto exit;
 
+	if (msm_smem_recycle_put(inst, smem)) {
+		smem->device_addr = 0x0;
+		smem->dma_buf = NULL;
+		goto exit;
+	}
+
 	rc = msm_dma_put_device_address(smem->flags, &smem->mapping_info,
 		smem->buffer_type);
 	if (rc) {
@@ -1411,6 +1411,9 @@ static void msm_vidc_stop_streaming(struct vb2_queue *q)
 
 	msm_comm_scale_clocks_and_bus(inst);
 
+	/* client may free its buffers after streamoff, drop cached maps */
+	msm_smem_recycle_flush(inst);
+
 	if (rc)
 		dprintk(VIDC_ERR,
 			"Failed STOP Streaming inst = %pK on cap = %d\n",
@@ -1897,6 +1900,7 @@ void *msm_vidc_open(int core_id, int session_type)
 	INIT_MSM_VIDC_LIST(&inst->eosbufs);
 	INIT_MSM_VIDC_LIST(&inst->etb_data);
 	INIT_MSM_VIDC_LIST(&inst->fbd_data);
+	INIT_MSM_VIDC_LIST(&inst->smem_recycle);
 
 	kref_init(&inst->kref);
 
@@ -2021,6 +2025,7 @@ void *msm_vidc_open(int core_id, int session_type)
 	DEINIT_MSM_VIDC_LIST(&inst->buffer_tags);
 	DEINIT_MSM_VIDC_LIST(&inst->etb_data);
 	DEINIT_MSM_VIDC_LIST(&inst->fbd_data);
+	DEINIT_MSM_VIDC_LIST(&inst->smem_recycle);
 
 	kfree(inst);
 	inst = NULL;
@@ -2070,6 +2075,8 @@ static void msm_vidc_cleanup_instance(struct msm_vidc_inst *inst)
 	}
 	mutex_unlock(&inst->registeredbufs.lock);
 
+	msm_smem_recycle_flush(inst);
+
 	del_timer(&inst->batch_timer);
 
 	cancel_work_sync(&inst->batch_work);
@@ -2156,6 +2163,7 @@ int msm_vidc_destroy(struct msm_vidc_inst *inst)
 	DEINIT_MSM_VIDC_LIST(&inst->input_crs);
 	DEINIT_MSM_VIDC_LIST(&inst->etb_data);
 	DEINIT_MSM_VIDC_LIST(&inst->fbd_data);
+	DEINIT_MSM_VIDC_LIST(&inst->smem_recycle);
 
 	mutex_destroy(&inst->sync_lock);
 	mutex_destroy(&inst->bufq[CAPTURE_PORT].lock);
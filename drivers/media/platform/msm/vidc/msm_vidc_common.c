@@ -25,6 +25,7 @@
 #include "msm_cvp.h"
 
 #define MSM_VIDC_QBUF_BATCH_TIMEOUT 300
+#define MSM_VIDC_MAX_HFI_SUBMIT 8
 #define IS_ALREADY_IN_STATE(__p, __d) (\
 	(__p >= __d)\
 )
@@ -2482,6 +2483,7 @@ static void handle_ebd(enum hal_command_response cmd, void *data)
 	struct vidc_tag_data tag_data = {0};
 	u32 planes[VIDEO_MAX_PLANES] = {0};
 	u32 extra_idx = 0;
+	ktime_t start = ktime_get();
 
 	if (!response) {
 		dprintk(VIDC_ERR, "Invalid response from vidc_hal\n");
@@ -2564,6 +2566,8 @@ static void handle_ebd(enum hal_command_response cmd, void *data)
 	msm_vidc_debugfs_update(inst, MSM_VIDC_DEBUGFS_EVENT_EBD);
 	kref_put_mbuf(mbuf);
 exit:
+	inst->debug.cpu_stats.response_ns +=
+		ktime_to_ns(ktime_sub(ktime_get(), start));
 	put_inst(inst);
 }
 
@@ -2621,6 +2625,7 @@ static void handle_fbd(enum hal_command_response cmd, void *data)
 	u64 time_usec = 0;
 	u32 planes[VIDEO_MAX_PLANES] = {0};
 	u32 extra_idx;
+	ktime_t start = ktime_get();
 
 	if (!response) {
 		dprintk(VIDC_ERR, "Invalid response from vidc_hal\n");
@@ -2744,6 +2749,8 @@ static void handle_fbd(enum hal_command_response cmd, void *data)
 	kref_put_mbuf(mbuf);
 
 exit:
+	inst->debug.cpu_stats.response_ns +=
+		ktime_to_ns(ktime_sub(ktime_get(), start));
 	put_inst(inst);
 }
 
@@ -4333,6 +4340,7 @@ static int msm_comm_qbuf_to_hfi(struct msm_vidc_inst *inst,
 	struct hfi_device *hdev;
 	enum msm_vidc_debugfs_event e;
 	struct vidc_frame_data frame_data = {0};
+	ktime_t start = ktime_get();
 
 	if (!inst || !inst->core || !inst->core->device || !mbuf) {
 		dprintk(VIDC_ERR, "%s: Invalid arguments\n", __func__);
@@ -4362,8 +4370,107 @@ static int msm_comm_qbuf_to_hfi(struct msm_vidc_inst *inst,
 	}
 	mbuf->flags |= MSM_VIDC_FLAG_QUEUED;
 	msm_vidc_debugfs_update(inst, e);
+	inst->debug.cpu_stats.hfi_submits++;
+	inst->debug.cpu_stats.hfi_buffers++;
 
 err_bad_input:
+	inst->debug.cpu_stats.qbuf_ns +=
+		ktime_to_ns(ktime_sub(ktime_get(), start));
+	return rc;
+}
+
+/*
+ * struct msm_vidc_hfi_submit - buffers of one port gathered under
+ * registeredbufs.lock and written to the cmdq with a single interrupt.
+ */
+struct msm_vidc_hfi_submit {
+	u32 type;
+	int count;
+	struct msm_vidc_buffer *mbufs[MSM_VIDC_MAX_HFI_SUBMIT];
+	struct vidc_frame_data frames[MSM_VIDC_MAX_HFI_SUBMIT];
+};
+
+static int msm_comm_hfi_submit_flush(struct msm_vidc_inst *inst,
+		struct msm_vidc_hfi_submit *submit)
+{
+	int rc = 0, i;
+	struct hfi_device *hdev = inst->core->device;
+	enum msm_vidc_debugfs_event e;
+	ktime_t start;
+
+	if (!submit->count)
+		return 0;
+
+	start = ktime_get();
+	if (submit->type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE) {
+		e = MSM_VIDC_DEBUGFS_EVENT_ETB;
+		rc = call_hfi_op(hdev, session_queue_buffers, inst->session,
+				submit->count, submit->frames, 0, NULL);
+	} else {
+		e = MSM_VIDC_DEBUGFS_EVENT_FTB;
+		rc = call_hfi_op(hdev, session_queue_buffers, inst->session,
+				0, NULL, submit->count, submit->frames);
+	}
+	if (rc) {
+		dprintk(VIDC_ERR, "%s: Failed to queue %d buffers: %d\n",
+			__func__, submit->count, rc);
+		goto exit;
+	}
+
+	/* mbufs stay deferred, and so get retried, unless the queue worked */
+	for (i = 0; i < submit->count; i++) {
+		submit->mbufs[i]->flags &= ~MSM_VIDC_FLAG_DEFERRED;
+		submit->mbufs[i]->flags |= MSM_VIDC_FLAG_QUEUED;
+		msm_vidc_debugfs_update(inst, e);
+	}
+	inst->debug.cpu_stats.hfi_submits++;
+	inst->debug.cpu_stats.hfi_buffers += submit->count;
+
+exit:
+	inst->debug.cpu_stats.qbuf_ns +=
+		ktime_to_ns(ktime_sub(ktime_get(), start));
+	submit->count = 0;
+	return rc;
+}
+
+/*
+ * msm_comm_hfi_submit_add - gather mbuf into the pending submission,
+ *              flushing it first if it is full or holds the other port.
+ *              Falls back to queueing one buffer at a time when the hfi
+ *              layer does not support batched submission.
+ */
+static int msm_comm_hfi_submit_add(struct msm_vidc_inst *inst,
+		struct msm_vidc_hfi_submit *submit,
+		struct msm_vidc_buffer *mbuf)
+{
+	int rc = 0;
+	u32 type = mbuf->vvb.vb2_buf.type;
+	struct hfi_device *hdev = inst->core->device;
+
+	if (!hdev->session_queue_buffers)
+		return msm_comm_qbuf_to_hfi(inst, mbuf);
+
+	if (type != V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE &&
+			type != V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
+		dprintk(VIDC_ERR, "%s: invalid qbuf type %d\n",
+			__func__, type);
+		return -EINVAL;
+	}
+
+	if (submit->count &&
+		(submit->type != type ||
+		 submit->count == MSM_VIDC_MAX_HFI_SUBMIT)) {
+		rc = msm_comm_hfi_submit_flush(inst, submit);
+		if (rc)
+			return rc;
+	}
+
+	submit->type = type;
+	memset(&submit->frames[submit->count], 0,
+		sizeof(submit->frames[submit->count]));
+	populate_frame_data(&submit->frames[submit->count], mbuf, inst);
+	submit->mbufs[submit->count++] = mbuf;
+
 	return rc;
 }
 
@@ -4463,8 +4570,9 @@ int msm_comm_qbuf(struct msm_vidc_inst *inst, struct msm_vidc_buffer *mbuf)
 
 int msm_comm_qbufs(struct msm_vidc_inst *inst)
 {
-	int rc = 0;
+	int rc = 0, flush_rc;
 	struct msm_vidc_buffer *mbuf;
+	struct msm_vidc_hfi_submit submit;
 
 	if (!inst) {
 		dprintk(VIDC_ERR, "%s: Invalid arguments\n", __func__);
@@ -4481,19 +4589,24 @@ int msm_comm_qbufs(struct msm_vidc_inst *inst)
 	if (rc)
 		dprintk(VIDC_ERR, "%s: scale clocks failed\n", __func__);
 
+	submit.count = 0;
 	mutex_lock(&inst->registeredbufs.lock);
 	list_for_each_entry(mbuf, &inst->registeredbufs.list, list) {
 		/* Queue only deferred buffers */
 		if (!(mbuf->flags & MSM_VIDC_FLAG_DEFERRED))
 			continue;
 		print_vidc_buffer(VIDC_DBG, "qbufs", inst, mbuf);
-		rc = msm_comm_qbuf_to_hfi(inst, mbuf);
+		rc = msm_comm_hfi_submit_add(inst, &submit, mbuf);
 		if (rc) {
 			dprintk(VIDC_ERR, "%s: Failed qbuf to hfi: %d\n",
 				__func__, rc);
 			break;
 		}
 	}
+	/* still submit what was gathered before a failure */
+	flush_rc = msm_comm_hfi_submit_flush(inst, &submit);
+	if (!rc)
+		rc = flush_rc;
 	mutex_unlock(&inst->registeredbufs.lock);
 
 	return rc;
@@ -4502,9 +4615,11 @@ int msm_comm_qbufs(struct msm_vidc_inst *inst)
 int msm_comm_qbufs_batch(struct msm_vidc_inst *inst,
 		struct msm_vidc_buffer *mbuf)
 {
-	int rc = 0;
+	int rc = 0, flush_rc;
 	struct msm_vidc_buffer *buf;
+	struct msm_vidc_hfi_submit submit;
 
+	submit.count = 0;
 	mutex_lock(&inst->registeredbufs.lock);
 	list_for_each_entry(buf, &inst->registeredbufs.list, list) {
 		/* Don't queue if buffer is not CAPTURE_MPLANE */
@@ -4519,7 +4634,7 @@ int msm_comm_qbufs_batch(struct msm_vidc_inst *inst,
 			goto loop_end;
 
 		print_vidc_buffer(VIDC_DBG, "batch-qbuf", inst, buf);
-		rc = msm_comm_qbuf_to_hfi(inst, buf);
+		rc = msm_comm_hfi_submit_add(inst, &submit, buf);
 		if (rc) {
 			dprintk(VIDC_ERR, "%s: Failed batch qbuf to hfi: %d\n",
 				__func__, rc);
@@ -4530,6 +4645,10 @@ int msm_comm_qbufs_batch(struct msm_vidc_inst *inst,
 		if (buf == mbuf)
 			break;
 	}
+	/* still submit what was gathered before a failure */
+	flush_rc = msm_comm_hfi_submit_flush(inst, &submit);
+	if (!rc)
+		rc = flush_rc;
 	mutex_unlock(&inst->registeredbufs.lock);
 
 	return rc;
@@ -31,6 +31,7 @@ bool msm_vidc_fw_coverage = !true;
 bool msm_vidc_thermal_mitigation_disabled = !true;
 int msm_vidc_clock_voting = !1;
 bool msm_vidc_syscache_disable = !true;
+bool msm_vidc_smem_recycle = true;
 
 #define MAX_DBG_BUF_SIZE 4096
 
@@ -256,7 +257,9 @@ struct dentry *msm_vidc_debugfs_init_drv(void)
 	__debugfs_create(u32, "core_clock_voting",
 			&msm_vidc_clock_voting) &&
 	__debugfs_create(bool, "disable_video_syscache",
-			&msm_vidc_syscache_disable);
+			&msm_vidc_syscache_disable) &&
+	__debugfs_create(bool, "smem_recycle",
+			&msm_vidc_smem_recycle);
 
 #undef __debugfs_create
 
@@ -366,8 +369,9 @@ static ssize_t inst_info_read(struct file *file, char __user *buf,
 	struct core_inst_pair *idata = file->private_data;
 	struct msm_vidc_core *core;
 	struct msm_vidc_inst *inst, *temp = NULL;
+	struct msm_vidc_cpu_stats *stats;
 	char *dbuf, *cur, *end;
-	int i, j;
+	int i, j, frames;
 	ssize_t len = 0;
 
 	if (!idata || !idata->core || !idata->inst) {
@@ -400,6 +404,7 @@ static ssize_t inst_info_read(struct file *file, char __user *buf,
 	}
 	cur = dbuf;
 	end = cur + MAX_DBG_BUF_SIZE;
+	stats = &inst->debug.cpu_stats;
 
 	cur += write_str(cur, end - cur, "==============================\n");
 	cur += write_str(cur, end - cur, "INSTANCE: %pK (%s)\n", inst,
@@ -460,6 +465,16 @@ static ssize_t inst_info_read(struct file *file, char __user *buf,
 	cur += write_str(cur, end - cur, "EBD Count: %d\n", inst->count.ebd);
 	cur += write_str(cur, end - cur, "FTB Count: %d\n", inst->count.ftb);
 	cur += write_str(cur, end - cur, "FBD Count: %d\n", inst->count.fbd);
+	cur += write_str(cur, end - cur, "-------------------------------\n");
+	frames = max(inst->count.ebd, inst->count.fbd);
+	cur += write_str(cur, end - cur, "HFI submits: %u (%u buffers)\n",
+		stats->hfi_submits, stats->hfi_buffers);
+	cur += write_str(cur, end - cur, "Map recycle hits: %u misses: %u\n",
+		stats->recycle_hits, stats->recycle_misses);
+	cur += write_str(cur, end - cur, "CPU ns/frame qbuf: %llu\n",
+		frames ? div_u64(stats->qbuf_ns, frames) : 0);
+	cur += write_str(cur, end - cur, "CPU ns/frame response: %llu\n",
+		frames ? div_u64(stats->response_ns, frames) : 0);
 
 	publish_unreleased_reference(inst, &cur, end);
 	len = simple_read_from_buffer(buf, count, ppos,
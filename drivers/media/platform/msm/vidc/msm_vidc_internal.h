@@ -392,10 +392,20 @@ struct profile_data {
 	int average;
 };
 
+struct msm_vidc_cpu_stats {
+	u64 qbuf_ns;
+	u64 response_ns;
+	u32 hfi_submits;
+	u32 hfi_buffers;
+	u32 recycle_hits;
+	u32 recycle_misses;
+};
+
 struct msm_vidc_debug {
 	struct profile_data pdata[MAX_PROFILING_POINTS];
 	int profile;
 	int samples;
+	struct msm_vidc_cpu_stats cpu_stats;
 };
 
 enum msm_vidc_modes {
@@ -463,6 +473,9 @@ struct msm_vidc_inst {
 	struct msm_vidc_list cvpbufs;
 	struct msm_vidc_list etb_data;
 	struct msm_vidc_list fbd_data;
+	struct msm_vidc_list smem_recycle;
+	u32 smem_recycle_count;
+	size_t smem_recycle_bytes;
 	struct buffer_requirements buff_req;
 	struct v4l2_ctrl_handler ctrl_handler;
 	struct completion completions[SESSION_MSG_END - SESSION_MSG_START + 1];
@@ -564,6 +577,7 @@ struct context_bank_info *msm_smem_get_context_bank(u32 session_type,
 	enum hal_buffer buffer_type);
 int msm_smem_map_dma_buf(struct msm_vidc_inst *inst, struct msm_smem *smem);
 int msm_smem_unmap_dma_buf(struct msm_vidc_inst *inst, struct msm_smem *smem);
+void msm_smem_recycle_flush(struct msm_vidc_inst *inst);
 struct dma_buf *msm_smem_get_dma_buf(int fd);
 void msm_smem_put_dma_buf(void *dma_buf);
 int msm_smem_cache_operations(struct dma_buf *dbuf,
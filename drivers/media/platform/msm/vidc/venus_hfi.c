@@ -2911,7 +2911,8 @@ static int venus_hfi_session_stop(void *session)
 }
 
 static int __session_etb(struct hal_session *session,
-		struct vidc_frame_data *input_frame, bool relaxed)
+		struct vidc_frame_data *input_frame, bool relaxed,
+		bool *requires_interrupt)
 {
 	int rc = 0;
 	struct venus_hfi_device *device = session->device;
@@ -2934,7 +2935,7 @@ static int __session_etb(struct hal_session *session,
 			rc = __iface_cmdq_write(session->device, &pkt);
 		else
 			rc = __iface_cmdq_write_relaxed(session->device,
-					&pkt, NULL);
+					&pkt, requires_interrupt);
 		if (rc)
 			goto err_create_pkt;
 	} else {
@@ -2953,7 +2954,7 @@ static int __session_etb(struct hal_session *session,
 			rc = __iface_cmdq_write(session->device, &pkt);
 		else
 			rc = __iface_cmdq_write_relaxed(session->device,
-					&pkt, NULL);
+					&pkt, requires_interrupt);
 		if (rc)
 			goto err_create_pkt;
 	}
@@ -2976,13 +2977,14 @@ static int venus_hfi_session_etb(void *sess,
 
 	device = session->device;
 	mutex_lock(&device->lock);
-	rc = __session_etb(session, input_frame, false);
+	rc = __session_etb(session, input_frame, false, NULL);
 	mutex_unlock(&device->lock);
 	return rc;
 }
 
 static int __session_ftb(struct hal_session *session,
-		struct vidc_frame_data *output_frame, bool relaxed)
+		struct vidc_frame_data *output_frame, bool relaxed,
+		bool *requires_interrupt)
 {
 	int rc = 0;
 	struct venus_hfi_device *device = session->device;
@@ -3002,7 +3004,7 @@ static int __session_ftb(struct hal_session *session,
 		rc = __iface_cmdq_write(session->device, &pkt);
 	else
 		rc = __iface_cmdq_write_relaxed(session->device,
-				&pkt, NULL);
+				&pkt, requires_interrupt);
 
 err_create_pkt:
 	return rc;
@@ -3022,7 +3024,7 @@ static int venus_hfi_session_ftb(void *sess,
 
 	device = session->device;
 	mutex_lock(&device->lock);
-	rc = __session_ftb(session, output_frame, false);
+	rc = __session_ftb(session, output_frame, false, NULL);
 	mutex_unlock(&device->lock);
 	return rc;
 }
@@ -3051,7 +3053,7 @@ static int venus_hfi_session_process_batch(void *sess,
 	}
 
 	for (c = 0; c < num_ftbs; ++c) {
-		rc = __session_ftb(session, &ftbs[c], true);
+		rc = __session_ftb(session, &ftbs[c], true, NULL);
 		if (rc) {
 			dprintk(VIDC_ERR, "Failed to queue batched ftb: %d\n",
 					rc);
@@ -3060,7 +3062,7 @@ static int venus_hfi_session_process_batch(void *sess,
 	}
 
 	for (c = 0; c < num_etbs; ++c) {
-		rc = __session_etb(session, &etbs[c], true);
+		rc = __session_etb(session, &etbs[c], true, NULL);
 		if (rc) {
 			dprintk(VIDC_ERR, "Failed to queue batched etb: %d\n",
 					rc);
@@ -3082,6 +3084,69 @@ static int venus_hfi_session_process_batch(void *sess,
 	return rc;
 }
 
+/*
+ * Writes all etbs and ftbs into the cmdq under a single device lock and
+ * raises at most one interrupt to firmware once the whole batch is queued.
+ */
+static int venus_hfi_session_queue_buffers(void *sess,
+		int num_etbs, struct vidc_frame_data etbs[],
+		int num_ftbs, struct vidc_frame_data ftbs[])
+{
+	int rc = 0, c = 0;
+	bool needs_interrupt = false, pkt_needs_interrupt;
+	struct hal_session *session = sess;
+	struct venus_hfi_device *device;
+
+	if (!session || !session->device) {
+		dprintk(VIDC_ERR, "%s: Invalid Params\n", __func__);
+		return -EINVAL;
+	}
+
+	device = session->device;
+
+	mutex_lock(&device->lock);
+
+	if (!__is_session_valid(device, session, __func__)) {
+		rc = -EINVAL;
+		goto err_queue_buffers;
+	}
+
+	for (c = 0; c < num_ftbs; ++c) {
+		pkt_needs_interrupt = false;
+		rc = __session_ftb(session, &ftbs[c], true,
+				&pkt_needs_interrupt);
+		if (rc) {
+			dprintk(VIDC_ERR, "Failed to queue ftb %d/%d: %d\n",
+					c, num_ftbs, rc);
+			goto err_queue_buffers;
+		}
+		needs_interrupt |= pkt_needs_interrupt;
+	}
+
+	for (c = 0; c < num_etbs; ++c) {
+		pkt_needs_interrupt = false;
+		rc = __session_etb(session, &etbs[c], true,
+				&pkt_needs_interrupt);
+		if (rc) {
+			dprintk(VIDC_ERR, "Failed to queue etb %d/%d: %d\n",
+					c, num_etbs, rc);
+			goto err_queue_buffers;
+		}
+		needs_interrupt |= pkt_needs_interrupt;
+	}
+
+err_queue_buffers:
+	/*
+	 * Packets written before a failure are already visible to firmware,
+	 * so raise the interrupt for them even on the error path.
+	 */
+	if (needs_interrupt)
+		__write_register(device, VIDC_CPU_IC_SOFTINT,
+				1 << VIDC_CPU_IC_SOFTINT_H2A_SHFT);
+	mutex_unlock(&device->lock);
+	return rc;
+}
+
 static int venus_hfi_session_get_buf_req(void *sess)
 {
 	struct hfi_cmd_session_get_property_packet pkt;
@@ -5303,6 +5368,7 @@ static void venus_init_hfi_callbacks(struct hfi_device *hdev)
 	hdev->session_etb = venus_hfi_session_etb;
 	hdev->session_ftb = venus_hfi_session_ftb;
 	hdev->session_process_batch = venus_hfi_session_process_batch;
+	hdev->session_queue_buffers = venus_hfi_session_queue_buffers;
 	hdev->session_get_buf_req = venus_hfi_session_get_buf_req;
 	hdev->session_flush = venus_hfi_session_flush;
 	hdev->session_set_property = venus_hfi_session_set_property;
@@ -559,6 +559,15 @@ static void gsi_process_chan(struct gsi_xfer_compl_evt *evt,
 	notify->xfer_user_data = ch_ctx->user_data[rp_idx].p;
 	ch_ctx->user_data[rp_idx].valid = false;
 
+	/*
+	 * only hand the completed elements back to lockless producers once
+	 * their user data has been consumed, they may be reused right away
+	 */
+	if (evt->type != GSI_XFER_COMPL_TYPE_GCI)
+		smp_store_release(&ch_ctx->ring.rp_idx,
+			gsi_find_idx_from_addr(&ch_ctx->ring,
+				ch_ctx->ring.rp_local));
+
 	notify->chan_user_data = ch_ctx->props.chan_user_data;
 	notify->evt_id = evt->code;
 	notify->bytes_xfered = evt->len;
@@ -612,6 +621,7 @@ static void gsi_ring_chan_doorbell(struct gsi_chan_ctx *ctx)
 	if (ctx->evtr && ctx->props.dir == GSI_CHAN_DIR_FROM_GSI)
 		gsi_ring_evt_doorbell(ctx->evtr);
 	ctx->ring.wp = ctx->ring.wp_local;
+	ctx->stats.doorbells++;
 
 	val = (ctx->ring.wp_local &
 			GSI_EE_n_GSI_CH_k_DOORBELL_0_WRITE_PTR_LSB_BMSK) <<
@@ -1494,6 +1504,7 @@ static void gsi_init_evt_ring(struct gsi_evt_ring_props *props,
 	ctx->rp = ctx->base;
 	ctx->wp_local = ctx->base;
 	ctx->rp_local = ctx->base;
+	ctx->rp_idx = 0;
 	ctx->len = props->ring_len;
 	ctx->elem_sz = props->re_size;
 	ctx->max_num_elem = ctx->len / ctx->elem_sz - 1;
@@ -2232,6 +2243,7 @@ static void gsi_init_chan_ring(struct gsi_chan_props *props,
 	ctx->rp = ctx->base;
 	ctx->wp_local = ctx->base;
 	ctx->rp_local = ctx->base;
+	ctx->rp_idx = 0;
 	ctx->len = props->ring_len;
 	ctx->elem_sz = props->re_size;
 	ctx->max_num_elem = ctx->len / ctx->elem_sz - 1;
@@ -3678,6 +3690,103 @@ int gsi_queue_xfer(unsigned long chan_hdl, uint16_t num_xfers,
 }
 EXPORT_SYMBOL(gsi_queue_xfer);
 
+static uint16_t gsi_lockless_free_re(struct gsi_chan_ctx *ctx)
+{
+	uint16_t start;
+	uint16_t end;
+	uint16_t used;
+
+	/* pairs with the release in gsi_process_chan */
+	start = smp_load_acquire(&ctx->ring.rp_idx);
+	end = gsi_find_idx_from_addr(&ctx->ring, ctx->ring.wp_local);
+
+	if (end >= start)
+		used = end - start;
+	else
+		used = ctx->ring.max_num_elem + 1 - (start - end);
+
+	return ctx->ring.max_num_elem - used;
+}
+
+int gsi_queue_xfer_lockless(unsigned long chan_hdl, uint16_t num_xfers,
+		struct gsi_xfer_elem *xfer)
+{
+	struct gsi_chan_ctx *ctx;
+	uint64_t wp_rollback;
+	int i;
+
+	if (unlikely(!gsi_ctx || chan_hdl >= gsi_ctx->max_ch || !num_xfers ||
+		!xfer))
+		return -GSI_STATUS_INVALID_PARAMS;
+
+	ctx = &gsi_ctx->chan[chan_hdl];
+
+	if (unlikely(ctx->state == GSI_CHAN_STATE_NOT_ALLOCATED ||
+		ctx->props.prot != GSI_CHAN_PROT_GPI || !ctx->evtr)) {
+		GSIERR("chan_hdl=%lu state=%d prot=%u not supported\n",
+			chan_hdl, ctx->state, ctx->props.prot);
+		return -GSI_STATUS_UNSUPPORTED_OP;
+	}
+
+	if (unlikely(num_xfers > gsi_lockless_free_re(ctx)))
+		return -GSI_STATUS_RING_INSUFFICIENT_SPACE;
+
+	wp_rollback = ctx->ring.wp_local;
+	for (i = 0; i < num_xfers; i++) {
+		if (__gsi_populate_tre(ctx, &xfer[i]))
+			break;
+		gsi_incr_ring_wp(&ctx->ring);
+	}
+
+	if (unlikely(i != num_xfers)) {
+		/* reject all the xfers */
+		ctx->ring.wp_local = wp_rollback;
+		return -GSI_STATUS_INVALID_PARAMS;
+	}
+
+	ctx->stats.queued += num_xfers;
+
+	return GSI_STATUS_SUCCESS;
+}
+EXPORT_SYMBOL(gsi_queue_xfer_lockless);
+
+int gsi_commit_xfer(unsigned long chan_hdl)
+{
+	struct gsi_chan_ctx *ctx;
+	unsigned long flags;
+
+	if (unlikely(!gsi_ctx || chan_hdl >= gsi_ctx->max_ch))
+		return -GSI_STATUS_INVALID_PARAMS;
+
+	ctx = &gsi_ctx->chan[chan_hdl];
+
+	if (unlikely(ctx->state == GSI_CHAN_STATE_NOT_ALLOCATED ||
+		!ctx->evtr))
+		return -GSI_STATUS_UNSUPPORTED_OP;
+
+	/* nothing queued since the last commit */
+	if (ctx->ring.wp == ctx->ring.wp_local)
+		return GSI_STATUS_SUCCESS;
+
+	/* ensure TRE is set before ringing doorbell */
+	wmb();
+
+	/*
+	 * FROM_GSI channels also ring the event ring doorbell, whose write
+	 * pointer is advanced by the completion path under the ring lock.
+	 */
+	if (ctx->props.dir == GSI_CHAN_DIR_FROM_GSI) {
+		spin_lock_irqsave(&ctx->evtr->ring.slock, flags);
+		gsi_ring_chan_doorbell(ctx);
+		spin_unlock_irqrestore(&ctx->evtr->ring.slock, flags);
+	} else {
+		gsi_ring_chan_doorbell(ctx);
+	}
+
+	return GSI_STATUS_SUCCESS;
+}
+EXPORT_SYMBOL(gsi_commit_xfer);
+
 int gsi_start_xfer(unsigned long chan_hdl)
 {
 	struct gsi_chan_ctx *ctx;
@@ -97,6 +97,7 @@ struct gsi_ring_ctx {
 	uint64_t rp;
 	uint64_t wp_local;
 	uint64_t rp_local;
+	uint16_t rp_idx; /* rp_local index, published for lockless producers */
 	uint16_t len;
 	uint8_t elem_sz;
 	uint16_t max_num_elem;
@@ -114,6 +115,7 @@ struct gsi_chan_dp_stats {
 struct gsi_chan_stats {
 	unsigned long queued;
 	unsigned long completed;
+	unsigned long doorbells;
 	unsigned long callback_to_poll;
 	unsigned long poll_to_callback;
 	unsigned long poll_pending_irq;
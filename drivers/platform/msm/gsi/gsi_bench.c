@@ -0,0 +1,397 @@
+/* Copyright (c) 2019, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * GSI transfer submission benchmark.
+ *
+ * Allocates a spare GPI TO_GSI channel and its event ring, streams NOP
+ * TREs through it and reaps the completions in polling mode, timing the
+ * submission path. Meant to be run on the emulation platform, where a
+ * channel that is not used by IPA can be handed over to the benchmark:
+ *
+ *   echo "<ch_id> <batch> <iterations> <lockless>" > /d/gsi_bench/run
+ *   cat /d/gsi_bench/result
+ */
+
+#include <linux/debugfs.h>
+#include <linux/dma-mapping.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/msm_gsi.h>
+#include "gsi.h"
+
+#define GSI_BENCH_RING_ELEM	256
+#define GSI_BENCH_RING_LEN	(GSI_BENCH_RING_ELEM * GSI_CHAN_RE_SIZE_16B)
+#define GSI_BENCH_MAX_BATCH	64
+#define GSI_BENCH_POLL_TIMEOUT_US	1000000
+
+#define TERR(fmt, args...) \
+		pr_err("%s:%d " fmt, __func__, __LINE__, ## args)
+
+struct gsi_bench_result {
+	u8 ch_id;
+	bool lockless;
+	u32 batch;
+	u64 descs;
+	u64 doorbells;
+	u64 total_ns;
+	u64 submit_ns;
+	int status;
+};
+
+struct gsi_bench_ctx {
+	unsigned long evt_hdl;
+	unsigned long ch_hdl;
+	void *evt_va;
+	dma_addr_t evt_pa;
+	void *ch_va;
+	dma_addr_t ch_pa;
+	void *buf_va;
+	dma_addr_t buf_pa;
+	struct gsi_xfer_elem xfer[GSI_BENCH_MAX_BATCH];
+	struct gsi_chan_xfer_notify notify[GSI_BENCH_MAX_BATCH];
+};
+
+static struct dentry *dent;
+static DEFINE_MUTEX(gsi_bench_lock);
+static struct gsi_bench_result gsi_bench_last;
+
+static void gsi_bench_evt_err_cb(struct gsi_evt_err_notify *notify)
+{
+	TERR("evt err %u\n", notify->evt_id);
+}
+
+static void gsi_bench_chan_err_cb(struct gsi_chan_err_notify *notify)
+{
+	TERR("chan err %u\n", notify->evt_id);
+}
+
+static void gsi_bench_xfer_cb(struct gsi_chan_xfer_notify *notify)
+{
+	/* channel is kept in polling mode while the benchmark runs */
+}
+
+static int gsi_bench_setup(struct gsi_bench_ctx *b, u8 ch_id)
+{
+	struct gsi_evt_ring_props evt_props;
+	struct gsi_chan_props ch_props;
+	unsigned long dev_hdl = (uintptr_t)gsi_ctx;
+	int res;
+
+	b->evt_va = dma_alloc_coherent(gsi_ctx->dev, GSI_BENCH_RING_LEN,
+			&b->evt_pa, GFP_KERNEL);
+	b->ch_va = dma_alloc_coherent(gsi_ctx->dev, GSI_BENCH_RING_LEN,
+			&b->ch_pa, GFP_KERNEL);
+	b->buf_va = dma_alloc_coherent(gsi_ctx->dev, PAGE_SIZE,
+			&b->buf_pa, GFP_KERNEL);
+	if (!b->evt_va || !b->ch_va || !b->buf_va) {
+		res = -ENOMEM;
+		goto fail_free;
+	}
+
+	memset(&evt_props, 0, sizeof(evt_props));
+	evt_props.intf = GSI_EVT_CHTYPE_GPI_EV;
+	evt_props.intr = GSI_INTR_IRQ;
+	evt_props.re_size = GSI_EVT_RING_RE_SIZE_16B;
+	evt_props.ring_len = GSI_BENCH_RING_LEN;
+	evt_props.ring_base_addr = b->evt_pa;
+	evt_props.ring_base_vaddr = b->evt_va;
+	evt_props.exclusive = true;
+	evt_props.err_cb = gsi_bench_evt_err_cb;
+
+	res = gsi_alloc_evt_ring(&evt_props, dev_hdl, &b->evt_hdl);
+	if (res != GSI_STATUS_SUCCESS) {
+		TERR("evt ring alloc failed %d\n", res);
+		goto fail_free;
+	}
+
+	memset(&ch_props, 0, sizeof(ch_props));
+	ch_props.prot = GSI_CHAN_PROT_GPI;
+	ch_props.dir = GSI_CHAN_DIR_TO_GSI;
+	ch_props.ch_id = ch_id;
+	ch_props.evt_ring_hdl = b->evt_hdl;
+	ch_props.re_size = GSI_CHAN_RE_SIZE_16B;
+	ch_props.ring_len = GSI_BENCH_RING_LEN;
+	ch_props.ring_base_addr = b->ch_pa;
+	ch_props.ring_base_vaddr = b->ch_va;
+	ch_props.use_db_eng = GSI_CHAN_DB_MODE;
+	ch_props.max_prefetch = GSI_ONE_PREFETCH_SEG;
+	ch_props.prefetch_mode = GSI_USE_PREFETCH_BUFS;
+	ch_props.xfer_cb = gsi_bench_xfer_cb;
+	ch_props.err_cb = gsi_bench_chan_err_cb;
+
+	res = gsi_alloc_channel(&ch_props, dev_hdl, &b->ch_hdl);
+	if (res != GSI_STATUS_SUCCESS) {
+		TERR("chan %u alloc failed %d\n", ch_id, res);
+		goto fail_evt;
+	}
+
+	res = gsi_start_channel(b->ch_hdl);
+	if (res != GSI_STATUS_SUCCESS) {
+		TERR("chan %u start failed %d\n", ch_id, res);
+		goto fail_chan;
+	}
+
+	res = gsi_config_channel_mode(b->ch_hdl, GSI_CHAN_MODE_POLL);
+	if (res != GSI_STATUS_SUCCESS) {
+		TERR("chan %u poll mode failed %d\n", ch_id, res);
+		goto fail_stop;
+	}
+
+	return 0;
+
+fail_stop:
+	gsi_stop_channel(b->ch_hdl);
+	gsi_reset_channel(b->ch_hdl);
+fail_chan:
+	gsi_dealloc_channel(b->ch_hdl);
+fail_evt:
+	gsi_dealloc_evt_ring(b->evt_hdl);
+fail_free:
+	if (b->buf_va)
+		dma_free_coherent(gsi_ctx->dev, PAGE_SIZE, b->buf_va,
+			b->buf_pa);
+	if (b->ch_va)
+		dma_free_coherent(gsi_ctx->dev, GSI_BENCH_RING_LEN, b->ch_va,
+			b->ch_pa);
+	if (b->evt_va)
+		dma_free_coherent(gsi_ctx->dev, GSI_BENCH_RING_LEN,
+			b->evt_va, b->evt_pa);
+	return res;
+}
+
+static void gsi_bench_teardown(struct gsi_bench_ctx *b)
+{
+	int res;
+	int retry = 10;
+
+	do {
+		res = gsi_stop_channel(b->ch_hdl);
+	} while (res == -GSI_STATUS_AGAIN && retry--);
+
+	gsi_reset_channel(b->ch_hdl);
+	gsi_dealloc_channel(b->ch_hdl);
+	gsi_reset_evt_ring(b->evt_hdl);
+	gsi_dealloc_evt_ring(b->evt_hdl);
+
+	dma_free_coherent(gsi_ctx->dev, PAGE_SIZE, b->buf_va, b->buf_pa);
+	dma_free_coherent(gsi_ctx->dev, GSI_BENCH_RING_LEN, b->ch_va,
+		b->ch_pa);
+	dma_free_coherent(gsi_ctx->dev, GSI_BENCH_RING_LEN, b->evt_va,
+		b->evt_pa);
+}
+
+/* reap whatever completed, each completion covers one submitted batch */
+static u64 gsi_bench_reap(struct gsi_bench_ctx *b)
+{
+	int actual;
+	u64 reaped = 0;
+
+	while (gsi_poll_n_channel(b->ch_hdl, b->notify, GSI_BENCH_MAX_BATCH,
+			&actual) == GSI_STATUS_SUCCESS)
+		reaped += actual;
+
+	return reaped;
+}
+
+static int gsi_bench_run(struct gsi_bench_ctx *b, u32 batch, u64 iterations,
+		bool lockless, struct gsi_bench_result *r)
+{
+	u64 submitted = 0, inflight = 0, descs = 0, reaped;
+	u16 ring_elem = gsi_ctx->chan[b->ch_hdl].ring.max_num_elem;
+	ktime_t start, t, now, deadline;
+	int i, res;
+
+	for (i = 0; i < batch; i++) {
+		b->xfer[i].addr = b->buf_pa;
+		b->xfer[i].len = 0;
+		b->xfer[i].type = GSI_XFER_ELEM_NOP;
+		b->xfer[i].flags = (i == batch - 1) ? GSI_XFER_FLAG_EOT : 0;
+		b->xfer[i].xfer_user_data = b;
+	}
+
+	r->doorbells = gsi_ctx->chan[b->ch_hdl].stats.doorbells;
+	start = ktime_get();
+	deadline = ktime_add_us(start, GSI_BENCH_POLL_TIMEOUT_US);
+	while (submitted < iterations) {
+		cond_resched();
+
+		/*
+		 * Only submit when the batch fits, gsi_queue_xfer() logs an
+		 * error for every attempt on a full ring.
+		 */
+		if ((inflight + 1) * batch > ring_elem) {
+			reaped = gsi_bench_reap(b);
+			if (reaped) {
+				inflight -= reaped;
+				deadline = ktime_add_us(ktime_get(),
+					GSI_BENCH_POLL_TIMEOUT_US);
+			} else if (ktime_after(ktime_get(), deadline)) {
+				TERR("ring full, %llu batches did not complete\n",
+					inflight);
+				return -ETIMEDOUT;
+			}
+			continue;
+		}
+
+		t = ktime_get();
+		if (lockless) {
+			res = gsi_queue_xfer_lockless(b->ch_hdl, batch,
+				b->xfer);
+			if (res == GSI_STATUS_SUCCESS)
+				res = gsi_commit_xfer(b->ch_hdl);
+		} else {
+			res = gsi_queue_xfer(b->ch_hdl, batch, b->xfer, true);
+		}
+
+		if (res != GSI_STATUS_SUCCESS) {
+			TERR("queue failed %d\n", res);
+			return res;
+		}
+		now = ktime_get();
+		r->submit_ns += ktime_to_ns(ktime_sub(now, t));
+		deadline = ktime_add_us(now, GSI_BENCH_POLL_TIMEOUT_US);
+		submitted++;
+		inflight++;
+		descs += batch;
+
+		inflight -= gsi_bench_reap(b);
+	}
+
+	t = ktime_add_us(ktime_get(), GSI_BENCH_POLL_TIMEOUT_US);
+	while (inflight) {
+		inflight -= gsi_bench_reap(b);
+		if (ktime_after(ktime_get(), t)) {
+			TERR("%llu batches did not complete\n", inflight);
+			return -ETIMEDOUT;
+		}
+		cpu_relax();
+	}
+
+	r->total_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	r->descs = descs;
+	r->doorbells = gsi_ctx->chan[b->ch_hdl].stats.doorbells -
+		r->doorbells;
+
+	return 0;
+}
+
+static ssize_t gsi_bench_run_write(struct file *file,
+		const char __user *ubuf, size_t count, loff_t *ppos)
+{
+	struct gsi_bench_result r;
+	struct gsi_bench_ctx *b;
+	char buf[64];
+	u32 ch_id, batch, lockless;
+	u64 iterations;
+	int res;
+
+	if (!gsi_ctx)
+		return -ENODEV;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	if (sscanf(buf, "%u %u %llu %u", &ch_id, &batch, &iterations,
+			&lockless) != 4)
+		return -EINVAL;
+	if (ch_id >= gsi_ctx->max_ch || !batch ||
+		batch > GSI_BENCH_MAX_BATCH || !iterations)
+		return -EINVAL;
+
+	b = kzalloc(sizeof(*b), GFP_KERNEL);
+	if (!b)
+		return -ENOMEM;
+
+	memset(&r, 0, sizeof(r));
+	r.ch_id = ch_id;
+	r.batch = batch;
+	r.lockless = !!lockless;
+
+	mutex_lock(&gsi_bench_lock);
+	res = gsi_bench_setup(b, ch_id);
+	if (!res) {
+		r.status = gsi_bench_run(b, batch, iterations, r.lockless, &r);
+		gsi_bench_teardown(b);
+	} else {
+		r.status = res;
+	}
+	gsi_bench_last = r;
+	mutex_unlock(&gsi_bench_lock);
+
+	kfree(b);
+
+	return count;
+}
+
+static ssize_t gsi_bench_result_read(struct file *file, char __user *ubuf,
+		size_t count, loff_t *ppos)
+{
+	struct gsi_bench_result r;
+	char buf[256];
+	int nbytes;
+
+	mutex_lock(&gsi_bench_lock);
+	r = gsi_bench_last;
+	mutex_unlock(&gsi_bench_lock);
+
+	nbytes = scnprintf(buf, sizeof(buf),
+		"ch=%u mode=%s batch=%u status=%d\n"
+		"descs=%llu doorbells=%llu total_ns=%llu\n"
+		"descs_per_sec=%llu submit_ns_per_desc=%llu\n",
+		r.ch_id, r.lockless ? "lockless" : "locked", r.batch,
+		r.status, r.descs, r.doorbells, r.total_ns,
+		r.total_ns ? div64_u64(r.descs * NSEC_PER_SEC, r.total_ns) : 0,
+		r.descs ? div64_u64(r.submit_ns, r.descs) : 0);
+
+	return simple_read_from_buffer(ubuf, count, ppos, buf, nbytes);
+}
+
+static const struct file_operations gsi_bench_run_ops = {
+	.write = gsi_bench_run_write,
+};
+
+static const struct file_operations gsi_bench_result_ops = {
+	.read = gsi_bench_result_read,
+};
+
+static int __init gsi_bench_init(void)
+{
+	struct dentry *dfile;
+
+	dent = debugfs_create_dir("gsi_bench", NULL);
+	if (IS_ERR_OR_NULL(dent)) {
+		TERR("fail to create dir\n");
+		return -ENOMEM;
+	}
+
+	dfile = debugfs_create_file("run", 0220, dent, NULL,
+			&gsi_bench_run_ops);
+	if (IS_ERR_OR_NULL(dfile))
+		goto fail;
+
+	dfile = debugfs_create_file("result", 0444, dent, NULL,
+			&gsi_bench_result_ops);
+	if (IS_ERR_OR_NULL(dfile))
+		goto fail;
+
+	return 0;
+fail:
+	TERR("fail to create files\n");
+	debugfs_remove_recursive(dent);
+	return -ENOMEM;
+}
+late_initcall(gsi_bench_init);
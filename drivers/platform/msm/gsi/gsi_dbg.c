@@ -270,9 +270,10 @@ static void gsi_dump_ch_stats(struct gsi_chan_ctx *ctx)
 		return;
 
 	PRT_STAT("CH%2d:\n", ctx->props.ch_id);
-	PRT_STAT("queued=%lu compl=%lu\n",
+	PRT_STAT("queued=%lu compl=%lu db=%lu\n",
 		ctx->stats.queued,
-		ctx->stats.completed);
+		ctx->stats.completed,
+		ctx->stats.doorbells);
 	PRT_STAT("cb->poll=%lu poll->cb=%lu poll_pend_irq=%lu\n",
 		ctx->stats.callback_to_poll,
 		ctx->stats.poll_to_callback,
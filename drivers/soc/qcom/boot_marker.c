@@ -26,6 +26,8 @@
 #include <linux/types.h>
 #include <linux/spinlock.h>
 #include <linux/mm.h>
+#include <linux/device.h>
+#include <linux/seq_file.h>
 #include <asm/arch_timer.h>
 #include <soc/qcom/boot_stats.h>
 
@@ -41,6 +43,7 @@ struct boot_marker {
 };
 
 static struct dentry *dent_bkpi, *dent_bkpi_status, *dent_mpm_timer;
+static struct dentry *dent_probe_path;
 static struct boot_marker boot_marker_list;
 
 static void _destroy_boot_marker(const char *name)
@@ -229,6 +232,142 @@ static const struct file_operations fops_mpm_timer = {
 	.mmap = mpm_timer_mmap,
 };
 
+static struct driver_probe_stat *probe_stats_load(int *nr)
+{
+	struct driver_probe_stat st, *recs;
+	int i, n = 0;
+
+	while (!driver_probe_stat(n, &st))
+		n++;
+
+	recs = kvmalloc_array(n ?: 1, sizeof(*recs), GFP_KERNEL);
+	if (!recs)
+		return NULL;
+
+	for (i = 0; i < n && !driver_probe_stat(i, &recs[i]); i++)
+		;
+	*nr = i;
+	return recs;
+}
+
+/*
+ * Start from the successful probe that finished last and follow each probe
+ * back to the dependency it waited for.  @path is filled tail first.
+ */
+static int probe_critical_path(struct driver_probe_stat *recs, int nr,
+		int *path)
+{
+	int i, tail = -1, len = 0;
+
+	for (i = 0; i < nr; i++)
+		if (!recs[i].ret && recs[i].end_ns &&
+		    (tail < 0 || recs[i].end_ns > recs[tail].end_ns))
+			tail = i;
+
+	for (i = tail; i >= 0 && len < nr; i = recs[i].dep)
+		path[len++] = i;
+	return len;
+}
+
+static u64 probe_path_ms(struct driver_probe_stat *recs, int *path, int len)
+{
+	if (!len)
+		return 0;
+	return div_u64(recs[path[0]].end_ns - recs[path[len - 1]].start_ns,
+			NSEC_PER_MSEC);
+}
+
+static int probe_path_show(struct seq_file *m, void *unused)
+{
+	struct driver_probe_stat *recs, *r;
+	u64 busy = 0, wasted = 0, run, wait;
+	int i, nr = 0, len, async = 0, deferred = 0;
+	int *path;
+
+	recs = probe_stats_load(&nr);
+	if (!recs)
+		return -ENOMEM;
+	path = kvmalloc_array(nr ?: 1, sizeof(*path), GFP_KERNEL);
+	if (!path) {
+		kvfree(recs);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < nr; i++) {
+		r = &recs[i];
+		run = r->end_ns ? r->end_ns - r->start_ns : 0;
+		busy += run;
+		async += r->async;
+		if (r->ret == -EPROBE_DEFER) {
+			deferred++;
+			wasted += run;
+		}
+	}
+	len = probe_critical_path(recs, nr, path);
+
+	seq_printf(m, "probes: %d async: %d deferred: %d\n",
+			nr, async, deferred);
+	seq_printf(m, "probe time: %llu ms deferred: %llu ms\n",
+			div_u64(busy, NSEC_PER_MSEC),
+			div_u64(wasted, NSEC_PER_MSEC));
+	seq_printf(m, "critical path: %llu ms, %d probes\n\n",
+			probe_path_ms(recs, path, len), len);
+
+	seq_printf(m, "%-32s %-24s %9s %8s %8s %6s %5s\n", "device", "driver",
+			"start_ms", "run_us", "wait_us", "defers", "async");
+	for (i = len - 1; i >= 0; i--) {
+		r = &recs[path[i]];
+		wait = r->dep >= 0 ? r->start_ns - recs[r->dep].end_ns : 0;
+		seq_printf(m, "%-32s %-24s %9llu %8llu %8llu %6u %5d\n",
+				r->dev_name, r->drv_name,
+				div_u64(r->start_ns, NSEC_PER_MSEC),
+				div_u64(r->end_ns - r->start_ns, NSEC_PER_USEC),
+				div_u64(wait, NSEC_PER_USEC),
+				r->defers, r->async);
+	}
+
+	kvfree(path);
+	kvfree(recs);
+	return 0;
+}
+
+static int probe_path_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, probe_path_show, NULL);
+}
+
+static const struct file_operations fops_probe_path = {
+	.owner   = THIS_MODULE,
+	.open    = probe_path_open,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
+static int __init probe_path_marker(void)
+{
+	struct driver_probe_stat *recs;
+	char marker[BOOT_MARKER_MAX_LEN];
+	int nr = 0, len;
+	int *path;
+
+	recs = probe_stats_load(&nr);
+	if (!recs)
+		return 0;
+	path = kvmalloc_array(nr ?: 1, sizeof(*path), GFP_KERNEL);
+	if (path) {
+		len = probe_critical_path(recs, nr, path);
+		snprintf(marker, sizeof(marker),
+				"M - DRIVER Probe Path : %llu ms",
+				probe_path_ms(recs, path, len));
+		place_marker(marker);
+		kvfree(path);
+	}
+	kvfree(recs);
+	return 0;
+}
+late_initcall_sync(probe_path_marker);
+
 static int __init init_bootkpi(void)
 {
 	dent_bkpi = debugfs_create_dir("bootkpi", NULL);
@@ -255,6 +394,11 @@ static int __init init_bootkpi(void)
 		return -ENODEV;
 	}
 
+	dent_probe_path = debugfs_create_file("probe_critical_path",
+			0444, dent_bkpi, NULL, &fops_probe_path);
+	if (IS_ERR_OR_NULL(dent_probe_path))
+		pr_warn("boot_marker: Could not create 'probe_critical_path' debugfs file\n");
+
 	INIT_LIST_HEAD(&boot_marker_list.list);
 	spin_lock_init(&boot_marker_list.slock);
 	set_bootloader_stats();
@@ -915,6 +915,76 @@ dfc_send_ack(struct net_device *dev, u8 bearer_id, u16 seq, u8 mux_id, u8 type)
 	rmnet_map_tx_qmap_cmd(skb);
 }
 
+/* Record a TX queue state change, deferring it while a batch is open */
+static void dfc_flow_control(struct net_device *dev, struct qos_info *qos,
+			     u32 mq_idx, int enable)
+{
+	if (qos->fc_batch && mq_idx < BITS_PER_TYPE(qos->fc_on)) {
+		if (enable) {
+			qos->fc_on |= BIT(mq_idx);
+			qos->fc_off &= ~BIT(mq_idx);
+		} else {
+			qos->fc_off |= BIT(mq_idx);
+			qos->fc_on &= ~BIT(mq_idx);
+		}
+		return;
+	}
+
+	qmi_rmnet_flow_control(dev, mq_idx, enable);
+}
+
+static void dfc_flow_control_begin(struct qos_info *qos)
+{
+	qos->fc_batch = true;
+	qos->fc_on = 0;
+	qos->fc_off = 0;
+}
+
+/* Apply the final state of each TX queue touched since the batch began */
+static void dfc_flow_control_end(struct net_device *dev, struct qos_info *qos)
+{
+	unsigned long on = qos->fc_on;
+	unsigned long off = qos->fc_off;
+	int i;
+
+	qos->fc_batch = false;
+	qos->fc_on = 0;
+	qos->fc_off = 0;
+
+	for_each_set_bit(i, &off, BITS_PER_TYPE(qos->fc_off))
+		qmi_rmnet_flow_control(dev, i, 0);
+
+	for_each_set_bit(i, &on, BITS_PER_TYPE(qos->fc_on))
+		qmi_rmnet_flow_control(dev, i, 1);
+}
+
+static void dfc_bearer_update_stats(struct qos_info *qos,
+				    struct rmnet_bearer_map *bearer,
+				    bool enable)
+{
+	struct rmnet_bearer_stats *stats = &bearer->stats;
+	u64 stall;
+
+	if (!enable) {
+		if (!stats->disable_ts) {
+			stats->disable_ts = ktime_get();
+			stats->disables++;
+		}
+		return;
+	}
+
+	if (!stats->disable_ts)
+		return;
+
+	stall = ktime_to_ns(ktime_sub(ktime_get(), stats->disable_ts));
+	stats->disable_ts = 0;
+	stats->stall_ns += stall;
+	if (stall > stats->max_stall_ns)
+		stats->max_stall_ns = stall;
+
+	trace_dfc_grant_latency(qos->mux_id, bearer->bearer_id, stall);
+}
+
 int dfc_bearer_flow_ctl(struct net_device *dev,
 			struct rmnet_bearer_map *bearer,
 			struct qos_info *qos)
@@ -923,12 +993,14 @@ int dfc_bearer_flow_ctl(struct net_device *dev,
 
 	enable = bearer->grant_size ? true : false;
 
-	qmi_rmnet_flow_control(dev, bearer->mq_idx, enable);
+	dfc_bearer_update_stats(qos, bearer, enable);
+
+	dfc_flow_control(dev, qos, bearer->mq_idx, enable);
 
 	/* Do not flow disable tcp ack q in tcp bidir */
 	if (bearer->ack_mq_idx != INVALID_MQ &&
 	    (enable || !bearer->tcp_bidir))
-		qmi_rmnet_flow_control(dev, bearer->ack_mq_idx, enable);
+		dfc_flow_control(dev, qos, bearer->ack_mq_idx, enable);
 
 	if (!enable && bearer->ack_req)
 		dfc_send_ack(dev, bearer->bearer_id,
@@ -954,6 +1026,7 @@ static int dfc_all_bearer_flow_ctl(struct net_device *dev,
 		bearer->last_grant = fc_info->num_bytes;
 		bearer->last_seq = fc_info->seq_num;
 		bearer->last_adjusted_grant = fc_info->num_bytes;
+		bearer->stats.grants++;
 
 		dfc_bearer_flow_ctl(dev, bearer, qos);
 	}
@@ -1049,6 +1122,7 @@ static int dfc_update_fc_map(struct net_device *dev, struct qos_info *qos,
 		itm->last_grant = fc_info->num_bytes;
 		itm->last_seq = fc_info->seq_num;
 		itm->last_adjusted_grant = adjusted_grant;
+		itm->stats.grants++;
 
 		if (action)
 			rc = dfc_bearer_flow_ctl(dev, itm, qos);
@@ -1057,12 +1131,17 @@ static int dfc_update_fc_map(struct net_device *dev, struct qos_info *qos,
 	return rc;
 }
 
+/*
+ * Grants for all bearers of a device in an indication are applied under a
+ * single hold of the qos lock, and each TX queue is woken or stopped once
+ * when the device is done.
+ */
 void dfc_do_burst_flow_control(struct dfc_qmi_data *dfc,
 			       struct dfc_flow_status_ind_msg_v01 *ind,
 			       bool is_query)
 {
-	struct net_device *dev;
-	struct qos_info *qos;
+	struct net_device *dev, *batch_dev = NULL;
+	struct qos_info *qos = NULL;
 	struct dfc_flow_status_info_type_v01 *flow_status;
 	struct dfc_ancillary_info_type_v01 *ai;
 	u8 ack_req = ind->eod_ack_reqd_valid ? ind->eod_ack_reqd : 0;
@@ -1099,17 +1178,25 @@ void dfc_do_burst_flow_control(struct dfc_qmi_data *dfc,
 		if (!dev)
 			goto clean_out;
 
-		qos = (struct qos_info *)rmnet_get_qos_pt(dev);
-		if (!qos)
-			continue;
+		if (dev != batch_dev) {
+			if (batch_dev) {
+				dfc_flow_control_end(batch_dev, qos);
+				spin_unlock_bh(&qos->qos_lock);
+				batch_dev = NULL;
+			}
 
-		spin_lock_bh(&qos->qos_lock);
+			qos = (struct qos_info *)rmnet_get_qos_pt(dev);
+			if (!qos)
+				continue;
 
-		if (qmi_rmnet_ignore_grant(dfc->rmnet_port)) {
-			spin_unlock_bh(&qos->qos_lock);
-			continue;
+			spin_lock_bh(&qos->qos_lock);
+			dfc_flow_control_begin(qos);
+			batch_dev = dev;
 		}
 
+		if (qmi_rmnet_ignore_grant(dfc->rmnet_port))
+			continue;
+
 		if (unlikely(flow_status->bearer_id == 0xFF))
 			dfc_all_bearer_flow_ctl(
 				dev, qos, ack_req, ancillary, flow_status);
@@ -1117,11 +1204,13 @@ void dfc_do_burst_flow_control(struct dfc_qmi_data *dfc,
 			dfc_update_fc_map(
 				dev, qos, ack_req, ancillary, flow_status,
 				is_query);
-
-		spin_unlock_bh(&qos->qos_lock);
 	}
 
 clean_out:
+	if (batch_dev) {
+		dfc_flow_control_end(batch_dev, qos);
+		spin_unlock_bh(&qos->qos_lock);
+	}
 	rcu_read_unlock();
 }
 
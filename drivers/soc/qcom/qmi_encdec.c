@@ -18,9 +18,14 @@
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <linux/errno.h>
+#include <linux/hashtable.h>
 #include <linux/io.h>
+#include <linux/ktime.h>
+#include <linux/rculist.h>
+#include <linux/spinlock.h>
 #include <linux/string.h>
 #include <linux/soc/qcom/qmi.h>
+#include <asm/sections.h>
 
 #define QMI_ENCDEC_ENCODE_TLV(type, length, p_dst) do { \
 	*p_dst++ = type; \
@@ -707,6 +712,561 @@ static int qmi_decode(struct qmi_elem_info *ei_array, void *out_c_struct,
 	return decoded_bytes;
 }
 
+/*
+ * Codec cache
+ *
+ * Interpreting a qmi_elem_info array means a linear find_ei() scan per
+ * decoded TLV, a skip_to_next_elem() walk per absent optional TLV and a
+ * memcpy per array element. Each array is therefore compiled once, on
+ * first use, into a qmi_codec: a flat op list with the TLV lookup table,
+ * optional TLV skip targets, nested codecs and whole array copy sizes
+ * precomputed. The encode and decode loops below follow qmi_encode() and
+ * qmi_decode() step by step so the wire format and the decoded structs
+ * are identical.
+ *
+ * Codecs are keyed by the address of the qmi_elem_info array. Only
+ * arrays in kernel or module data are cached, and codecs of a module are
+ * dropped when it goes away.
+ */
+#define QMI_CODEC_HASH_BITS	6
+#define QMI_CODEC_MAX_OPS	1024
+#define QMI_CODEC_MAX_DEPTH	8
+#define QMI_CODEC_NO_TLV	U16_MAX
+
+/**
+ * struct qmi_codec_op - one precompiled element
+ * @ei:		element this op was compiled from, for the string helpers
+ * @nested:	codec of the nested structure for QMI_STRUCT
+ * @offset:	offset of the element in the C structure
+ * @elem_len:	maximum number of instances of the element
+ * @elem_size:	size of a single instance of the element
+ * @copy_size:	bytes copied for a NO_ARRAY or STATIC_ARRAY basic element
+ * @skip:	index of the op following this optional TLV at level 1
+ * @data_type:	enum qmi_elem_type of the element
+ * @is_array:	enum qmi_array_type of the element
+ * @tlv_type:	TLV type of the element
+ */
+struct qmi_codec_op {
+	struct qmi_elem_info *ei;
+	struct qmi_codec *nested;
+	u32 offset;
+	u32 elem_len;
+	u32 elem_size;
+	u32 copy_size;
+	u16 skip;
+	u8 data_type;
+	u8 is_array;
+	u8 tlv_type;
+};
+
+/**
+ * struct qmi_codec - precompiled qmi_elem_info array
+ * @node:	entry in the codec hash table
+ * @rcu:	deferred free once the owning module goes away
+ * @ei:		array this codec was compiled from
+ * @owner:	module holding @ei, NULL for the core kernel
+ * @tlv_index:	first op for each TLV type, QMI_CODEC_NO_TLV if none
+ * @nr_ops:	number of ops, not counting the QMI_EOTI terminator
+ * @ops:	the ops, terminated by a QMI_EOTI op
+ */
+struct qmi_codec {
+	struct hlist_node node;
+	struct rcu_head rcu;
+	struct qmi_elem_info *ei;
+	struct module *owner;
+	u16 tlv_index[256];
+	u16 nr_ops;
+	struct qmi_codec_op ops[];
+};
+
+static DEFINE_HASHTABLE(qmi_codecs, QMI_CODEC_HASH_BITS);
+static DEFINE_SPINLOCK(qmi_codec_lock);
+
+static bool codec_cache = true;
+module_param(codec_cache, bool, 0644);
+MODULE_PARM_DESC(codec_cache, "Use precompiled codecs for QMI encode/decode");
+
+static struct qmi_codec *qmi_codec_lookup(struct qmi_elem_info *ei)
+{
+	struct qmi_codec *codec;
+
+	rcu_read_lock();
+	hash_for_each_possible_rcu(qmi_codecs, codec, node, (unsigned long)ei) {
+		if (codec->ei == ei) {
+			rcu_read_unlock();
+			return codec;
+		}
+	}
+	rcu_read_unlock();
+
+	return NULL;
+}
+
+/* Only arrays with a static lifetime can be keyed by address */
+static bool qmi_codec_cacheable(struct qmi_elem_info *ei,
+				struct module **owner)
+{
+	unsigned long addr = (unsigned long)ei;
+
+	preempt_disable();
+	*owner = __module_address(addr);
+	preempt_enable();
+	if (*owner)
+		return true;
+
+	return core_kernel_data(addr) ||
+	       (addr >= (unsigned long)__start_rodata &&
+		addr < (unsigned long)__end_rodata);
+}
+
+static struct qmi_codec *qmi_codec_get(struct qmi_elem_info *ei, int depth);
+
+static struct qmi_codec *qmi_codec_compile(struct qmi_elem_info *ei,
+					   int depth)
+{
+	struct qmi_codec *codec, *old;
+	struct qmi_codec_op *op;
+	struct module *owner;
+	unsigned long flags;
+	u16 i, j, n = 0;
+	u8 tlv_type;
+
+	if (depth > QMI_CODEC_MAX_DEPTH || !qmi_codec_cacheable(ei, &owner))
+		return NULL;
+
+	while (ei[n].data_type != QMI_EOTI) {
+		if (++n >= QMI_CODEC_MAX_OPS)
+			return NULL;
+	}
+
+	codec = kzalloc(sizeof(*codec) + (n + 1) * sizeof(*op),
+			GFP_ATOMIC | __GFP_NOWARN);
+	if (!codec)
+		return NULL;
+
+	codec->ei = ei;
+	codec->owner = owner;
+	codec->nr_ops = n;
+	memset(codec->tlv_index, 0xff, sizeof(codec->tlv_index));
+
+	for (i = 0; i <= n; i++) {
+		op = &codec->ops[i];
+		op->ei = &ei[i];
+		op->offset = ei[i].offset;
+		op->elem_len = ei[i].elem_len;
+		op->elem_size = ei[i].elem_size;
+		op->data_type = ei[i].data_type;
+		op->is_array = ei[i].is_array;
+		op->tlv_type = ei[i].tlv_type;
+		if (i == n)
+			break;
+
+		if (op->is_array == STATIC_ARRAY)
+			op->copy_size = op->elem_len * op->elem_size;
+		else
+			op->copy_size = op->elem_size;
+
+		if (op->data_type == QMI_STRUCT) {
+			/* qmi_decode() can't cope with these either */
+			if (!ei[i].ei_array)
+				goto err;
+			op->nested = qmi_codec_get(ei[i].ei_array, depth + 1);
+			if (!op->nested)
+				goto err;
+		}
+
+		/* find_ei() returns the first element of a TLV */
+		if (codec->tlv_index[op->tlv_type] == QMI_CODEC_NO_TLV)
+			codec->tlv_index[op->tlv_type] = i;
+
+		/* same walk as skip_to_next_elem() at level 1 */
+		j = i;
+		do {
+			tlv_type = ei[j].tlv_type;
+			j++;
+		} while (j < n && tlv_type == ei[j].tlv_type);
+		op->skip = j;
+	}
+
+	spin_lock_irqsave(&qmi_codec_lock, flags);
+	old = qmi_codec_lookup(ei);
+	if (old) {
+		spin_unlock_irqrestore(&qmi_codec_lock, flags);
+		kfree(codec);
+		return old;
+	}
+	hash_add_rcu(qmi_codecs, &codec->node, (unsigned long)ei);
+	spin_unlock_irqrestore(&qmi_codec_lock, flags);
+
+	return codec;
+
+err:
+	kfree(codec);
+	return NULL;
+}
+
+/* Returns the codec for @ei, compiling it on first use, or NULL */
+static struct qmi_codec *qmi_codec_get(struct qmi_elem_info *ei, int depth)
+{
+	struct qmi_codec *codec;
+
+	if (!ei)
+		return NULL;
+
+	codec = qmi_codec_lookup(ei);
+	if (codec)
+		return codec;
+
+	return qmi_codec_compile(ei, depth);
+}
+
+static int qmi_codec_module_notify(struct notifier_block *nb,
+				   unsigned long action, void *data)
+{
+	struct module *mod = data;
+	struct qmi_codec *codec;
+	struct hlist_node *tmp;
+	unsigned long flags;
+	int bkt;
+
+	if (action != MODULE_STATE_GOING)
+		return NOTIFY_DONE;
+
+	spin_lock_irqsave(&qmi_codec_lock, flags);
+	hash_for_each_safe(qmi_codecs, bkt, tmp, codec, node) {
+		if (codec->owner != mod)
+			continue;
+		hash_del_rcu(&codec->node);
+		kfree_rcu(codec, rcu);
+	}
+	spin_unlock_irqrestore(&qmi_codec_lock, flags);
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block qmi_codec_module_nb = {
+	.notifier_call = qmi_codec_module_notify,
+};
+
+static int qmi_codec_encode(const struct qmi_codec *codec, void *out_buf,
+			    const void *in_c_struct, u32 out_buf_len,
+			    int enc_level);
+
+static int qmi_codec_decode(const struct qmi_codec *codec,
+			    void *out_c_struct, const void *in_buf,
+			    u32 in_buf_len, int dec_level);
+
+static inline const struct qmi_codec_op *
+qmi_codec_skip(const struct qmi_codec *codec, const struct qmi_codec_op *op,
+	       int level)
+{
+	if (level > 1)
+		return op + 1;
+
+	return &codec->ops[op->skip];
+}
+
+static int qmi_codec_encode_struct(const struct qmi_codec_op *op,
+				   void *buf_dst, const void *buf_src,
+				   u32 elem_len, u32 out_buf_len,
+				   int enc_level)
+{
+	int i, rc, encoded_bytes = 0;
+
+	for (i = 0; i < elem_len; i++) {
+		rc = qmi_codec_encode(op->nested, buf_dst, buf_src,
+				      out_buf_len - encoded_bytes, enc_level);
+		if (rc < 0) {
+			pr_err("%s: STRUCT Encode failure\n", __func__);
+			return rc;
+		}
+		buf_dst = buf_dst + rc;
+		buf_src = buf_src + op->elem_size;
+		encoded_bytes += rc;
+	}
+
+	return encoded_bytes;
+}
+
+/* qmi_encode() on a precompiled codec */
+static int qmi_codec_encode(const struct qmi_codec *codec, void *out_buf,
+			    const void *in_c_struct, u32 out_buf_len,
+			    int enc_level)
+{
+	const struct qmi_codec_op *op = codec->ops;
+	u8 opt_flag_value;
+	u32 data_len_value = 0, data_len_sz;
+	u8 *buf_dst = (u8 *)out_buf;
+	u8 *tlv_pointer;
+	u32 tlv_len;
+	u8 tlv_type;
+	u32 encoded_bytes = 0;
+	const void *buf_src;
+	int encode_tlv = 0;
+	u32 copy_size;
+	int rc;
+
+	if (!in_c_struct)
+		return 0;
+
+	tlv_pointer = buf_dst;
+	tlv_len = 0;
+	if (enc_level == 1)
+		buf_dst = buf_dst + (TLV_LEN_SIZE + TLV_TYPE_SIZE);
+
+	while (op->data_type != QMI_EOTI) {
+		buf_src = in_c_struct + op->offset;
+		tlv_type = op->tlv_type;
+
+		if (op->is_array == NO_ARRAY) {
+			data_len_value = 1;
+			copy_size = op->copy_size;
+		} else if (op->is_array == STATIC_ARRAY) {
+			data_len_value = op->elem_len;
+			copy_size = op->copy_size;
+		} else if (data_len_value <= 0 ||
+			   op->elem_len < data_len_value) {
+			pr_err("%s: Invalid data length\n", __func__);
+			return -EINVAL;
+		} else {
+			copy_size = data_len_value * op->elem_size;
+		}
+
+		switch (op->data_type) {
+		case QMI_OPT_FLAG:
+			opt_flag_value = *(const u8 *)buf_src;
+			if (opt_flag_value)
+				op = op + 1;
+			else
+				op = qmi_codec_skip(codec, op, enc_level);
+			break;
+
+		case QMI_DATA_LEN:
+			memcpy(&data_len_value, buf_src, op->elem_size);
+			data_len_sz = op->elem_size == sizeof(u8) ?
+					sizeof(u8) : sizeof(u16);
+			/* Check to avoid out of range buffer access */
+			if ((data_len_sz + encoded_bytes + TLV_LEN_SIZE +
+			    TLV_TYPE_SIZE) > out_buf_len) {
+				pr_err("%s: Too Small Buffer @DATA_LEN\n",
+				       __func__);
+				return -ETOOSMALL;
+			}
+			memcpy(buf_dst, &data_len_value, data_len_sz);
+			rc = data_len_sz;
+			UPDATE_ENCODE_VARIABLES(op, buf_dst,
+						encoded_bytes, tlv_len,
+						encode_tlv, rc);
+			if (!data_len_value)
+				op = qmi_codec_skip(codec, op, enc_level);
+			else
+				encode_tlv = 0;
+			break;
+
+		case QMI_UNSIGNED_1_BYTE:
+		case QMI_UNSIGNED_2_BYTE:
+		case QMI_UNSIGNED_4_BYTE:
+		case QMI_UNSIGNED_8_BYTE:
+		case QMI_SIGNED_2_BYTE_ENUM:
+		case QMI_SIGNED_4_BYTE_ENUM:
+			/* Check to avoid out of range buffer access */
+			if ((copy_size + encoded_bytes + TLV_LEN_SIZE +
+			    TLV_TYPE_SIZE) > out_buf_len) {
+				pr_err("%s: Too Small Buffer @data_type:%d\n",
+				       __func__, op->data_type);
+				return -ETOOSMALL;
+			}
+			memcpy(buf_dst, buf_src, copy_size);
+			rc = copy_size;
+			UPDATE_ENCODE_VARIABLES(op, buf_dst,
+						encoded_bytes, tlv_len,
+						encode_tlv, rc);
+			break;
+
+		case QMI_STRUCT:
+			rc = qmi_codec_encode_struct(op, buf_dst, buf_src,
+						     data_len_value,
+						     out_buf_len - encoded_bytes,
+						     enc_level + 1);
+			if (rc < 0)
+				return rc;
+			UPDATE_ENCODE_VARIABLES(op, buf_dst,
+						encoded_bytes, tlv_len,
+						encode_tlv, rc);
+			break;
+
+		case QMI_STRING:
+			rc = qmi_encode_string_elem(op->ei, buf_dst, buf_src,
+						    out_buf_len - encoded_bytes,
+						    enc_level);
+			if (rc < 0)
+				return rc;
+			UPDATE_ENCODE_VARIABLES(op, buf_dst,
+						encoded_bytes, tlv_len,
+						encode_tlv, rc);
+			break;
+		default:
+			pr_err("%s: Unrecognized data type\n", __func__);
+			return -EINVAL;
+		}
+
+		if (encode_tlv && enc_level == 1) {
+			QMI_ENCDEC_ENCODE_TLV(tlv_type, tlv_len, tlv_pointer);
+			encoded_bytes += (TLV_TYPE_SIZE + TLV_LEN_SIZE);
+			tlv_pointer = buf_dst;
+			tlv_len = 0;
+			buf_dst = buf_dst + TLV_LEN_SIZE + TLV_TYPE_SIZE;
+			encode_tlv = 0;
+		}
+	}
+	return encoded_bytes;
+}
+
+static int qmi_codec_decode_struct(const struct qmi_codec_op *op,
+				   void *buf_dst, const void *buf_src,
+				   u32 elem_len, u32 tlv_len,
+				   int dec_level)
+{
+	int i, rc, decoded_bytes = 0;
+
+	for (i = 0; i < elem_len && decoded_bytes < tlv_len; i++) {
+		rc = qmi_codec_decode(op->nested, buf_dst, buf_src,
+				      tlv_len - decoded_bytes, dec_level);
+		if (rc < 0)
+			return rc;
+		buf_src = buf_src + rc;
+		buf_dst = buf_dst + op->elem_size;
+		decoded_bytes += rc;
+	}
+
+	if ((dec_level <= 2 && decoded_bytes != tlv_len) ||
+	    (dec_level > 2 && (i < elem_len || decoded_bytes > tlv_len))) {
+		pr_err("%s: Fault in decoding: dl(%d), db(%d), tl(%d), i(%d), el(%d)\n",
+		       __func__, dec_level, decoded_bytes, tlv_len,
+		       i, elem_len);
+		return -EFAULT;
+	}
+	return decoded_bytes;
+}
+
+/* qmi_decode() on a precompiled codec */
+static int qmi_codec_decode(const struct qmi_codec *codec,
+			    void *out_c_struct, const void *in_buf,
+			    u32 in_buf_len, int dec_level)
+{
+	const struct qmi_codec_op *op = codec->ops;
+	u8 opt_flag_value = 1;
+	u32 data_len_value = 0, data_len_sz = 0;
+	u8 *buf_dst = out_c_struct;
+	const u8 *tlv_pointer;
+	u32 tlv_len = 0;
+	u32 tlv_type;
+	u32 decoded_bytes = 0;
+	const void *buf_src = in_buf;
+	u32 copy_size;
+	u16 idx;
+	int rc;
+
+	while (decoded_bytes < in_buf_len) {
+		if (dec_level >= 2 && op->data_type == QMI_EOTI)
+			return decoded_bytes;
+
+		if (dec_level == 1) {
+			tlv_pointer = buf_src;
+			QMI_ENCDEC_DECODE_TLV(&tlv_type,
+					      &tlv_len, tlv_pointer);
+			buf_src += (TLV_TYPE_SIZE + TLV_LEN_SIZE);
+			decoded_bytes += (TLV_TYPE_SIZE + TLV_LEN_SIZE);
+			idx = codec->tlv_index[(u8)tlv_type];
+			if (idx == QMI_CODEC_NO_TLV &&
+			    tlv_type < OPTIONAL_TLV_TYPE_START) {
+				pr_err("%s: Inval element info\n", __func__);
+				return -EINVAL;
+			} else if (idx == QMI_CODEC_NO_TLV) {
+				UPDATE_DECODE_VARIABLES(buf_src,
+							decoded_bytes, tlv_len);
+				continue;
+			}
+			op = &codec->ops[idx];
+		} else {
+			/*
+			 * No length information for elements in nested
+			 * structures. So use remaining decodable buffer space.
+			 */
+			tlv_len = in_buf_len - decoded_bytes;
+		}
+
+		buf_dst = out_c_struct + op->offset;
+		if (op->data_type == QMI_OPT_FLAG) {
+			*buf_dst = opt_flag_value;
+			op = op + 1;
+			buf_dst = out_c_struct + op->offset;
+		}
+
+		if (op->data_type == QMI_DATA_LEN) {
+			data_len_sz = op->elem_size == sizeof(u8) ?
+					sizeof(u8) : sizeof(u16);
+			memcpy(&data_len_value, buf_src, data_len_sz);
+			rc = data_len_sz;
+			memcpy(buf_dst, &data_len_value, sizeof(u32));
+			op = op + 1;
+			buf_dst = out_c_struct + op->offset;
+			tlv_len -= data_len_sz;
+			UPDATE_DECODE_VARIABLES(buf_src, decoded_bytes, rc);
+		}
+
+		if (op->is_array == NO_ARRAY) {
+			data_len_value = 1;
+			copy_size = op->copy_size;
+		} else if (op->is_array == STATIC_ARRAY) {
+			data_len_value = op->elem_len;
+			copy_size = op->copy_size;
+		} else if (data_len_value > op->elem_len) {
+			pr_err("%s: Data len %d > max spec %d\n",
+			       __func__, data_len_value, op->elem_len);
+			return -ETOOSMALL;
+		} else {
+			copy_size = data_len_value * op->elem_size;
+		}
+
+		switch (op->data_type) {
+		case QMI_UNSIGNED_1_BYTE:
+		case QMI_UNSIGNED_2_BYTE:
+		case QMI_UNSIGNED_4_BYTE:
+		case QMI_UNSIGNED_8_BYTE:
+		case QMI_SIGNED_2_BYTE_ENUM:
+		case QMI_SIGNED_4_BYTE_ENUM:
+			memcpy(buf_dst, buf_src, copy_size);
+			rc = copy_size;
+			UPDATE_DECODE_VARIABLES(buf_src, decoded_bytes, rc);
+			break;
+
+		case QMI_STRUCT:
+			rc = qmi_codec_decode_struct(op, buf_dst, buf_src,
+						     data_len_value, tlv_len,
+						     dec_level + 1);
+			if (rc < 0)
+				return rc;
+			UPDATE_DECODE_VARIABLES(buf_src, decoded_bytes, rc);
+			break;
+
+		case QMI_STRING:
+			rc = qmi_decode_string_elem(op->ei, buf_dst, buf_src,
+						    tlv_len, dec_level);
+			if (rc < 0)
+				return rc;
+			UPDATE_DECODE_VARIABLES(buf_src, decoded_bytes, rc);
+			break;
+
+		default:
+			pr_err("%s: Unrecognized data type\n", __func__);
+			return -EINVAL;
+		}
+		op = op + 1;
+	}
+	return decoded_bytes;
+}
+
 /**
  * qmi_encode_message() - Encode C structure as QMI encoded message
  * @type:	Type of QMI message
@@ -722,6 +1282,7 @@ void *qmi_encode_message(int type, unsigned int msg_id, size_t *len,
 			 unsigned int txn_id, struct qmi_elem_info *ei,
 			 const void *c_struct)
 {
+	struct qmi_codec *codec;
 	struct qmi_header *hdr;
 	ssize_t msglen = 0;
 	void *msg;
@@ -745,7 +1306,13 @@ void *qmi_encode_message(int type, unsigned int msg_id, size_t *len,
 
 	/* Encode message, if we have a message */
 	if (c_struct) {
-		msglen = qmi_encode(ei, msg + sizeof(*hdr), c_struct, *len, 1);
+		codec = codec_cache ? qmi_codec_get(ei, 1) : NULL;
+		if (codec)
+			msglen = qmi_codec_encode(codec, msg + sizeof(*hdr),
+						  c_struct, *len, 1);
+		else
+			msglen = qmi_encode(ei, msg + sizeof(*hdr), c_struct,
+					    *len, 1);
 		if (msglen < 0) {
 			kfree(msg);
 			return ERR_PTR(msglen);
@@ -777,12 +1344,20 @@ EXPORT_SYMBOL(qmi_encode_message);
 int qmi_decode_message(const void *buf, size_t len,
 		       struct qmi_elem_info *ei, void *c_struct)
 {
+	struct qmi_codec *codec;
+
 	if (!ei)
 		return -EINVAL;
 
 	if (!c_struct || !buf || !len)
 		return -EINVAL;
 
+	codec = codec_cache ? qmi_codec_get(ei, 1) : NULL;
+	if (codec)
+		return qmi_codec_decode(codec, c_struct,
+					buf + sizeof(struct qmi_header),
+					len - sizeof(struct qmi_header), 1);
+
 	return qmi_decode(ei, c_struct, buf + sizeof(struct qmi_header),
 			  len - sizeof(struct qmi_header), 1);
 }
@@ -822,5 +1397,346 @@ struct qmi_elem_info qmi_response_type_v01_ei[] = {
 };
 EXPORT_SYMBOL(qmi_response_type_v01_ei);
 
+static int __init qmi_codec_init(void)
+{
+	return register_module_notifier(&qmi_codec_module_nb);
+}
+core_initcall(qmi_codec_init);
+
+#ifdef CONFIG_QCOM_QMI_ENCDEC_TEST
+/*
+ * Self test: encode and decode representative messages through both the
+ * interpreter and the precompiled codec, check that the wire format and
+ * the decoded structs are identical, and report the time taken by each.
+ */
+#define QMI_ENCDEC_TEST_ITERS	10000
+#define QMI_ENCDEC_TEST_BUF_LEN	2048
+
+struct qmi_encdec_test_elem {
+	u32 id;
+	u32 data_len;
+	u16 data[8];
+	char label[16 + 1];
+};
+
+struct qmi_encdec_test_msg {
+	u32 handle;
+	struct qmi_response_type_v01 resp;
+	u8 name_valid;
+	char name[32 + 1];
+	u8 elems_valid;
+	u32 elems_len;
+	struct qmi_encdec_test_elem elems[4];
+	u8 blob_valid;
+	u32 blob_len;
+	u8 blob[256];
+	u8 stats_valid;
+	u64 stats[8];
+	u8 cookie_valid;
+	u32 cookie;
+};
+
+static struct qmi_elem_info qmi_encdec_test_elem_ei[] = {
+	{
+		.data_type	= QMI_UNSIGNED_4_BYTE,
+		.elem_len	= 1,
+		.elem_size	= sizeof(u32),
+		.is_array	= NO_ARRAY,
+		.tlv_type	= QMI_COMMON_TLV_TYPE,
+		.offset		= offsetof(struct qmi_encdec_test_elem, id),
+	},
+	{
+		.data_type	= QMI_DATA_LEN,
+		.elem_len	= 1,
+		.elem_size	= sizeof(u8),
+		.is_array	= NO_ARRAY,
+		.tlv_type	= QMI_COMMON_TLV_TYPE,
+		.offset		= offsetof(struct qmi_encdec_test_elem,
+					   data_len),
+	},
+	{
+		.data_type	= QMI_UNSIGNED_2_BYTE,
+		.elem_len	= 8,
+		.elem_size	= sizeof(u16),
+		.is_array	= VAR_LEN_ARRAY,
+		.tlv_type	= QMI_COMMON_TLV_TYPE,
+		.offset		= offsetof(struct qmi_encdec_test_elem, data),
+	},
+	{
+		.data_type	= QMI_STRING,
+		.elem_len	= 16 + 1,
+		.elem_size	= sizeof(char),
+		.is_array	= NO_ARRAY,
+		.tlv_type	= QMI_COMMON_TLV_TYPE,
+		.offset		= offsetof(struct qmi_encdec_test_elem, label),
+	},
+	{}
+};
+
+static struct qmi_elem_info qmi_encdec_test_msg_ei[] = {
+	{
+		.data_type	= QMI_UNSIGNED_4_BYTE,
+		.elem_len	= 1,
+		.elem_size	= sizeof(u32),
+		.is_array	= NO_ARRAY,
+		.tlv_type	= 0x01,
+		.offset		= offsetof(struct qmi_encdec_test_msg, handle),
+	},
+	{
+		.data_type	= QMI_STRUCT,
+		.elem_len	= 1,
+		.elem_size	= sizeof(struct qmi_response_type_v01),
+		.is_array	= NO_ARRAY,
+		.tlv_type	= 0x02,
+		.offset		= offsetof(struct qmi_encdec_test_msg, resp),
+		.ei_array	= qmi_response_type_v01_ei,
+	},
+	{
+		.data_type	= QMI_OPT_FLAG,
+		.elem_len	= 1,
+		.elem_size	= sizeof(u8),
+		.is_array	= NO_ARRAY,
+		.tlv_type	= 0x10,
+		.offset		= offsetof(struct qmi_encdec_test_msg,
+					   name_valid),
+	},
+	{
+		.data_type	= QMI_STRING,
+		.elem_len	= 32 + 1,
+		.elem_size	= sizeof(char),
+		.is_array	= NO_ARRAY,
+		.tlv_type	= 0x10,
+		.offset		= offsetof(struct qmi_encdec_test_msg, name),
+	},
+	{
+		.data_type	= QMI_OPT_FLAG,
+		.elem_len	= 1,
+		.elem_size	= sizeof(u8),
+		.is_array	= NO_ARRAY,
+		.tlv_type	= 0x11,
+		.offset		= offsetof(struct qmi_encdec_test_msg,
+					   elems_valid),
+	},
+	{
+		.data_type	= QMI_DATA_LEN,
+		.elem_len	= 1,
+		.elem_size	= sizeof(u8),
+		.is_array	= NO_ARRAY,
+		.tlv_type	= 0x11,
+		.offset		= offsetof(struct qmi_encdec_test_msg,
+					   elems_len),
+	},
+	{
+		.data_type	= QMI_STRUCT,
+		.elem_len	= 4,
+		.elem_size	= sizeof(struct qmi_encdec_test_elem),
+		.is_array	= VAR_LEN_ARRAY,
+		.tlv_type	= 0x11,
+		.offset		= offsetof(struct qmi_encdec_test_msg, elems),
+		.ei_array	= qmi_encdec_test_elem_ei,
+	},
+	{
+		.data_type	= QMI_OPT_FLAG,
+		.elem_len	= 1,
+		.elem_size	= sizeof(u8),
+		.is_array	= NO_ARRAY,
+		.tlv_type	= 0x12,
+		.offset		= offsetof(struct qmi_encdec_test_msg,
+					   blob_valid),
+	},
+	{
+		.data_type	= QMI_DATA_LEN,
+		.elem_len	= 1,
+		.elem_size	= sizeof(u16),
+		.is_array	= NO_ARRAY,
+		.tlv_type	= 0x12,
+		.offset		= offsetof(struct qmi_encdec_test_msg,
+					   blob_len),
+	},
+	{
+		.data_type	= QMI_UNSIGNED_1_BYTE,
+		.elem_len	= 256,
+		.elem_size	= sizeof(u8),
+		.is_array	= VAR_LEN_ARRAY,
+		.tlv_type	= 0x12,
+		.offset		= offsetof(struct qmi_encdec_test_msg, blob),
+	},
+	{
+		.data_type	= QMI_OPT_FLAG,
+		.elem_len	= 1,
+		.elem_size	= sizeof(u8),
+		.is_array	= NO_ARRAY,
+		.tlv_type	= 0x13,
+		.offset		= offsetof(struct qmi_encdec_test_msg,
+					   stats_valid),
+	},
+	{
+		.data_type	= QMI_UNSIGNED_8_BYTE,
+		.elem_len	= 8,
+		.elem_size	= sizeof(u64),
+		.is_array	= STATIC_ARRAY,
+		.tlv_type	= 0x13,
+		.offset		= offsetof(struct qmi_encdec_test_msg, stats),
+	},
+	{
+		.data_type	= QMI_OPT_FLAG,
+		.elem_len	= 1,
+		.elem_size	= sizeof(u8),
+		.is_array	= NO_ARRAY,
+		.tlv_type	= 0x14,
+		.offset		= offsetof(struct qmi_encdec_test_msg,
+					   cookie_valid),
+	},
+	{
+		.data_type	= QMI_UNSIGNED_4_BYTE,
+		.elem_len	= 1,
+		.elem_size	= sizeof(u32),
+		.is_array	= NO_ARRAY,
+		.tlv_type	= 0x14,
+		.offset		= offsetof(struct qmi_encdec_test_msg, cookie),
+	},
+	{}
+};
+
+static void __init qmi_encdec_test_fill(struct qmi_encdec_test_msg *msg,
+					bool full)
+{
+	int i, j;
+
+	memset(msg, 0, sizeof(*msg));
+	msg->handle = 0x12345678;
+	msg->resp.result = QMI_RESULT_FAILURE_V01;
+	msg->resp.error = QMI_ERR_MALFORMED_MSG_V01;
+	if (!full)
+		return;
+
+	msg->name_valid = 1;
+	strlcpy(msg->name, "qmi-encdec-selftest", sizeof(msg->name));
+	msg->elems_valid = 1;
+	msg->elems_len = ARRAY_SIZE(msg->elems);
+	for (i = 0; i < msg->elems_len; i++) {
+		msg->elems[i].id = i;
+		msg->elems[i].data_len = i + 1;
+		for (j = 0; j <= i; j++)
+			msg->elems[i].data[j] = i * 16 + j;
+		snprintf(msg->elems[i].label, sizeof(msg->elems[i].label),
+			 "elem%d", i);
+	}
+	msg->blob_valid = 1;
+	msg->blob_len = 200;
+	for (i = 0; i < msg->blob_len; i++)
+		msg->blob[i] = i;
+	msg->stats_valid = 1;
+	for (i = 0; i < ARRAY_SIZE(msg->stats); i++)
+		msg->stats[i] = 0x0101010101010101ULL * i;
+}
+
+static int __init qmi_encdec_test_one(const char *name,
+				      struct qmi_encdec_test_msg *msg,
+				      u8 *ref_buf, u8 *buf,
+				      struct qmi_encdec_test_msg *ref_out,
+				      struct qmi_encdec_test_msg *out)
+{
+	struct qmi_elem_info *ei = qmi_encdec_test_msg_ei;
+	struct qmi_codec *codec;
+	ktime_t t0, t1, t2;
+	int ref_len, len;
+	int ref_rc, rc;
+	int i;
+
+	codec = qmi_codec_get(ei, 1);
+	if (!codec) {
+		pr_err("qmi_encdec_test: %s: no codec\n", name);
+		return -ENOMEM;
+	}
+
+	memset(ref_buf, 0, QMI_ENCDEC_TEST_BUF_LEN);
+	memset(buf, 0, QMI_ENCDEC_TEST_BUF_LEN);
+	ref_len = qmi_encode(ei, ref_buf, msg, QMI_ENCDEC_TEST_BUF_LEN, 1);
+	len = qmi_codec_encode(codec, buf, msg, QMI_ENCDEC_TEST_BUF_LEN, 1);
+	if (ref_len < 0 || len != ref_len || memcmp(ref_buf, buf, len)) {
+		pr_err("qmi_encdec_test: %s: encode mismatch %d/%d\n",
+		       name, ref_len, len);
+		return -EINVAL;
+	}
+
+	memset(ref_out, 0, sizeof(*ref_out));
+	memset(out, 0, sizeof(*out));
+	ref_rc = qmi_decode(ei, ref_out, ref_buf, ref_len, 1);
+	rc = qmi_codec_decode(codec, out, ref_buf, ref_len, 1);
+	if (ref_rc < 0 || rc != ref_rc || memcmp(ref_out, out, sizeof(*out)) ||
+	    memcmp(ref_out, msg, sizeof(*msg))) {
+		pr_err("qmi_encdec_test: %s: decode mismatch %d/%d\n",
+		       name, ref_rc, rc);
+		return -EINVAL;
+	}
+
+	/* A buffer that is too short must fail the same way */
+	ref_rc = qmi_encode(ei, ref_buf, msg, ref_len - 1, 1);
+	rc = qmi_codec_encode(codec, buf, msg, ref_len - 1, 1);
+	if (ref_rc >= 0 || rc != ref_rc) {
+		pr_err("qmi_encdec_test: %s: short buffer %d/%d\n",
+		       name, ref_rc, rc);
+		return -EINVAL;
+	}
+
+	t0 = ktime_get();
+	for (i = 0; i < QMI_ENCDEC_TEST_ITERS; i++) {
+		qmi_encode(ei, ref_buf, msg, QMI_ENCDEC_TEST_BUF_LEN, 1);
+		qmi_decode(ei, ref_out, ref_buf, ref_len, 1);
+	}
+	t1 = ktime_get();
+	for (i = 0; i < QMI_ENCDEC_TEST_ITERS; i++) {
+		qmi_codec_encode(codec, buf, msg, QMI_ENCDEC_TEST_BUF_LEN, 1);
+		qmi_codec_decode(codec, out, buf, ref_len, 1);
+	}
+	t2 = ktime_get();
+
+	pr_info("qmi_encdec_test: %s: %d bytes, interpreter %lld ns, codec %lld ns per round trip\n",
+		name, ref_len,
+		div_s64(ktime_to_ns(ktime_sub(t1, t0)), QMI_ENCDEC_TEST_ITERS),
+		div_s64(ktime_to_ns(ktime_sub(t2, t1)), QMI_ENCDEC_TEST_ITERS));
+
+	return 0;
+}
+
+static int __init qmi_encdec_test(void)
+{
+	struct qmi_encdec_test_msg *msg, *ref_out, *out;
+	u8 *ref_buf, *buf;
+	int ret = -ENOMEM;
+
+	msg = kmalloc(sizeof(*msg), GFP_KERNEL);
+	ref_out = kmalloc(sizeof(*ref_out), GFP_KERNEL);
+	out = kmalloc(sizeof(*out), GFP_KERNEL);
+	ref_buf = kmalloc(QMI_ENCDEC_TEST_BUF_LEN, GFP_KERNEL);
+	buf = kmalloc(QMI_ENCDEC_TEST_BUF_LEN, GFP_KERNEL);
+	if (!msg || !ref_out || !out || !ref_buf || !buf)
+		goto out;
+
+	qmi_encdec_test_fill(msg, false);
+	ret = qmi_encdec_test_one("mandatory", msg, ref_buf, buf,
+				  ref_out, out);
+	if (ret)
+		goto out;
+
+	qmi_encdec_test_fill(msg, true);
+	ret = qmi_encdec_test_one("optional", msg, ref_buf, buf,
+				  ref_out, out);
+out:
+	kfree(buf);
+	kfree(ref_buf);
+	kfree(out);
+	kfree(ref_out);
+	kfree(msg);
+	if (ret)
+		pr_err("qmi_encdec_test: FAILED (%d)\n", ret);
+	else
+		pr_info("qmi_encdec_test: all tests passed\n");
+	return 0;
+}
+late_initcall(qmi_encdec_test);
+#endif
+
 MODULE_DESCRIPTION("QMI encoder/decoder helper");
 MODULE_LICENSE("GPL v2");
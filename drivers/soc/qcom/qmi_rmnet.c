@@ -18,12 +18,15 @@
 #include <uapi/linux/rtnetlink.h>
 #include <net/pkt_sched.h>
 #include "qmi_rmnet_i.h"
+#include "dfc_defs.h"
 #include <trace/events/dfc.h>
 #include <linux/module.h>
 #include <linux/moduleparam.h>
 #include <linux/ip.h>
 #include <linux/ipv6.h>
 #include <linux/alarmtimer.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #define NLMSG_FLOW_ACTIVATE 1
 #define NLMSG_FLOW_DEACTIVATE 2
@@ -59,6 +62,10 @@ MODULE_PARM_DESC(rmnet_wq_frequency, "Frequency of PS check in ms");
 #ifdef CONFIG_QCOM_QMI_DFC
 static unsigned int qmi_rmnet_scale_factor = 5;
 static LIST_HEAD(qos_cleanup_list);
+static LIST_HEAD(qos_active_list);
+static DEFINE_SPINLOCK(qos_active_lock);
+
+#define QMI_RMNET_FLOW_KEY(flow_id, ip_type) ((flow_id) ^ ((u32)(ip_type) << 24))
 #endif
 
 static int
@@ -149,11 +156,13 @@ qmi_rmnet_clean_flow_list(struct qos_info *qos)
 
 	list_for_each_entry_safe(itm, fl_tmp, &qos->flow_head, list) {
 		list_del(&itm->list);
+		hash_del(&itm->hlist);
 		kfree(itm);
 	}
 
 	list_for_each_entry_safe(bearer, br_tmp, &qos->bearer_head, list) {
 		list_del(&bearer->list);
+		hash_del(&bearer->hlist);
 		kfree(bearer);
 	}
 
@@ -168,7 +177,8 @@ qmi_rmnet_get_flow_map(struct qos_info *qos, u32 flow_id, int ip_type)
 	if (!qos)
 		return NULL;
 
-	list_for_each_entry(itm, &qos->flow_head, list) {
+	hash_for_each_possible(qos->flow_ht, itm, hlist,
+			       QMI_RMNET_FLOW_KEY(flow_id, ip_type)) {
 		if ((itm->flow_id == flow_id) && (itm->ip_type == ip_type))
 			return itm;
 	}
@@ -183,7 +193,7 @@ qmi_rmnet_get_bearer_map(struct qos_info *qos, uint8_t bearer_id)
 	if (!qos)
 		return NULL;
 
-	list_for_each_entry(itm, &qos->bearer_head, list) {
+	hash_for_each_possible(qos->bearer_ht, itm, hlist, bearer_id) {
 		if (itm->bearer_id == bearer_id)
 			return itm;
 	}
@@ -255,6 +265,7 @@ static struct rmnet_bearer_map *__qmi_rmnet_bearer_get(
 		bearer->mq_idx = INVALID_MQ;
 		bearer->ack_mq_idx = INVALID_MQ;
 		list_add(&bearer->list, &qos_info->bearer_head);
+		hash_add(qos_info->bearer_ht, &bearer->hlist, bearer_id);
 	}
 
 	return bearer;
@@ -289,6 +300,7 @@ static void __qmi_rmnet_bearer_put(struct net_device *dev,
 
 		/* Remove from bearer map */
 		list_del(&bearer->list);
+		hash_del(&bearer->hlist);
 		kfree(bearer);
 	}
 }
@@ -406,6 +418,8 @@ static int qmi_rmnet_add_flow(struct net_device *dev, struct tcmsg *tcm,
 
 	qmi_rmnet_update_flow_map(itm, &new_map);
 	list_add(&itm->list, &qos_info->flow_head);
+	hash_add(qos_info->flow_ht, &itm->hlist,
+		 QMI_RMNET_FLOW_KEY(itm->flow_id, itm->ip_type));
 
 	/* Create or update bearer map */
 	bearer = __qmi_rmnet_bearer_get(qos_info, new_map.bearer_id);
@@ -456,6 +470,7 @@ qmi_rmnet_del_flow(struct net_device *dev, struct tcmsg *tcm,
 
 		/* Remove from flow map */
 		list_del(&itm->list);
+		hash_del(&itm->hlist);
 		kfree(itm);
 	}
 
@@ -919,8 +934,14 @@ void *qmi_rmnet_qos_init(struct net_device *real_dev, u8 mux_id)
 	qos->tran_num = 0;
 	INIT_LIST_HEAD(&qos->flow_head);
 	INIT_LIST_HEAD(&qos->bearer_head);
+	hash_init(qos->flow_ht);
+	hash_init(qos->bearer_ht);
 	spin_lock_init(&qos->qos_lock);
 
+	spin_lock_bh(&qos_active_lock);
+	list_add_tail(&qos->qos_list, &qos_active_list);
+	spin_unlock_bh(&qos_active_lock);
+
 	return qos;
 }
 EXPORT_SYMBOL(qmi_rmnet_qos_init);
@@ -930,6 +951,10 @@ void qmi_rmnet_qos_exit_pre(void *qos)
 	if (!qos)
 		return;
 
+	spin_lock_bh(&qos_active_lock);
+	list_del(&((struct qos_info *)qos)->qos_list);
+	spin_unlock_bh(&qos_active_lock);
+
 	list_add(&((struct qos_info *)qos)->list, &qos_cleanup_list);
 }
 EXPORT_SYMBOL(qmi_rmnet_qos_exit_pre);
@@ -946,6 +971,169 @@ void qmi_rmnet_qos_exit_post(void)
 	}
 }
 EXPORT_SYMBOL(qmi_rmnet_qos_exit_post);
+
+#ifdef CONFIG_DEBUG_FS
+static int qmi_rmnet_bearer_stats_show(struct seq_file *m, void *v)
+{
+	struct rmnet_bearer_stats *stats;
+	struct rmnet_bearer_map *bearer;
+	struct qos_info *qos;
+	u64 avg_us, max_us;
+	u32 completed;
+
+	spin_lock_bh(&qos_active_lock);
+	list_for_each_entry(qos, &qos_active_list, qos_list) {
+		spin_lock(&qos->qos_lock);
+		list_for_each_entry(bearer, &qos->bearer_head, list) {
+			stats = &bearer->stats;
+			completed = stats->disables - (stats->disable_ts ? 1 : 0);
+			avg_us = completed ?
+				div_u64(stats->stall_ns, completed) : 0;
+			avg_us = div_u64(avg_us, NSEC_PER_USEC);
+			max_us = div_u64(stats->max_stall_ns, NSEC_PER_USEC);
+			seq_printf(m,
+				   "mux=%u bearer=%u grant=%u seq=%u grants=%u disables=%u stall_avg=%lluus stall_max=%lluus%s\n",
+				   qos->mux_id, bearer->bearer_id,
+				   bearer->grant_size, bearer->seq,
+				   stats->grants, stats->disables,
+				   avg_us, max_us,
+				   stats->disable_ts ? " [off]" : "");
+		}
+		spin_unlock(&qos->qos_lock);
+	}
+	spin_unlock_bh(&qos_active_lock);
+
+	return 0;
+}
+
+static int qmi_rmnet_bearer_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, qmi_rmnet_bearer_stats_show, NULL);
+}
+
+static const struct file_operations qmi_rmnet_bearer_stats_fops = {
+	.open		= qmi_rmnet_bearer_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+#ifdef CONFIG_QCOM_QMI_DFC_TEST
+/*
+ * Inject a synthetic flow status indication, as if sent by the modem:
+ *   <rmnet dev> <ack_req> <bearer>:<grant>:<seq> [<bearer>:<grant>:<seq>...]
+ * A bearer id of 255 applies the grant to all bearers of the device.
+ */
+static ssize_t qmi_rmnet_dfc_inject_write(struct file *file,
+					  const char __user *ubuf,
+					  size_t count, loff_t *ppos)
+{
+	struct dfc_flow_status_info_type_v01 *fs;
+	struct dfc_flow_status_ind_msg_v01 *ind;
+	struct dfc_qmi_data *dfc;
+	struct net_device *dev;
+	struct qos_info *qos;
+	char buf[256], *p, *tok;
+	u8 bearer_id, ack_req, mux_id = 0;
+	u32 grant;
+	u16 seq;
+	int rc;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+	p = strim(buf);
+
+	tok = strsep(&p, " ");
+	dev = dev_get_by_name(&init_net, tok);
+	if (!dev)
+		return -ENODEV;
+
+	ind = kzalloc(sizeof(*ind), GFP_KERNEL);
+	dfc = kzalloc(sizeof(*dfc), GFP_KERNEL);
+	if (!ind || !dfc) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	rc = -EINVAL;
+	if (!dev->rtnl_link_ops || strcmp(dev->rtnl_link_ops->kind, "rmnet"))
+		goto out;
+
+	tok = strsep(&p, " ");
+	if (!tok || kstrtou8(tok, 0, &ack_req))
+		goto out;
+
+	rcu_read_lock();
+	qos = (struct qos_info *)rmnet_get_qos_pt(dev);
+	if (qos)
+		mux_id = qos->mux_id;
+	rcu_read_unlock();
+	if (!qos)
+		goto out;
+
+	while ((tok = strsep(&p, " "))) {
+		if (!*tok)
+			continue;
+		if (ind->flow_status_len >= DFC_MAX_BEARERS_V01 ||
+		    sscanf(tok, "%hhu:%u:%hu", &bearer_id, &grant, &seq) != 3)
+			goto out;
+
+		fs = &ind->flow_status[ind->flow_status_len++];
+		fs->mux_id = mux_id;
+		fs->bearer_id = bearer_id;
+		fs->num_bytes = grant;
+		fs->seq_num = seq;
+	}
+	if (!ind->flow_status_len)
+		goto out;
+
+	ind->flow_status_valid = 1;
+	ind->eod_ack_reqd_valid = 1;
+	ind->eod_ack_reqd = ack_req;
+	dfc->rmnet_port = rmnet_get_rmnet_port(dev);
+	dfc->index = -1;
+
+	local_bh_disable();
+	dfc_do_burst_flow_control(dfc, ind, false);
+	local_bh_enable();
+	rc = count;
+
+out:
+	kfree(dfc);
+	kfree(ind);
+	dev_put(dev);
+	return rc;
+}
+
+static const struct file_operations qmi_rmnet_dfc_inject_fops = {
+	.open		= simple_open,
+	.write		= qmi_rmnet_dfc_inject_write,
+	.llseek		= no_llseek,
+};
+#endif
+
+static int __init qmi_rmnet_debugfs_init(void)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("qmi_rmnet", NULL);
+	if (IS_ERR_OR_NULL(dir))
+		return 0;
+
+	debugfs_create_file("bearer_stats", 0444, dir, NULL,
+			    &qmi_rmnet_bearer_stats_fops);
+#ifdef CONFIG_QCOM_QMI_DFC_TEST
+	debugfs_create_file("dfc_inject", 0200, dir, NULL,
+			    &qmi_rmnet_dfc_inject_fops);
+#endif
+	return 0;
+}
+late_initcall(qmi_rmnet_debugfs_init);
+#endif
 #endif
 
 #ifdef CONFIG_QCOM_QMI_POWER_COLLAPSE
@@ -14,6 +14,8 @@
 #ifndef _RMNET_QMI_I_H
 #define _RMNET_QMI_I_H
 
+#include <linux/hashtable.h>
+#include <linux/ktime.h>
 #include <linux/netdevice.h>
 #include <linux/skbuff.h>
 
@@ -25,6 +27,8 @@
 #define DEFAULT_MQ_NUM 0
 #define ACK_MQ_OFFSET (MAX_MQ_NUM - 1)
 #define INVALID_MQ 0xFF
+#define QOS_FLOW_HASH_BITS 5
+#define QOS_BEARER_HASH_BITS 4
 
 #define DFC_MODE_FLOW_ID 2
 #define DFC_MODE_MQ_NUM 3
@@ -33,8 +37,17 @@
 extern int dfc_mode;
 extern int dfc_qmap;
 
+struct rmnet_bearer_stats {
+	u32 grants;
+	u32 disables;
+	ktime_t disable_ts;
+	u64 stall_ns;
+	u64 max_stall_ns;
+};
+
 struct rmnet_bearer_map {
 	struct list_head list;
+	struct hlist_node hlist;
 	u8 bearer_id;
 	int flow_ref;
 	u32 grant_size;
@@ -51,10 +64,12 @@ struct rmnet_bearer_map {
 	u32 ack_txid;
 	u32 mq_idx;
 	u32 ack_mq_idx;
+	struct rmnet_bearer_stats stats;
 };
 
 struct rmnet_flow_map {
 	struct list_head list;
+	struct hlist_node hlist;
 	u8 bearer_id;
 	u32 flow_id;
 	int ip_type;
@@ -74,13 +89,20 @@ struct mq_map {
 
 struct qos_info {
 	struct list_head list;
+	struct list_head qos_list;
 	u8 mux_id;
 	struct net_device *real_dev;
 	struct list_head flow_head;
 	struct list_head bearer_head;
+	DECLARE_HASHTABLE(flow_ht, QOS_FLOW_HASH_BITS);
+	DECLARE_HASHTABLE(bearer_ht, QOS_BEARER_HASH_BITS);
 	struct mq_map mq[MAX_MQ_NUM];
 	u32 tran_num;
 	spinlock_t qos_lock;
+	/* TX queue state changes deferred while an indication is applied */
+	bool fc_batch;
+	u32 fc_on;
+	u32 fc_off;
 };
 
 struct qmi_info {
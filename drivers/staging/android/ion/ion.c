@@ -78,6 +78,122 @@ bool ion_buffer_cached(struct ion_buffer *buffer)
 	return !!(buffer->flags & ION_FLAG_CACHED);
 }
 
+/*
+ * Cache maintenance elision for cached buffers.
+ *
+ * The buffer is split into at most ION_CMO_CHUNKS power-of-two sized
+ * chunks and two bitmaps track, per chunk, whether the CPU may hold dirty
+ * lines (@cpu_dirty) and whether a device may have written memory behind
+ * the CPU caches since the last invalidate (@dev_dirty). begin_cpu_access
+ * only invalidates when a device may have written, end_cpu_access only
+ * cleans when the CPU may have written. Kernel mappings are always
+ * treated as dirty since vmap users rarely bracket their writes. A bit is
+ * only cleared once a sync was issued through at least one device mapping;
+ * with no mapped attachment the bits stay set so that ion_map_dma_buf()
+ * does the maintenance instead.
+ */
+#define ION_CMO_CHUNKS		64
+#define ION_CMO_ALL		(~0ULL)
+
+static void ion_buffer_cmo_init(struct ion_buffer *buffer)
+{
+	unsigned int shift = PAGE_SHIFT;
+
+	while (DIV_ROUND_UP(buffer->size, 1UL << shift) > ION_CMO_CHUNKS)
+		shift++;
+
+	buffer->cmo_chunk_shift = shift;
+	buffer->cpu_dirty = ION_CMO_ALL;
+	buffer->dev_dirty = ION_CMO_ALL;
+}
+
+/*
+ * Chunks touched by [offset, offset + len), or with @whole only the chunks
+ * the range covers completely; a sync of a partial chunk leaves the rest of
+ * that chunk in its old state.
+ */
+static u64 ion_cmo_mask(struct ion_buffer *buffer, unsigned long offset,
+			unsigned long len, bool whole)
+{
+	unsigned int shift = buffer->cmo_chunk_shift;
+	unsigned long end = min_t(unsigned long, offset + len, buffer->size);
+	unsigned long first, last;
+
+	if (offset >= end)
+		return 0;
+
+	if (!whole) {
+		first = offset >> shift;
+		last = (end - 1) >> shift;
+	} else {
+		first = DIV_ROUND_UP(offset, 1UL << shift);
+		if (end == buffer->size)
+			last = (end - 1) >> shift;
+		else if (end >> shift)
+			last = (end >> shift) - 1;
+		else
+			return 0;
+		if (first > last)
+			return 0;
+	}
+
+	return GENMASK_ULL(last, first);
+}
+
+static u64 ion_cmo_vmas_mask(struct ion_buffer *buffer, bool whole,
+			     unsigned long *size)
+{
+	struct ion_vma_list *vma_list;
+	u64 mask = 0;
+
+	*size = 0;
+	list_for_each_entry(vma_list, &buffer->vmas, list) {
+		struct vm_area_struct *vma = vma_list->vma;
+		unsigned long len = vma->vm_end - vma->vm_start;
+
+		mask |= ion_cmo_mask(buffer, vma->vm_pgoff * PAGE_SIZE, len,
+				     whole);
+		*size += len;
+	}
+
+	return mask;
+}
+
+static bool ion_cmo_needs_invalidate(struct ion_buffer *buffer, u64 mask)
+{
+	if (!IS_ENABLED(CONFIG_ION_CMO_ELISION))
+		return true;
+
+	return buffer->dev_dirty & mask;
+}
+
+static bool ion_cmo_needs_clean(struct ion_buffer *buffer, u64 mask)
+{
+	if (!IS_ENABLED(CONFIG_ION_CMO_ELISION))
+		return true;
+
+	return buffer->kmap_cnt || (buffer->cpu_dirty & mask);
+}
+
+/* The CPU owns @touched now; it may dirty it unless it only reads */
+static void ion_cmo_begin_done(struct ion_buffer *buffer,
+			       enum dma_data_direction dir,
+			       u64 touched, u64 covered)
+{
+	buffer->dev_dirty &= ~covered;
+	if (dir != DMA_FROM_DEVICE)
+		buffer->cpu_dirty |= touched;
+}
+
+/* Ownership of @touched returns to any device that can write it */
+static void ion_cmo_end_done(struct ion_buffer *buffer, u64 touched,
+			     u64 covered)
+{
+	buffer->cpu_dirty &= ~covered;
+	if (buffer->dev_writers)
+		buffer->dev_dirty |= touched;
+}
+
 /* this function should only be called while dev->lock is held */
 static void ion_buffer_add(struct ion_device *dev,
 			   struct ion_buffer *buffer)
@@ -151,6 +267,7 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 	INIT_LIST_HEAD(&buffer->attachments);
 	INIT_LIST_HEAD(&buffer->vmas);
 	mutex_init(&buffer->lock);
+	ion_buffer_cmo_init(buffer);
 
 	if (IS_ENABLED(CONFIG_ION_FORCE_DMA_SYNC)) {
 		int i;
@@ -284,6 +401,7 @@ struct ion_dma_buf_attachment {
 	struct sg_table *table;
 	struct list_head list;
 	bool dma_mapped;
+	bool dev_writable;
 };
 
 static int ion_dma_buf_attach(struct dma_buf *dmabuf, struct device *dev,
@@ -348,6 +466,10 @@ static struct sg_table *ion_map_dma_buf(struct dma_buf_attachment *attachment,
 		map_attrs |= DMA_ATTR_SKIP_CPU_SYNC;
 
 	mutex_lock(&buffer->lock);
+	/* Clean CPU caches count as no dirty lines to write back or drop */
+	if (!ion_cmo_needs_clean(buffer, ION_CMO_ALL))
+		map_attrs |= DMA_ATTR_SKIP_CPU_SYNC;
+
 	if (map_attrs & DMA_ATTR_SKIP_CPU_SYNC)
 		trace_ion_dma_map_cmo_skip(attachment->dev,
 					   attachment->dmabuf->buf_name,
@@ -378,6 +500,14 @@ static struct sg_table *ion_map_dma_buf(struct dma_buf_attachment *attachment,
 		return ERR_PTR(-ENOMEM);
 	}
 
+	if (!(map_attrs & DMA_ATTR_SKIP_CPU_SYNC))
+		buffer->cpu_dirty = 0;
+	if (direction != DMA_TO_DEVICE) {
+		a->dev_writable = true;
+		buffer->dev_writers++;
+		buffer->dev_dirty = ION_CMO_ALL;
+	}
+
 	a->dma_mapped = true;
 	mutex_unlock(&buffer->lock);
 	return table;
@@ -420,6 +550,10 @@ static void ion_unmap_dma_buf(struct dma_buf_attachment *attachment,
 	else
 		dma_unmap_sg_attrs(attachment->dev, table->sgl, table->nents,
 				   direction, map_attrs);
+	if (a->dev_writable) {
+		a->dev_writable = false;
+		buffer->dev_writers--;
+	}
 	a->dma_mapped = false;
 	mutex_unlock(&buffer->lock);
 }
@@ -650,13 +784,16 @@ static int __ion_dma_buf_begin_cpu_access(struct dma_buf *dmabuf,
 {
 	struct ion_buffer *buffer = dmabuf->priv;
 	struct ion_dma_buf_attachment *a;
+	unsigned long size = buffer->size;
+	u64 touched = ION_CMO_ALL, covered = ION_CMO_ALL;
+	bool synced = false;
 	int ret = 0;
 
 	if (!hlos_accessible_buffer(buffer)) {
 		trace_ion_begin_cpu_access_cmo_skip(NULL, dmabuf->buf_name,
 						    ion_buffer_cached(buffer),
 						    false, direction,
-						    sync_only_mapped);
+						    sync_only_mapped, size);
 		ret = -EPERM;
 		goto out;
 	}
@@ -664,12 +801,26 @@ static int __ion_dma_buf_begin_cpu_access(struct dma_buf *dmabuf,
 	if (!(buffer->flags & ION_FLAG_CACHED)) {
 		trace_ion_begin_cpu_access_cmo_skip(NULL, dmabuf->buf_name,
 						    false, true, direction,
-						    sync_only_mapped);
+						    sync_only_mapped, size);
 		goto out;
 	}
 
 	mutex_lock(&buffer->lock);
 
+	if (sync_only_mapped) {
+		touched = ion_cmo_vmas_mask(buffer, false, &size);
+		covered = ion_cmo_vmas_mask(buffer, true, &size);
+	}
+
+	if (!ion_cmo_needs_invalidate(buffer, touched)) {
+		trace_ion_begin_cpu_access_cmo_skip(NULL, dmabuf->buf_name,
+						    true, true, direction,
+						    sync_only_mapped, size);
+		ion_cmo_begin_done(buffer, direction, touched, 0);
+		mutex_unlock(&buffer->lock);
+		goto out;
+	}
+
 	if (IS_ENABLED(CONFIG_ION_FORCE_DMA_SYNC)) {
 		struct device *dev = buffer->heap->priv;
 		struct sg_table *table = buffer->sg_table;
@@ -682,18 +833,22 @@ static int __ion_dma_buf_begin_cpu_access(struct dma_buf *dmabuf,
 			dma_sync_sg_for_cpu(dev, table->sgl,
 					    table->nents, direction);
 
-		if (!ret)
+		if (!ret) {
 			trace_ion_begin_cpu_access_cmo_apply(dev,
 							     dmabuf->buf_name,
 							     true, true,
 							     direction,
-							     sync_only_mapped);
-		else
+							     sync_only_mapped,
+							     size);
+			ion_cmo_begin_done(buffer, direction, touched, covered);
+		} else {
 			trace_ion_begin_cpu_access_cmo_skip(dev,
 							    dmabuf->buf_name,
 							    true, true,
 							    direction,
-							    sync_only_mapped);
+							    sync_only_mapped,
+							    size);
+		}
 		mutex_unlock(&buffer->lock);
 		goto out;
 	}
@@ -706,7 +861,8 @@ static int __ion_dma_buf_begin_cpu_access(struct dma_buf *dmabuf,
 							     dmabuf->buf_name,
 							     true, true,
 							     direction,
-							     sync_only_mapped);
+							     sync_only_mapped,
+							     size);
 			continue;
 		}
 
@@ -720,21 +876,27 @@ static int __ion_dma_buf_begin_cpu_access(struct dma_buf *dmabuf,
 					    a->table->nents, direction);
 
 		if (!tmp) {
+			synced = true;
 			trace_ion_begin_cpu_access_cmo_apply(a->dev,
 							     dmabuf->buf_name,
 							     true, true,
 							     direction,
-							     sync_only_mapped);
+							     sync_only_mapped,
+							     size);
 		} else {
 			trace_ion_begin_cpu_access_cmo_skip(a->dev,
 							    dmabuf->buf_name,
 							    true, true,
 							    direction,
-							    sync_only_mapped);
+							    sync_only_mapped,
+							    size);
 			ret = tmp;
 		}
 
 	}
+	if (!ret)
+		ion_cmo_begin_done(buffer, direction, touched,
+				   synced ? covered : 0);
 	mutex_unlock(&buffer->lock);
 
 out:
@@ -747,13 +909,16 @@ static int __ion_dma_buf_end_cpu_access(struct dma_buf *dmabuf,
 {
 	struct ion_buffer *buffer = dmabuf->priv;
 	struct ion_dma_buf_attachment *a;
+	unsigned long size = buffer->size;
+	u64 touched = ION_CMO_ALL, covered = ION_CMO_ALL;
+	bool synced = false;
 	int ret = 0;
 
 	if (!hlos_accessible_buffer(buffer)) {
 		trace_ion_end_cpu_access_cmo_skip(NULL, dmabuf->buf_name,
 						  ion_buffer_cached(buffer),
 						  false, direction,
-						  sync_only_mapped);
+						  sync_only_mapped, size);
 		ret = -EPERM;
 		goto out;
 	}
@@ -761,11 +926,26 @@ static int __ion_dma_buf_end_cpu_access(struct dma_buf *dmabuf,
 	if (!(buffer->flags & ION_FLAG_CACHED)) {
 		trace_ion_end_cpu_access_cmo_skip(NULL, dmabuf->buf_name, false,
 						  true, direction,
-						  sync_only_mapped);
+						  sync_only_mapped, size);
 		goto out;
 	}
 
 	mutex_lock(&buffer->lock);
+
+	if (sync_only_mapped) {
+		touched = ion_cmo_vmas_mask(buffer, false, &size);
+		covered = ion_cmo_vmas_mask(buffer, true, &size);
+	}
+
+	if (!ion_cmo_needs_clean(buffer, touched)) {
+		trace_ion_end_cpu_access_cmo_skip(NULL, dmabuf->buf_name,
+						  true, true, direction,
+						  sync_only_mapped, size);
+		ion_cmo_end_done(buffer, touched, 0);
+		mutex_unlock(&buffer->lock);
+		goto out;
+	}
+
 	if (IS_ENABLED(CONFIG_ION_FORCE_DMA_SYNC)) {
 		struct device *dev = buffer->heap->priv;
 		struct sg_table *table = buffer->sg_table;
@@ -778,16 +958,20 @@ static int __ion_dma_buf_end_cpu_access(struct dma_buf *dmabuf,
 			dma_sync_sg_for_device(dev, table->sgl,
 					       table->nents, direction);
 
-		if (!ret)
+		if (!ret) {
 			trace_ion_end_cpu_access_cmo_apply(dev,
 							   dmabuf->buf_name,
 							   true, true,
 							   direction,
-							   sync_only_mapped);
-		else
+							   sync_only_mapped,
+							   size);
+			ion_cmo_end_done(buffer, touched, covered);
+		} else {
 			trace_ion_end_cpu_access_cmo_skip(dev, dmabuf->buf_name,
 							  true, true, direction,
-							  sync_only_mapped);
+							  sync_only_mapped,
+							  size);
+		}
 		mutex_unlock(&buffer->lock);
 		goto out;
 	}
@@ -800,7 +984,8 @@ static int __ion_dma_buf_end_cpu_access(struct dma_buf *dmabuf,
 							   dmabuf->buf_name,
 							   true, true,
 							   direction,
-							   sync_only_mapped);
+							   sync_only_mapped,
+							   size);
 			continue;
 		}
 
@@ -814,19 +999,23 @@ static int __ion_dma_buf_end_cpu_access(struct dma_buf *dmabuf,
 					       a->table->nents, direction);
 
 		if (!tmp) {
+			synced = true;
 			trace_ion_end_cpu_access_cmo_apply(a->dev,
 							   dmabuf->buf_name,
 							   true, true,
 							   direction,
-							   sync_only_mapped);
+							   sync_only_mapped,
+							   size);
 		} else {
 			trace_ion_end_cpu_access_cmo_skip(a->dev,
 							  dmabuf->buf_name,
 							  true, true, direction,
-							  sync_only_mapped);
+							  sync_only_mapped,
+							  size);
 			ret = tmp;
 		}
 	}
+	ion_cmo_end_done(buffer, touched, !ret && synced ? covered : 0);
 	mutex_unlock(&buffer->lock);
 
 out:
@@ -864,13 +1053,15 @@ static int ion_dma_buf_begin_cpu_access_partial(struct dma_buf *dmabuf,
 {
 	struct ion_buffer *buffer = dmabuf->priv;
 	struct ion_dma_buf_attachment *a;
+	u64 touched, covered;
+	bool synced = false;
 	int ret = 0;
 
 	if (!hlos_accessible_buffer(buffer)) {
 		trace_ion_begin_cpu_access_cmo_skip(NULL, dmabuf->buf_name,
 						    ion_buffer_cached(buffer),
 						    false, dir,
-						    false);
+						    false, len);
 		ret = -EPERM;
 		goto out;
 	}
@@ -878,11 +1069,23 @@ static int ion_dma_buf_begin_cpu_access_partial(struct dma_buf *dmabuf,
 	if (!(buffer->flags & ION_FLAG_CACHED)) {
 		trace_ion_begin_cpu_access_cmo_skip(NULL, dmabuf->buf_name,
 						    false, true, dir,
-						    false);
+						    false, len);
 		goto out;
 	}
 
 	mutex_lock(&buffer->lock);
+	touched = ion_cmo_mask(buffer, offset, len, false);
+	covered = ion_cmo_mask(buffer, offset, len, true);
+
+	if (!ion_cmo_needs_invalidate(buffer, touched)) {
+		trace_ion_begin_cpu_access_cmo_skip(NULL, dmabuf->buf_name,
+						    true, true, dir,
+						    false, len);
+		ion_cmo_begin_done(buffer, dir, touched, 0);
+		mutex_unlock(&buffer->lock);
+		goto out;
+	}
+
 	if (IS_ENABLED(CONFIG_ION_FORCE_DMA_SYNC)) {
 		struct device *dev = buffer->heap->priv;
 		struct sg_table *table = buffer->sg_table;
@@ -890,16 +1093,18 @@ static int ion_dma_buf_begin_cpu_access_partial(struct dma_buf *dmabuf,
 		ret = ion_sgl_sync_range(dev, table->sgl, table->nents,
 					 offset, len, dir, true);
 
-		if (!ret)
+		if (!ret) {
 			trace_ion_begin_cpu_access_cmo_apply(dev,
 							     dmabuf->buf_name,
 							     true, true, dir,
-							     false);
-		else
+							     false, len);
+			ion_cmo_begin_done(buffer, dir, touched, covered);
+		} else {
 			trace_ion_begin_cpu_access_cmo_skip(dev,
 							    dmabuf->buf_name,
 							    true, true, dir,
-							    false);
+							    false, len);
+		}
 		mutex_unlock(&buffer->lock);
 		goto out;
 	}
@@ -912,7 +1117,7 @@ static int ion_dma_buf_begin_cpu_access_partial(struct dma_buf *dmabuf,
 							     dmabuf->buf_name,
 							     true, true,
 							     dir,
-							     false);
+							     false, len);
 			continue;
 		}
 
@@ -920,19 +1125,23 @@ static int ion_dma_buf_begin_cpu_access_partial(struct dma_buf *dmabuf,
 					 offset, len, dir, true);
 
 		if (!tmp) {
+			synced = true;
 			trace_ion_begin_cpu_access_cmo_apply(a->dev,
 							     dmabuf->buf_name,
 							     true, true, dir,
-							     false);
+							     false, len);
 		} else {
 			trace_ion_begin_cpu_access_cmo_skip(a->dev,
 							    dmabuf->buf_name,
 							    true, true, dir,
-							    false);
+							    false, len);
 			ret = tmp;
 		}
 
 	}
+	if (!ret)
+		ion_cmo_begin_done(buffer, dir, touched,
+				   synced ? covered : 0);
 	mutex_unlock(&buffer->lock);
 
 out:
@@ -946,13 +1155,15 @@ static int ion_dma_buf_end_cpu_access_partial(struct dma_buf *dmabuf,
 {
 	struct ion_buffer *buffer = dmabuf->priv;
 	struct ion_dma_buf_attachment *a;
+	u64 touched, covered;
+	bool synced = false;
 	int ret = 0;
 
 	if (!hlos_accessible_buffer(buffer)) {
 		trace_ion_end_cpu_access_cmo_skip(NULL, dmabuf->buf_name,
 						  ion_buffer_cached(buffer),
 						  false, direction,
-						  false);
+						  false, len);
 		ret = -EPERM;
 		goto out;
 	}
@@ -960,11 +1171,23 @@ static int ion_dma_buf_end_cpu_access_partial(struct dma_buf *dmabuf,
 	if (!(buffer->flags & ION_FLAG_CACHED)) {
 		trace_ion_end_cpu_access_cmo_skip(NULL, dmabuf->buf_name, false,
 						  true, direction,
-						  false);
+						  false, len);
 		goto out;
 	}
 
 	mutex_lock(&buffer->lock);
+	touched = ion_cmo_mask(buffer, offset, len, false);
+	covered = ion_cmo_mask(buffer, offset, len, true);
+
+	if (!ion_cmo_needs_clean(buffer, touched)) {
+		trace_ion_end_cpu_access_cmo_skip(NULL, dmabuf->buf_name,
+						  true, true, direction,
+						  false, len);
+		ion_cmo_end_done(buffer, touched, 0);
+		mutex_unlock(&buffer->lock);
+		goto out;
+	}
+
 	if (IS_ENABLED(CONFIG_ION_FORCE_DMA_SYNC)) {
 		struct device *dev = buffer->heap->priv;
 		struct sg_table *table = buffer->sg_table;
@@ -972,15 +1195,19 @@ static int ion_dma_buf_end_cpu_access_partial(struct dma_buf *dmabuf,
 		ret = ion_sgl_sync_range(dev, table->sgl, table->nents,
 					 offset, len, direction, false);
 
-		if (!ret)
+		if (!ret) {
 			trace_ion_end_cpu_access_cmo_apply(dev,
 							   dmabuf->buf_name,
 							   true, true,
-							   direction, false);
-		else
+							   direction, false,
+							   len);
+			ion_cmo_end_done(buffer, touched, covered);
+		} else {
 			trace_ion_end_cpu_access_cmo_skip(dev, dmabuf->buf_name,
 							  true, true,
-							  direction, false);
+							  direction, false,
+							  len);
+		}
 
 		mutex_unlock(&buffer->lock);
 		goto out;
@@ -994,7 +1221,7 @@ static int ion_dma_buf_end_cpu_access_partial(struct dma_buf *dmabuf,
 							   dmabuf->buf_name,
 							   true, true,
 							   direction,
-							   false);
+							   false, len);
 			continue;
 		}
 
@@ -1002,19 +1229,22 @@ static int ion_dma_buf_end_cpu_access_partial(struct dma_buf *dmabuf,
 					 offset, len, direction, false);
 
 		if (!tmp) {
+			synced = true;
 			trace_ion_end_cpu_access_cmo_apply(a->dev,
 							   dmabuf->buf_name,
 							   true, true,
-							   direction, false);
+							   direction, false,
+							   len);
 
 		} else {
 			trace_ion_end_cpu_access_cmo_skip(a->dev,
 							  dmabuf->buf_name,
 							  true, true, direction,
-							  false);
+							  false, len);
 			ret = tmp;
 		}
 	}
+	ion_cmo_end_done(buffer, touched, !ret && synced ? covered : 0);
 	mutex_unlock(&buffer->lock);
 
 out:
@@ -1298,6 +1528,9 @@ void ion_device_add_heap(struct ion_device *dev, struct ion_heap *heap)
 
 	dev->heap_cnt++;
 	up_write(&dev->lock);
+
+	if (heap->type == ION_HEAP_TYPE_SYSTEM)
+		ion_system_dma_heap_register(heap);
 }
 EXPORT_SYMBOL(ion_device_add_heap);
 
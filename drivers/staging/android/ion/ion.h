@@ -138,6 +138,11 @@ struct ion_buffer {
 	struct sg_table *sg_table;
 	struct list_head attachments;
 	struct list_head vmas;
+	/* Cache maintenance state, see ion_buffer_cmo_init() */
+	u64 cpu_dirty;
+	u64 dev_dirty;
+	unsigned int cmo_chunk_shift;
+	int dev_writers;
 };
 
 void ion_buffer_destroy(struct ion_buffer *buffer);
@@ -379,6 +384,16 @@ size_t ion_heap_freelist_size(struct ion_heap *heap);
 struct ion_heap *ion_heap_create(struct ion_platform_heap *heap_data);
 
 struct ion_heap *ion_system_heap_create(struct ion_platform_heap *unused);
+
+#ifdef CONFIG_DMABUF_HEAPS_SYSTEM
+int ion_system_dma_heap_register(struct ion_heap *heap);
+#else
+static inline int ion_system_dma_heap_register(struct ion_heap *heap)
+{
+	return 0;
+}
+#endif
+
 struct ion_heap *ion_system_contig_heap_create(struct ion_platform_heap *heap);
 
 struct ion_heap *ion_carveout_heap_create(struct ion_platform_heap *heap_data);
@@ -0,0 +1,598 @@
+/*
+ * drivers/staging/android/ion/ion_system_dma_heap.c
+ *
+ * Copyright (c) 2020, The Linux Foundation. All rights reserved.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/dma-buf.h>
+#include <linux/dma-heap.h>
+#include <linux/dma-mapping.h>
+#include <linux/err.h>
+#include <linux/highmem.h>
+#include <linux/mm.h>
+#include <linux/scatterlist.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include "ion.h"
+#include "ion_system_heap.h"
+
+/*
+ * Exports the pools of the ION system heap as the "system" (cached) and
+ * "system-uncached" DMA-BUF heaps. The buffers skip the ion_buffer
+ * bookkeeping (heap id masks, the global buffer rbtree, deferred free)
+ * but draw from and return to the very same page pools, so ION and
+ * dma-heap clients keep each other's pools warm.
+ */
+
+struct ion_dma_heap {
+	struct ion_system_heap *sys_heap;
+	bool cached;
+};
+
+struct ion_dma_heap_buffer {
+	struct ion_dma_heap *heap;
+	struct list_head attachments;
+	struct mutex lock;
+	unsigned long len;
+	struct sg_table sg_table;
+	int vmap_cnt;
+	void *vaddr;
+};
+
+struct ion_dma_heap_attachment {
+	struct device *dev;
+	struct sg_table table;
+	struct list_head list;
+	bool mapped;
+};
+
+static struct ion_dma_heap ion_dma_heaps[2];
+
+static struct ion_page_pool *ion_dma_heap_pool(struct ion_dma_heap *heap,
+					       unsigned int order)
+{
+	if (heap->cached)
+		return heap->sys_heap->cached_pools[order_to_index(order)];
+	return heap->sys_heap->uncached_pools[order_to_index(order)];
+}
+
+static pgprot_t ion_dma_heap_pgprot(struct ion_dma_heap *heap, pgprot_t prot)
+{
+	return heap->cached ? prot : pgprot_writecombine(prot);
+}
+
+static struct page_info *ion_dma_heap_alloc_largest(struct ion_dma_heap *heap,
+						    unsigned long size,
+						    unsigned int max_order)
+{
+	struct device *dev = heap->sys_heap->heap.priv;
+	struct page_info *info;
+	struct page *page;
+	bool from_pool;
+	int i;
+
+	info = kmalloc(sizeof(*info), GFP_KERNEL);
+	if (!info)
+		return NULL;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		if (size < (PAGE_SIZE << orders[i]))
+			continue;
+		if (max_order < orders[i])
+			continue;
+
+		from_pool = true;
+		page = ion_page_pool_alloc(ion_dma_heap_pool(heap, orders[i]),
+					   &from_pool);
+		if (IS_ERR(page))
+			continue;
+
+		if (MAKE_ION_ALLOC_DMA_READY || !from_pool)
+			ion_pages_sync_for_device(dev, page,
+						  PAGE_SIZE << orders[i],
+						  DMA_BIDIRECTIONAL);
+		mod_node_page_state(page_pgdat(page), NR_UNRECLAIMABLE_PAGES,
+				    1 << orders[i]);
+
+		info->page = page;
+		info->order = orders[i];
+		info->from_pool = from_pool;
+		INIT_LIST_HEAD(&info->list);
+		return info;
+	}
+	kfree(info);
+
+	return NULL;
+}
+
+static void ion_dma_heap_free_page(struct ion_dma_heap *heap,
+				   struct page *page, unsigned int order)
+{
+	ion_page_pool_free(ion_dma_heap_pool(heap, order), page);
+	mod_node_page_state(page_pgdat(page), NR_UNRECLAIMABLE_PAGES,
+			    -(1 << order));
+}
+
+static int ion_dma_heap_attach(struct dma_buf *dmabuf,
+			       struct device *dev,
+			       struct dma_buf_attachment *attachment)
+{
+	struct ion_dma_heap_buffer *buffer = dmabuf->priv;
+	struct ion_dma_heap_attachment *a;
+	struct scatterlist *sg, *new_sg;
+	int i, ret;
+
+	a = kzalloc(sizeof(*a), GFP_KERNEL);
+	if (!a)
+		return -ENOMEM;
+
+	ret = sg_alloc_table(&a->table, buffer->sg_table.orig_nents,
+			     GFP_KERNEL);
+	if (ret) {
+		kfree(a);
+		return ret;
+	}
+
+	new_sg = a->table.sgl;
+	for_each_sg(buffer->sg_table.sgl, sg, buffer->sg_table.orig_nents, i) {
+		sg_set_page(new_sg, sg_page(sg), sg->length, sg->offset);
+		new_sg = sg_next(new_sg);
+	}
+
+	a->dev = dev;
+	INIT_LIST_HEAD(&a->list);
+	attachment->priv = a;
+
+	mutex_lock(&buffer->lock);
+	list_add(&a->list, &buffer->attachments);
+	mutex_unlock(&buffer->lock);
+
+	return 0;
+}
+
+static void ion_dma_heap_detach(struct dma_buf *dmabuf,
+				struct dma_buf_attachment *attachment)
+{
+	struct ion_dma_heap_buffer *buffer = dmabuf->priv;
+	struct ion_dma_heap_attachment *a = attachment->priv;
+
+	mutex_lock(&buffer->lock);
+	list_del(&a->list);
+	mutex_unlock(&buffer->lock);
+
+	sg_free_table(&a->table);
+	kfree(a);
+}
+
+static struct sg_table *
+ion_dma_heap_map_dma_buf(struct dma_buf_attachment *attachment,
+			 enum dma_data_direction direction)
+{
+	struct ion_dma_heap_buffer *buffer = attachment->dmabuf->priv;
+	struct ion_dma_heap_attachment *a = attachment->priv;
+	struct sg_table *table = &a->table;
+	unsigned long attrs = attachment->dma_map_attrs;
+	int nents;
+
+	if (!buffer->heap->cached)
+		attrs |= DMA_ATTR_SKIP_CPU_SYNC;
+
+	nents = dma_map_sg_attrs(attachment->dev, table->sgl, table->nents,
+				 direction, attrs);
+	if (!nents)
+		return ERR_PTR(-ENOMEM);
+
+	mutex_lock(&buffer->lock);
+	a->mapped = true;
+	mutex_unlock(&buffer->lock);
+
+	return table;
+}
+
+static void ion_dma_heap_unmap_dma_buf(struct dma_buf_attachment *attachment,
+				       struct sg_table *table,
+				       enum dma_data_direction direction)
+{
+	struct ion_dma_heap_buffer *buffer = attachment->dmabuf->priv;
+	struct ion_dma_heap_attachment *a = attachment->priv;
+	unsigned long attrs = attachment->dma_map_attrs;
+
+	if (!buffer->heap->cached)
+		attrs |= DMA_ATTR_SKIP_CPU_SYNC;
+
+	mutex_lock(&buffer->lock);
+	a->mapped = false;
+	mutex_unlock(&buffer->lock);
+
+	dma_unmap_sg_attrs(attachment->dev, table->sgl, table->nents,
+			   direction, attrs);
+}
+
+static int ion_dma_heap_begin_cpu_access(struct dma_buf *dmabuf,
+					 enum dma_data_direction direction)
+{
+	struct ion_dma_heap_buffer *buffer = dmabuf->priv;
+	struct ion_dma_heap_attachment *a;
+
+	if (!buffer->heap->cached)
+		return 0;
+
+	mutex_lock(&buffer->lock);
+	if (buffer->vmap_cnt)
+		invalidate_kernel_vmap_range(buffer->vaddr, buffer->len);
+
+	list_for_each_entry(a, &buffer->attachments, list) {
+		if (!a->mapped)
+			continue;
+		dma_sync_sg_for_cpu(a->dev, a->table.sgl, a->table.nents,
+				    direction);
+	}
+	mutex_unlock(&buffer->lock);
+
+	return 0;
+}
+
+static int ion_dma_heap_end_cpu_access(struct dma_buf *dmabuf,
+				       enum dma_data_direction direction)
+{
+	struct ion_dma_heap_buffer *buffer = dmabuf->priv;
+	struct ion_dma_heap_attachment *a;
+
+	if (!buffer->heap->cached)
+		return 0;
+
+	mutex_lock(&buffer->lock);
+	if (buffer->vmap_cnt)
+		flush_kernel_vmap_range(buffer->vaddr, buffer->len);
+
+	list_for_each_entry(a, &buffer->attachments, list) {
+		if (!a->mapped)
+			continue;
+		dma_sync_sg_for_device(a->dev, a->table.sgl, a->table.nents,
+				       direction);
+	}
+	mutex_unlock(&buffer->lock);
+
+	return 0;
+}
+
+static int ion_dma_heap_mmap(struct dma_buf *dmabuf,
+			     struct vm_area_struct *vma)
+{
+	struct ion_dma_heap_buffer *buffer = dmabuf->priv;
+	struct sg_table *table = &buffer->sg_table;
+	unsigned long addr = vma->vm_start;
+	unsigned long offset = vma->vm_pgoff * PAGE_SIZE;
+	struct scatterlist *sg;
+	int i, ret;
+
+	vma->vm_page_prot = ion_dma_heap_pgprot(buffer->heap,
+						vma->vm_page_prot);
+
+	for_each_sg(table->sgl, sg, table->nents, i) {
+		struct page *page = sg_page(sg);
+		unsigned long remainder = vma->vm_end - addr;
+		unsigned long len = sg->length;
+
+		if (offset >= sg->length) {
+			offset -= sg->length;
+			continue;
+		} else if (offset) {
+			page += offset / PAGE_SIZE;
+			len = sg->length - offset;
+			offset = 0;
+		}
+		len = min(len, remainder);
+		ret = remap_pfn_range(vma, addr, page_to_pfn(page), len,
+				      vma->vm_page_prot);
+		if (ret)
+			return ret;
+		addr += len;
+		if (addr >= vma->vm_end)
+			return 0;
+	}
+
+	return 0;
+}
+
+static void *ion_dma_heap_do_vmap(struct ion_dma_heap_buffer *buffer)
+{
+	struct sg_table *table = &buffer->sg_table;
+	int npages = PAGE_ALIGN(buffer->len) / PAGE_SIZE;
+	struct page **pages, **tmp;
+	struct scatterlist *sg;
+	void *vaddr;
+	int i, j;
+
+	pages = vmalloc(sizeof(struct page *) * npages);
+	if (!pages)
+		return ERR_PTR(-ENOMEM);
+
+	tmp = pages;
+	for_each_sg(table->sgl, sg, table->nents, i) {
+		int npages_this_entry = PAGE_ALIGN(sg->length) / PAGE_SIZE;
+		struct page *page = sg_page(sg);
+
+		for (j = 0; j < npages_this_entry; j++)
+			*(tmp++) = page++;
+	}
+
+	vaddr = vmap(pages, npages, VM_MAP,
+		     ion_dma_heap_pgprot(buffer->heap, PAGE_KERNEL));
+	vfree(pages);
+
+	if (!vaddr)
+		return ERR_PTR(-ENOMEM);
+
+	return vaddr;
+}
+
+static void *ion_dma_heap_vmap(struct dma_buf *dmabuf)
+{
+	struct ion_dma_heap_buffer *buffer = dmabuf->priv;
+	void *vaddr;
+
+	mutex_lock(&buffer->lock);
+	if (buffer->vmap_cnt) {
+		buffer->vmap_cnt++;
+		vaddr = buffer->vaddr;
+		goto out;
+	}
+
+	vaddr = ion_dma_heap_do_vmap(buffer);
+	if (IS_ERR(vaddr)) {
+		vaddr = NULL;
+		goto out;
+	}
+
+	buffer->vaddr = vaddr;
+	buffer->vmap_cnt++;
+out:
+	mutex_unlock(&buffer->lock);
+
+	return vaddr;
+}
+
+static void ion_dma_heap_vunmap(struct dma_buf *dmabuf, void *vaddr)
+{
+	struct ion_dma_heap_buffer *buffer = dmabuf->priv;
+
+	mutex_lock(&buffer->lock);
+	if (!--buffer->vmap_cnt) {
+		vunmap(buffer->vaddr);
+		buffer->vaddr = NULL;
+	}
+	mutex_unlock(&buffer->lock);
+}
+
+static struct page *ion_dma_heap_nth_page(struct ion_dma_heap_buffer *buffer,
+					  unsigned long page_num)
+{
+	struct scatterlist *sg;
+	int i;
+
+	for_each_sg(buffer->sg_table.sgl, sg, buffer->sg_table.nents, i) {
+		unsigned long npages = sg->length >> PAGE_SHIFT;
+
+		if (page_num < npages)
+			return nth_page(sg_page(sg), page_num);
+		page_num -= npages;
+	}
+
+	return NULL;
+}
+
+static void *ion_dma_heap_kmap(struct dma_buf *dmabuf, unsigned long page_num)
+{
+	struct ion_dma_heap_buffer *buffer = dmabuf->priv;
+	struct page *page = ion_dma_heap_nth_page(buffer, page_num);
+
+	return page ? kmap(page) : NULL;
+}
+
+static void ion_dma_heap_kunmap(struct dma_buf *dmabuf,
+				unsigned long page_num, void *vaddr)
+{
+	struct ion_dma_heap_buffer *buffer = dmabuf->priv;
+	struct page *page = ion_dma_heap_nth_page(buffer, page_num);
+
+	if (page)
+		kunmap(page);
+}
+
+static int ion_dma_heap_get_flags(struct dma_buf *dmabuf,
+				  unsigned long *flags)
+{
+	struct ion_dma_heap_buffer *buffer = dmabuf->priv;
+
+	*flags = buffer->heap->cached ? ION_FLAG_CACHED : 0;
+	return 0;
+}
+
+static void ion_dma_heap_free_pages(struct ion_dma_heap *heap,
+				    struct sg_table *table, bool zero)
+{
+	pgprot_t pgprot = ion_dma_heap_pgprot(heap, PAGE_KERNEL);
+	struct scatterlist *sg;
+	int i;
+
+	for_each_sg(table->sgl, sg, table->nents, i) {
+		struct page *page = sg_page(sg);
+
+		/* Pools hand out zeroed pages, so scrub before returning */
+		if (zero)
+			ion_heap_pages_zero(page, sg->length, pgprot);
+		ion_dma_heap_free_page(heap, page, get_order(sg->length));
+	}
+}
+
+static void ion_dma_heap_release(struct dma_buf *dmabuf)
+{
+	struct ion_dma_heap_buffer *buffer = dmabuf->priv;
+
+	ion_dma_heap_free_pages(buffer->heap, &buffer->sg_table, true);
+	sg_free_table(&buffer->sg_table);
+	kfree(buffer);
+}
+
+static const struct dma_buf_ops ion_dma_heap_buf_ops = {
+	.attach = ion_dma_heap_attach,
+	.detach = ion_dma_heap_detach,
+	.map_dma_buf = ion_dma_heap_map_dma_buf,
+	.unmap_dma_buf = ion_dma_heap_unmap_dma_buf,
+	.begin_cpu_access = ion_dma_heap_begin_cpu_access,
+	.end_cpu_access = ion_dma_heap_end_cpu_access,
+	.mmap = ion_dma_heap_mmap,
+	.vmap = ion_dma_heap_vmap,
+	.vunmap = ion_dma_heap_vunmap,
+	.map = ion_dma_heap_kmap,
+	.unmap = ion_dma_heap_kunmap,
+	.map_atomic = ion_dma_heap_kmap,
+	.unmap_atomic = ion_dma_heap_kunmap,
+	.release = ion_dma_heap_release,
+	.get_flags = ion_dma_heap_get_flags,
+};
+
+static int ion_dma_heap_allocate(struct dma_heap *dma_heap,
+				 unsigned long len,
+				 unsigned long fd_flags,
+				 unsigned long heap_flags)
+{
+	struct ion_dma_heap *heap = dma_heap_get_drvdata(dma_heap);
+	struct ion_dma_heap_buffer *buffer;
+	DEFINE_DMA_BUF_EXPORT_INFO(exp_info);
+	unsigned long size_remaining = len;
+	unsigned int max_order = orders[0];
+	struct dma_buf *dmabuf;
+	struct sg_table *table;
+	struct scatterlist *sg;
+	struct list_head pages;
+	struct page_info *info, *tmp_info;
+	int i = 0;
+	int ret = -ENOMEM;
+
+	if (len / PAGE_SIZE > totalram_pages / 2)
+		return -ENOMEM;
+
+	buffer = kzalloc(sizeof(*buffer), GFP_KERNEL);
+	if (!buffer)
+		return -ENOMEM;
+
+	INIT_LIST_HEAD(&buffer->attachments);
+	mutex_init(&buffer->lock);
+	buffer->heap = heap;
+	buffer->len = len;
+
+	INIT_LIST_HEAD(&pages);
+	while (size_remaining > 0) {
+		if (fatal_signal_pending(current)) {
+			ret = -EINTR;
+			goto free_pages;
+		}
+
+		info = ion_dma_heap_alloc_largest(heap, size_remaining,
+						  max_order);
+		if (!info)
+			goto free_pages;
+
+		list_add_tail(&info->list, &pages);
+		size_remaining -= PAGE_SIZE << info->order;
+		max_order = info->order;
+		i++;
+	}
+
+	table = &buffer->sg_table;
+	if (sg_alloc_table(table, i, GFP_KERNEL))
+		goto free_pages;
+
+	sg = table->sgl;
+	list_for_each_entry_safe(info, tmp_info, &pages, list) {
+		sg_set_page(sg, info->page, PAGE_SIZE << info->order, 0);
+		/*
+		 * Same shortcut as the ION system heap: the physical address
+		 * stands in for the DMA address until a device maps it.
+		 */
+		sg_dma_address(sg) = page_to_phys(info->page);
+		sg = sg_next(sg);
+		list_del(&info->list);
+		kfree(info);
+	}
+
+	exp_info.exp_name = dma_heap_get_name(dma_heap);
+	exp_info.ops = &ion_dma_heap_buf_ops;
+	exp_info.size = buffer->len;
+	exp_info.flags = fd_flags;
+	exp_info.priv = buffer;
+	dmabuf = dma_buf_export(&exp_info);
+	if (IS_ERR(dmabuf)) {
+		ret = PTR_ERR(dmabuf);
+		goto free_table;
+	}
+
+	ret = dma_buf_fd(dmabuf, fd_flags);
+	if (ret < 0)
+		/* release takes care of the pages and the buffer */
+		dma_buf_put(dmabuf);
+
+	return ret;
+
+free_table:
+	ion_dma_heap_free_pages(heap, table, false);
+	sg_free_table(table);
+	kfree(buffer);
+	return ret;
+
+free_pages:
+	list_for_each_entry_safe(info, tmp_info, &pages, list) {
+		ion_dma_heap_free_page(heap, info->page, info->order);
+		kfree(info);
+	}
+	kfree(buffer);
+	return ret;
+}
+
+static const struct dma_heap_ops ion_dma_heap_ops = {
+	.allocate = ion_dma_heap_allocate,
+};
+
+int ion_system_dma_heap_register(struct ion_heap *heap)
+{
+	struct ion_system_heap *sys_heap = container_of(heap,
+							struct ion_system_heap,
+							heap);
+	struct dma_heap_export_info exp_info;
+	struct dma_heap *dma_heap;
+	int i;
+
+	/* Only the first system heap backs the dma-buf heaps */
+	if (ion_dma_heaps[0].sys_heap)
+		return -EEXIST;
+
+	for (i = 0; i < ARRAY_SIZE(ion_dma_heaps); i++) {
+		ion_dma_heaps[i].sys_heap = sys_heap;
+		ion_dma_heaps[i].cached = (i == 0);
+
+		exp_info.name = i == 0 ? "system" : "system-uncached";
+		exp_info.ops = &ion_dma_heap_ops;
+		exp_info.priv = &ion_dma_heaps[i];
+
+		dma_heap = dma_heap_add(&exp_info);
+		if (IS_ERR(dma_heap)) {
+			pr_err("%s: failed to add dma heap %s: %ld\n",
+			       __func__, exp_info.name, PTR_ERR(dma_heap));
+			return PTR_ERR(dma_heap);
+		}
+	}
+
+	return 0;
+}
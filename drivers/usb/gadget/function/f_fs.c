@@ -19,11 +19,14 @@
 /* #define VERBOSE_DEBUG */
 
 #include <linux/blkdev.h>
+#include <linux/debugfs.h>
 #include <linux/pagemap.h>
 #include <linux/export.h>
 #include <linux/hid.h>
 #include <linux/module.h>
 #include <linux/sched/signal.h>
+#include <linux/scatterlist.h>
+#include <linux/seq_file.h>
 #include <linux/uio.h>
 #include <asm/unaligned.h>
 
@@ -44,6 +47,14 @@
 
 #define NUM_PAGES	10 /* # of pages for ipc logging */
 
+/*
+ * Transfers of at least FFS_SG_MIN_LEN are done straight from/to the
+ * pinned user pages if the UDC supports scatter-gather, instead of being
+ * bounced through a kmalloc'ed buffer.
+ */
+#define FFS_SG_MIN_LEN		(4 * PAGE_SIZE)
+#define FFS_SG_MAX_PAGES	64
+
 #ifdef CONFIG_DYNAMIC_DEBUG
 #define ffs_log(fmt, ...) do { \
 	dynamic_pr_debug("%s: " fmt, __func__, ##__VA_ARGS__); \
@@ -229,11 +240,17 @@ struct ffs_io_data {
 	char *buf;
 
 	struct mm_struct *mm;
-	struct work_struct work;
+	struct llist_node done_node;
 
 	struct usb_ep *ep;
 	struct usb_request *req;
 
+	/* Pinned user pages, valid if use_sg */
+	bool use_sg;
+	struct page **pages;
+	unsigned int n_pages;
+	struct sg_table sgt;
+
 	struct ffs_data *ffs;
 };
 
@@ -749,6 +766,101 @@ static const struct file_operations ffs_ep0_operations = {
 
 /* "Normal" endpoints operations ********************************************/
 
+static struct ffs_ep_stats *ffs_epfile_stats(struct ffs_epfile *epfile)
+{
+	return &epfile->ffs->ep_stats[epfile - epfile->ffs->epfiles];
+}
+
+/*
+ * Throughput is accounted over the time the endpoint had at least one
+ * request queued, so overlapping AIO requests are not counted twice.
+ */
+static void ffs_ep_stats_queued(struct ffs_ep_stats *stats)
+{
+	if (atomic_inc_return(&stats->inflight) == 1)
+		stats->active_start = ktime_get();
+}
+
+static void ffs_ep_stats_done(struct ffs_ep_stats *stats, int actual,
+			      bool sg)
+{
+	if (actual > 0)
+		atomic64_add(actual, &stats->bytes);
+	atomic_inc(&stats->reqs);
+	if (sg)
+		atomic_inc(&stats->sg_reqs);
+	if (atomic_dec_and_test(&stats->inflight))
+		atomic64_add(ktime_to_ns(ktime_sub(ktime_get(),
+						   stats->active_start)),
+			     &stats->active_ns);
+}
+
+static void ffs_put_user_pages(struct ffs_io_data *io_data, bool dirty)
+{
+	unsigned int i;
+
+	for (i = 0; i < io_data->n_pages; i++) {
+		if (dirty)
+			set_page_dirty_lock(io_data->pages[i]);
+		put_page(io_data->pages[i]);
+	}
+	kvfree(io_data->pages);
+	io_data->pages = NULL;
+}
+
+static void ffs_release_user_sg(struct ffs_io_data *io_data)
+{
+	if (!io_data->use_sg)
+		return;
+
+	sg_free_table(&io_data->sgt);
+	ffs_put_user_pages(io_data, io_data->read);
+	io_data->use_sg = false;
+}
+
+/*
+ * Pins the user buffer and builds an sg list over it so the UDC can DMA
+ * to/from it directly.  Returns false if the transfer has to go through
+ * a bounce buffer instead.  Reads only qualify if no alignment padding
+ * was added, since excess data would otherwise land in user memory.
+ */
+static bool ffs_epfile_use_sg(struct ffs_epfile *epfile,
+			      struct usb_gadget *gadget,
+			      struct ffs_io_data *io_data, size_t len)
+{
+	struct iov_iter *iter = &io_data->data;
+	size_t start;
+	ssize_t got;
+
+	if (!gadget || !gadget->sg_supported || epfile->isoc ||
+	    len < FFS_SG_MIN_LEN || !iter_is_iovec(iter) ||
+	    iter->nr_segs != 1 || iov_iter_count(iter) != len)
+		return false;
+
+	got = iov_iter_get_pages_alloc(iter, &io_data->pages, len, &start);
+	if (got <= 0)
+		return false;
+
+	io_data->n_pages = DIV_ROUND_UP(got + start, PAGE_SIZE);
+	if (got != len || io_data->n_pages > FFS_SG_MAX_PAGES)
+		goto fallback;
+
+	if (sg_alloc_table_from_pages(&io_data->sgt, io_data->pages,
+				      io_data->n_pages, start, len,
+				      GFP_KERNEL))
+		goto fallback;
+
+	if (!io_data->read)
+		iov_iter_advance(iter, len);
+
+	io_data->use_sg = true;
+	return true;
+
+fallback:
+	ffs_put_user_pages(io_data, false);
+	return false;
+}
+
 static void ffs_epfile_io_complete(struct usb_ep *_ep, struct usb_request *req)
 {
 	ENTER();
@@ -802,18 +914,23 @@ static ssize_t ffs_copy_to_iter(void *data, int data_len, struct iov_iter *iter)
 	return ret;
 }
 
-static void ffs_user_copy_worker(struct work_struct *work)
+/*
+ * Completes one finished AIO request.  Returns true if the completion
+ * is to be signalled on the function's eventfd.
+ */
+static bool ffs_user_copy_one(struct ffs_io_data *io_data)
 {
-	struct ffs_io_data *io_data = container_of(work, struct ffs_io_data,
-						   work);
 	struct ffs_data *ffs = io_data->ffs;
+	struct ffs_epfile *epfile = io_data->kiocb->ki_filp->private_data;
 	int ret = io_data->req->status ? io_data->req->status :
 					 io_data->req->actual;
 	bool kiocb_has_eventfd = io_data->kiocb->ki_flags & IOCB_EVENTFD;
 
 	ffs_log("enter: ret %d for %s", ret, io_data->read ? "read" : "write");
 
-	if (io_data->read && ret > 0) {
+	ffs_ep_stats_done(ffs_epfile_stats(epfile), ret, io_data->use_sg);
+
+	if (io_data->read && ret > 0 && !io_data->use_sg) {
 		mm_segment_t oldfs = get_fs();
 
 		set_fs(USER_DS);
@@ -823,10 +940,9 @@ static void ffs_user_copy_worker(struct work_struct *work)
 		set_fs(oldfs);
 	}
 
-	io_data->kiocb->ki_complete(io_data->kiocb, ret, ret);
+	ffs_release_user_sg(io_data);
 
-	if (io_data->ffs->ffs_eventfd && !kiocb_has_eventfd)
-		eventfd_signal(io_data->ffs->ffs_eventfd, 1);
+	io_data->kiocb->ki_complete(io_data->kiocb, ret, ret);
 
 	usb_ep_free_request(io_data->ep, io_data->req);
 
@@ -836,6 +952,39 @@ static void ffs_user_copy_worker(struct work_struct *work)
 	kfree(io_data);
 
 	ffs_log("exit");
+
+	return ffs->ffs_eventfd && !kiocb_has_eventfd;
+}
+
+/*
+ * Requests submitted together by one io_submit() tend to finish
+ * together, so all completions pending at the time the work runs are
+ * handled in one go and the eventfd is signalled once for the batch.
+ */
+static void ffs_user_copy_worker(struct work_struct *work)
+{
+	struct ffs_data *ffs = container_of(work, struct ffs_data,
+					    io_done_work);
+	struct ffs_io_data *io_data, *tmp;
+	struct llist_node *done;
+	unsigned int nr = 0, nr_signal = 0;
+
+	/* llist_add() pushes at the head, restore completion order */
+	done = llist_reverse_order(llist_del_all(&ffs->io_done));
+
+	llist_for_each_entry_safe(io_data, tmp, done, done_node) {
+		if (ffs_user_copy_one(io_data))
+			nr_signal++;
+		nr++;
+	}
+
+	if (nr_signal)
+		eventfd_signal(ffs->ffs_eventfd, nr_signal);
+
+	if (nr) {
+		ffs->aio_batches++;
+		ffs->aio_max_batch = max(ffs->aio_max_batch, nr);
+	}
 }
 
 static void ffs_epfile_async_io_complete(struct usb_ep *_ep,
@@ -848,8 +997,8 @@ static void ffs_epfile_async_io_complete(struct usb_ep *_ep,
 
 	ffs_log("enter");
 
-	INIT_WORK(&io_data->work, ffs_user_copy_worker);
-	queue_work(ffs->io_completion_wq, &io_data->work);
+	llist_add(&io_data->done_node, &ffs->io_done);
+	queue_work(ffs->io_completion_wq, &ffs->io_done_work);
 }
 
 static void __ffs_epfile_read_buffer_free(struct ffs_epfile *epfile)
@@ -1021,15 +1170,18 @@ static ssize_t ffs_epfile_io(struct file *file, struct ffs_io_data *io_data)
 			data_len = usb_ep_align_maybe(gadget, ep->ep, data_len);
 		spin_unlock_irq(&epfile->ffs->eps_lock);
 
-		data = kmalloc(data_len, GFP_KERNEL);
-		if (unlikely(!data)) {
-			ret = -ENOMEM;
-			goto error_mutex;
-		}
-		if (!io_data->read &&
-		    !copy_from_iter_full(data, data_len, &io_data->data)) {
-			ret = -EFAULT;
-			goto error_mutex;
+		if (!ffs_epfile_use_sg(epfile, gadget, io_data, data_len)) {
+			data = kmalloc(data_len, GFP_KERNEL);
+			if (unlikely(!data)) {
+				ret = -ENOMEM;
+				goto error_mutex;
+			}
+			if (!io_data->read &&
+			    !copy_from_iter_full(data, data_len,
+						 &io_data->data)) {
+				ret = -EFAULT;
+				goto error_mutex;
+			}
 		}
 	}
 
@@ -1063,6 +1215,8 @@ static ssize_t ffs_epfile_io(struct file *file, struct ffs_io_data *io_data)
 		req = ep->req;
 		req->buf      = data;
 		req->length   = data_len;
+		req->sg       = io_data->use_sg ? io_data->sgt.sgl : NULL;
+		req->num_sgs  = io_data->use_sg ? io_data->sgt.nents : 0;
 
 		req->context  = &done;
 		req->complete = ffs_epfile_io_complete;
@@ -1071,6 +1225,7 @@ static ssize_t ffs_epfile_io(struct file *file, struct ffs_io_data *io_data)
 		if (unlikely(ret < 0))
 			goto error_lock;
 
+		ffs_ep_stats_queued(ffs_epfile_stats(epfile));
 		spin_unlock_irq(&epfile->ffs->eps_lock);
 
 		ffs_log("queued %ld bytes on %s", data_len, epfile->name);
@@ -1101,6 +1256,10 @@ static ssize_t ffs_epfile_io(struct file *file, struct ffs_io_data *io_data)
 
 		ffs_log("ep status %d for req %pK", ep->status, req);
 
+		ffs_ep_stats_done(ffs_epfile_stats(epfile),
+				  interrupted ? 0 : ep->status,
+				  io_data->use_sg);
+
 		if (interrupted) {
 			ret = -EINTR;
 			goto error_mutex;
@@ -1116,7 +1275,9 @@ static ssize_t ffs_epfile_io(struct file *file, struct ffs_io_data *io_data)
 		if (epfile->ep == ep)
 			ret = ep->status;
 		spin_unlock_irq(&epfile->ffs->eps_lock);
-		if (io_data->read && ret > 0)
+		if (io_data->read && ret > 0 && io_data->use_sg)
+			iov_iter_advance(&io_data->data, ret);
+		else if (io_data->read && ret > 0)
 			ret = __ffs_epfile_read_data(epfile, data, ep->status,
 						     &io_data->data);
 		goto error_mutex;
@@ -1125,6 +1286,8 @@ static ssize_t ffs_epfile_io(struct file *file, struct ffs_io_data *io_data)
 	} else {
 		req->buf      = data;
 		req->length   = data_len;
+		req->sg       = io_data->use_sg ? io_data->sgt.sgl : NULL;
+		req->num_sgs  = io_data->use_sg ? io_data->sgt.nents : 0;
 
 		io_data->buf = data;
 		io_data->ep = ep->ep;
@@ -1134,8 +1297,12 @@ static ssize_t ffs_epfile_io(struct file *file, struct ffs_io_data *io_data)
 		req->context  = io_data;
 		req->complete = ffs_epfile_async_io_complete;
 
+		/* The request may complete before usb_ep_queue returns */
+		ffs_ep_stats_queued(ffs_epfile_stats(epfile));
+
 		ret = usb_ep_queue(ep->ep, req, GFP_ATOMIC);
 		if (unlikely(ret)) {
+			atomic_dec(&ffs_epfile_stats(epfile)->inflight);
 			io_data->req = NULL;
 			usb_ep_free_request(ep->ep, req);
 			goto error_lock;
@@ -1145,8 +1312,8 @@ static ssize_t ffs_epfile_io(struct file *file, struct ffs_io_data *io_data)
 
 		ret = -EIOCBQUEUED;
 		/*
-		 * Do not kfree the buffer in this function.  It will be freed
-		 * by ffs_user_copy_worker.
+		 * Do not kfree the buffer or unpin the user pages in this
+		 * function.  They will be released by ffs_user_copy_one.
 		 */
 		data = NULL;
 	}
@@ -1156,6 +1323,8 @@ static ssize_t ffs_epfile_io(struct file *file, struct ffs_io_data *io_data)
 error_mutex:
 	mutex_unlock(&epfile->mutex);
 error:
+	if (ret != -EIOCBQUEUED)
+		ffs_release_user_sg(io_data);
 	kfree(data);
 
 	ffs_log("exit: %s ret %zd", epfile->name, ret);
@@ -1723,6 +1892,8 @@ MODULE_ALIAS_FS("functionfs");
 
 /* Driver's main init/cleanup functions *************************************/
 
+static struct dentry *ffs_debugfs_root;
+
 static int functionfs_init(void)
 {
 	int ret;
@@ -1735,6 +1906,10 @@ static int functionfs_init(void)
 	else
 		pr_err("failed registering file system (%d)\n", ret);
 
+	ffs_debugfs_root = debugfs_create_dir("usb_ffs", NULL);
+	if (IS_ERR(ffs_debugfs_root))
+		ffs_debugfs_root = NULL;
+
 	return ret;
 }
 
@@ -1743,10 +1918,74 @@ static void functionfs_cleanup(void)
 	ENTER();
 
 	pr_info("unloading\n");
+	debugfs_remove_recursive(ffs_debugfs_root);
+	ffs_debugfs_root = NULL;
 	unregister_filesystem(&ffs_fs_type);
 }
 
 
+/* Per-instance statistics **************************************************/
+
+static int ffs_stats_show(struct seq_file *s, void *unused)
+{
+	struct ffs_data *ffs = s->private;
+	unsigned int i;
+
+	seq_printf(s, "aio batches %u max batch %u\n",
+		   ffs->aio_batches, ffs->aio_max_batch);
+
+	for (i = 0; i < ffs->eps_count; i++) {
+		struct ffs_ep_stats *stats = &ffs->ep_stats[i];
+		u64 bytes = atomic64_read(&stats->bytes);
+		u64 active_ns = atomic64_read(&stats->active_ns);
+		u64 kbps = 0;
+
+		if (active_ns)
+			kbps = div64_u64((bytes >> 10) * NSEC_PER_SEC,
+					 active_ns);
+
+		seq_printf(s, "ep%u: reqs %u sg_reqs %u bytes %llu active_ms %llu KB/s %llu\n",
+			   i + 1, atomic_read(&stats->reqs),
+			   atomic_read(&stats->sg_reqs), bytes,
+			   div_u64(active_ns, NSEC_PER_MSEC), kbps);
+	}
+
+	return 0;
+}
+
+static int ffs_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ffs_stats_show, inode->i_private);
+}
+
+/* Writing anything resets the counters */
+static ssize_t ffs_stats_write(struct file *file, const char __user *ubuf,
+			       size_t count, loff_t *ppos)
+{
+	struct ffs_data *ffs = ((struct seq_file *)file->private_data)->private;
+	unsigned int i;
+
+	for (i = 0; i < FFS_MAX_EPS_COUNT; i++) {
+		atomic64_set(&ffs->ep_stats[i].bytes, 0);
+		atomic64_set(&ffs->ep_stats[i].active_ns, 0);
+		atomic_set(&ffs->ep_stats[i].reqs, 0);
+		atomic_set(&ffs->ep_stats[i].sg_reqs, 0);
+	}
+	ffs->aio_batches = 0;
+	ffs->aio_max_batch = 0;
+
+	return count;
+}
+
+static const struct file_operations ffs_stats_fops = {
+	.open		= ffs_stats_open,
+	.read		= seq_read,
+	.write		= ffs_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+
 /* ffs_data and ffs_function construction and destruction code **************/
 
 static void ffs_data_clear(struct ffs_data *ffs);
@@ -1785,6 +2024,7 @@ static void ffs_data_put(struct ffs_data *ffs)
 
 	if (unlikely(refcount_dec_and_test(&ffs->ref))) {
 		pr_info("%s(): freeing\n", __func__);
+		debugfs_remove(ffs->debugfs);
 		ffs_data_clear(ffs);
 		BUG_ON(waitqueue_active(&ffs->ev.waitq) ||
 		       waitqueue_active(&ffs->ep0req_completion.wait) ||
@@ -1857,6 +2097,8 @@ static struct ffs_data *ffs_data_new(const char *dev_name)
 	init_waitqueue_head(&ffs->ev.waitq);
 	init_waitqueue_head(&ffs->wait);
 	init_completion(&ffs->ep0req_completion);
+	init_llist_head(&ffs->io_done);
+	INIT_WORK(&ffs->io_done_work, ffs_user_copy_worker);
 
 	/* XXX REVISIT need to update it in some places, or do we? */
 	ffs->ev.can_stall = 1;
@@ -1866,6 +2108,11 @@ static struct ffs_data *ffs_data_new(const char *dev_name)
 	if (IS_ERR_OR_NULL(ffs->ipc_log))
 		ffs->ipc_log =  NULL;
 
+	if (ffs_debugfs_root)
+		ffs->debugfs = debugfs_create_file(dev_name, 0600,
+						   ffs_debugfs_root, ffs,
+						   &ffs_stats_fops);
+
 	return ffs;
 }
 
@@ -30,6 +30,8 @@
 #include <linux/debugfs.h>
 #include <linux/types.h>
 #include <linux/file.h>
+#include <linux/pagemap.h>
+#include <linux/scatterlist.h>
 #include <linux/device.h>
 #include <linux/miscdevice.h>
 #include <linux/ipc_logging.h>
@@ -70,7 +72,9 @@
 
 /* number of tx and rx requests to allocate */
 #define MTP_TX_REQ_MAX 8
-#define RX_REQ_MAX 2
+#define RX_REQ_MAX 8
+/* HZ waits for the UDC to give back dequeued OUT requests */
+#define MTP_RX_DRAIN_TRIES 3
 #define INTR_REQ_MAX 5
 
 /* ID for Microsoft MTP OS String */
@@ -98,6 +102,14 @@ module_param(mtp_tx_req_len, uint, 0644);
 unsigned int mtp_tx_reqs = MTP_TX_REQ_MAX;
 module_param(mtp_tx_reqs, uint, 0644);
 
+/* number of OUT requests kept queued while receiving a file */
+unsigned int mtp_rx_reqs = RX_REQ_MAX;
+module_param(mtp_rx_reqs, uint, 0644);
+
+/* send file data straight from the page cache if the UDC supports SG */
+static bool mtp_tx_zero_copy = true;
+module_param(mtp_tx_zero_copy, bool, 0644);
+
 static const char mtp_shortname[] = DRIVER_NAME "_usb";
 
 struct mtp_dev {
@@ -122,7 +134,12 @@ struct mtp_dev {
 	wait_queue_head_t read_wq;
 	wait_queue_head_t write_wq;
 	struct usb_request *rx_req[RX_REQ_MAX];
+	unsigned int rx_reqs;
 	int rx_done;
+	atomic_t rx_completed;
+	/* OUT requests the UDC did not give back, cleared by ep_out disable */
+	bool rx_stuck;
+	unsigned int tx_max_sgs;
 
 	/* for processing MTP_SEND_FILE, MTP_RECEIVE_FILE and
 	 * MTP_SEND_FILE_WITH_HEADER ioctls on a work queue
@@ -145,6 +162,17 @@ struct mtp_dev {
 	} perf[MAX_ITERATION];
 	unsigned int dbg_read_index;
 	unsigned int dbg_write_index;
+	/* per file transfer throughput, reset with the perf samples */
+	struct {
+		u64 tx_bytes;
+		u64 tx_zc_bytes;
+		u64 tx_us;
+		u64 rx_bytes;
+		u64 rx_us;
+		unsigned int tx_files;
+		unsigned int rx_files;
+		unsigned int rx_max_inflight;
+	} xfer_stats;
 	struct mutex  read_mutex;
 };
 
@@ -415,6 +443,7 @@ static struct usb_request *mtp_request_new(struct usb_ep *ep, int buffer_size)
 static void mtp_request_free(struct usb_request *req, struct usb_ep *ep)
 {
 	if (req) {
+		kfree(req->sg);
 		kfree(req->buf);
 		usb_ep_free_request(ep, req);
 	}
@@ -464,6 +493,16 @@ static struct usb_request
 	return req;
 }
 
+/* drop the page cache references taken by mtp_tx_map_pages() */
+static void mtp_tx_unmap_pages(struct usb_request *req)
+{
+	int i;
+
+	for (i = 0; i < req->num_sgs; i++)
+		put_page(sg_page(&req->sg[i]));
+	req->num_sgs = 0;
+}
+
 static void mtp_complete_in(struct usb_ep *ep, struct usb_request *req)
 {
 	struct mtp_dev *dev = _mtp_dev;
@@ -471,6 +510,7 @@ static void mtp_complete_in(struct usb_ep *ep, struct usb_request *req)
 	if (req->status != 0 && dev->state != STATE_OFFLINE)
 		dev->state = STATE_ERROR;
 
+	mtp_tx_unmap_pages(req);
 	mtp_req_put(dev, &dev->tx_idle, req);
 
 	wake_up(&dev->write_wq);
@@ -481,6 +521,7 @@ static void mtp_complete_out(struct usb_ep *ep, struct usb_request *req)
 	struct mtp_dev *dev = _mtp_dev;
 
 	dev->rx_done = 1;
+	atomic_inc(&dev->rx_completed);
 	if (req->status != 0 && dev->state != STATE_OFFLINE)
 		dev->state = STATE_ERROR;
 
@@ -540,6 +581,11 @@ static int mtp_create_bulk_endpoints(struct mtp_dev *dev,
 	if (mtp_tx_req_len > MTP_BULK_BUFFER_SIZE)
 		mtp_tx_reqs = 4;
 
+	/* a request may start mid-page, hence the extra entry */
+	dev->tx_max_sgs = 0;
+	if (cdev->gadget->sg_supported)
+		dev->tx_max_sgs = DIV_ROUND_UP(mtp_tx_req_len, PAGE_SIZE) + 1;
+
 	/* now allocate requests for our endpoints */
 	for (i = 0; i < mtp_tx_reqs; i++) {
 		req = mtp_request_new(dev->ep_in, mtp_tx_req_len);
@@ -552,6 +598,10 @@ static int mtp_create_bulk_endpoints(struct mtp_dev *dev,
 			mtp_tx_reqs = MTP_TX_REQ_MAX;
 			goto retry_tx_alloc;
 		}
+		/* zero-copy is optional, fall back to copying without it */
+		if (dev->tx_max_sgs)
+			req->sg = kcalloc(dev->tx_max_sgs, sizeof(*req->sg),
+					  GFP_KERNEL);
 		req->complete = mtp_complete_in;
 		mtp_req_put(dev, &dev->tx_idle, req);
 	}
@@ -565,10 +615,15 @@ static int mtp_create_bulk_endpoints(struct mtp_dev *dev,
 	if (mtp_rx_req_len % 1024)
 		mtp_rx_req_len = MTP_BULK_BUFFER_SIZE;
 
+	mtp_rx_reqs = clamp_t(unsigned int, mtp_rx_reqs, 2, RX_REQ_MAX);
+
 retry_rx_alloc:
-	for (i = 0; i < RX_REQ_MAX; i++) {
+	for (i = 0; i < mtp_rx_reqs; i++) {
 		req = mtp_request_new(dev->ep_out, mtp_rx_req_len);
 		if (!req) {
+			/* a shallower pipeline still works */
+			if (i >= 2)
+				break;
 			if (mtp_rx_req_len <= MTP_BULK_BUFFER_SIZE)
 				goto fail;
 			for (--i; i >= 0; i--)
@@ -579,6 +634,7 @@ static int mtp_create_bulk_endpoints(struct mtp_dev *dev,
 		req->complete = mtp_complete_out;
 		dev->rx_req[i] = req;
 	}
+	dev->rx_reqs = i;
 	for (i = 0; i < INTR_REQ_MAX; i++) {
 		req = mtp_request_new(dev->ep_intr, INTR_BUFFER_SIZE);
 		if (!req)
@@ -646,7 +702,7 @@ static ssize_t mtp_read(struct file *fp, char __user *buf,
 	spin_unlock_irq(&dev->lock);
 
 	mutex_lock(&dev->read_mutex);
-	if (dev->state == STATE_OFFLINE) {
+	if (dev->state == STATE_OFFLINE || dev->rx_stuck) {
 		r = -EIO;
 		goto done;
 	}
@@ -800,6 +856,51 @@ static ssize_t mtp_write(struct file *fp, const char __user *buf,
 	return r;
 }
 
+/*
+ * Points @req at @len bytes of @filp's page cache starting at *@offset so
+ * the UDC can DMA straight from it.  Returns the number of bytes mapped,
+ * or 0 if the range has to be copied with vfs_read() instead.
+ */
+static int mtp_tx_map_pages(struct mtp_dev *dev, struct usb_request *req,
+			    struct file *filp, loff_t *offset, int len)
+{
+	struct address_space *mapping = filp->f_mapping;
+	struct page *page;
+	loff_t pos = *offset;
+	int mapped = 0, n = 0;
+
+	if (!mtp_tx_zero_copy || !req->sg || !(filp->f_mode & FMODE_READ) ||
+	    (filp->f_flags & O_DIRECT) || !mapping->a_ops->readpage)
+		return 0;
+
+	/* let vfs_read() deal with the tail of a file that got truncated */
+	if (pos + len > i_size_read(file_inode(filp)))
+		return 0;
+
+	sg_init_table(req->sg, dev->tx_max_sgs);
+	while (mapped < len) {
+		unsigned int off = (pos + mapped) & ~PAGE_MASK;
+		unsigned int chunk = min_t(unsigned int, PAGE_SIZE - off,
+					   len - mapped);
+
+		page = read_mapping_page(mapping,
+					 (pos + mapped) >> PAGE_SHIFT, filp);
+		if (IS_ERR(page)) {
+			req->num_sgs = n;
+			mtp_tx_unmap_pages(req);
+			return 0;
+		}
+		sg_set_page(&req->sg[n++], page, chunk, off);
+		mapped += chunk;
+	}
+	sg_mark_end(&req->sg[n - 1]);
+	req->num_sgs = n;
+
+	file_accessed(filp);
+	*offset = pos + mapped;
+	return mapped;
+}
+
 /* read from a local file and write to USB */
 static void send_file_work(struct work_struct *data)
 {
@@ -813,13 +914,15 @@ static void send_file_work(struct work_struct *data)
 	int xfer, ret, hdr_size;
 	int r = 0;
 	int sendZLP = 0;
-	ktime_t start_time;
+	ktime_t start_time, xfer_start;
+	u64 sent = 0, sent_zc = 0;
 
 	/* read our parameters */
 	smp_rmb();
 	filp = dev->xfer_file;
 	offset = dev->xfer_file_offset;
 	count = dev->xfer_file_length;
+	xfer_start = ktime_get();
 
 	mtp_log("(%lld %lld)\n", offset, count);
 
@@ -857,11 +960,19 @@ static void send_file_work(struct work_struct *data)
 			break;
 		}
 
-		if (count > MTP_BULK_BUFFER_SIZE)
-			xfer = MTP_BULK_BUFFER_SIZE;
+		if (count > mtp_tx_req_len)
+			xfer = mtp_tx_req_len;
 		else
 			xfer = count;
 
+		if (!hdr_size && xfer) {
+			ret = mtp_tx_map_pages(dev, req, filp, &offset, xfer);
+			if (ret > 0) {
+				sent_zc += ret;
+				goto queue;
+			}
+		}
+
 		if (hdr_size) {
 			/* prepend MTP data header */
 			header = (struct mtp_data_header *)req->buf;
@@ -890,7 +1001,7 @@ static void send_file_work(struct work_struct *data)
 		dev->perf[dev->dbg_read_index].vfs_rbytes = xfer;
 		dev->dbg_read_index = (dev->dbg_read_index + 1) % MAX_ITERATION;
 		hdr_size = 0;
-
+queue:
 		req->length = xfer;
 		ret = usb_ep_queue(dev->ep_in, req, GFP_KERNEL);
 		if (ret < 0) {
@@ -902,13 +1013,23 @@ static void send_file_work(struct work_struct *data)
 		}
 
 		count -= xfer;
+		sent += xfer;
 
 		/* zero this so we don't try to free it on error exit */
 		req = 0;
 	}
 
-	if (req)
+	if (req) {
+		mtp_tx_unmap_pages(req);
 		mtp_req_put(dev, &dev->tx_idle, req);
+	}
+
+	spin_lock_irq(&dev->lock);
+	dev->xfer_stats.tx_bytes += sent;
+	dev->xfer_stats.tx_zc_bytes += sent_zc;
+	dev->xfer_stats.tx_us += ktime_us_delta(ktime_get(), xfer_start);
+	dev->xfer_stats.tx_files++;
+	spin_unlock_irq(&dev->lock);
 
 	mtp_log("returning %d state:%d\n", r, dev->state);
 	/* write the result */
@@ -921,111 +1042,157 @@ static void receive_file_work(struct work_struct *data)
 {
 	struct mtp_dev *dev = container_of(data, struct mtp_dev,
 						receive_file_work);
-	struct usb_request *read_req = NULL, *write_req = NULL;
+	struct usb_request *req;
 	struct file *filp;
 	loff_t offset;
-	int64_t count;
-	int ret, cur_buf = 0;
+	int64_t count, to_queue;
+	unsigned int head = 0, tail = 0, inflight = 0, queued = 0;
+	unsigned int max_inflight = 0, i, tries;
+	int ret;
 	int r = 0;
-	ktime_t start_time;
+	ktime_t start_time, xfer_start;
+	u64 received = 0;
 
 	/* read our parameters */
 	smp_rmb();
 	filp = dev->xfer_file;
 	offset = dev->xfer_file_offset;
 	count = dev->xfer_file_length;
+	xfer_start = ktime_get();
 
 	mtp_log("(%lld)\n", count);
 	if (!IS_ALIGNED(count, dev->ep_out->maxpacket))
 		mtp_log("- count(%lld) not multiple of mtu(%d)\n",
 						count, dev->ep_out->maxpacket);
 	mutex_lock(&dev->read_mutex);
-	if (dev->state == STATE_OFFLINE) {
+	if (dev->state == STATE_OFFLINE || dev->rx_stuck) {
 		r = -EIO;
 		goto fail;
 	}
-	while (count > 0 || write_req) {
-		if (count > 0) {
-			/* queue a request */
-			read_req = dev->rx_req[cur_buf];
-			cur_buf = (cur_buf + 1) % RX_REQ_MAX;
+
+	/*
+	 * Keep up to rx_reqs requests queued so the host never waits for
+	 * vfs_write(), but never ask for more than the host is going to
+	 * send: a request still queued after the data phase would swallow
+	 * the next command.
+	 */
+	atomic_set(&dev->rx_completed, 0);
+	to_queue = count;
+
+	while (count > 0) {
+		while (inflight < dev->rx_reqs && to_queue > 0) {
+			req = dev->rx_req[tail];
 
 			/* some h/w expects size to be aligned to ep's MTU */
-			read_req->length = mtp_rx_req_len;
+			req->length = mtp_rx_req_len;
 
-			dev->rx_done = 0;
-			ret = usb_ep_queue(dev->ep_out, read_req, GFP_KERNEL);
+			ret = usb_ep_queue(dev->ep_out, req, GFP_KERNEL);
 			if (ret < 0) {
 				r = -EIO;
 				if (dev->state != STATE_OFFLINE)
 					dev->state = STATE_ERROR;
-				break;
+				goto drain;
 			}
+			tail = (tail + 1) % dev->rx_reqs;
+			inflight++;
+			queued++;
+			/* 0xFFFFFFFF: read until we get a short packet */
+			if (count != 0xFFFFFFFF)
+				to_queue -= mtp_rx_req_len;
 		}
-
-		if (write_req) {
-			mtp_log("rx %pK %d\n", write_req, write_req->actual);
-			start_time = ktime_get();
-			ret = vfs_write(filp, write_req->buf, write_req->actual,
-				&offset);
-			mtp_log("vfs_write %d\n", ret);
-			if (ret != write_req->actual) {
+		max_inflight = max(max_inflight, inflight);
+
+		/* requests on an endpoint complete in order */
+		req = dev->rx_req[head];
+		ret = wait_event_interruptible(dev->read_wq,
+			atomic_read(&dev->rx_completed) > queued - inflight ||
+			dev->state != STATE_BUSY);
+		if (dev->state == STATE_CANCELED
+				|| dev->state == STATE_OFFLINE) {
+			if (dev->state == STATE_OFFLINE)
 				r = -EIO;
-				if (dev->state != STATE_OFFLINE)
-					dev->state = STATE_ERROR;
-				if (read_req && !dev->rx_done)
-					usb_ep_dequeue(dev->ep_out, read_req);
-				break;
-			}
-			dev->perf[dev->dbg_write_index].vfs_wtime =
-				ktime_to_us(ktime_sub(ktime_get(), start_time));
-			dev->perf[dev->dbg_write_index].vfs_wbytes = ret;
-			dev->dbg_write_index =
-				(dev->dbg_write_index + 1) % MAX_ITERATION;
-			write_req = NULL;
+			else
+				r = -ECANCELED;
+			goto drain;
 		}
+		if (atomic_read(&dev->rx_completed) <= queued - inflight) {
+			r = ret ? ret : -EIO;
+			goto drain;
+		}
+		head = (head + 1) % dev->rx_reqs;
+		inflight--;
 
-		if (read_req) {
-			/* wait for our last read to complete */
-			ret = wait_event_interruptible(dev->read_wq,
-				dev->rx_done || dev->state != STATE_BUSY);
-			if (dev->state == STATE_CANCELED
-					|| dev->state == STATE_OFFLINE) {
-				if (dev->state == STATE_OFFLINE)
-					r = -EIO;
-				else
-					r = -ECANCELED;
-				if (!dev->rx_done)
-					usb_ep_dequeue(dev->ep_out, read_req);
-				break;
-			}
-			if (read_req->status) {
-				r = read_req->status;
-				break;
-			}
+		if (req->status) {
+			r = req->status;
+			goto drain;
+		}
 
-			/* Check if we aligned the size due to MTU constraint */
-			if (count < read_req->length)
-				read_req->actual = (read_req->actual > count ?
-						count : read_req->actual);
-			/* if xfer_file_length is 0xFFFFFFFF, then we read until
-			 * we get a zero length packet
+		/* Check if we aligned the size due to MTU constraint */
+		if (count < req->length)
+			req->actual = (req->actual > count ?
+					count : req->actual);
+		/* if xfer_file_length is 0xFFFFFFFF, then we read until
+		 * we get a zero length packet
+		 */
+		if (count != 0xFFFFFFFF)
+			count -= req->actual;
+		if (req->actual < req->length) {
+			/*
+			 * short packet is used to signal EOF for
+			 * sizes > 4 gig
 			 */
-			if (count != 0xFFFFFFFF)
-				count -= read_req->actual;
-			if (read_req->actual < read_req->length) {
-				/*
-				 * short packet is used to signal EOF for
-				 * sizes > 4 gig
-				 */
-				mtp_log("got short packet\n");
-				count = 0;
-			}
+			mtp_log("got short packet\n");
+			count = 0;
+		}
+
+		mtp_log("rx %pK %d\n", req, req->actual);
+		start_time = ktime_get();
+		ret = vfs_write(filp, req->buf, req->actual, &offset);
+		mtp_log("vfs_write %d\n", ret);
+		if (ret != req->actual) {
+			r = -EIO;
+			if (dev->state != STATE_OFFLINE)
+				dev->state = STATE_ERROR;
+			goto drain;
+		}
+		dev->perf[dev->dbg_write_index].vfs_wtime =
+			ktime_to_us(ktime_sub(ktime_get(), start_time));
+		dev->perf[dev->dbg_write_index].vfs_wbytes = ret;
+		dev->dbg_write_index =
+			(dev->dbg_write_index + 1) % MAX_ITERATION;
+		received += ret;
+	}
 
-			write_req = read_req;
-			read_req = NULL;
+drain:
+	/*
+	 * Give back whatever the host did not fill.  mtp_read() and the
+	 * next transfer reuse these requests, so they must all complete
+	 * first; dequeue again if the controller held on to any.  Should it
+	 * never give them back, fail the transfer and refuse OUT transfers
+	 * until ep_out is disabled, rather than hang with read_mutex held.
+	 */
+	for (tries = 0; atomic_read(&dev->rx_completed) != queued; tries++) {
+		if (tries == MTP_RX_DRAIN_TRIES) {
+			mtp_log("%d rx requests stuck\n",
+				queued - atomic_read(&dev->rx_completed));
+			dev->rx_stuck = true;
+			r = -EIO;
+			break;
 		}
+		for (i = 0; i < inflight; i++)
+			usb_ep_dequeue(dev->ep_out,
+				dev->rx_req[(head + i) % dev->rx_reqs]);
+		wait_event_timeout(dev->read_wq,
+			atomic_read(&dev->rx_completed) == queued, HZ);
 	}
+
+	spin_lock_irq(&dev->lock);
+	dev->xfer_stats.rx_bytes += received;
+	dev->xfer_stats.rx_us += ktime_us_delta(ktime_get(), xfer_start);
+	dev->xfer_stats.rx_files++;
+	dev->xfer_stats.rx_max_inflight =
+		max(dev->xfer_stats.rx_max_inflight, max_inflight);
+	spin_unlock_irq(&dev->lock);
 fail:
 	mutex_unlock(&dev->read_mutex);
 	mtp_log("returning %d\n", r);
@@ -1481,8 +1648,11 @@ mtp_function_unbind(struct usb_configuration *c, struct usb_function *f)
 	mutex_lock(&dev->read_mutex);
 	while ((req = mtp_req_get(dev, &dev->tx_idle)))
 		mtp_request_free(req, dev->ep_in);
-	for (i = 0; i < RX_REQ_MAX; i++)
+	for (i = 0; i < dev->rx_reqs; i++) {
 		mtp_request_free(dev->rx_req[i], dev->ep_out);
+		dev->rx_req[i] = NULL;
+	}
+	dev->rx_reqs = 0;
 	while ((req = mtp_req_get(dev, &dev->intr_idle)))
 		mtp_request_free(req, dev->ep_intr);
 	spin_lock_irq(&dev->lock);
@@ -1551,6 +1721,8 @@ static void mtp_function_disable(struct usb_function *f)
 	usb_ep_disable(dev->ep_in);
 	usb_ep_disable(dev->ep_out);
 	usb_ep_disable(dev->ep_intr);
+	/* disabling ep_out gave back every OUT request */
+	dev->rx_stuck = false;
 
 	/* readers may be blocked waiting for us to go online */
 	wake_up(&dev->read_wq);
@@ -1558,6 +1730,11 @@ static void mtp_function_disable(struct usb_function *f)
 	mtp_log("%s disabled\n", dev->function.name);
 }
 
+static u64 mtp_kbps(u64 bytes, u64 us)
+{
+	return us ? div64_u64(bytes * USEC_PER_SEC, us) >> 10 : 0;
+}
+
 static int debug_mtp_read_stats(struct seq_file *s, void *unused)
 {
 	struct mtp_dev *dev = _mtp_dev;
@@ -1608,6 +1785,18 @@ static int debug_mtp_read_stats(struct seq_file *s, void *unused)
 
 	seq_printf(s, "vfs_read(time in usec) min:%d\t max:%d\t avg:%d\n",
 				min, max, (iteration ? (sum / iteration) : 0));
+
+	seq_puts(s, "\n=======================\n");
+	seq_puts(s, "MTP Throughput:\n");
+	seq_puts(s, "\n=======================\n");
+	seq_printf(s, "send: files:%u bytes:%llu zero-copy:%llu KB/s:%llu\n",
+		   dev->xfer_stats.tx_files, dev->xfer_stats.tx_bytes,
+		   dev->xfer_stats.tx_zc_bytes,
+		   mtp_kbps(dev->xfer_stats.tx_bytes, dev->xfer_stats.tx_us));
+	seq_printf(s, "receive: files:%u bytes:%llu KB/s:%llu max queued:%u/%u\n",
+		   dev->xfer_stats.rx_files, dev->xfer_stats.rx_bytes,
+		   mtp_kbps(dev->xfer_stats.rx_bytes, dev->xfer_stats.rx_us),
+		   dev->xfer_stats.rx_max_inflight, dev->rx_reqs);
 	spin_unlock_irqrestore(&dev->lock, flags);
 	return 0;
 }
@@ -1633,6 +1822,7 @@ static ssize_t debug_mtp_reset_stats(struct file *file, const char __user *buf,
 	memset(&dev->perf[0], 0, MAX_ITERATION * sizeof(dev->perf[0]));
 	dev->dbg_read_index = 0;
 	dev->dbg_write_index = 0;
+	memset(&dev->xfer_stats, 0, sizeof(dev->xfer_stats));
 	spin_unlock_irqrestore(&dev->lock, flags);
 done:
 	return count;
@@ -21,6 +21,8 @@
 #include <linux/mutex.h>
 #include <linux/workqueue.h>
 #include <linux/refcount.h>
+#include <linux/llist.h>
+#include <linux/ktime.h>
 #include <linux/ipc_logging.h>
 
 #ifdef VERBOSE_DEBUG
@@ -290,6 +292,28 @@ struct ffs_data {
 	 */
 	struct ffs_epfile		*epfiles;
 
+	/*
+	 * Per-endpoint throughput accounting, indexed like epfiles.  Kept
+	 * here rather than in struct ffs_epfile so it outlives the endpoint
+	 * files and survives a function rebind.
+	 */
+	struct ffs_ep_stats {
+		atomic_t			inflight;
+		ktime_t				active_start;
+		atomic64_t			active_ns;
+		atomic64_t			bytes;
+		atomic_t			reqs;
+		atomic_t			sg_reqs;
+	}				ep_stats[FFS_MAX_EPS_COUNT];
+
+	/* Finished AIO requests, completed in batches by io_done_work */
+	struct llist_head		io_done;
+	struct work_struct		io_done_work;
+	unsigned int			aio_batches;
+	unsigned int			aio_max_batch;
+
+	struct dentry			*debugfs;
+
 	void				*ipc_log;
 };
 
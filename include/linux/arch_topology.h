@@ -29,6 +29,12 @@ unsigned long topology_get_cpu_scale(struct sched_domain *sd, int cpu)
 
 void topology_set_cpu_scale(unsigned int cpu, unsigned long capacity);
 
+struct cpumask;
+void topology_lowest_capacity_cpus(struct cpumask *mask);
+
+struct notifier_block;
+int topology_register_cpu_scale_notifier(struct notifier_block *nb);
+
 DECLARE_PER_CPU(unsigned long, efficiency);
 static inline
 unsigned long topology_get_cpu_efficiency(int cpu)
@@ -0,0 +1,45 @@
+/*
+ * Timer slack controller for cgroups, see kernel/cgroup/timer_slack.c.
+ *
+ * This file is subject to the terms and conditions of version 2 of the GNU
+ * General Public License. See the file COPYING in the main directory of the
+ * Linux distribution for more details.
+ */
+
+#ifndef _CGROUP_TIMER_SLACK_H
+#define _CGROUP_TIMER_SLACK_H
+
+#include <linux/hrtimer.h>
+#include <linux/sched.h>
+
+#ifdef CONFIG_CGROUP_TIMER_SLACK
+
+u64 task_timer_slack_ns(struct task_struct *p);
+void timer_slack_coalesce(struct hrtimer *timer, ktime_t offset,
+			  struct task_struct *p);
+unsigned long timer_slack_coalesce_jiffies(unsigned long expire);
+void timer_slack_count_wakeup(struct task_struct *p);
+
+#else
+
+static inline u64 task_timer_slack_ns(struct task_struct *p)
+{
+	return p->timer_slack_ns;
+}
+
+static inline void timer_slack_coalesce(struct hrtimer *timer, ktime_t offset,
+					struct task_struct *p)
+{
+}
+
+static inline unsigned long timer_slack_coalesce_jiffies(unsigned long expire)
+{
+	return expire;
+}
+
+static inline void timer_slack_count_wakeup(struct task_struct *p)
+{
+}
+
+#endif	/* CONFIG_CGROUP_TIMER_SLACK */
+#endif	/* _CGROUP_TIMER_SLACK_H */
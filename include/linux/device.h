@@ -299,6 +299,24 @@ extern struct device_driver *driver_find(const char *name,
 extern int driver_probe_done(void);
 extern void wait_for_device_probe(void);
 
+/*
+ * One probe attempt made before late_initcall.  @dep is the record of the
+ * dependency (parent, device link or DT supplier) that finished last before
+ * this probe started, or -1.
+ */
+struct driver_probe_stat {
+	char dev_name[32];
+	char drv_name[24];
+	u64 start_ns;
+	u64 end_ns;
+	int dep;
+	int ret;
+	unsigned int defers;
+	bool async;
+};
+
+extern int driver_probe_stat(unsigned int idx, struct driver_probe_stat *stat);
+
 
 /* sysfs interface for exporting driver attributes */
 
@@ -18,6 +18,37 @@
 
 struct dma_iommu_mapping;
 
+/* IOVA sizes cached per CPU: 4K << 0 .. 4K << (FAST_IOVA_CACHE_ORDERS - 1) */
+#define FAST_IOVA_CACHE_ORDERS	5
+#define FAST_IOVA_MAG_SIZE	16
+#define FAST_IOVA_DEFER_BATCH	32
+
+/*
+ * Per-CPU IOVA cache.  Unmapped IOVAs are parked in @deferred until a
+ * batch is full, then one TLB invalidate covers the whole batch and the
+ * IOVAs move to the magazine of their size, ready to be handed out again
+ * without taking mapping->lock or touching the bitmap.
+ */
+struct fast_smmu_cpu_cache {
+	spinlock_t	lock;
+	unsigned int	mag_nr[FAST_IOVA_CACHE_ORDERS];
+	dma_addr_t	mag[FAST_IOVA_CACHE_ORDERS][FAST_IOVA_MAG_SIZE];
+	unsigned int	nr_deferred;
+	dma_addr_t	deferred[FAST_IOVA_DEFER_BATCH];
+	u8		deferred_order[FAST_IOVA_DEFER_BATCH];
+
+	u64		cache_hits;
+	u64		cache_misses;
+	u64		tlbi_batches;
+};
+
+struct fast_smmu_stats {
+	u64		map_count;
+	u64		map_ns;
+	u64		unmap_count;
+	u64		unmap_ns;
+};
+
 struct dma_fast_smmu_mapping {
 	struct device		*dev;
 	struct iommu_domain	*domain;
@@ -41,6 +72,10 @@ struct dma_fast_smmu_mapping {
 	struct notifier_block notifier;
 
 	int		is_smmu_pt_coherent;
+
+	struct fast_smmu_cpu_cache __percpu *cpu_cache;
+	struct fast_smmu_stats __percpu *stats;
+	struct dentry	*debugfs;
 };
 
 #ifdef CONFIG_IOMMU_IO_PGTABLE_FAST
@@ -78,6 +78,11 @@ void futex_exit_recursive(struct task_struct *tsk);
 void futex_exit_release(struct task_struct *tsk);
 void futex_exec_release(struct task_struct *tsk);
 
+int futex_hash_prctl(unsigned long nr_threads);
+int futex_hash_prctl_get(void);
+void futex_mm_dup(struct mm_struct *mm, struct mm_struct *oldmm);
+void futex_mm_release(struct mm_struct *mm);
+
 long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 	      u32 __user *uaddr2, u32 val2, u32 val3);
 #else
@@ -85,6 +90,17 @@ static inline void futex_init_task(struct task_struct *tsk) { }
 static inline void futex_exit_recursive(struct task_struct *tsk) { }
 static inline void futex_exit_release(struct task_struct *tsk) { }
 static inline void futex_exec_release(struct task_struct *tsk) { }
+static inline int futex_hash_prctl(unsigned long nr_threads)
+{
+	return -EINVAL;
+}
+static inline int futex_hash_prctl_get(void)
+{
+	return -EINVAL;
+}
+static inline void futex_mm_dup(struct mm_struct *mm,
+				struct mm_struct *oldmm) { }
+static inline void futex_mm_release(struct mm_struct *mm) { }
 #endif
 
 #endif
@@ -106,12 +106,14 @@ struct hrtimer {
  * struct hrtimer_sleeper - simple sleeper structure
  * @timer:	embedded timer structure
  * @task:	task to wake up
+ * @coalesce:	let the timer slack cgroup of @task align the expiry
  *
  * task is set to NULL, when the timer expires.
  */
 struct hrtimer_sleeper {
 	struct hrtimer timer;
 	struct task_struct *task;
+	bool coalesce;
 };
 
 #ifdef CONFIG_64BIT
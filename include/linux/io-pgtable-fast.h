@@ -21,7 +21,10 @@ typedef u64 av8l_fast_iopte;
 
 int av8l_fast_map_public(av8l_fast_iopte *ptep, phys_addr_t paddr, size_t size,
 			 int prot);
-void av8l_fast_unmap_public(av8l_fast_iopte *ptep, size_t size);
+int av8l_fast_unmap_public(av8l_fast_iopte *ptep, size_t size);
+void av8l_fast_split_cont_public(av8l_fast_iopte *ptep, size_t size,
+				 void (*tlb_flush_all)(void *cookie),
+				 void *cookie);
 
 /* events for notifiers passed to av8l_register_notify */
 #define MAPPED_OVER_STALE_TLB 1
@@ -21,7 +21,8 @@ enum {
 	TSV_TYPE_MSG_START = 1,
 	TSV_TYPE_SKB = TSV_TYPE_MSG_START,
 	TSV_TYPE_STRING,
-	TSV_TYPE_MSG_END = TSV_TYPE_STRING,
+	TSV_TYPE_BINARY,
+	TSV_TYPE_MSG_END = TSV_TYPE_BINARY,
 };
 
 struct tsv_header {
@@ -124,6 +125,19 @@ void ipc_log_write(void *ctxt, struct encode_context *ectxt);
  */
 int ipc_log_string(void *ilctxt, const char *fmt, ...) __printf(2, 3);
 
+/*
+ * ipc_log_context_set_binary: Switch ipc_log_string() to binary records
+ *
+ * @ctxt:   Debug Log Context created using ipc_log_context_create()
+ * @enable: Store the format pointer and raw arguments in per-CPU buffers
+ *          and format them only when the log is read
+ *
+ * Binary records cannot be decoded from a ramdump and formats using
+ * pointer-dereferencing %p extensions still take the string path.
+ * Should not be called from atomic context.
+ */
+int ipc_log_context_set_binary(void *ctxt, bool enable);
+
 /**
  * ipc_log_extract - Reads and deserializes log
  *
@@ -256,6 +270,9 @@ static inline void ipc_log_write(void *ctxt, struct encode_context *ectxt) { }
 static inline int ipc_log_string(void *ilctxt, const char *fmt, ...)
 { return -EINVAL; }
 
+static inline int ipc_log_context_set_binary(void *ctxt, bool enable)
+{ return -EINVAL; }
+
 static inline int ipc_log_extract(void *ilctxt, char *buff, int size)
 { return -EINVAL; }
 
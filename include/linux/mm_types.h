@@ -521,6 +521,11 @@ struct mm_struct {
 #endif
 	struct work_struct async_put_work;
 
+#ifdef CONFIG_FUTEX
+	/* private futex hash, see futex_hash_prctl() */
+	struct futex_private_hash *futex_hash;
+#endif
+
 #if IS_ENABLED(CONFIG_HMM)
 	/* HMM needs to track a few things per mm */
 	struct hmm *hmm;
@@ -1657,6 +1657,36 @@ int gsi_config_channel_mode(unsigned long chan_hdl, enum gsi_chan_mode mode);
 int gsi_queue_xfer(unsigned long chan_hdl, uint16_t num_xfers,
 		struct gsi_xfer_elem *xfer, bool ring_db);
 
+/**
+ * gsi_queue_xfer_lockless - Peripheral should call this function
+ * to queue transfers on a GPI channel without taking the ring lock
+ *
+ * The caller must be the only producer on the channel and must not mix
+ * this with gsi_queue_xfer. The TREs are not visible to HW until
+ * gsi_commit_xfer is called, which allows doorbell writes to be batched
+ * across several calls.
+ *
+ * @chan_hdl:  Client handle previously obtained from
+ *             gsi_alloc_channel
+ * @num_xfers: Number of transfer in the array @ xfer
+ * @xfer:      Array of num_xfers transfer descriptors
+ *
+ * @Return gsi_status
+ */
+int gsi_queue_xfer_lockless(unsigned long chan_hdl, uint16_t num_xfers,
+		struct gsi_xfer_elem *xfer);
+
+/**
+ * gsi_commit_xfer - Peripheral should call this function to ring
+ * the doorbell for xfers queued with gsi_queue_xfer_lockless
+ *
+ * @chan_hdl:  Client handle previously obtained from
+ *             gsi_alloc_channel
+ *
+ * @Return gsi_status
+ */
+int gsi_commit_xfer(unsigned long chan_hdl);
+
 /**
  * gsi_start_xfer - Peripheral should call this function to
  * inform HW about queued xfers
@@ -1994,6 +2024,17 @@ static inline int gsi_queue_xfer(unsigned long chan_hdl, uint16_t num_xfers,
 	return -GSI_STATUS_UNSUPPORTED_OP;
 }
 
+static inline int gsi_queue_xfer_lockless(unsigned long chan_hdl,
+		uint16_t num_xfers, struct gsi_xfer_elem *xfer)
+{
+	return -GSI_STATUS_UNSUPPORTED_OP;
+}
+
+static inline int gsi_commit_xfer(unsigned long chan_hdl)
+{
+	return -GSI_STATUS_UNSUPPORTED_OP;
+}
+
 static inline int gsi_start_xfer(unsigned long chan_hdl)
 {
 	return -GSI_STATUS_UNSUPPORTED_OP;
@@ -570,6 +570,10 @@ struct dev_pm_info {
 	bool			wakeup_path:1;
 	bool			syscore:1;
 	bool			no_pm_callbacks:1;	/* Owned by the PM core */
+	bool			async_auto:1;	/* Owned by the PM core */
+#ifdef CONFIG_PM_SLEEP_DEBUG
+	int			prof_slot;	/* Owned by the PM core */
+#endif
 #else
 	unsigned int		should_wakeup:1;
 #endif
@@ -120,6 +120,19 @@ struct delayed_work {
 	int cpu;
 };
 
+/*
+ * Capacity class of the CPUs a workqueue's work items should run on, for
+ * systems with asymmetric CPU capacities (big.LITTLE).  Without capacity
+ * information every CPU belongs to both classes.
+ */
+enum wq_capacity {
+	WQ_CAPACITY_ANY,		/* no preference */
+	WQ_CAPACITY_EFFICIENCY,		/* lowest-capacity CPUs */
+	WQ_CAPACITY_PERFORMANCE,	/* highest-capacity CPUs */
+
+	WQ_CAPACITY_NR,
+};
+
 /**
  * struct workqueue_attrs - A struct for workqueue attributes.
  *
@@ -144,6 +157,15 @@ struct workqueue_attrs {
 	 * doesn't participate in pool hash calculations or equality comparisons.
 	 */
 	bool no_numa;
+
+	/**
+	 * @capacity: capacity class, &enum wq_capacity
+	 *
+	 * Like ``no_numa``, this only narrows the cpumask
+	 * :c:func:`apply_workqueue_attrs` computes for the pools and is not
+	 * a worker_pool attribute itself.
+	 */
+	int capacity;
 };
 
 static inline struct delayed_work *to_delayed_work(struct work_struct *work)
@@ -467,6 +489,8 @@ extern bool cancel_delayed_work_sync(struct delayed_work *dwork);
 
 extern void workqueue_set_max_active(struct workqueue_struct *wq,
 				     int max_active);
+extern int workqueue_set_capacity(struct workqueue_struct *wq,
+				  enum wq_capacity capacity);
 extern struct work_struct *current_work(void);
 extern bool current_is_workqueue_rescuer(void);
 extern bool workqueue_congested(int cpu, struct workqueue_struct *wq);
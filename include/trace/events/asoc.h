@@ -154,6 +154,35 @@ TRACE_EVENT(snd_soc_dapm_walk_done,
 		  (int)__entry->path_checks, (int)__entry->neighbour_checks)
 );
 
+TRACE_EVENT(snd_soc_dapm_update_latency,
+
+	TP_PROTO(struct snd_soc_card *card, int event, int widgets,
+		 u64 walk_ns, u64 total_ns),
+
+	TP_ARGS(card, event, widgets, walk_ns, total_ns),
+
+	TP_STRUCT__entry(
+		__string(	name,	card->name		)
+		__field(	int,	event			)
+		__field(	int,	widgets			)
+		__field(	u64,	walk_ns			)
+		__field(	u64,	total_ns		)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, card->name);
+		__entry->event = event;
+		__entry->widgets = widgets;
+		__entry->walk_ns = walk_ns;
+		__entry->total_ns = total_ns;
+	),
+
+	TP_printk("%s: event %d widgets %d walk %llu ns total %llu ns",
+		  __get_str(name), __entry->event, __entry->widgets,
+		  (unsigned long long)__entry->walk_ns,
+		  (unsigned long long)__entry->total_ns)
+);
+
 TRACE_EVENT(snd_soc_dapm_path,
 
 	TP_PROTO(struct snd_soc_dapm_widget *widget,
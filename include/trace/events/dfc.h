@@ -291,6 +291,28 @@ TRACE_EVENT(dfc_adjust_grant,
 		__entry->rx_bytes, __entry->inflight, __entry->a_grant)
 );
 
+TRACE_EVENT(dfc_grant_latency,
+
+	TP_PROTO(u8 mux_id, u8 bearer_id, u64 latency_ns),
+
+	TP_ARGS(mux_id, bearer_id, latency_ns),
+
+	TP_STRUCT__entry(
+		__field(u8, mux_id)
+		__field(u8, bearer_id)
+		__field(u64, latency_ns)
+	),
+
+	TP_fast_assign(
+		__entry->mux_id = mux_id;
+		__entry->bearer_id = bearer_id;
+		__entry->latency_ns = latency_ns;
+	),
+
+	TP_printk("mid=%u bid=%u latency=%lluns",
+		__entry->mux_id, __entry->bearer_id, __entry->latency_ns)
+);
+
 #endif /* _TRACE_DFC_H */
 
 /* This part must be outside protection */
@@ -96,9 +96,9 @@ DECLARE_EVENT_CLASS(ion_access_cmo_class,
 
 	TP_PROTO(const struct device *dev, const char *name,
 		 bool cached, bool hlos_accessible, enum dma_data_direction dir,
-		 bool only_mapped),
+		 bool only_mapped, unsigned long size),
 
-	TP_ARGS(dev, name, cached, hlos_accessible, dir, only_mapped),
+	TP_ARGS(dev, name, cached, hlos_accessible, dir, only_mapped, size),
 
 	TP_STRUCT__entry(
 		__string(dev_name, dev ? dev_name(dev) : DEV_NAME_NONE)
@@ -107,6 +107,7 @@ DECLARE_EVENT_CLASS(ion_access_cmo_class,
 		__field(bool, hlos_accessible)
 		__field(enum dma_data_direction, dir)
 		__field(bool, only_mapped)
+		__field(unsigned long, size)
 	),
 
 	TP_fast_assign(
@@ -116,63 +117,65 @@ DECLARE_EVENT_CLASS(ion_access_cmo_class,
 		__entry->hlos_accessible = hlos_accessible;
 		__entry->dir = dir;
 		__entry->only_mapped = only_mapped;
+		__entry->size = size;
 	),
 
-	TP_printk("dev=%s name=%s cached=%d access=%d dir=%d, only_mapped=%d",
+	TP_printk("dev=%s name=%s cached=%d access=%d dir=%d, only_mapped=%d size=%lu",
 		  __get_str(dev_name),
 		  __get_str(name),
 		  __entry->cached,
 		  __entry->hlos_accessible,
 		  __entry->dir,
-		  __entry->only_mapped)
+		  __entry->only_mapped,
+		  __entry->size)
 );
 
 DEFINE_EVENT(ion_access_cmo_class, ion_begin_cpu_access_cmo_apply,
 	TP_PROTO(const struct device *dev, const char *name,
 		 bool cached, bool hlos_accessible, enum dma_data_direction dir,
-		 bool only_mapped),
+		 bool only_mapped, unsigned long size),
 
-	TP_ARGS(dev, name, cached, hlos_accessible, dir, only_mapped)
+	TP_ARGS(dev, name, cached, hlos_accessible, dir, only_mapped, size)
 );
 
 DEFINE_EVENT(ion_access_cmo_class, ion_begin_cpu_access_cmo_skip,
 	TP_PROTO(const struct device *dev, const char *name,
 		 bool cached, bool hlos_accessible, enum dma_data_direction dir,
-		 bool only_mapped),
+		 bool only_mapped, unsigned long size),
 
-	TP_ARGS(dev, name, cached, hlos_accessible, dir, only_mapped)
+	TP_ARGS(dev, name, cached, hlos_accessible, dir, only_mapped, size)
 );
 
 DEFINE_EVENT(ion_access_cmo_class, ion_begin_cpu_access_notmapped,
 	TP_PROTO(const struct device *dev, const char *name,
 		 bool cached, bool hlos_accessible, enum dma_data_direction dir,
-		 bool only_mapped),
+		 bool only_mapped, unsigned long size),
 
-	TP_ARGS(dev, name, cached, hlos_accessible, dir, only_mapped)
+	TP_ARGS(dev, name, cached, hlos_accessible, dir, only_mapped, size)
 );
 
 DEFINE_EVENT(ion_access_cmo_class, ion_end_cpu_access_cmo_apply,
 	TP_PROTO(const struct device *dev, const char *name,
 		 bool cached, bool hlos_accessible, enum dma_data_direction dir,
-		 bool only_mapped),
+		 bool only_mapped, unsigned long size),
 
-	TP_ARGS(dev, name, cached, hlos_accessible, dir, only_mapped)
+	TP_ARGS(dev, name, cached, hlos_accessible, dir, only_mapped, size)
 );
 
 DEFINE_EVENT(ion_access_cmo_class, ion_end_cpu_access_cmo_skip,
 	TP_PROTO(const struct device *dev, const char *name,
 		 bool cached, bool hlos_accessible, enum dma_data_direction dir,
-		 bool only_mapped),
+		 bool only_mapped, unsigned long size),
 
-	TP_ARGS(dev, name, cached, hlos_accessible, dir, only_mapped)
+	TP_ARGS(dev, name, cached, hlos_accessible, dir, only_mapped, size)
 );
 
 DEFINE_EVENT(ion_access_cmo_class, ion_end_cpu_access_notmapped,
 	TP_PROTO(const struct device *dev, const char *name,
 		 bool cached, bool hlos_accessible, enum dma_data_direction dir,
-		 bool only_mapped),
+		 bool only_mapped, unsigned long size),
 
-	TP_ARGS(dev, name, cached, hlos_accessible, dir, only_mapped)
+	TP_ARGS(dev, name, cached, hlos_accessible, dir, only_mapped, size)
 );
 #endif /* _TRACE_ION_H */
 
@@ -56,6 +56,59 @@ TRACE_EVENT(task_rename,
 		__entry->newcomm, __entry->oom_score_adj)
 );
 
+TRACE_EVENT(task_dup_mmap,
+
+	TP_PROTO(struct mm_struct *mm, int map_count, bool lazy, u64 delta_ns),
+
+	TP_ARGS(mm, map_count, lazy, delta_ns),
+
+	TP_STRUCT__entry(
+		__field(	pid_t,	pid)
+		__field(	int,	map_count)
+		__field(	unsigned long, rss)
+		__field(	bool,	lazy)
+		__field(	u64,	delta_ns)
+	),
+
+	TP_fast_assign(
+		__entry->pid = current->pid;
+		__entry->map_count = map_count;
+		__entry->rss = get_mm_rss(mm);
+		__entry->lazy = lazy;
+		__entry->delta_ns = delta_ns;
+	),
+
+	TP_printk("pid=%d map_count=%d child_rss=%lu lazy=%d delta_us=%llu",
+		__entry->pid, __entry->map_count, __entry->rss, __entry->lazy,
+		__entry->delta_ns / NSEC_PER_USEC)
+);
+
+TRACE_EVENT(task_fork_latency,
+
+	TP_PROTO(struct task_struct *task, unsigned long clone_flags,
+		 u64 delta_ns),
+
+	TP_ARGS(task, clone_flags, delta_ns),
+
+	TP_STRUCT__entry(
+		__field(	pid_t,	pid)
+		__field(	pid_t,	child_pid)
+		__field( unsigned long, clone_flags)
+		__field(	u64,	delta_ns)
+	),
+
+	TP_fast_assign(
+		__entry->pid = current->pid;
+		__entry->child_pid = task->pid;
+		__entry->clone_flags = clone_flags;
+		__entry->delta_ns = delta_ns;
+	),
+
+	TP_printk("pid=%d child_pid=%d clone_flags=%lx delta_us=%llu",
+		__entry->pid, __entry->child_pid, __entry->clone_flags,
+		__entry->delta_ns / NSEC_PER_USEC)
+);
+
 #endif
 
 /* This part must be outside protection */
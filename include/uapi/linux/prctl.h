@@ -214,6 +214,20 @@ struct prctl_mm_map {
 #define PR_SET_VMA		0x53564d41
 # define PR_SET_VMA_ANON_NAME		0
 
+/*
+ * Lazy fork: page cache pages mapped by private file mappings are not
+ * copied into children, which fault them back in on first access.
+ */
+#define PR_SET_LAZY_FORK	0x4c5a4601
+#define PR_GET_LAZY_FORK	0x4c5a4602
+
+/*
+ * Per-process hash table for private futexes, sized for arg2 threads.
+ * Must be set while the process is single threaded; inherited by fork().
+ */
+#define PR_SET_FUTEX_HASH	0x46485401
+#define PR_GET_FUTEX_HASH	0x46485402
+
 /* Tagged user address controls for arm64 */
 #define PR_SET_TAGGED_ADDR_CTRL		55
 #define PR_GET_TAGGED_ADDR_CTRL		56
@@ -0,0 +1,318 @@
+/*
+ * Timer slack controller for cgroups.
+ *
+ * Per-task timer slack (PR_SET_TIMERSLACK) leaves it to every application
+ * to tolerate late wakeups.  This controller lets the system impose it on
+ * whole groups of tasks instead, typically background applications, so
+ * that their periodic sleeps stop waking otherwise idle CPUs one by one.
+ *
+ *  timer_slack.min_slack_ns
+ *	Lower bound for the timer slack of the tasks in the cgroup.  A task's
+ *	own timer slack is used if it is larger.
+ *
+ *  timer_slack.coalesce_ns
+ *	Wakeup boundary period.  The nanosleep()s of the tasks in the cgroup
+ *	expire on a multiple of this period (in CLOCK_MONOTONIC) when one
+ *	lies within their slack, so that sleepers of all such cgroups
+ *	share wakeups; min_slack_ns should be at least this large for that
+ *	to happen.  schedule_timeout() expiries are rounded up to a multiple
+ *	of the period in jiffies when that delays them by no more than their
+ *	slack.  Zero, the default, disables coalescing.
+ *
+ *  timer_slack.stats
+ *	Sleeps ended by a timer, how many of those took the CPU out of idle,
+ *	and how many timers were moved onto a boundary, for the cgroup and
+ *	its descendants.
+ *
+ * Both settings apply on top of those of the ancestors: a task gets the
+ * largest value set along the path from its cgroup to the root, so that a
+ * child cannot loosen what its parent imposes.
+ *
+ * This file is subject to the terms and conditions of version 2 of the GNU
+ * General Public License.  See the file COPYING in the main directory of the
+ * Linux distribution for more details.
+ */
+
+#include <linux/cgroup.h>
+#include <linux/cgroup_timer_slack.h>
+#include <linux/jiffies.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/sched/deadline.h>
+#include <linux/sched/rt.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+
+struct timer_slack_stat {
+	u64				wakeups;
+	u64				idle_wakeups;
+	u64				coalesced;
+};
+
+struct timer_slack_cgroup {
+	struct cgroup_subsys_state	css;
+
+	u64				min_slack_ns;
+	u64				coalesce_ns;
+
+	struct timer_slack_stat __percpu *stat;
+};
+
+static struct timer_slack_cgroup *css_timer_slack(struct cgroup_subsys_state *css)
+{
+	return container_of(css, struct timer_slack_cgroup, css);
+}
+
+/* Caller holds rcu_read_lock(). */
+static struct timer_slack_cgroup *task_timer_slack(struct task_struct *p)
+{
+	return css_timer_slack(task_css(p, timer_slack_cgrp_id));
+}
+
+/* Effective settings of @ts and its ancestors, caller holds rcu_read_lock() */
+static void timer_slack_effective(struct timer_slack_cgroup *ts,
+				  u64 *min_slack_ns, u64 *coalesce_ns)
+{
+	struct cgroup_subsys_state *css;
+
+	*min_slack_ns = 0;
+	*coalesce_ns = 0;
+	for (css = &ts->css; css; css = css->parent) {
+		ts = css_timer_slack(css);
+		*min_slack_ns = max(*min_slack_ns, READ_ONCE(ts->min_slack_ns));
+		*coalesce_ns = max(*coalesce_ns, READ_ONCE(ts->coalesce_ns));
+	}
+}
+
+static struct cgroup_subsys_state *
+timer_slack_css_alloc(struct cgroup_subsys_state *parent)
+{
+	struct timer_slack_cgroup *ts;
+
+	ts = kzalloc(sizeof(*ts), GFP_KERNEL);
+	if (!ts)
+		return ERR_PTR(-ENOMEM);
+
+	ts->stat = alloc_percpu(struct timer_slack_stat);
+	if (!ts->stat) {
+		kfree(ts);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	return &ts->css;
+}
+
+static void timer_slack_css_free(struct cgroup_subsys_state *css)
+{
+	struct timer_slack_cgroup *ts = css_timer_slack(css);
+
+	free_percpu(ts->stat);
+	kfree(ts);
+}
+
+/**
+ * task_timer_slack_ns - effective timer slack of a task
+ * @p: the task
+ *
+ * Return: @p's own timer slack, raised to the minimum of its cgroup.
+ */
+u64 task_timer_slack_ns(struct task_struct *p)
+{
+	u64 min_slack, period;
+
+	if (!cgroup_subsys_enabled(timer_slack_cgrp_subsys))
+		return p->timer_slack_ns;
+
+	rcu_read_lock();
+	timer_slack_effective(task_timer_slack(p), &min_slack, &period);
+	rcu_read_unlock();
+
+	return max(p->timer_slack_ns, min_slack);
+}
+
+/**
+ * timer_slack_coalesce - move a sleeper's expiry onto a wakeup boundary
+ * @timer: hrtimer of the sleeper, expiry range already set
+ * @offset: offset of @timer's clock base from CLOCK_MONOTONIC
+ * @p: the sleeping task
+ *
+ * Sets the hard expiry of @timer to the last multiple of the cgroup's
+ * coalesce_ns that is not before its soft expiry.  Called with the
+ * hrtimer base locked.
+ */
+void timer_slack_coalesce(struct hrtimer *timer, ktime_t offset,
+			  struct task_struct *p)
+{
+	struct timer_slack_cgroup *ts;
+	u64 min_slack, period, rem;
+	ktime_t soft, hard;
+	s64 mono;
+
+	if (!cgroup_subsys_enabled(timer_slack_cgrp_subsys))
+		return;
+
+	rcu_read_lock();
+	ts = task_timer_slack(p);
+	timer_slack_effective(ts, &min_slack, &period);
+	if (!period)
+		goto out;
+
+	soft = hrtimer_get_softexpires(timer);
+	hard = hrtimer_get_expires(timer);
+	mono = ktime_to_ns(ktime_sub(hard, offset));
+	if (mono <= 0)
+		goto out;
+
+	div64_u64_rem(mono, period, &rem);
+	if (!rem)
+		goto out;
+	hard = ktime_sub_ns(hard, rem);
+	if (hard < soft)
+		goto out;
+
+	hrtimer_set_expires_range_ns(timer, soft, ktime_to_ns(hard - soft));
+	this_cpu_inc(ts->stat->coalesced);
+out:
+	rcu_read_unlock();
+}
+
+/**
+ * timer_slack_coalesce_jiffies - round a timeout onto a wakeup boundary
+ * @expire: absolute timeout in jiffies of the current task
+ *
+ * Return: @expire rounded up to a multiple of the current task's cgroup
+ * coalesce_ns, in jiffies, if that is within the task's timer slack.
+ * Realtime and deadline tasks get no slack, as in hrtimer_nanosleep().
+ */
+unsigned long timer_slack_coalesce_jiffies(unsigned long expire)
+{
+	struct timer_slack_cgroup *ts;
+	unsigned long period, slack, rounded;
+	u64 min_slack, coalesce;
+
+	if (!cgroup_subsys_enabled(timer_slack_cgrp_subsys) ||
+	    dl_task(current) || rt_task(current))
+		return expire;
+
+	rcu_read_lock();
+	ts = task_timer_slack(current);
+	timer_slack_effective(ts, &min_slack, &coalesce);
+	period = nsecs_to_jiffies(coalesce);
+	if (period > 1) {
+		slack = nsecs_to_jiffies(max(current->timer_slack_ns,
+					     min_slack));
+		rounded = roundup(expire, period);
+		if (time_after(rounded, expire) && rounded - expire <= slack) {
+			this_cpu_inc(ts->stat->coalesced);
+			expire = rounded;
+		}
+	}
+	rcu_read_unlock();
+
+	return expire;
+}
+
+/**
+ * timer_slack_count_wakeup - account a timer ending a task's sleep
+ * @p: the task being woken
+ *
+ * Called from the timer callback, so an idle current task means that the
+ * timer took the CPU out of idle.
+ */
+void timer_slack_count_wakeup(struct task_struct *p)
+{
+	struct timer_slack_cgroup *ts;
+
+	if (!cgroup_subsys_enabled(timer_slack_cgrp_subsys))
+		return;
+
+	rcu_read_lock();
+	ts = task_timer_slack(p);
+	this_cpu_inc(ts->stat->wakeups);
+	if (is_idle_task(current))
+		this_cpu_inc(ts->stat->idle_wakeups);
+	rcu_read_unlock();
+}
+
+static u64 timer_slack_min_read(struct cgroup_subsys_state *css,
+				struct cftype *cft)
+{
+	return READ_ONCE(css_timer_slack(css)->min_slack_ns);
+}
+
+static int timer_slack_min_write(struct cgroup_subsys_state *css,
+				 struct cftype *cft, u64 val)
+{
+	WRITE_ONCE(css_timer_slack(css)->min_slack_ns, val);
+	return 0;
+}
+
+static u64 timer_slack_coalesce_read(struct cgroup_subsys_state *css,
+				     struct cftype *cft)
+{
+	return READ_ONCE(css_timer_slack(css)->coalesce_ns);
+}
+
+static int timer_slack_coalesce_write(struct cgroup_subsys_state *css,
+				      struct cftype *cft, u64 val)
+{
+	/* Sub-millisecond boundaries would not save any wakeups. */
+	if (val && val < NSEC_PER_MSEC)
+		return -EINVAL;
+
+	WRITE_ONCE(css_timer_slack(css)->coalesce_ns, val);
+	return 0;
+}
+
+static int timer_slack_stats_show(struct seq_file *sf, void *v)
+{
+	struct cgroup_subsys_state *css = seq_css(sf), *pos;
+	struct timer_slack_stat *stat, sum = { };
+	int cpu;
+
+	rcu_read_lock();
+	css_for_each_descendant_pre(pos, css) {
+		for_each_possible_cpu(cpu) {
+			stat = per_cpu_ptr(css_timer_slack(pos)->stat, cpu);
+			sum.wakeups += READ_ONCE(stat->wakeups);
+			sum.idle_wakeups += READ_ONCE(stat->idle_wakeups);
+			sum.coalesced += READ_ONCE(stat->coalesced);
+		}
+	}
+	rcu_read_unlock();
+
+	seq_printf(sf, "wakeups %llu\n", sum.wakeups);
+	seq_printf(sf, "idle_wakeups %llu\n", sum.idle_wakeups);
+	seq_printf(sf, "coalesced %llu\n", sum.coalesced);
+	return 0;
+}
+
+static struct cftype timer_slack_files[] = {
+	{
+		.name = "min_slack_ns",
+		.read_u64 = timer_slack_min_read,
+		.write_u64 = timer_slack_min_write,
+		.flags = CFTYPE_NOT_ON_ROOT,
+	},
+	{
+		.name = "coalesce_ns",
+		.read_u64 = timer_slack_coalesce_read,
+		.write_u64 = timer_slack_coalesce_write,
+		.flags = CFTYPE_NOT_ON_ROOT,
+	},
+	{
+		.name = "stats",
+		.seq_show = timer_slack_stats_show,
+	},
+	{ }	/* terminate */
+};
+
+struct cgroup_subsys timer_slack_cgrp_subsys = {
+	.css_alloc	= timer_slack_css_alloc,
+	.css_free	= timer_slack_css_free,
+	.legacy_cftypes	= timer_slack_files,
+	.dfl_cftypes	= timer_slack_files,
+	.threaded	= true,
+};
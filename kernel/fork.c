@@ -609,6 +609,7 @@ static __latent_entropy int dup_mmap(struct mm_struct *mm,
 	struct rb_node **rb_link, *rb_parent;
 	int retval;
 	unsigned long charge;
+	u64 start = trace_task_dup_mmap_enabled() ? ktime_get_ns() : 0;
 	LIST_HEAD(uf);
 
 	uprobe_start_dup_mmap();
@@ -730,6 +731,10 @@ static __latent_entropy int dup_mmap(struct mm_struct *mm,
 	/* a new mm has just been created */
 	retval = arch_dup_mmap(oldmm, mm);
 out:
+	if (start)
+		trace_task_dup_mmap(mm, mm->map_count,
+				    test_bit(MMF_LAZY_FORK, &oldmm->flags),
+				    ktime_get_ns() - start);
 	up_write(&mm->mmap_sem);
 	flush_tlb_mm(oldmm);
 	up_write(&oldmm->mmap_sem);
@@ -853,6 +858,9 @@ static struct mm_struct *mm_init(struct mm_struct *mm, struct task_struct *p,
 	mm->pmd_huge_pte = NULL;
 #endif
 	mm_init_uprobes_state(mm);
+#ifdef CONFIG_FUTEX
+	mm->futex_hash = NULL;
+#endif
 
 	if (current->mm) {
 		mm->flags = current->mm->flags & MMF_INIT_MASK;
@@ -947,6 +955,7 @@ static inline void __mmput(struct mm_struct *mm)
 	ksm_exit(mm);
 	khugepaged_exit(mm); /* must run before exit_mmap */
 	exit_mmap(mm);
+	futex_mm_release(mm);
 	mm_put_huge_zero_page(mm);
 	set_mm_exe_file(mm, NULL);
 	if (!list_empty(&mm->mmlist)) {
@@ -1220,6 +1229,8 @@ static struct mm_struct *dup_mm(struct task_struct *tsk)
 	if (!mm_init(mm, tsk, mm->user_ns))
 		goto fail_nomem;
 
+	futex_mm_dup(mm, oldmm);
+
 	err = dup_mmap(mm, oldmm);
 	if (err)
 		goto free_pt;
@@ -2203,6 +2214,7 @@ long _do_fork(unsigned long clone_flags,
 	struct task_struct *p;
 	int trace = 0;
 	long nr;
+	u64 start = trace_task_fork_latency_enabled() ? ktime_get_ns() : 0;
 
 	/*
 	 * Determine whether and which event to report to ptracer.  When
@@ -2235,6 +2247,9 @@ long _do_fork(unsigned long clone_flags,
 
 		cpufreq_task_times_alloc(p);
 
+		if (start)
+			trace_task_fork_latency(p, clone_flags,
+						ktime_get_ns() - start);
 		trace_sched_process_fork(current, p);
 
 		pid = get_task_pid(p, PIDTYPE_PID);
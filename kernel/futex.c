@@ -63,11 +63,15 @@
 #include <linux/ptrace.h>
 #include <linux/sched/rt.h>
 #include <linux/sched/wake_q.h>
+#include <linux/sched/signal.h>
 #include <linux/sched/mm.h>
 #include <linux/hugetlb.h>
 #include <linux/freezer.h>
 #include <linux/bootmem.h>
 #include <linux/fault-inject.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/cgroup_timer_slack.h>
 
 #include <asm/futex.h>
 
@@ -266,8 +270,23 @@ struct futex_hash_bucket {
 	atomic_t waiters;
 	spinlock_t lock;
 	struct plist_head chain;
+	/* waiters of other futexes skipped by futex_wake(), under lock */
+	unsigned int collisions;
+	/* lock found held when taken by a waiter or waker */
+	atomic_t contended;
 } ____cacheline_aligned_in_smp;
 
+/*
+ * Per-process table for private futexes, see futex_hash_prctl().  It only
+ * exists once the process asked for it while single threaded, so no waiter
+ * can ever be queued in the global table under a key that now hashes here.
+ */
+struct futex_private_hash {
+	unsigned long hashsize;
+	unsigned int nr_threads;
+	struct futex_hash_bucket queues[];
+};
+
 /*
  * The base of the bucket array and its size are always used together
  * (after initialization only in hash_futex()), so ensure that they
@@ -280,6 +299,11 @@ static struct {
 #define futex_queues   (__futex_data.queues)
 #define futex_hashsize (__futex_data.hashsize)
 
+/* statistics of private tables that have already been freed */
+static atomic_long_t futex_private_tables;
+static atomic_long_t futex_private_collisions;
+static atomic_long_t futex_private_contended;
+
 
 /*
  * Fault injections for futexes.
@@ -393,20 +417,138 @@ static inline int hb_waiters_pending(struct futex_hash_bucket *hb)
 }
 
 /**
- * hash_futex - Return the hash bucket in the global hash
+ * hash_futex - Return the hash bucket in the global or per-process hash
  * @key:	Pointer to the futex key for which the hash is calculated
  *
  * We hash on the keys returned from get_futex_key (see below) and return the
- * corresponding hash bucket in the global hash.
+ * corresponding hash bucket.  Process private keys use the table of their
+ * mm when it has one, everything else uses the global hash.
  */
 static struct futex_hash_bucket *hash_futex(union futex_key *key)
 {
 	u32 hash = jhash2((u32 *)key, offsetof(typeof(*key), both.offset) / 4,
 			  key->both.offset);
+	struct futex_private_hash *fph;
+
+	if (!(key->both.offset & (FUT_OFF_INODE|FUT_OFF_MMSHARED))) {
+		fph = READ_ONCE(key->private.mm->futex_hash);
+		if (fph)
+			return &fph->queues[hash & (fph->hashsize - 1)];
+	}
 
 	return &futex_queues[hash & (futex_hashsize - 1)];
 }
 
+static inline void hb_lock(struct futex_hash_bucket *hb)
+	__acquires(&hb->lock)
+{
+	if (unlikely(spin_is_locked(&hb->lock)))
+		atomic_inc(&hb->contended);
+	spin_lock(&hb->lock);
+}
+
+static void futex_hash_init(struct futex_hash_bucket *queues,
+			    unsigned long hashsize)
+{
+	unsigned long i;
+
+	for (i = 0; i < hashsize; i++) {
+		atomic_set(&queues[i].waiters, 0);
+		plist_head_init(&queues[i].chain);
+		spin_lock_init(&queues[i].lock);
+		queues[i].collisions = 0;
+		atomic_set(&queues[i].contended, 0);
+	}
+}
+
+static struct futex_private_hash *futex_private_hash_alloc(unsigned int nr)
+{
+	struct futex_private_hash *fph;
+	unsigned long hashsize;
+
+	/* four buckets per thread, like the global table has 256 per CPU */
+	hashsize = roundup_pow_of_two(clamp_t(unsigned long, 4UL * nr, 16,
+					      futex_hashsize));
+	fph = kvzalloc(sizeof(*fph) + hashsize * sizeof(fph->queues[0]),
+		       GFP_KERNEL);
+	if (!fph)
+		return NULL;
+
+	fph->hashsize = hashsize;
+	fph->nr_threads = nr;
+	futex_hash_init(fph->queues, hashsize);
+	return fph;
+}
+
+/**
+ * futex_hash_prctl - Give the current process its own private futex hash
+ * @nr_threads:	Expected number of threads, used to size the table
+ *
+ * Only allowed while the mm has a single user: nothing can be waiting on a
+ * private futex of this mm then, so moving private keys out of the global
+ * table cannot strand a waiter.  The table is inherited across fork() and
+ * dropped on exec().
+ */
+int futex_hash_prctl(unsigned long nr_threads)
+{
+	struct mm_struct *mm = current->mm;
+	struct futex_private_hash *fph;
+
+	if (!nr_threads || nr_threads > PID_MAX_LIMIT)
+		return -EINVAL;
+	if (mm->futex_hash)
+		return -EEXIST;
+	if (!thread_group_empty(current) || atomic_read(&mm->mm_users) != 1)
+		return -EBUSY;
+
+	fph = futex_private_hash_alloc(nr_threads);
+	if (!fph)
+		return -ENOMEM;
+
+	WRITE_ONCE(mm->futex_hash, fph);
+	return 0;
+}
+
+/* Returns the number of buckets of the current private hash, or 0. */
+int futex_hash_prctl_get(void)
+{
+	struct futex_private_hash *fph = READ_ONCE(current->mm->futex_hash);
+
+	return fph ? fph->hashsize : 0;
+}
+
+/*
+ * Called at fork() for the child's new mm, which has no other user yet.
+ * Failing to allocate just leaves the child on the global table.
+ */
+void futex_mm_dup(struct mm_struct *mm, struct mm_struct *oldmm)
+{
+	struct futex_private_hash *fph = READ_ONCE(oldmm->futex_hash);
+
+	mm->futex_hash = fph ? futex_private_hash_alloc(fph->nr_threads) : NULL;
+}
+
+/* Called once the last user of @mm is gone. */
+void futex_mm_release(struct mm_struct *mm)
+{
+	struct futex_private_hash *fph = mm->futex_hash;
+	unsigned long i, collisions = 0, contended = 0;
+
+	if (!fph)
+		return;
+
+	for (i = 0; i < fph->hashsize; i++) {
+		collisions += fph->queues[i].collisions;
+		contended += atomic_read(&fph->queues[i].contended);
+	}
+	atomic_long_inc(&futex_private_tables);
+	atomic_long_add(collisions, &futex_private_collisions);
+	atomic_long_add(contended, &futex_private_contended);
+
+	mm->futex_hash = NULL;
+	kvfree(fph);
+}
+
 
 /**
  * match_futex - Check whether two futex keys are equal
@@ -1649,11 +1791,11 @@ static inline void
 double_lock_hb(struct futex_hash_bucket *hb1, struct futex_hash_bucket *hb2)
 {
 	if (hb1 <= hb2) {
-		spin_lock(&hb1->lock);
+		hb_lock(hb1);
 		if (hb1 < hb2)
 			spin_lock_nested(&hb2->lock, SINGLE_DEPTH_NESTING);
 	} else { /* hb1 > hb2 */
-		spin_lock(&hb2->lock);
+		hb_lock(hb2);
 		spin_lock_nested(&hb1->lock, SINGLE_DEPTH_NESTING);
 	}
 }
@@ -1691,7 +1833,7 @@ futex_wake(u32 __user *uaddr, unsigned int flags, int nr_wake, u32 bitset)
 	if (!hb_waiters_pending(hb))
 		goto out_put_key;
 
-	spin_lock(&hb->lock);
+	hb_lock(hb);
 
 	plist_for_each_entry_safe(this, next, &hb->chain, list) {
 		if (match_futex (&this->key, &key)) {
@@ -1707,6 +1849,8 @@ futex_wake(u32 __user *uaddr, unsigned int flags, int nr_wake, u32 bitset)
 			mark_wake_futex(&wake_q, this);
 			if (++ret >= nr_wake)
 				break;
+		} else {
+			hb->collisions++;
 		}
 	}
 
@@ -2332,7 +2476,7 @@ static inline struct futex_hash_bucket *queue_lock(struct futex_q *q)
 
 	q->lock_ptr = &hb->lock;
 
-	spin_lock(&hb->lock); /* implies smp_mb(); (A) */
+	hb_lock(hb); /* implies smp_mb(); (A) */
 	return hb;
 }
 
@@ -2821,7 +2965,7 @@ static int futex_wait(u32 __user *uaddr, unsigned int flags, u32 val,
 				      HRTIMER_MODE_ABS);
 		hrtimer_init_sleeper(to, current);
 		hrtimer_set_expires_range_ns(&to->timer, *abs_time,
-					     current->timer_slack_ns);
+					     task_timer_slack_ns(current));
 	}
 
 retry:
@@ -3352,7 +3496,7 @@ static int futex_wait_requeue_pi(u32 __user *uaddr, unsigned int flags,
 				      HRTIMER_MODE_ABS);
 		hrtimer_init_sleeper(to, current);
 		hrtimer_set_expires_range_ns(&to->timer, *abs_time,
-					     current->timer_slack_ns);
+					     task_timer_slack_ns(current));
 	}
 
 	/*
@@ -4190,7 +4334,6 @@ static void __init futex_detect_cmpxchg(void)
 static int __init futex_init(void)
 {
 	unsigned int futex_shift;
-	unsigned long i;
 
 #if CONFIG_BASE_SMALL
 	futex_hashsize = 16;
@@ -4206,13 +4349,48 @@ static int __init futex_init(void)
 	futex_hashsize = 1UL << futex_shift;
 
 	futex_detect_cmpxchg();
+	futex_hash_init(futex_queues, futex_hashsize);
+
+	return 0;
+}
+core_initcall(futex_init);
+
+#ifdef CONFIG_DEBUG_FS
+static int futex_hash_stats_show(struct seq_file *s, void *unused)
+{
+	unsigned long i, collisions = 0, contended = 0;
 
 	for (i = 0; i < futex_hashsize; i++) {
-		atomic_set(&futex_queues[i].waiters, 0);
-		plist_head_init(&futex_queues[i].chain);
-		spin_lock_init(&futex_queues[i].lock);
+		collisions += READ_ONCE(futex_queues[i].collisions);
+		contended += atomic_read(&futex_queues[i].contended);
 	}
 
+	seq_printf(s, "global: buckets %lu collisions %lu contended %lu\n",
+		   futex_hashsize, collisions, contended);
+	seq_printf(s, "private (exited): tables %ld collisions %ld contended %ld\n",
+		   atomic_long_read(&futex_private_tables),
+		   atomic_long_read(&futex_private_collisions),
+		   atomic_long_read(&futex_private_contended));
 	return 0;
 }
-core_initcall(futex_init);
+
+static int futex_hash_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, futex_hash_stats_show, NULL);
+}
+
+static const struct file_operations futex_hash_stats_fops = {
+	.open		= futex_hash_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init futex_hash_debugfs(void)
+{
+	debugfs_create_file("futex_hash", 0444, NULL, NULL,
+			    &futex_hash_stats_fops);
+	return 0;
+}
+late_initcall(futex_hash_debugfs);
+#endif
@@ -78,6 +78,37 @@ static ssize_t pm_async_store(struct kobject *kobj, struct kobj_attribute *attr,
 
 power_attr(pm_async);
 
+/*
+ * If set, devices whose dependencies are all known to the PM core (a bound
+ * parent or device links) are suspended and resumed asynchronously even if
+ * their drivers did not ask for it.
+ */
+int pm_auto_async_enabled;
+
+static ssize_t pm_auto_async_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", pm_auto_async_enabled);
+}
+
+static ssize_t pm_auto_async_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t n)
+{
+	unsigned long val;
+
+	if (kstrtoul(buf, 10, &val))
+		return -EINVAL;
+
+	if (val > 1)
+		return -EINVAL;
+
+	pm_auto_async_enabled = val;
+	return n;
+}
+
+power_attr(pm_auto_async);
+
 #ifdef CONFIG_SUSPEND
 static ssize_t mem_sleep_show(struct kobject *kobj, struct kobj_attribute *attr,
 			      char *buf)
@@ -883,6 +914,7 @@ static struct attribute * g[] = {
 #endif
 #ifdef CONFIG_PM_SLEEP
 	&pm_async_attr.attr,
+	&pm_auto_async_attr.attr,
 	&wakeup_count_attr.attr,
 #ifdef CONFIG_SUSPEND
 	&mem_sleep_attr.attr,
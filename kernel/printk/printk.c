@@ -48,6 +48,7 @@
 #include <linux/sched/clock.h>
 #include <linux/sched/debug.h>
 #include <linux/sched/task_stack.h>
+#include <linux/kthread.h>
 
 #include <linux/uaccess.h>
 #include <asm/sections.h>
@@ -1887,23 +1888,17 @@ static size_t log_output(int facility, int level, enum log_flags lflags, const c
 	return log_store(facility, level, lflags, 0, dict, dictlen, text, text_len);
 }
 
-/* Must be called under logbuf_lock. */
-int vprintk_store(int facility, int level,
-		  const char *dict, size_t dictlen,
-		  const char *fmt, va_list args)
+/*
+ * Store an already formatted message.  @text still carries the syslog
+ * prefix, if any.  Must be called under logbuf_lock.
+ */
+static int log_store_text(int facility, int level,
+			  const char *dict, size_t dictlen,
+			  char *text, size_t text_len)
 {
-	static char textbuf[LOG_LINE_MAX];
-	char *text = textbuf;
-	size_t text_len;
 	enum log_flags lflags = 0;
 	size_t printed_len;
 
-	/*
-	 * The printf needs to come first; we need the syslog
-	 * prefix which might be passed-in as a parameter.
-	 */
-	text_len = vscnprintf(text, sizeof(textbuf), fmt, args);
-
 	/* mark and strip a trailing newline */
 	if (text_len && text[text_len-1] == '\n') {
 		text_len--;
@@ -1949,6 +1944,90 @@ int vprintk_store(int facility, int level,
 	return printed_len;
 }
 
+/* Must be called under logbuf_lock. */
+int vprintk_store(int facility, int level,
+		  const char *dict, size_t dictlen,
+		  const char *fmt, va_list args)
+{
+	static char textbuf[LOG_LINE_MAX];
+	size_t text_len;
+
+	/*
+	 * The printf needs to come first; we need the syslog
+	 * prefix which might be passed-in as a parameter.
+	 */
+	text_len = vscnprintf(textbuf, sizeof(textbuf), fmt, args);
+
+	return log_store_text(facility, level, dict, dictlen,
+			      textbuf, text_len);
+}
+
+/*
+ * vprintk_emit() formats into a per-CPU buffer with interrupts disabled
+ * and in printk-safe context, so nothing else on this CPU can use it, and
+ * only takes logbuf_lock to copy the result into the log.  NMI direct
+ * printing still goes through vprintk_store() and its buffer.
+ */
+static DEFINE_PER_CPU(char [LOG_LINE_MAX], printk_textbuf);
+
+/*
+ * Console output is normally handed to a dedicated low priority kthread,
+ * so the CPU that logs a message storm does not also have to push it out
+ * to a slow console.  Output stays synchronous until the kthread runs and
+ * while an oops, panic or shutdown is in progress.
+ */
+static bool console_kthread = true;
+module_param(console_kthread, bool, 0644);
+MODULE_PARM_DESC(console_kthread, "print to consoles from a kthread");
+
+static struct task_struct *printk_kthread;
+static DECLARE_WAIT_QUEUE_HEAD(printk_kthread_wait);
+static bool printk_kthread_wanted;
+
+static bool printk_kthread_active(void)
+{
+	return READ_ONCE(console_kthread) && printk_kthread &&
+		!oops_in_progress && system_state <= SYSTEM_RUNNING;
+}
+
+static void printk_kthread_wake(void)
+{
+	WRITE_ONCE(printk_kthread_wanted, true);
+	wake_up_interruptible(&printk_kthread_wait);
+}
+
+static int printk_kthread_func(void *data)
+{
+	while (!kthread_should_stop()) {
+		wait_event_interruptible(printk_kthread_wait,
+					 READ_ONCE(printk_kthread_wanted) ||
+					 kthread_should_stop());
+		/*
+		 * Clear before printing: anything logged from here on sets
+		 * it again, anything logged earlier is printed below.
+		 */
+		WRITE_ONCE(printk_kthread_wanted, false);
+		console_lock();
+		console_unlock();
+	}
+	return 0;
+}
+
+static int __init printk_kthread_init(void)
+{
+	struct task_struct *tsk;
+
+	tsk = kthread_run(printk_kthread_func, NULL, "printk");
+	if (IS_ERR(tsk)) {
+		pr_err("printk: failed to start console kthread, printing synchronously\n");
+		return PTR_ERR(tsk);
+	}
+	set_user_nice(tsk, 10);
+	printk_kthread = tsk;
+	return 0;
+}
+early_initcall(printk_kthread_init);
+
 asmlinkage int vprintk_emit(int facility, int level,
 			    const char *dict, size_t dictlen,
 			    const char *fmt, va_list args)
@@ -1956,6 +2035,8 @@ asmlinkage int vprintk_emit(int facility, int level,
 	int printed_len;
 	bool in_sched = false;
 	unsigned long flags;
+	size_t text_len;
+	char *text;
 
 	if (level == LOGLEVEL_SCHED) {
 		level = LOGLEVEL_DEFAULT;
@@ -1965,13 +2046,25 @@ asmlinkage int vprintk_emit(int facility, int level,
 	boot_delay_msec(level);
 	printk_delay();
 
+	printk_safe_enter_irqsave(flags);
+	text = *this_cpu_ptr(&printk_textbuf);
+	text_len = vscnprintf(text, LOG_LINE_MAX, fmt, args);
+
 	/* This stops the holder of console_sem just where we want him */
-	logbuf_lock_irqsave(flags);
-	printed_len = vprintk_store(facility, level, dict, dictlen, fmt, args);
-	logbuf_unlock_irqrestore(flags);
+	raw_spin_lock(&logbuf_lock);
+	printed_len = log_store_text(facility, level, dict, dictlen,
+				     text, text_len);
+	raw_spin_unlock(&logbuf_lock);
+	printk_safe_exit_irqrestore(flags);
 
-	/* If called from the scheduler, we can not call up(). */
-	if (!in_sched) {
+	/*
+	 * If called from the scheduler, we can not call up().  The console
+	 * kthread is woken through irq_work for the same reason: printk()
+	 * may be called with any lock held.
+	 */
+	if (printk_kthread_active()) {
+		defer_console_output();
+	} else if (!in_sched) {
 		/*
 		 * Disable preemption to avoid being preempted while holding
 		 * console_sem which would prevent anyone from printing to
@@ -2937,7 +3030,9 @@ static void wake_up_klogd_work_func(struct irq_work *irq_work)
 
 	if (pending & PRINTK_PENDING_OUTPUT) {
 		/* If trylock fails, someone else is doing the printing */
-		if (console_trylock())
+		if (printk_kthread_active())
+			printk_kthread_wake();
+		else if (console_trylock())
 			console_unlock();
 	}
 
@@ -94,6 +94,22 @@ static unsigned long b_rcu_perf_writer_started;
 static unsigned long b_rcu_perf_writer_finished;
 static DEFINE_PER_CPU(atomic_t, n_async_inflight);
 
+/* Callback queued by rcu_perf_writer() in gp_async mode. */
+struct rcu_perf_cb {
+	struct rcu_head rh;
+	u64 queued;	/* ktime_get_mono_fast_ns() when queued. */
+	int cpu;	/* CPU that queued it. */
+};
+
+/* Queue-to-invocation latency of gp_async callbacks, per invoking CPU. */
+struct rcu_perf_cb_stats {
+	unsigned long n;
+	unsigned long n_remote;	/* Invoked on some other CPU (offloaded). */
+	u64 total_ns;
+	u64 max_ns;
+};
+static DEFINE_PER_CPU(struct rcu_perf_cb_stats, rcu_perf_cb_stats);
+
 static int rcu_perf_writer_state;
 #define RTWS_INIT		0
 #define RTWS_ASYNC		1
@@ -390,11 +406,24 @@ rcu_perf_reader(void *arg)
 
 /*
  * Callback function for asynchronous grace periods from rcu_perf_writer().
+ * Callbacks are invoked with BH disabled, so the per-CPU statistics need
+ * no further protection.  With callback offloading the invoking CPU need
+ * not be the queuing CPU, hence the explicit ->cpu for the inflight count.
  */
 static void rcu_perf_async_cb(struct rcu_head *rhp)
 {
-	atomic_dec(this_cpu_ptr(&n_async_inflight));
-	kfree(rhp);
+	struct rcu_perf_cb *cb = container_of(rhp, struct rcu_perf_cb, rh);
+	struct rcu_perf_cb_stats *st = this_cpu_ptr(&rcu_perf_cb_stats);
+	u64 lat = ktime_get_mono_fast_ns() - cb->queued;
+
+	st->n++;
+	if (cb->cpu != smp_processor_id())
+		st->n_remote++;
+	st->total_ns += lat;
+	if (lat > st->max_ns)
+		st->max_ns = lat;
+	atomic_dec(per_cpu_ptr(&n_async_inflight, cb->cpu));
+	kfree(cb);
 }
 
 /*
@@ -406,7 +435,7 @@ rcu_perf_writer(void *arg)
 	int i = 0;
 	int i_max;
 	long me = (long)arg;
-	struct rcu_head *rhp = NULL;
+	struct rcu_perf_cb *cb = NULL;
 	struct sched_param sp;
 	bool started = false, done = false, alldone = false;
 	u64 t;
@@ -441,19 +470,21 @@ rcu_perf_writer(void *arg)
 		*wdp = ktime_get_mono_fast_ns();
 		if (gp_async) {
 retry:
-			if (!rhp)
-				rhp = kmalloc(sizeof(*rhp), GFP_KERNEL);
-			if (rhp && atomic_read(this_cpu_ptr(&n_async_inflight)) < gp_async_max) {
+			if (!cb)
+				cb = kmalloc(sizeof(*cb), GFP_KERNEL);
+			if (cb && atomic_read(this_cpu_ptr(&n_async_inflight)) < gp_async_max) {
 				rcu_perf_writer_state = RTWS_ASYNC;
-				atomic_inc(this_cpu_ptr(&n_async_inflight));
-				cur_ops->async(rhp, rcu_perf_async_cb);
-				rhp = NULL;
+				cb->cpu = raw_smp_processor_id();
+				atomic_inc(per_cpu_ptr(&n_async_inflight, cb->cpu));
+				cb->queued = ktime_get_mono_fast_ns();
+				cur_ops->async(&cb->rh, rcu_perf_async_cb);
+				cb = NULL;
 			} else if (!kthread_should_stop()) {
 				rcu_perf_writer_state = RTWS_BARRIER;
 				cur_ops->gp_barrier();
 				goto retry;
 			} else {
-				kfree(rhp); /* Because we are stopping. */
+				kfree(cb); /* Because we are stopping. */
 			}
 		} else if (gp_exp) {
 			rcu_perf_writer_state = RTWS_EXP_SYNC;
@@ -520,6 +551,37 @@ rcu_perf_print_module_parms(struct rcu_perf_ops *cur_ops, const char *tag)
 		 perf_type, tag, nrealreaders, nrealwriters, verbose, shutdown);
 }
 
+/*
+ * Print how long gp_async callbacks waited between being queued and being
+ * invoked, and on how many of them invocation was offloaded to another CPU.
+ */
+static void rcu_perf_print_cb_stats(void)
+{
+	struct rcu_perf_cb_stats *st;
+	unsigned long n = 0;
+	unsigned long n_remote = 0;
+	u64 total = 0;
+	u64 max = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		st = per_cpu_ptr(&rcu_perf_cb_stats, cpu);
+		if (!st->n)
+			continue;
+		pr_alert("%s%s cpu %d invoked %lu callbacks (%lu offloaded): avg %llu ns max %llu ns\n",
+			 perf_type, PERF_FLAG, cpu, st->n, st->n_remote,
+			 div64_ul(st->total_ns, st->n), st->max_ns);
+		n += st->n;
+		n_remote += st->n_remote;
+		total += st->total_ns;
+		max = max(max, st->max_ns);
+	}
+	if (n)
+		pr_alert("%s%s cb-latency: %lu callbacks, %lu offloaded, avg %llu ns max %llu ns\n",
+			 perf_type, PERF_FLAG, n, n_remote,
+			 div64_ul(total, n), max);
+}
+
 static void
 rcu_perf_cleanup(void)
 {
@@ -573,6 +635,8 @@ rcu_perf_cleanup(void)
 			 ngps,
 			 b_rcu_perf_writer_finished -
 			 b_rcu_perf_writer_started);
+		if (gp_async)
+			rcu_perf_print_cb_stats();
 		for (i = 0; i < nrealwriters; i++) {
 			if (!writer_durations)
 				break;
@@ -24,11 +24,13 @@
  *	   Paul E. McKenney <paulmck@linux.vnet.ibm.com>
  */
 
+#include <linux/arch_topology.h>
 #include <linux/delay.h>
 #include <linux/gfp.h>
 #include <linux/oom.h>
 #include <linux/sched/debug.h>
 #include <linux/smpboot.h>
+#include <linux/topology.h>
 #include <uapi/linux/sched/types.h>
 #include "../time/tick-internal.h"
 
@@ -1772,6 +1774,30 @@ static int __init parse_rcu_nocb_poll(char *arg)
 }
 early_param("rcu_nocb_poll", parse_rcu_nocb_poll);
 
+/*
+ * Cluster offload mode: offload callbacks from every CPU (unless rcu_nocbs=
+ * narrows the set), form one leader/follower group per cluster instead of
+ * per rcu_nocb_leader_stride CPUs, and run all rcuo kthreads on the
+ * lowest-capacity CPUs so that bursts of RCU frees stay off the big cores.
+ */
+static bool rcu_nocb_cluster;
+module_param(rcu_nocb_cluster, bool, 0444);
+static cpumask_var_t rcu_nocb_cluster_mask; /* CPUs the rcuo kthreads use. */
+
+/*
+ * Grace-period batching for no-CBs leaders.  While fewer than
+ * rcu_nocb_batch_qlen callbacks are outstanding in a group, the leader
+ * waits up to rcu_nocb_batch_delay jiffies, scaled down as the queue
+ * grows, for more callbacks to share the next grace period.  Default of
+ * -1 for two jiffies in cluster mode and no batching otherwise.  Nothing
+ * is delayed while an rcu_barrier() is in flight or while a synchronous
+ * grace-period waiter is queued, since someone is blocked on it.
+ */
+static int rcu_nocb_batch_delay = -1;
+module_param(rcu_nocb_batch_delay, int, 0644);
+static long rcu_nocb_batch_qlen = 256;
+module_param(rcu_nocb_batch_qlen, long, 0644);
+
 /*
  * Wake up any no-CBs CPUs' kthreads that were waiting on the just-ended
  * grace period.
@@ -2072,6 +2098,50 @@ static void rcu_nocb_wait_gp(struct rcu_data *rdp)
 	smp_mb(); /* Ensure that CB invocation happens after GP end. */
 }
 
+/*
+ * Does one of the first @max callbacks queued on @rdp wake a task blocked
+ * in synchronize_rcu() and friends?  Only the leader removes callbacks
+ * from ->nocb_head, so the list is stable up to its tail here.
+ */
+static bool nocb_q_has_waiter(struct rcu_data *rdp, long max)
+{
+	struct rcu_head *rhp;
+
+	for (rhp = READ_ONCE(rdp->nocb_head); rhp && max-- > 0;
+	     rhp = READ_ONCE(rhp->next))
+		if (READ_ONCE(rhp->func) == wakeme_after_rcu)
+			return true;
+	return false;
+}
+
+/*
+ * A leader that has just been woken holds off for a little while if its
+ * group has only a few callbacks outstanding, so that callbacks queued
+ * in quick succession wait for one grace period rather than several.
+ * Long queues, expedited mode, rcu_barrier() and callbacks that a task
+ * is blocked on start the grace period immediately.
+ */
+static void nocb_leader_batch(struct rcu_data *my_rdp)
+{
+	int delay = READ_ONCE(rcu_nocb_batch_delay);
+	long qhi = READ_ONCE(rcu_nocb_batch_qlen);
+	long qlen = 0;
+	struct rcu_data *rdp;
+
+	if (delay <= 0 || rcu_gp_is_expedited() ||
+	    rcu_seq_state(READ_ONCE(my_rdp->rsp->barrier_sequence)))
+		return;
+	for (rdp = my_rdp; rdp; rdp = rdp->nocb_next_follower)
+		qlen += atomic_long_read(&rdp->nocb_q_count);
+	if (qlen <= 0 || qlen >= qhi)
+		return;
+	for (rdp = my_rdp; rdp; rdp = rdp->nocb_next_follower)
+		if (nocb_q_has_waiter(rdp, qhi))
+			return;
+	trace_rcu_nocb_wake(my_rdp->rsp->name, my_rdp->cpu, TPS("Batch"));
+	schedule_timeout_interruptible(DIV_ROUND_UP(delay * (qhi - qlen), qhi));
+}
+
 /*
  * Leaders come here to wait for additional callbacks to show up.
  * This function does not return until callbacks appear.
@@ -2100,6 +2170,7 @@ static void nocb_leader_wait(struct rcu_data *my_rdp)
 		firsttime = false; /* Don't drown trace log with "Poll"! */
 		trace_rcu_nocb_wake(my_rdp->rsp->name, my_rdp->cpu, TPS("Poll"));
 	}
+	nocb_leader_batch(my_rdp);
 
 	/*
 	 * Each pass through the following loop checks a follower for CBs.
@@ -2310,6 +2381,20 @@ void __init rcu_init_nohz(void)
 	if (!have_rcu_nocb_mask)
 		return;
 
+	if (rcu_nocb_cluster &&
+	    !zalloc_cpumask_var(&rcu_nocb_cluster_mask, GFP_KERNEL)) {
+		pr_info("rcu_nocb_cluster_mask allocation failed, cluster offload disabled.\n");
+		rcu_nocb_cluster = false;
+	}
+	if (rcu_nocb_cluster) {
+		/* Capacities are not known yet, see rcu_nocb_cpu_scale_notify(). */
+		cpumask_copy(rcu_nocb_cluster_mask, cpu_possible_mask);
+		if (cpumask_empty(rcu_nocb_mask))
+			cpumask_copy(rcu_nocb_mask, cpu_possible_mask);
+	}
+	if (rcu_nocb_batch_delay < 0)
+		rcu_nocb_batch_delay = rcu_nocb_cluster ? 2 : 0;
+
 #if defined(CONFIG_NO_HZ_FULL)
 	if (tick_nohz_full_running)
 		cpumask_or(rcu_nocb_mask, rcu_nocb_mask, tick_nohz_full_mask);
@@ -2324,6 +2409,11 @@ void __init rcu_init_nohz(void)
 		cpumask_pr_args(rcu_nocb_mask));
 	if (rcu_nocb_poll)
 		pr_info("\tPoll for callbacks from no-CBs CPUs.\n");
+	if (rcu_nocb_cluster)
+		pr_info("\tOffload RCU callbacks per cluster to the lowest-capacity CPUs.\n");
+	if (rcu_nocb_batch_delay)
+		pr_info("\tBatch no-CBs grace periods below %ld callbacks for up to %d jiffies.\n",
+			rcu_nocb_batch_qlen, rcu_nocb_batch_delay);
 
 	for_each_rcu_flavor(rsp) {
 		for_each_cpu(cpu, rcu_nocb_mask)
@@ -2343,6 +2433,24 @@ static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
 		    (unsigned long)rdp);
 }
 
+/*
+ * Restrict rcuo kthreads to the lowest-capacity CPUs in cluster mode.
+ * Without asymmetric capacity information every possible CPU qualifies.
+ */
+static void rcu_nocb_update_cluster_mask(void)
+{
+#ifdef CONFIG_GENERIC_ARCH_TOPOLOGY
+	topology_lowest_capacity_cpus(rcu_nocb_cluster_mask);
+#endif /* #ifdef CONFIG_GENERIC_ARCH_TOPOLOGY */
+}
+
+static void rcu_nocb_set_affinity(struct task_struct *t)
+{
+	if (rcu_nocb_cluster &&
+	    cpumask_intersects(rcu_nocb_cluster_mask, cpu_online_mask))
+		set_cpus_allowed_ptr(t, rcu_nocb_cluster_mask);
+}
+
 /*
  * If the specified CPU is a no-CBs CPU that does not already have its
  * rcuo kthread for the specified RCU flavor, spawn it.  If the CPUs are
@@ -2385,9 +2493,11 @@ static void rcu_spawn_one_nocb_kthread(struct rcu_state *rsp, int cpu)
 	}
 
 	/* Spawn the kthread for this CPU and RCU flavor. */
-	t = kthread_run(rcu_nocb_kthread, rdp_spawn,
-			"rcuo%c/%d", rsp->abbr, cpu);
+	t = kthread_create(rcu_nocb_kthread, rdp_spawn,
+			   "rcuo%c/%d", rsp->abbr, cpu);
 	BUG_ON(IS_ERR(t));
+	rcu_nocb_set_affinity(t);
+	wake_up_process(t);
 	WRITE_ONCE(rdp_spawn->nocb_kthread, t);
 }
 
@@ -2404,6 +2514,40 @@ static void rcu_spawn_all_nocb_kthreads(int cpu)
 			rcu_spawn_one_nocb_kthread(rsp, cpu);
 }
 
+#ifdef CONFIG_GENERIC_ARCH_TOPOLOGY
+/*
+ * The CPU capacities changed, typically because cpufreq came up and
+ * normalized them, so recompute the set of lowest-capacity CPUs and move
+ * the rcuo kthreads spawned so far.  Holding off CPU hotplug keeps
+ * concurrent spawns from seeing a half-updated mask.
+ */
+static int rcu_nocb_cpu_scale_notify(struct notifier_block *nb,
+				     unsigned long val, void *data)
+{
+	int cpu;
+	struct rcu_state *rsp;
+	struct task_struct *t;
+
+	get_online_cpus();
+	rcu_nocb_update_cluster_mask();
+	for_each_rcu_flavor(rsp) {
+		for_each_cpu(cpu, rcu_nocb_mask) {
+			t = READ_ONCE(per_cpu_ptr(rsp->rda, cpu)->nocb_kthread);
+			if (t)
+				rcu_nocb_set_affinity(t);
+		}
+	}
+	put_online_cpus();
+	pr_info("RCU: rcuo kthreads confined to CPUs %*pbl.\n",
+		cpumask_pr_args(rcu_nocb_cluster_mask));
+	return NOTIFY_OK;
+}
+
+static struct notifier_block rcu_nocb_cpu_scale_nb = {
+	.notifier_call = rcu_nocb_cpu_scale_notify,
+};
+#endif /* #ifdef CONFIG_GENERIC_ARCH_TOPOLOGY */
+
 /*
  * Once the scheduler is running, spawn rcuo kthreads for all online
  * no-CBs CPUs.  This assumes that the early_initcall()s happen before
@@ -2413,7 +2557,16 @@ static void rcu_spawn_all_nocb_kthreads(int cpu)
 static void __init rcu_spawn_nocb_kthreads(void)
 {
 	int cpu;
+	struct rcu_state *rsp;
 
+	if (rcu_nocb_cluster) {
+#ifdef CONFIG_GENERIC_ARCH_TOPOLOGY
+		topology_register_cpu_scale_notifier(&rcu_nocb_cpu_scale_nb);
+#endif /* #ifdef CONFIG_GENERIC_ARCH_TOPOLOGY */
+		rcu_nocb_update_cluster_mask();
+		for_each_rcu_flavor(rsp)
+			rcu_organize_nocb_clusters(rsp);
+	}
 	for_each_online_cpu(cpu)
 		rcu_spawn_all_nocb_kthreads(cpu);
 }
@@ -2462,6 +2615,41 @@ static void __init rcu_organize_nocb_kthreads(struct rcu_state *rsp)
 	}
 }
 
+/*
+ * Regroup the no-CBs CPUs so that each cluster (physical package) has a
+ * leader of its own, its lowest-numbered CPU, and all other CPUs of that
+ * cluster as followers.  Runs before any rcuo kthread exists, once the
+ * topology has been parsed.
+ */
+static void __init rcu_organize_nocb_clusters(struct rcu_state *rsp)
+{
+	int cpu;
+	int other;
+	struct rcu_data *rdp;
+	struct rcu_data *rdp_prev;
+
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		rdp = per_cpu_ptr(rsp->rda, cpu);
+		rdp->nocb_leader = rdp;
+		rdp->nocb_next_follower = NULL;
+		for_each_cpu(other, rcu_nocb_mask) {
+			if (other == cpu)
+				break;
+			if (topology_physical_package_id(other) !=
+			    topology_physical_package_id(cpu))
+				continue;
+
+			/* First CPU of this cluster is its leader. */
+			rdp_prev = per_cpu_ptr(rsp->rda, other);
+			rdp->nocb_leader = rdp_prev;
+			while (rdp_prev->nocb_next_follower)
+				rdp_prev = rdp_prev->nocb_next_follower;
+			rdp_prev->nocb_next_follower = rdp;
+			break;
+		}
+	}
+}
+
 /* Prevent __call_rcu() from enqueuing callbacks on no-CBs CPUs */
 static bool init_nocb_callback_list(struct rcu_data *rdp)
 {
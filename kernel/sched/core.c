@@ -4125,6 +4125,27 @@ int idle_cpu(int cpu)
 	return 1;
 }
 
+/**
+ * idle_cpu_state_idx - how deep is a given idle CPU sleeping?
+ * @cpu: the processor in question.
+ *
+ * Return: the index of the cpuidle state @cpu entered, or -1 if @cpu is not
+ * idle or its idle state is unknown.
+ */
+int idle_cpu_state_idx(int cpu)
+{
+	int idx;
+
+	if (!idle_cpu(cpu))
+		return -1;
+
+	rcu_read_lock();
+	idx = idle_get_state_idx(cpu_rq(cpu));
+	rcu_read_unlock();
+
+	return idx;
+}
+
 /**
  * idle_task - return the idle task for a given CPU.
  * @cpu: the processor in question.
@@ -37,6 +37,7 @@
 #include <linux/ptrace.h>
 #include <linux/fs_struct.h>
 #include <linux/file.h>
+#include <linux/futex.h>
 #include <linux/mount.h>
 #include <linux/gfp.h>
 #include <linux/syscore_ops.h>
@@ -2549,6 +2550,32 @@ SYSCALL_DEFINE5(prctl, int, option, unsigned long, arg2, unsigned long, arg3,
 			clear_bit(MMF_DISABLE_THP, &me->mm->flags);
 		up_write(&me->mm->mmap_sem);
 		break;
+	case PR_GET_LAZY_FORK:
+		if (arg2 || arg3 || arg4 || arg5)
+			return -EINVAL;
+		error = !!test_bit(MMF_LAZY_FORK, &me->mm->flags);
+		break;
+	case PR_SET_LAZY_FORK:
+		if (arg3 || arg4 || arg5)
+			return -EINVAL;
+		if (down_write_killable(&me->mm->mmap_sem))
+			return -EINTR;
+		if (arg2)
+			set_bit(MMF_LAZY_FORK, &me->mm->flags);
+		else
+			clear_bit(MMF_LAZY_FORK, &me->mm->flags);
+		up_write(&me->mm->mmap_sem);
+		break;
+	case PR_GET_FUTEX_HASH:
+		if (arg2 || arg3 || arg4 || arg5)
+			return -EINVAL;
+		error = futex_hash_prctl_get();
+		break;
+	case PR_SET_FUTEX_HASH:
+		if (arg3 || arg4 || arg5)
+			return -EINVAL;
+		error = futex_hash_prctl(arg2);
+		break;
 	case PR_MPX_ENABLE_MANAGEMENT:
 		if (arg2 || arg3 || arg4 || arg5)
 			return -EINVAL;
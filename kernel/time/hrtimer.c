@@ -48,6 +48,7 @@
 #include <linux/sched/rt.h>
 #include <linux/sched/deadline.h>
 #include <linux/sched/nohz.h>
+#include <linux/cgroup_timer_slack.h>
 #include <linux/sched/debug.h>
 #include <linux/timer.h>
 #include <linux/freezer.h>
@@ -963,6 +964,8 @@ static inline ktime_t hrtimer_update_lowres(struct hrtimer *timer, ktime_t tim,
 	return tim;
 }
 
+static enum hrtimer_restart hrtimer_wakeup(struct hrtimer *timer);
+
 /**
  * hrtimer_start_range_ns - (re)start an hrtimer on the current CPU
  * @timer:	the timer to be added
@@ -990,6 +993,15 @@ void hrtimer_start_range_ns(struct hrtimer *timer, ktime_t tim,
 
 	hrtimer_set_expires_range_ns(timer, tim, delta_ns);
 
+	/* Let a nanosleep's cgroup align its expiry with other sleepers: */
+	if (delta_ns && timer->function == hrtimer_wakeup) {
+		struct hrtimer_sleeper *sl =
+			container_of(timer, struct hrtimer_sleeper, timer);
+
+		if (sl->task && sl->coalesce)
+			timer_slack_coalesce(timer, base->offset, sl->task);
+	}
+
 	/* Switch the timer base, if necessary: */
 	new_base = switch_hrtimer_base(timer, base, mode & HRTIMER_MODE_PINNED);
 
@@ -1491,8 +1503,10 @@ static enum hrtimer_restart hrtimer_wakeup(struct hrtimer *timer)
 	struct task_struct *task = t->task;
 
 	t->task = NULL;
-	if (task)
+	if (task) {
+		timer_slack_count_wakeup(task);
 		wake_up_process(task);
+	}
 
 	return HRTIMER_NORESTART;
 }
@@ -1501,6 +1515,7 @@ void hrtimer_init_sleeper(struct hrtimer_sleeper *sl, struct task_struct *task)
 {
 	sl->timer.function = hrtimer_wakeup;
 	sl->task = task;
+	sl->coalesce = false;
 }
 EXPORT_SYMBOL_GPL(hrtimer_init_sleeper);
 
@@ -1528,6 +1543,7 @@ static int __sched do_nanosleep(struct hrtimer_sleeper *t, enum hrtimer_mode mod
 	struct restart_block *restart;
 
 	hrtimer_init_sleeper(t, current);
+	t->coalesce = true;
 
 	do {
 		set_current_state(TASK_INTERRUPTIBLE);
@@ -1582,7 +1598,7 @@ long hrtimer_nanosleep(const struct timespec64 *rqtp,
 	int ret = 0;
 	u64 slack;
 
-	slack = current->timer_slack_ns;
+	slack = task_timer_slack_ns(current);
 	if (dl_task(current) || rt_task(current))
 		slack = 0;
 
@@ -42,6 +42,7 @@
 #include <linux/sched/sysctl.h>
 #include <linux/sched/nohz.h>
 #include <linux/sched/debug.h>
+#include <linux/cgroup_timer_slack.h>
 #include <linux/slab.h>
 #include <linux/compat.h>
 
@@ -1743,6 +1744,7 @@ static void process_timeout(struct timer_list *t)
 {
 	struct process_timer *timeout = from_timer(timeout, t, timer);
 
+	timer_slack_count_wakeup(timeout->task);
 	wake_up_process(timeout->task);
 }
 
@@ -1813,7 +1815,7 @@ signed long __sched schedule_timeout(signed long timeout)
 
 	timer.task = current;
 	timer_setup_on_stack(&timer.timer, process_timeout, 0);
-	__mod_timer(&timer.timer, expire, false);
+	__mod_timer(&timer.timer, timer_slack_coalesce_jiffies(expire), false);
 	schedule();
 	del_singleshot_timer_sync(&timer.timer);
 
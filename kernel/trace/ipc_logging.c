@@ -12,6 +12,7 @@
  */
 
 #include <asm/arch_timer.h>
+#include <asm/sections.h>
 #include <linux/slab.h>
 #include <linux/uaccess.h>
 #include <linux/module.h>
@@ -27,6 +28,9 @@
 #include <linux/wait.h>
 #include <linux/delay.h>
 #include <linux/completion.h>
+#include <linux/cpu.h>
+#include <linux/ctype.h>
+#include <linux/percpu.h>
 #include <linux/sched/clock.h>
 #include <linux/ipc_logging.h>
 
@@ -282,60 +286,148 @@ static void msg_drop(struct ipc_log_context *ilctxt)
 }
 
 /*
- * Commits messages to the FIFO.  If the FIFO is full, then enough
- * messages are dropped to create space for the new message.
+ * Copies one encoded message into the log pages, dropping the oldest
+ * messages if needed.  Must be called with context_lock_lhb1 held.
  */
-void ipc_log_write(void *ctxt, struct encode_context *ectxt)
+static void __ipc_log_write(struct ipc_log_context *ilctxt,
+			    const char *buff, int len)
 {
-	struct ipc_log_context *ilctxt = (struct ipc_log_context *)ctxt;
 	int bytes_to_write;
-	unsigned long flags;
-
-	if (!ilctxt || !ectxt) {
-		pr_err("%s: Invalid ipc_log or encode context\n", __func__);
-		return;
-	}
 
-	read_lock_irqsave(&context_list_lock_lha1, flags);
-	spin_lock(&ilctxt->context_lock_lhb1);
-	while (ilctxt->write_avail <= ectxt->offset)
+	while (ilctxt->write_avail <= len)
 		msg_drop(ilctxt);
 
 	bytes_to_write = MIN(LOG_PAGE_DATA_SIZE
 				- ilctxt->write_page->hdr.write_offset,
-				ectxt->offset);
+				len);
 	memcpy((ilctxt->write_page->data +
 		ilctxt->write_page->hdr.write_offset),
-		ectxt->buff, bytes_to_write);
+		buff, bytes_to_write);
 
-	if (bytes_to_write != ectxt->offset) {
+	if (bytes_to_write != len) {
 		uint64_t t_now = sched_clock();
 
 		ilctxt->write_page->hdr.write_offset += bytes_to_write;
 		ilctxt->write_page->hdr.end_time = t_now;
 
 		ilctxt->write_page = get_next_page(ilctxt, ilctxt->write_page);
-		if (WARN_ON(ilctxt->write_page == NULL)) {
-			spin_unlock(&ilctxt->context_lock_lhb1);
-			read_unlock_irqrestore(&context_list_lock_lha1, flags);
+		if (WARN_ON(ilctxt->write_page == NULL))
 			return;
-		}
 		ilctxt->write_page->hdr.write_offset = 0;
 		ilctxt->write_page->hdr.start_time = t_now;
 		memcpy((ilctxt->write_page->data +
 			ilctxt->write_page->hdr.write_offset),
-		       (ectxt->buff + bytes_to_write),
-		       (ectxt->offset - bytes_to_write));
-		bytes_to_write = (ectxt->offset - bytes_to_write);
+		       (buff + bytes_to_write),
+		       (len - bytes_to_write));
+		bytes_to_write = (len - bytes_to_write);
 	}
 	ilctxt->write_page->hdr.write_offset += bytes_to_write;
-	ilctxt->write_avail -= ectxt->offset;
+	ilctxt->write_avail -= len;
+}
+
+/*
+ * Commits messages to the FIFO.  If the FIFO is full, then enough
+ * messages are dropped to create space for the new message.
+ */
+void ipc_log_write(void *ctxt, struct encode_context *ectxt)
+{
+	struct ipc_log_context *ilctxt = (struct ipc_log_context *)ctxt;
+	unsigned long flags;
+
+	if (!ilctxt || !ectxt) {
+		pr_err("%s: Invalid ipc_log or encode context\n", __func__);
+		return;
+	}
+
+	read_lock_irqsave(&context_list_lock_lha1, flags);
+	spin_lock(&ilctxt->context_lock_lhb1);
+	__ipc_log_write(ilctxt, ectxt->buff, ectxt->offset);
 	complete(&ilctxt->read_avail);
 	spin_unlock(&ilctxt->context_lock_lhb1);
 	read_unlock_irqrestore(&context_list_lock_lha1, flags);
 }
 EXPORT_SYMBOL(ipc_log_write);
 
+/*
+ * Commits the binary records staged in @cb to the log pages in one go.
+ * Must be called with interrupts disabled, on the CPU owning @cb or with
+ * that CPU offline.
+ */
+static void ipc_log_cpu_flush(struct ipc_log_context *ilctxt,
+			      struct ipc_log_cpu_buf *cb)
+{
+	struct tsv_header *hdr;
+	unsigned int off = 0;
+	int len;
+
+	if (!cb->used)
+		return;
+
+	read_lock(&context_list_lock_lha1);
+	spin_lock(&ilctxt->context_lock_lhb1);
+	while (off < cb->used) {
+		hdr = (struct tsv_header *)(cb->data + off);
+		len = sizeof(*hdr) + hdr->size;
+		__ipc_log_write(ilctxt, cb->data + off, len);
+		off += len;
+	}
+	complete(&ilctxt->read_avail);
+	spin_unlock(&ilctxt->context_lock_lhb1);
+	read_unlock(&context_list_lock_lha1);
+
+	cb->used = 0;
+	cb->flushes++;
+}
+
+static void ipc_log_flush_local(void *info)
+{
+	struct ipc_log_context *ilctxt = info;
+
+	ipc_log_cpu_flush(ilctxt, this_cpu_ptr(ilctxt->cpu_buf));
+}
+
+/*
+ * Commits the binary records staged on every CPU so that a reader sees
+ * everything logged so far.  Must be called from process context.
+ */
+void ipc_log_flush_cpus(struct ipc_log_context *ilctxt)
+{
+	int cpu;
+
+	if (!ilctxt->cpu_buf)
+		return;
+
+	get_online_cpus();
+	on_each_cpu(ipc_log_flush_local, ilctxt, 1);
+	for_each_possible_cpu(cpu) {
+		if (cpu_online(cpu))
+			continue;
+		local_irq_disable();
+		ipc_log_cpu_flush(ilctxt, per_cpu_ptr(ilctxt->cpu_buf, cpu));
+		local_irq_enable();
+	}
+	put_online_cpus();
+}
+
+/*
+ * Appends an encoded message to this CPU's staging buffer, flushing the
+ * buffer to the log pages first if the message does not fit.
+ */
+static void ipc_log_stage(struct ipc_log_context *ilctxt,
+			  struct encode_context *ectxt)
+{
+	struct ipc_log_cpu_buf *cb;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	cb = this_cpu_ptr(ilctxt->cpu_buf);
+	if (cb->used + ectxt->offset > IPC_LOG_CPU_BUF_SIZE)
+		ipc_log_cpu_flush(ilctxt, cb);
+	memcpy(cb->data + cb->used, ectxt->buff, ectxt->offset);
+	cb->used += ectxt->offset;
+	local_irq_restore(flags);
+}
+
 /*
  * Starts a new message after which you can add serialized data and
  * then complete the message by calling msg_encode_end().
@@ -497,21 +589,114 @@ int tsv_byte_array_write(struct encode_context *ectxt,
 }
 EXPORT_SYMBOL(tsv_byte_array_write);
 
+/*
+ * Returns true if @fmt can be formatted after the fact from its raw
+ * arguments.  %p extensions other than %pK and the symbol ones
+ * dereference the pointer, which may be stale by the time the log is read.
+ */
+static bool ipc_log_fmt_binary_ok(const char *fmt)
+{
+	while ((fmt = strchr(fmt, '%'))) {
+		fmt++;
+		if (*fmt == '%') {
+			fmt++;
+			continue;
+		}
+		fmt += strspn(fmt, "-+ #0123456789.*hlLqjzt");
+		if (*fmt == 'p' && isalnum(fmt[1]) && !strchr("KSsFfB", fmt[1]))
+			return false;
+		if (*fmt)
+			fmt++;
+	}
+	return true;
+}
+
+/*
+ * Encodes a binary record (format pointer plus vbin_printf() arguments)
+ * and stages it on this CPU.  Returns -ENOSPC if the arguments do not fit
+ * in one message.
+ */
+static int ipc_log_string_binary(struct ipc_log_context *ilctxt,
+				 const char *fmt, va_list args)
+{
+	struct encode_context ectxt;
+	u32 bin[IPC_LOG_BIN_WORDS];
+	int hdr_size = sizeof(struct tsv_header);
+	int words, len;
+
+	msg_encode_start(&ectxt, TSV_TYPE_BINARY);
+	tsv_timestamp_write(&ectxt);
+	tsv_qtimer_write(&ectxt);
+	tsv_pointer_write(&ectxt, (void *)fmt);
+	words = min_t(int, (MAX_MSG_SIZE - (ectxt.offset + hdr_size)) /
+		      sizeof(u32), IPC_LOG_BIN_WORDS);
+	len = vbin_printf(bin, words, fmt, args);
+	if (len > words)
+		return -ENOSPC;
+	tsv_byte_array_write(&ectxt, bin, len * sizeof(u32));
+	msg_encode_end(&ectxt);
+	ipc_log_stage(ilctxt, &ectxt);
+	return 0;
+}
+
+/*
+ * Only one call in IPC_LOG_STATS_SAMPLE is timed so that the clock reads
+ * stay off the common path.
+ */
+static inline u64 ipc_log_stats_start(struct ipc_log_context *ilctxt)
+{
+	if (this_cpu_inc_return(ilctxt->stats->seq) % IPC_LOG_STATS_SAMPLE)
+		return 0;
+	return sched_clock();
+}
+
+static inline void ipc_log_stats_end(struct ipc_log_context *ilctxt,
+				     int mode, u64 start)
+{
+	this_cpu_inc(ilctxt->stats->calls[mode]);
+	if (start) {
+		this_cpu_inc(ilctxt->stats->sampled[mode]);
+		this_cpu_add(ilctxt->stats->ns[mode], sched_clock() - start);
+	}
+}
+
 /*
  * Helper function to log a string
  *
  * @ilctxt ipc_log_context created using ipc_log_context_create()
  * @fmt Data specified using format specifiers
  */
-int ipc_log_string(void *ilctxt, const char *fmt, ...)
+int ipc_log_string(void *ctxt, const char *fmt, ...)
 {
+	struct ipc_log_context *ilctxt = (struct ipc_log_context *)ctxt;
 	struct encode_context ectxt;
 	int avail_size, data_size, hdr_size = sizeof(struct tsv_header);
 	va_list arg_list;
+	bool binary;
+	u64 start;
+	int ret;
 
 	if (!ilctxt)
 		return -EINVAL;
 
+	start = ipc_log_stats_start(ilctxt);
+
+	/* pairs with smp_store_release() in ipc_log_context_set_binary() */
+	binary = smp_load_acquire(&ilctxt->binary);
+	if (binary) {
+		ret = -EINVAL;
+		if (ipc_log_fmt_binary_ok(fmt)) {
+			va_start(arg_list, fmt);
+			ret = ipc_log_string_binary(ilctxt, fmt, arg_list);
+			va_end(arg_list);
+		}
+		if (!ret) {
+			ipc_log_stats_end(ilctxt, IPC_LOG_MODE_BINARY, start);
+			return 0;
+		}
+		this_cpu_inc(ilctxt->stats->fallbacks);
+	}
+
 	msg_encode_start(&ectxt, TSV_TYPE_STRING);
 	tsv_timestamp_write(&ectxt);
 	tsv_qtimer_write(&ectxt);
@@ -523,11 +708,52 @@ int ipc_log_string(void *ilctxt, const char *fmt, ...)
 	tsv_write_header(&ectxt, TSV_TYPE_BYTE_ARRAY, data_size);
 	ectxt.offset += data_size;
 	msg_encode_end(&ectxt);
-	ipc_log_write(ilctxt, &ectxt);
+	/* keep fallbacks in order with the binary records of this CPU */
+	if (binary)
+		ipc_log_stage(ilctxt, &ectxt);
+	else
+		ipc_log_write(ilctxt, &ectxt);
+	ipc_log_stats_end(ilctxt, IPC_LOG_MODE_STRING, start);
 	return 0;
 }
 EXPORT_SYMBOL(ipc_log_string);
 
+/*
+ * Switches ipc_log_string() between formatting at the call site and
+ * staging binary records that are formatted when the log is read.
+ *
+ * @ctxt   ipc_log_context created using ipc_log_context_create()
+ * @enable true to log binary records
+ */
+int ipc_log_context_set_binary(void *ctxt, bool enable)
+{
+	struct ipc_log_context *ilctxt = (struct ipc_log_context *)ctxt;
+	static DEFINE_MUTEX(binary_lock);
+	struct ipc_log_cpu_buf __percpu *cpu_buf;
+
+	if (!ilctxt)
+		return -EINVAL;
+
+	mutex_lock(&binary_lock);
+	if (enable && !ilctxt->cpu_buf) {
+		cpu_buf = alloc_percpu(struct ipc_log_cpu_buf);
+		if (!cpu_buf) {
+			mutex_unlock(&binary_lock);
+			return -ENOMEM;
+		}
+		ilctxt->cpu_buf = cpu_buf;
+	}
+	/* publish cpu_buf before writers can see binary mode */
+	smp_store_release(&ilctxt->binary, enable);
+	mutex_unlock(&binary_lock);
+
+	/* buffers stay allocated: writers may still be staging records */
+	if (!enable)
+		ipc_log_flush_cpus(ilctxt);
+	return 0;
+}
+EXPORT_SYMBOL(ipc_log_context_set_binary);
+
 /**
  * ipc_log_extract - Reads and deserializes log
  *
@@ -748,6 +974,60 @@ void tsv_byte_array_read(struct encode_context *ectxt,
 }
 EXPORT_SYMBOL(tsv_byte_array_read);
 
+/*
+ * Binary records keep a pointer to the format string, which is only
+ * usable while the kernel or the logging module is still loaded.
+ */
+static bool ipc_log_fmt_valid(const char *fmt)
+{
+	unsigned long addr = (unsigned long)fmt;
+	bool ret;
+
+	if ((addr >= (unsigned long)__start_rodata &&
+	     addr < (unsigned long)__end_rodata) || core_kernel_data(addr))
+		return true;
+
+	preempt_disable();
+	ret = __module_address(addr) != NULL;
+	preempt_enable();
+	return ret;
+}
+
+/*
+ * Reads the format pointer and arguments of a binary record and formats
+ * them into the decode context.
+ *
+ * @ectxt   context initialized by calling msg_read()
+ * @dctxt   deserialization context
+ */
+void tsv_binary_read(struct encode_context *ectxt,
+		     struct decode_context *dctxt)
+{
+	struct tsv_header hdr;
+	u32 bin[IPC_LOG_BIN_WORDS];
+	const char *fmt;
+	int len;
+
+	tsv_read_header(ectxt, &hdr);
+	if (WARN_ON(hdr.type != TSV_TYPE_POINTER))
+		return;
+	tsv_read_data(ectxt, &fmt, sizeof(fmt));
+	tsv_read_header(ectxt, &hdr);
+	if (WARN_ON(hdr.type != TSV_TYPE_BYTE_ARRAY || hdr.size > sizeof(bin)))
+		return;
+	tsv_read_data(ectxt, bin, hdr.size);
+
+	if (!ipc_log_fmt_valid(fmt)) {
+		IPC_SPRINTF_DECODE(dctxt, "<format %pK unloaded>", fmt);
+		return;
+	}
+	len = bstr_printf(dctxt->buff, min(dctxt->size, MAX_MSG_SIZE),
+			  fmt, bin);
+	len = min(len, min(dctxt->size, MAX_MSG_SIZE) - 1);
+	dctxt->buff += len;
+	dctxt->size -= len;
+}
+
 int add_deserialization_func(void *ctxt, int type,
 			void (*dfunc)(struct encode_context *,
 				      struct decode_context *))
@@ -823,6 +1103,12 @@ void *ipc_log_context_create(int max_num_pages,
 	if (!ctxt)
 		return 0;
 
+	ctxt->stats = alloc_percpu(struct ipc_log_cpu_stats);
+	if (!ctxt->stats) {
+		kfree(ctxt);
+		return 0;
+	}
+
 	init_completion(&ctxt->read_avail);
 	INIT_LIST_HEAD(&ctxt->page_list);
 	INIT_LIST_HEAD(&ctxt->dfunc_info_list);
@@ -875,6 +1161,7 @@ void *ipc_log_context_create(int max_num_pages,
 		list_del(&pg->hdr.list);
 		kfree(pg);
 	}
+	free_percpu(ctxt->stats);
 	kfree(ctxt);
 	return 0;
 }
@@ -892,6 +1179,8 @@ void ipc_log_context_free(struct kref *kref)
 		kfree(pg);
 	}
 
+	free_percpu(ilctxt->cpu_buf);
+	free_percpu(ilctxt->stats);
 	kfree(ilctxt);
 }
 
@@ -910,6 +1199,7 @@ int ipc_log_context_destroy(void *ctxt)
 		return 0;
 
 	debugfs_remove_recursive(ilctxt->dent);
+	ipc_log_flush_cpus(ilctxt);
 
 	spin_lock(&ilctxt->context_lock_lhb1);
 	ilctxt->destroyed = true;
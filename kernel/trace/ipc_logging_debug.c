@@ -26,6 +26,8 @@
 #include <linux/wait.h>
 #include <linux/delay.h>
 #include <linux/completion.h>
+#include <linux/percpu.h>
+#include <linux/seq_file.h>
 #include <linux/ipc_logging.h>
 
 #include "ipc_logging_private.h"
@@ -37,7 +39,7 @@ static int debug_log(struct ipc_log_context *ilctxt,
 		     char *buff, int size, int cont)
 {
 	int i = 0;
-	int ret;
+	long ret;
 
 	if (size < MAX_MSG_DECODED_SIZE) {
 		pr_err("%s: buffer size %d < %d\n", __func__, size,
@@ -45,10 +47,16 @@ static int debug_log(struct ipc_log_context *ilctxt,
 		return -ENOMEM;
 	}
 	do {
+		ipc_log_flush_cpus(ilctxt);
 		i = ipc_log_extract(ilctxt, buff, size - 1);
 		if (cont && i == 0) {
-			ret = wait_for_completion_interruptible(
-				&ilctxt->read_avail);
+			/*
+			 * Staged binary records only complete read_avail
+			 * when a CPU buffer fills up, so poll for them.
+			 */
+			ret = wait_for_completion_interruptible_timeout(
+				&ilctxt->read_avail,
+				ilctxt->cpu_buf ? HZ : MAX_SCHEDULE_TIMEOUT);
 			if (ret < 0)
 				return ret;
 		}
@@ -151,14 +159,70 @@ static void debug_create(const char *name, mode_t mode,
 	debugfs_create_file_unsafe(name, mode, dent, ilctxt, fops);
 }
 
-static void dfunc_string(struct encode_context *ectxt,
-			 struct decode_context *dctxt)
+static int debug_stats_show(struct seq_file *s, void *unused)
 {
-	tsv_timestamp_read(ectxt, dctxt, "");
-	tsv_qtimer_read(ectxt, dctxt, " ");
-	tsv_byte_array_read(ectxt, dctxt, "");
+	static const char * const mode_name[IPC_LOG_MODE_MAX] = {
+		[IPC_LOG_MODE_STRING] = "string",
+		[IPC_LOG_MODE_BINARY] = "binary",
+	};
+	struct ipc_log_context *ilctxt = s->private;
+	struct ipc_log_cpu_stats *st;
+	unsigned long calls, sampled, fallbacks = 0, flushes = 0;
+	u64 ns;
+	int cpu, mode;
 
-	/* add trailing \n if necessary */
+	seq_puts(s, "mode      calls       avg_ns\n");
+	for (mode = 0; mode < IPC_LOG_MODE_MAX; mode++) {
+		calls = sampled = ns = 0;
+		for_each_possible_cpu(cpu) {
+			st = per_cpu_ptr(ilctxt->stats, cpu);
+			calls += st->calls[mode];
+			sampled += st->sampled[mode];
+			ns += st->ns[mode];
+		}
+		seq_printf(s, "%-8s %10lu %10llu\n", mode_name[mode], calls,
+			   sampled ? div64_u64(ns, sampled) : 0);
+	}
+
+	for_each_possible_cpu(cpu) {
+		fallbacks += per_cpu_ptr(ilctxt->stats, cpu)->fallbacks;
+		if (ilctxt->cpu_buf)
+			flushes += per_cpu_ptr(ilctxt->cpu_buf, cpu)->flushes;
+	}
+	seq_printf(s, "fallbacks: %lu\nflushes: %lu\n", fallbacks, flushes);
+	return 0;
+}
+
+static int debug_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, debug_stats_show, inode->i_private);
+}
+
+static const struct file_operations debug_stats_ops = {
+	.open = debug_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int debug_binary_get(void *data, u64 *val)
+{
+	struct ipc_log_context *ilctxt = data;
+
+	*val = READ_ONCE(ilctxt->binary);
+	return 0;
+}
+
+static int debug_binary_set(void *data, u64 val)
+{
+	return ipc_log_context_set_binary(data, !!val);
+}
+DEFINE_SIMPLE_ATTRIBUTE(debug_binary_ops, debug_binary_get,
+			debug_binary_set, "%llu\n");
+
+/* add trailing \n if necessary */
+static void dfunc_newline(struct decode_context *dctxt)
+{
 	if (*(dctxt->buff - 1) != '\n') {
 		if (dctxt->size) {
 			++dctxt->buff;
@@ -168,6 +232,24 @@ static void dfunc_string(struct encode_context *ectxt,
 	}
 }
 
+static void dfunc_string(struct encode_context *ectxt,
+			 struct decode_context *dctxt)
+{
+	tsv_timestamp_read(ectxt, dctxt, "");
+	tsv_qtimer_read(ectxt, dctxt, " ");
+	tsv_byte_array_read(ectxt, dctxt, "");
+	dfunc_newline(dctxt);
+}
+
+static void dfunc_binary(struct encode_context *ectxt,
+			 struct decode_context *dctxt)
+{
+	tsv_timestamp_read(ectxt, dctxt, "");
+	tsv_qtimer_read(ectxt, dctxt, " ");
+	tsv_binary_read(ectxt, dctxt);
+	dfunc_newline(dctxt);
+}
+
 void check_and_create_debugfs(void)
 {
 	mutex_lock(&ipc_log_debugfs_init_lock);
@@ -197,9 +279,15 @@ void create_ctx_debugfs(struct ipc_log_context *ctxt,
 				     ctxt, &debug_ops);
 			debug_create("log_cont", 0444, ctxt->dent,
 				     ctxt, &debug_ops_cont);
+			debugfs_create_file("stats", 0444, ctxt->dent,
+					    ctxt, &debug_stats_ops);
+			debugfs_create_file("binary", 0644, ctxt->dent,
+					    ctxt, &debug_binary_ops);
 		}
 	}
 	add_deserialization_func((void *)ctxt,
 				 TSV_TYPE_STRING, dfunc_string);
+	add_deserialization_func((void *)ctxt,
+				 TSV_TYPE_BINARY, dfunc_binary);
 }
 EXPORT_SYMBOL(create_ctx_debugfs);
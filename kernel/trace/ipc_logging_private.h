@@ -17,6 +17,9 @@
 
 #define IPC_LOG_VERSION 0x0003
 #define IPC_LOG_MAX_CONTEXT_NAME_LEN 32
+#define IPC_LOG_CPU_BUF_SIZE 1024
+#define IPC_LOG_BIN_WORDS 64
+#define IPC_LOG_STATS_SAMPLE 16
 
 /**
  * struct ipc_log_page_header - Individual log page header
@@ -70,6 +73,42 @@ struct ipc_log_page {
 	char data[PAGE_SIZE - sizeof(struct ipc_log_page_header)];
 };
 
+/**
+ * struct ipc_log_cpu_buf - Per-CPU staging buffer for binary records
+ *
+ * @used:  Bytes of encoded messages in @data
+ * @flushes:  Number of times @data was committed to the log pages
+ * @data:  Encoded messages, committed in order when full or on read
+ */
+struct ipc_log_cpu_buf {
+	unsigned int used;
+	unsigned long flushes;
+	char data[IPC_LOG_CPU_BUF_SIZE];
+};
+
+enum {
+	IPC_LOG_MODE_STRING,
+	IPC_LOG_MODE_BINARY,
+	IPC_LOG_MODE_MAX,
+};
+
+/**
+ * struct ipc_log_cpu_stats - Per-CPU ipc_log_string() overhead
+ *
+ * @seq:  Call counter used to pick which calls are timed
+ * @calls:  Calls per logging mode
+ * @sampled:  Timed calls per logging mode
+ * @ns:  Total time of the timed calls per logging mode
+ * @fallbacks:  Binary mode calls that had to take the string path
+ */
+struct ipc_log_cpu_stats {
+	unsigned long seq;
+	unsigned long calls[IPC_LOG_MODE_MAX];
+	unsigned long sampled[IPC_LOG_MODE_MAX];
+	u64 ns[IPC_LOG_MODE_MAX];
+	unsigned long fallbacks;
+};
+
 /**
  * struct ipc_log_context - main logging context
  *
@@ -95,6 +134,9 @@ struct ipc_log_page {
  * @dfunc_info_list:  List of deserialization functions
  * @context_lock_lhb1:  Lock for entire structure
  * @read_avail:  Completed when new data is added to the log
+ * @binary:  ipc_log_string() stages binary records in @cpu_buf
+ * @cpu_buf:  Per-CPU binary record buffers (allocated on first enable)
+ * @stats:  Per-CPU ipc_log_string() statistics
  */
 struct ipc_log_context {
 	uint32_t magic;
@@ -121,6 +163,9 @@ struct ipc_log_context {
 	struct completion read_avail;
 	struct kref refcount;
 	bool destroyed;
+	bool binary;
+	struct ipc_log_cpu_buf __percpu *cpu_buf;
+	struct ipc_log_cpu_stats __percpu *stats;
 };
 
 struct dfunc_info {
@@ -150,6 +195,9 @@ enum {
 #define MAX_MSG_DECODED_SIZE (MAX_MSG_SIZE*4)
 
 void ipc_log_context_free(struct kref *kref);
+void ipc_log_flush_cpus(struct ipc_log_context *ilctxt);
+void tsv_binary_read(struct encode_context *ectxt,
+		     struct decode_context *dctxt);
 
 static inline void ipc_log_context_put(struct ipc_log_context *ilctxt)
 {
@@ -51,6 +51,10 @@
 #include <linux/bug.h>
 #include <linux/delay.h>
 #include <linux/nmi.h>
+#include <linux/arch_topology.h>
+#include <linux/debugfs.h>
+#include <linux/jump_label.h>
+#include <linux/seq_file.h>
 
 #include "workqueue_internal.h"
 
@@ -211,6 +215,9 @@ struct pool_workqueue {
 	int			nr_active;	/* L: nr of active works */
 	int			max_active;	/* L: max active works */
 	struct list_head	delayed_works;	/* L: delayed works */
+	unsigned long		nr_queued;	/* L: work items queued */
+	unsigned long		nr_wakeups;	/* L: queued onto an idle CPU */
+	unsigned long		nr_redirected;	/* L: moved for capacity class */
 	struct list_head	pwqs_node;	/* WR: node on wq->pwqs */
 	struct list_head	mayday_node;	/* MD: node on wq->maydays */
 
@@ -277,6 +284,7 @@ struct workqueue_struct {
 
 	/* hot fields used during command issue, aligned to cacheline */
 	unsigned int		flags ____cacheline_aligned; /* WQ: WQ_* flags */
+	int			capacity;	/* enum wq_capacity */
 	struct pool_workqueue __percpu *cpu_pwqs; /* I: per-cpu pwqs */
 	struct pool_workqueue __rcu *numa_pwq_tbl[]; /* PWR: unbound pwqs indexed by node */
 };
@@ -310,6 +318,15 @@ static bool workqueue_freezing;		/* PL: have wqs started freezing? */
 /* PL: allowable cpus for unbound wqs and work items */
 static cpumask_var_t wq_unbound_cpumask;
 
+/* PL: CPUs of each capacity class, see wq_update_capacity_cpumasks() */
+static cpumask_var_t wq_capacity_cpumask[WQ_CAPACITY_NR];
+
+static const char * const wq_capacity_names[WQ_CAPACITY_NR] = {
+	[WQ_CAPACITY_ANY]		= "any",
+	[WQ_CAPACITY_EFFICIENCY]	= "efficiency",
+	[WQ_CAPACITY_PERFORMANCE]	= "performance",
+};
+
 /* CPU where unbound work was last round robin scheduled from this CPU */
 static DEFINE_PER_CPU(int, wq_rr_cpu_last);
 
@@ -1390,6 +1407,69 @@ static int wq_select_unbound_cpu(int cpu)
 	return new_cpu;
 }
 
+/*
+ * Pick the CPU for a work item queued from @cpu without a target CPU on a
+ * per-cpu workqueue with a capacity class.  @cpu itself is used if it is
+ * in the class.  Otherwise prefer a CPU of the class that is running
+ * something already, then the idle one in the shallowest cpuidle state,
+ * so that housekeeping work does not pull a CPU out of deep idle.
+ */
+static int wq_select_capacity_cpu(struct workqueue_struct *wq, int cpu)
+{
+	const struct cpumask *mask = wq_capacity_cpumask[wq->capacity];
+	int best = -1, best_idx = INT_MAX;
+	int i, idx;
+
+	if (cpumask_test_cpu(cpu, mask))
+		return cpu;
+
+	for_each_cpu_wrap(i, mask, cpu) {
+		if (!cpu_online(i))
+			continue;
+		if (!idle_cpu(i))
+			return i;
+		idx = idle_cpu_state_idx(i);
+		if (idx < best_idx) {
+			best_idx = idx;
+			best = i;
+		}
+	}
+
+	return best >= 0 ? best : cpu;
+}
+
+#ifdef CONFIG_DEBUG_FS
+/* counting for the workqueue_stats debugfs file, off until enabled there */
+static DEFINE_STATIC_KEY_FALSE(wq_stats_key);
+
+static inline bool wq_stats_enabled(void)
+{
+	return static_branch_unlikely(&wq_stats_key);
+}
+#else
+static inline bool wq_stats_enabled(void)
+{
+	return false;
+}
+#endif
+
+/*
+ * Will waking a worker of @pool take a CPU out of idle?  Only the CPU the
+ * idle worker to be woken last ran on is looked at, which is where an
+ * unbound worker is most likely to wake up.
+ */
+static bool wq_wakes_idle_cpu(struct worker_pool *pool)
+{
+	struct worker *worker = first_idle_worker(pool);
+	int cpu;
+
+	if (!worker)
+		return false;
+
+	cpu = pool->cpu >= 0 ? pool->cpu : task_cpu(worker->task);
+	return cpu != raw_smp_processor_id() && idle_cpu(cpu);
+}
+
 static void __queue_work(int cpu, struct workqueue_struct *wq,
 			 struct work_struct *work)
 {
@@ -1398,6 +1478,7 @@ static void __queue_work(int cpu, struct workqueue_struct *wq,
 	struct list_head *worklist;
 	unsigned int work_flags;
 	unsigned int req_cpu = cpu;
+	bool redirected = false;
 
 	/*
 	 * While a work item is PENDING && off queue, a task trying to
@@ -1420,8 +1501,13 @@ static void __queue_work(int cpu, struct workqueue_struct *wq,
 			cpu = wq_select_unbound_cpu(raw_smp_processor_id());
 		pwq = unbound_pwq_by_node(wq, cpu_to_node(cpu));
 	} else {
-		if (req_cpu == WORK_CPU_UNBOUND)
+		if (req_cpu == WORK_CPU_UNBOUND) {
 			cpu = raw_smp_processor_id();
+			if (unlikely(wq->capacity != WQ_CAPACITY_ANY)) {
+				cpu = wq_select_capacity_cpu(wq, cpu);
+				redirected = cpu != raw_smp_processor_id();
+			}
+		}
 		pwq = per_cpu_ptr(wq->cpu_pwqs, cpu);
 	}
 
@@ -1478,6 +1564,11 @@ static void __queue_work(int cpu, struct workqueue_struct *wq,
 
 	pwq->nr_in_flight[pwq->work_color]++;
 	work_flags = work_color_to_flags(pwq->work_color);
+	if (wq_stats_enabled()) {
+		pwq->nr_queued++;
+		if (redirected)
+			pwq->nr_redirected++;
+	}
 
 	if (likely(pwq->nr_active < pwq->max_active)) {
 		trace_workqueue_activate_work(work);
@@ -1485,6 +1576,9 @@ static void __queue_work(int cpu, struct workqueue_struct *wq,
 		worklist = &pwq->pool->worklist;
 		if (list_empty(worklist))
 			pwq->pool->watchdog_ts = jiffies;
+		if (wq_stats_enabled() && __need_more_worker(pwq->pool) &&
+		    wq_wakes_idle_cpu(pwq->pool))
+			pwq->nr_wakeups++;
 	} else {
 		work_flags |= WORK_STRUCT_DELAYED;
 		worklist = &pwq->delayed_works;
@@ -3232,6 +3326,7 @@ static void copy_workqueue_attrs(struct workqueue_attrs *to,
 	 * get_unbound_pool() explicitly clears ->no_numa after copying.
 	 */
 	to->no_numa = from->no_numa;
+	to->capacity = from->capacity;
 }
 
 /* hash value of the content of @attr */
@@ -3439,6 +3534,7 @@ static struct worker_pool *get_unbound_pool(const struct workqueue_attrs *attrs)
 	 * 'struct workqueue_attrs' comments for detail.
 	 */
 	pool->attrs->no_numa = false;
+	pool->attrs->capacity = WQ_CAPACITY_ANY;
 
 	if (worker_pool_assign_id(pool) < 0)
 		goto fail;
@@ -3731,6 +3827,13 @@ apply_wqattrs_prepare(struct workqueue_struct *wq,
 	if (unlikely(cpumask_empty(new_attrs->cpumask)))
 		cpumask_copy(new_attrs->cpumask, wq_unbound_cpumask);
 
+	/* narrow to the capacity class unless that leaves no CPU */
+	if (new_attrs->capacity != WQ_CAPACITY_ANY &&
+	    cpumask_intersects(new_attrs->cpumask,
+			       wq_capacity_cpumask[new_attrs->capacity]))
+		cpumask_and(new_attrs->cpumask, new_attrs->cpumask,
+			    wq_capacity_cpumask[new_attrs->capacity]);
+
 	/*
 	 * We may create multiple pwqs with differing cpumasks.  Make a
 	 * copy of @new_attrs which will be modified and used to obtain
@@ -4250,6 +4353,55 @@ void workqueue_set_max_active(struct workqueue_struct *wq, int max_active)
 }
 EXPORT_SYMBOL_GPL(workqueue_set_max_active);
 
+/**
+ * workqueue_set_capacity - steer a workqueue to a CPU capacity class
+ * @wq: target workqueue
+ * @capacity: &enum wq_capacity
+ *
+ * The worker pools of an unbound @wq are restricted to the CPUs of
+ * @capacity, unless that would leave none of its cpumask.  On a per-cpu
+ * @wq, work queued without a target CPU from a CPU outside @capacity is
+ * moved to a CPU of the class, preferring CPUs that are not idle.  Work
+ * queued on a specific CPU always runs there.  Ordered workqueues cannot
+ * change their capacity class.
+ *
+ * CONTEXT:
+ * Might sleep.
+ *
+ * Return: 0 on success and -errno on failure.
+ */
+int workqueue_set_capacity(struct workqueue_struct *wq,
+			   enum wq_capacity capacity)
+{
+	struct workqueue_attrs *attrs;
+	int ret = 0;
+
+	if (capacity < WQ_CAPACITY_ANY || capacity >= WQ_CAPACITY_NR)
+		return -EINVAL;
+
+	if (wq->flags & WQ_UNBOUND) {
+		if (wq->flags & __WQ_ORDERED_EXPLICIT)
+			return -EINVAL;
+
+		apply_wqattrs_lock();
+		attrs = alloc_workqueue_attrs(GFP_KERNEL);
+		if (attrs) {
+			copy_workqueue_attrs(attrs, wq->unbound_attrs);
+			attrs->capacity = capacity;
+			ret = apply_workqueue_attrs_locked(wq, attrs);
+			free_workqueue_attrs(attrs);
+		} else {
+			ret = -ENOMEM;
+		}
+		apply_wqattrs_unlock();
+	}
+
+	if (!ret)
+		WRITE_ONCE(wq->capacity, capacity);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(workqueue_set_capacity);
+
 /**
  * current_work - retrieve %current task's work struct
  *
@@ -5088,6 +5240,137 @@ int workqueue_set_unbound_cpumask(cpumask_var_t cpumask)
 	return ret;
 }
 
+/*
+ * Sort the possible CPUs into capacity classes: the lowest-capacity CPUs
+ * are the efficiency class and all others the performance class.  With
+ * symmetric (or unknown) capacities both classes cover every CPU.
+ */
+static void wq_update_capacity_cpumasks(void)
+{
+#ifdef CONFIG_GENERIC_ARCH_TOPOLOGY
+	struct cpumask *eff = wq_capacity_cpumask[WQ_CAPACITY_EFFICIENCY];
+	struct cpumask *perf = wq_capacity_cpumask[WQ_CAPACITY_PERFORMANCE];
+
+	lockdep_assert_held(&wq_pool_mutex);
+
+	topology_lowest_capacity_cpus(eff);
+	cpumask_andnot(perf, cpu_possible_mask, eff);
+	if (cpumask_empty(perf))
+		cpumask_copy(perf, cpu_possible_mask);
+#endif
+}
+
+#ifdef CONFIG_GENERIC_ARCH_TOPOLOGY
+/*
+ * The CPU capacities changed, typically because cpufreq came up and
+ * normalized them.  Sort the CPUs again and re-apply the attrs of the
+ * unbound workqueues which have a capacity class.
+ */
+static int wq_cpu_scale_notify(struct notifier_block *nb, unsigned long val,
+			       void *data)
+{
+	struct workqueue_struct *wq;
+
+	apply_wqattrs_lock();
+	wq_update_capacity_cpumasks();
+	list_for_each_entry(wq, &workqueues, list) {
+		if (!(wq->flags & WQ_UNBOUND) || (wq->flags & __WQ_ORDERED))
+			continue;
+		if (wq->unbound_attrs->capacity == WQ_CAPACITY_ANY)
+			continue;
+		WARN_ON(apply_workqueue_attrs_locked(wq, wq->unbound_attrs));
+	}
+	apply_wqattrs_unlock();
+
+	pr_info("workqueue: efficiency CPUs %*pbl, performance CPUs %*pbl\n",
+		cpumask_pr_args(wq_capacity_cpumask[WQ_CAPACITY_EFFICIENCY]),
+		cpumask_pr_args(wq_capacity_cpumask[WQ_CAPACITY_PERFORMANCE]));
+	return NOTIFY_OK;
+}
+
+static struct notifier_block wq_cpu_scale_nb = {
+	.notifier_call = wq_cpu_scale_notify,
+};
+#endif
+
+#ifdef CONFIG_DEBUG_FS
+/*
+ * Per-workqueue counters summed over its pwqs: work items queued, how
+ * many of them had to wake an idle CPU and how many were moved off the
+ * queueing CPU for the capacity class.  The counters of unbound pwqs
+ * replaced by an attrs change are dropped with them.
+ *
+ * Counting costs every queue_work(), so it only runs after writing 1 to
+ * the file, and stops again on writing 0.
+ */
+static int wq_stats_show(struct seq_file *s, void *unused)
+{
+	struct workqueue_struct *wq;
+	struct pool_workqueue *pwq;
+	unsigned long queued, wakeups, redirected;
+
+	seq_printf(s, "%-24s %-11s %12s %12s %12s\n", "workqueue",
+		   "capacity", "queued", "wakeups", "redirected");
+
+	rcu_read_lock_sched();
+	list_for_each_entry_rcu(wq, &workqueues, list) {
+		queued = wakeups = redirected = 0;
+		for_each_pwq(pwq, wq) {
+			queued += READ_ONCE(pwq->nr_queued);
+			wakeups += READ_ONCE(pwq->nr_wakeups);
+			redirected += READ_ONCE(pwq->nr_redirected);
+		}
+		if (!queued)
+			continue;
+		seq_printf(s, "%-24s %-11s %12lu %12lu %12lu\n", wq->name,
+			   wq_capacity_names[READ_ONCE(wq->capacity)],
+			   queued, wakeups, redirected);
+	}
+	rcu_read_unlock_sched();
+
+	return 0;
+}
+
+static int wq_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, wq_stats_show, NULL);
+}
+
+static ssize_t wq_stats_write(struct file *file, const char __user *ubuf,
+			      size_t count, loff_t *ppos)
+{
+	bool enable;
+	int ret;
+
+	ret = kstrtobool_from_user(ubuf, count, &enable);
+	if (ret)
+		return ret;
+
+	if (enable)
+		static_branch_enable(&wq_stats_key);
+	else
+		static_branch_disable(&wq_stats_key);
+
+	return count;
+}
+
+static const struct file_operations wq_stats_fops = {
+	.open		= wq_stats_open,
+	.read		= seq_read,
+	.write		= wq_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init wq_debugfs_init(void)
+{
+	debugfs_create_file("workqueue_stats", 0644, NULL, NULL,
+			    &wq_stats_fops);
+	return 0;
+}
+late_initcall(wq_debugfs_init);
+#endif /* CONFIG_DEBUG_FS */
+
 #ifdef CONFIG_SYSFS
 /*
  * Workqueues with WQ_SYSFS flag set is visible to userland via
@@ -5096,6 +5379,7 @@ int workqueue_set_unbound_cpumask(cpumask_var_t cpumask)
  *
  *  per_cpu	RO bool	: whether the workqueue is per-cpu or unbound
  *  max_active	RW int	: maximum number of in-flight work items
+ *  capacity	RW str	: CPU capacity class, any, efficiency or performance
  *
  * Unbound workqueues have the following extra attributes.
  *
@@ -5147,9 +5431,35 @@ static ssize_t max_active_store(struct device *dev,
 }
 static DEVICE_ATTR_RW(max_active);
 
+static ssize_t capacity_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%s\n",
+			 wq_capacity_names[READ_ONCE(wq->capacity)]);
+}
+
+static ssize_t capacity_store(struct device *dev,
+			      struct device_attribute *attr, const char *buf,
+			      size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	int capacity, ret;
+
+	capacity = sysfs_match_string(wq_capacity_names, buf);
+	if (capacity < 0)
+		return capacity;
+
+	ret = workqueue_set_capacity(wq, capacity);
+	return ret ?: count;
+}
+static DEVICE_ATTR_RW(capacity);
+
 static struct attribute *wq_sysfs_attrs[] = {
 	&dev_attr_per_cpu.attr,
 	&dev_attr_max_active.attr,
+	&dev_attr_capacity.attr,
 	NULL,
 };
 ATTRIBUTE_GROUPS(wq_sysfs);
@@ -5667,6 +5977,11 @@ int __init workqueue_init_early(void)
 	BUG_ON(!alloc_cpumask_var(&wq_unbound_cpumask, GFP_KERNEL));
 	cpumask_copy(wq_unbound_cpumask, cpu_possible_mask);
 
+	for (i = 0; i < WQ_CAPACITY_NR; i++) {
+		BUG_ON(!alloc_cpumask_var(&wq_capacity_cpumask[i], GFP_KERNEL));
+		cpumask_copy(wq_capacity_cpumask[i], cpu_possible_mask);
+	}
+
 	pwq_cache = KMEM_CACHE(pool_workqueue, SLAB_PANIC);
 
 	/* initialize CPU pools */
@@ -5755,6 +6070,11 @@ int __init workqueue_init(void)
 
 	mutex_lock(&wq_pool_mutex);
 
+#ifdef CONFIG_GENERIC_ARCH_TOPOLOGY
+	topology_register_cpu_scale_notifier(&wq_cpu_scale_nb);
+#endif
+	wq_update_capacity_cpumasks();
+
 	for_each_possible_cpu(cpu) {
 		for_each_cpu_worker_pool(pool, cpu) {
 			pool->node = cpu_to_node(cpu);
@@ -0,0 +1,125 @@
+/*
+ * Measure the cost of a printk() call while every online CPU (or
+ * nr_threads of them) logs at the same time.
+ *
+ * Run in QEMU with e.g. "-smp 8" and a serial console:
+ *	modprobe test_printk_bench nr_calls=20000 console=1
+ */
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/module.h>
+#include <linux/sched/clock.h>
+#include <linux/slab.h>
+
+static unsigned int nr_threads;
+module_param(nr_threads, uint, 0444);
+MODULE_PARM_DESC(nr_threads, "logging threads, one per CPU (0: all online)");
+
+static unsigned int nr_calls = 10000;
+module_param(nr_calls, uint, 0444);
+MODULE_PARM_DESC(nr_calls, "printk() calls per thread");
+
+static bool console;
+module_param(console, bool, 0444);
+MODULE_PARM_DESC(console, "log above the console loglevel");
+
+struct bench_thread {
+	struct task_struct *task;
+	struct completion done;
+	unsigned int cpu;
+	u64 total_ns;
+	u64 max_ns;
+};
+
+static DECLARE_COMPLETION(bench_go);
+
+static int bench_thread_fn(void *data)
+{
+	struct bench_thread *bt = data;
+	unsigned int i;
+	u64 t0, dt;
+
+	wait_for_completion(&bench_go);
+
+	for (i = 0; i < nr_calls; i++) {
+		t0 = local_clock();
+		if (console)
+			printk(KERN_ERR "bench cpu%u msg %u\n", bt->cpu, i);
+		else
+			printk(KERN_DEBUG "bench cpu%u msg %u\n", bt->cpu, i);
+		dt = local_clock() - t0;
+
+		bt->total_ns += dt;
+		if (dt > bt->max_ns)
+			bt->max_ns = dt;
+		if (!(i % 256))
+			cond_resched();
+	}
+
+	complete(&bt->done);
+	return 0;
+}
+
+static int __init test_printk_bench_init(void)
+{
+	struct bench_thread *threads;
+	unsigned int n = 0, i, cpu;
+	u64 total = 0, max = 0;
+
+	if (!nr_calls)
+		return -EINVAL;
+	if (!nr_threads || nr_threads > num_online_cpus())
+		nr_threads = num_online_cpus();
+
+	threads = kcalloc(nr_threads, sizeof(*threads), GFP_KERNEL);
+	if (!threads)
+		return -ENOMEM;
+
+	reinit_completion(&bench_go);
+	for_each_online_cpu(cpu) {
+		struct bench_thread *bt = &threads[n];
+
+		if (n == nr_threads)
+			break;
+		bt->cpu = cpu;
+		init_completion(&bt->done);
+		bt->task = kthread_create(bench_thread_fn, bt, "printk_bench/%u",
+					  cpu);
+		if (IS_ERR(bt->task))
+			break;
+		kthread_bind(bt->task, cpu);
+		wake_up_process(bt->task);
+		n++;
+	}
+
+	complete_all(&bench_go);
+	for (i = 0; i < n; i++)
+		wait_for_completion(&threads[i].done);
+
+	for (i = 0; i < n; i++) {
+		pr_info("cpu%u: avg %llu ns max %llu ns\n", threads[i].cpu,
+			div_u64(threads[i].total_ns, nr_calls),
+			threads[i].max_ns);
+		total += threads[i].total_ns;
+		max = max(max, threads[i].max_ns);
+	}
+	if (n)
+		pr_info("%u threads x %u calls: avg %llu ns max %llu ns\n",
+			n, nr_calls, div_u64(total, (u64)n * nr_calls), max);
+
+	kfree(threads);
+	return n ? 0 : -ENOMEM;
+}
+module_init(test_printk_bench_init);
+
+static void __exit test_printk_bench_exit(void)
+{
+}
+module_exit(test_printk_bench_exit);
+
+MODULE_LICENSE("GPL");
@@ -0,0 +1,138 @@
+/*
+ * Queue a small work item periodically from one CPU and report where it
+ * ran and how idle every CPU stayed meanwhile, to compare workqueue
+ * capacity classes (see workqueue_set_capacity()) against each other.
+ * The per-workqueue wakeup counts are in debugfs "workqueue_stats".
+ *
+ * Run in QEMU with e.g. "-smp 8" and asymmetric capacity-dmips-mhz:
+ *	modprobe test_wq_placement capacity=1 queue_cpu=7
+ */
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/delay.h>
+#include <linux/init.h>
+#include <linux/jiffies.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/module.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/tick.h>
+#include <linux/workqueue.h>
+
+static unsigned int capacity;
+module_param(capacity, uint, 0444);
+MODULE_PARM_DESC(capacity, "capacity class: 0 any, 1 efficiency, 2 performance");
+
+static bool unbound;
+module_param(unbound, bool, 0444);
+MODULE_PARM_DESC(unbound, "use an unbound instead of a per-cpu workqueue");
+
+static int queue_cpu = -1;
+module_param(queue_cpu, int, 0444);
+MODULE_PARM_DESC(queue_cpu, "CPU to queue from (-1: last online CPU)");
+
+static unsigned int period_ms = 10;
+module_param(period_ms, uint, 0444);
+MODULE_PARM_DESC(period_ms, "queueing period in milliseconds");
+
+static unsigned int duration = 5;
+module_param(duration, uint, 0444);
+MODULE_PARM_DESC(duration, "test duration in seconds");
+
+static DEFINE_PER_CPU(unsigned long, work_runs);
+static struct workqueue_struct *test_wq;
+
+static void test_work_fn(struct work_struct *work)
+{
+	this_cpu_inc(work_runs);
+	udelay(50);
+}
+static DECLARE_WORK(test_work, test_work_fn);
+
+static int queue_thread_fn(void *data)
+{
+	unsigned long end = jiffies + duration * HZ;
+
+	while (time_before(jiffies, end)) {
+		queue_work(test_wq, &test_work);
+		msleep(period_ms);
+	}
+	flush_workqueue(test_wq);
+	complete(data);
+	return 0;
+}
+
+static int __init test_wq_placement_init(void)
+{
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct task_struct *task;
+	u64 *idle_us;
+	u64 now;
+	int cpu, ret;
+
+	if (queue_cpu < 0)
+		queue_cpu = cpumask_last(cpu_online_mask);
+	if (queue_cpu >= nr_cpu_ids || !cpu_online(queue_cpu) ||
+	    capacity >= WQ_CAPACITY_NR || !period_ms || !duration)
+		return -EINVAL;
+
+	idle_us = kcalloc(nr_cpu_ids, sizeof(*idle_us), GFP_KERNEL);
+	if (!idle_us)
+		return -ENOMEM;
+
+	test_wq = alloc_workqueue("test_wq_placement",
+				  unbound ? WQ_UNBOUND : 0, 0);
+	if (!test_wq) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+	ret = workqueue_set_capacity(test_wq, capacity);
+	if (ret)
+		goto out_destroy;
+
+	for_each_online_cpu(cpu)
+		idle_us[cpu] = get_cpu_idle_time_us(cpu, NULL);
+
+	task = kthread_create(queue_thread_fn, &done, "wq_placement/%d",
+			      queue_cpu);
+	if (IS_ERR(task)) {
+		ret = PTR_ERR(task);
+		goto out_destroy;
+	}
+	kthread_bind(task, queue_cpu);
+	wake_up_process(task);
+	wait_for_completion(&done);
+
+	pr_info("%s workqueue, capacity %u, queued from cpu%d every %u ms for %u s\n",
+		unbound ? "unbound" : "per-cpu", capacity, queue_cpu,
+		period_ms, duration);
+	for_each_online_cpu(cpu) {
+		now = get_cpu_idle_time_us(cpu, NULL);
+		if (now == -1ULL || idle_us[cpu] == -1ULL) {
+			pr_info("cpu%d: %lu runs\n", cpu,
+				per_cpu(work_runs, cpu));
+			continue;
+		}
+		now -= idle_us[cpu];
+		pr_info("cpu%d: %lu runs, idle %llu ms (%llu%%)\n", cpu,
+			per_cpu(work_runs, cpu), div_u64(now, USEC_PER_MSEC),
+			div_u64(now, duration * (USEC_PER_SEC / 100)));
+	}
+
+out_destroy:
+	destroy_workqueue(test_wq);
+out_free:
+	kfree(idle_us);
+	return ret;
+}
+module_init(test_wq_placement_init);
+
+static void __exit test_wq_placement_exit(void)
+{
+}
+module_exit(test_wq_placement_exit);
+
+MODULE_LICENSE("GPL");
@@ -1079,10 +1079,36 @@ copy_one_pte(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 	return 0;
 }
 
+/*
+ * With MMF_LAZY_FORK set on the parent, page cache pages mapped by a
+ * private file mapping are left out of the child: a fault refills them from
+ * the page cache exactly as it would for a vma without an anon_vma, which
+ * copy_page_range() already skips.  Only the anonymous (COWed) pages of
+ * such a vma, e.g. relocated data, have to be copied at fork time.
+ */
+static inline bool fork_lazy_vma(struct mm_struct *src_mm,
+				 struct vm_area_struct *vma)
+{
+	return test_bit(MMF_LAZY_FORK, &src_mm->flags) && vma->vm_file &&
+		!(vma->vm_flags & (VM_SHARED | VM_PFNMAP | VM_MIXEDMAP));
+}
+
+static inline bool fork_pte_refaults(struct vm_area_struct *vma,
+				     unsigned long addr, pte_t pte)
+{
+	struct page *page;
+
+	if (!pte_present(pte))
+		return false;
+	page = vm_normal_page(vma, addr, pte);
+	return page && !PageAnon(page);
+}
+
 static int copy_pte_range(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		   pmd_t *dst_pmd, pmd_t *src_pmd, struct vm_area_struct *vma,
 		   unsigned long addr, unsigned long end)
 {
+	bool lazy = fork_lazy_vma(src_mm, vma);
 	pte_t *orig_src_pte, *orig_dst_pte;
 	pte_t *src_pte, *dst_pte;
 	spinlock_t *src_ptl, *dst_ptl;
@@ -1115,7 +1141,8 @@ static int copy_pte_range(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 			    spin_needbreak(src_ptl) || spin_needbreak(dst_ptl))
 				break;
 		}
-		if (pte_none(*src_pte)) {
+		if (pte_none(*src_pte) ||
+		    (lazy && fork_pte_refaults(vma, addr, *src_pte))) {
 			progress++;
 			continue;
 		}
@@ -21,6 +21,8 @@
 #include <linux/ipc_logging.h>
 #include <linux/uidgid.h>
 #include <linux/pm_wakeup.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 
 #include <net/sock.h>
 #include <uapi/linux/sched/types.h>
@@ -128,13 +130,29 @@ static unsigned int qrtr_local_nid = CONFIG_QRTR_NODE_ID;
 static RADIX_TREE(qrtr_nodes, GFP_KERNEL);
 /* broadcast list */
 static LIST_HEAD(qrtr_all_epts);
-/* lock for qrtr_nodes, qrtr_all_epts and node reference */
+/* lock for qrtr_nodes updates, qrtr_all_epts and node reference */
 static DECLARE_RWSEM(qrtr_node_lock);
 
-/* local port allocation management */
+/* local port allocation management, lookups are done under RCU */
 static DEFINE_IDR(qrtr_ports);
 static DEFINE_MUTEX(qrtr_port_lock);
 
+/* max data packets handed to one socket per receive queue lock/wakeup */
+#define QRTR_RX_BATCH	32
+
+struct qrtr_stats {
+	u64 rx_pkts;
+	u64 rx_batches;
+	u64 rx_drops;
+	u64 tx_pkts;
+	u64 fwd_pkts;
+	u64 local_pkts;
+};
+
+static DEFINE_PER_CPU(struct qrtr_stats, qrtr_stats);
+
+#define QRTR_STAT_INC(field)	this_cpu_inc(qrtr_stats.field)
+
 /**
  * struct qrtr_node - endpoint node
  * @ep_lock: lock for endpoint management and callbacks
@@ -154,6 +172,7 @@ static DEFINE_MUTEX(qrtr_port_lock);
  * @say_hello: scheduled work for initiating hello
  * @ws: wakeupsource avoid system suspend
  * @ilc: ipc logging context reference
+ * @rcu: deferred free for lockless node lookups
  */
 struct qrtr_node {
 	struct mutex ep_lock;
@@ -179,6 +198,7 @@ struct qrtr_node {
 	struct wakeup_source *ws;
 
 	void *ilc;
+	struct rcu_head rcu;
 };
 
 struct qrtr_tx_flow_waiter {
@@ -371,15 +391,7 @@ static void __qrtr_node_release(struct kref *kref)
 	kthread_stop(node->task);
 
 	skb_queue_purge(&node->rx_queue);
-	kfree(node);
-}
-
-/* Increment reference to node. */
-static struct qrtr_node *qrtr_node_acquire(struct qrtr_node *node)
-{
-	if (node)
-		kref_get(&node->ref);
-	return node;
+	kfree_rcu(node, rcu);
 }
 
 /* Decrement reference to node and release as necessary. */
@@ -578,6 +590,9 @@ static int qrtr_node_enqueue(struct qrtr_node *node, struct sk_buff *skb,
 		kfree_skb(skb);
 	mutex_unlock(&node->ep_lock);
 
+	if (!rc)
+		QRTR_STAT_INC(tx_pkts);
+
 	if (!rc && type == QRTR_TYPE_HELLO)
 		atomic_inc(&node->hello_sent);
 
@@ -603,10 +618,12 @@ static struct qrtr_node *qrtr_node_lookup(unsigned int nid)
 {
 	struct qrtr_node *node;
 
-	down_read(&qrtr_node_lock);
+	rcu_read_lock();
 	node = radix_tree_lookup(&qrtr_nodes, nid);
-	node = qrtr_node_acquire(node);
-	up_read(&qrtr_node_lock);
+	/* the node may be on its way out, its entry is removed at ref 0 */
+	if (node && !kref_get_unless_zero(&node->ref))
+		node = NULL;
+	rcu_read_unlock();
 
 	return node;
 }
@@ -919,6 +936,8 @@ static void qrtr_fwd_pkt(struct sk_buff *skb, struct qrtr_cb *cb)
 		return;
 	}
 
+	QRTR_STAT_INC(fwd_pkts);
+
 	qrtr_node_enqueue(node, skb, cb->type, &from, &to, 0);
 	qrtr_node_release(node);
 }
@@ -946,26 +965,105 @@ static void qrtr_sock_queue_skb(struct qrtr_node *node, struct sk_buff *skb,
 	}
 }
 
-/* Handle and route a received packet.
+/* Queue a batch of packets for one socket, taking the receive queue lock
+ * and waking up the reader once for the whole batch. Mirrors the checks
+ * done by sock_queue_rcv_skb() for each packet.
+ */
+static void qrtr_sock_queue_batch(struct qrtr_sock *ipc,
+				  struct sk_buff_head *batch)
+{
+	struct sk_buff_head *list = &ipc->sk.sk_receive_queue;
+	struct sock *sk = &ipc->sk;
+	struct sk_buff_head ready;
+	struct sk_buff *skb;
+	unsigned long flags;
+	int dropped = 0;
+
+	__skb_queue_head_init(&ready);
+	while ((skb = __skb_dequeue(batch)) != NULL) {
+		if (atomic_read(&sk->sk_rmem_alloc) >= sk->sk_rcvbuf ||
+		    sk_filter(sk, skb) ||
+		    !sk_rmem_schedule(sk, skb, skb->truesize)) {
+			atomic_inc(&sk->sk_drops);
+			kfree_skb(skb);
+			dropped++;
+			continue;
+		}
+
+		skb->dev = NULL;
+		skb_set_owner_r(skb, sk);
+		skb_dst_force(skb);
+		sock_skb_set_dropcount(sk, skb);
+		__skb_queue_tail(&ready, skb);
+	}
+
+	if (dropped) {
+		this_cpu_add(qrtr_stats.rx_drops, dropped);
+		pr_err_ratelimited("%s: qrtr port %d dropped %d pkts\n",
+				   __func__, ipc->us.sq_port, dropped);
+	}
+
+	if (skb_queue_empty(&ready))
+		return;
+
+	spin_lock_irqsave(&list->lock, flags);
+	skb_queue_splice_tail_init(&ready, list);
+	spin_unlock_irqrestore(&list->lock, flags);
+
+	if (!sock_flag(sk, SOCK_DEAD))
+		sk->sk_data_ready(sk);
+
+	QRTR_STAT_INC(rx_batches);
+}
+
+/* Deliver and release the pending batch, if any. */
+static void qrtr_rx_flush(struct qrtr_sock **ipc, struct sk_buff_head *batch)
+{
+	if (!*ipc)
+		return;
+
+	qrtr_sock_queue_batch(*ipc, batch);
+	qrtr_port_put(*ipc);
+	*ipc = NULL;
+}
+
+/* Handle and route received packets.
  *
- * This will auto-reply with resume-tx packet as necessary.
+ * This will auto-reply with resume-tx packet as necessary. Consecutive
+ * data packets for the same local port are delivered as one batch.
  */
 static void qrtr_node_rx_work(struct kthread_work *work)
 {
 	struct qrtr_node *node = container_of(work, struct qrtr_node,
 					      read_data);
+	struct qrtr_sock *batch_ipc = NULL;
 	struct qrtr_ctrl_pkt *pkt;
+	struct sk_buff_head batch;
+	struct sk_buff_head rxq;
 	struct sk_buff *skb;
+	unsigned long flags;
+	u32 batch_port = 0;
+
+	__skb_queue_head_init(&batch);
+	__skb_queue_head_init(&rxq);
 
-	while ((skb = skb_dequeue(&node->rx_queue)) != NULL) {
+	/* grab everything posted so far in one go */
+	spin_lock_irqsave(&node->rx_queue.lock, flags);
+	skb_queue_splice_init(&node->rx_queue, &rxq);
+	spin_unlock_irqrestore(&node->rx_queue.lock, flags);
+
+	while ((skb = __skb_dequeue(&rxq)) != NULL) {
 		struct qrtr_sock *ipc;
 		struct qrtr_cb *cb;
 
+		QRTR_STAT_INC(rx_pkts);
 		cb = (struct qrtr_cb *)skb->cb;
 		qrtr_node_assign(node, cb->src_node);
 
-		if (cb->type != QRTR_TYPE_DATA)
+		if (cb->type != QRTR_TYPE_DATA) {
+			qrtr_rx_flush(&batch_ipc, &batch);
 			qrtr_fwd_ctrl_pkt(skb);
+		}
 
 		if (cb->type == QRTR_TYPE_NEW_SERVER &&
 		    skb->len == sizeof(*pkt)) {
@@ -983,6 +1081,22 @@ static void qrtr_node_rx_work(struct kthread_work *work)
 		} else if (cb->dst_node != qrtr_local_nid &&
 			   cb->type == QRTR_TYPE_DATA) {
 			qrtr_fwd_pkt(skb, cb);
+		} else if (cb->type == QRTR_TYPE_DATA) {
+			if (batch_ipc && (batch_port != cb->dst_port ||
+			    skb_queue_len(&batch) >= QRTR_RX_BATCH))
+				qrtr_rx_flush(&batch_ipc, &batch);
+
+			if (!batch_ipc) {
+				batch_ipc = qrtr_port_lookup(cb->dst_port);
+				batch_port = cb->dst_port;
+			}
+
+			if (!batch_ipc) {
+				QRTR_STAT_INC(rx_drops);
+				kfree_skb(skb);
+			} else {
+				__skb_queue_tail(&batch, skb);
+			}
 		} else {
 			ipc = qrtr_port_lookup(cb->dst_port);
 			if (!ipc) {
@@ -993,6 +1107,8 @@ static void qrtr_node_rx_work(struct kthread_work *work)
 			}
 		}
 	}
+
+	qrtr_rx_flush(&batch_ipc, &batch);
 }
 
 static void qrtr_hello_work(struct kthread_work *work)
@@ -1189,11 +1305,12 @@ static struct qrtr_sock *qrtr_port_lookup(int port)
 	if (port == QRTR_PORT_CTRL)
 		port = 0;
 
-	mutex_lock(&qrtr_port_lock);
+	/* sockets are SOCK_RCU_FREE, one being released is skipped */
+	rcu_read_lock();
 	ipc = idr_find(&qrtr_ports, port);
-	if (ipc)
-		sock_hold(&ipc->sk);
-	mutex_unlock(&qrtr_port_lock);
+	if (ipc && !refcount_inc_not_zero(&ipc->sk.sk_refcnt))
+		ipc = NULL;
+	rcu_read_unlock();
 
 	return ipc;
 }
@@ -1260,11 +1377,15 @@ static void qrtr_port_remove(struct qrtr_sock *ipc)
 	if (port == QRTR_PORT_CTRL)
 		port = 0;
 
-	__sock_put(&ipc->sk);
-
 	mutex_lock(&qrtr_port_lock);
 	idr_remove(&qrtr_ports, port);
 	mutex_unlock(&qrtr_port_lock);
+
+	/* lookups still seeing the idr entry cannot take a reference once
+	 * the count dropped to zero, and SOCK_RCU_FREE keeps the socket
+	 * memory around for them
+	 */
+	__sock_put(&ipc->sk);
 }
 
 /* Assign port number to socket.
@@ -1447,6 +1568,7 @@ static int qrtr_local_enqueue(struct qrtr_node *node, struct sk_buff *skb,
 	cb->src_node = from->sq_node;
 	cb->src_port = from->sq_port;
 
+	QRTR_STAT_INC(local_pkts);
 	if (sock_queue_rcv_skb(&ipc->sk, skb)) {
 		qrtr_port_put(ipc);
 		kfree_skb(skb);
@@ -1880,6 +2002,8 @@ static int qrtr_create(struct net *net, struct socket *sock,
 		return -ENOMEM;
 
 	sock_set_flag(sk, SOCK_ZAPPED);
+	/* qrtr_port_lookup() finds sockets under RCU */
+	sock_set_flag(sk, SOCK_RCU_FREE);
 
 	sock_init_data(sock, sk);
 	sock->ops = &qrtr_proto_ops;
@@ -1921,6 +2045,45 @@ static int qrtr_addr_doit(struct sk_buff *skb, struct nlmsghdr *nlh,
 	return 0;
 }
 
+static int qrtr_stats_show(struct seq_file *m, void *v)
+{
+	struct qrtr_stats sum = {0};
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct qrtr_stats *s = per_cpu_ptr(&qrtr_stats, cpu);
+
+		sum.rx_pkts += s->rx_pkts;
+		sum.rx_batches += s->rx_batches;
+		sum.rx_drops += s->rx_drops;
+		sum.tx_pkts += s->tx_pkts;
+		sum.fwd_pkts += s->fwd_pkts;
+		sum.local_pkts += s->local_pkts;
+	}
+
+	seq_printf(m, "rx_pkts: %llu\n", sum.rx_pkts);
+	seq_printf(m, "rx_batches: %llu\n", sum.rx_batches);
+	seq_printf(m, "rx_drops: %llu\n", sum.rx_drops);
+	seq_printf(m, "tx_pkts: %llu\n", sum.tx_pkts);
+	seq_printf(m, "fwd_pkts: %llu\n", sum.fwd_pkts);
+	seq_printf(m, "local_pkts: %llu\n", sum.local_pkts);
+
+	return 0;
+}
+
+static int qrtr_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, qrtr_stats_show, NULL);
+}
+
+static const struct file_operations qrtr_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= qrtr_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static const struct net_proto_family qrtr_family = {
 	.owner	= THIS_MODULE,
 	.family	= AF_QIPCRTR,
@@ -1943,12 +2106,15 @@ static int __init qrtr_proto_init(void)
 
 	rtnl_register(PF_QIPCRTR, RTM_NEWADDR, qrtr_addr_doit, NULL, 0);
 
+	proc_create("qrtr_stats", 0444, init_net.proc_net, &qrtr_stats_fops);
+
 	return 0;
 }
 postcore_initcall(qrtr_proto_init);
 
 static void __exit qrtr_proto_fini(void)
 {
+	remove_proc_entry("qrtr_stats", init_net.proc_net);
 	rtnl_unregister(PF_QIPCRTR, RTM_NEWADDR);
 	sock_unregister(qrtr_family.family);
 	proto_unregister(&qrtr_proto);
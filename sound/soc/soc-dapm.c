@@ -37,6 +37,7 @@
 #include <linux/regulator/consumer.h>
 #include <linux/clk.h>
 #include <linux/slab.h>
+#include <linux/ktime.h>
 #include <sound/core.h>
 #include <sound/pcm.h>
 #include <sound/pcm_params.h>
@@ -321,11 +322,55 @@ void dapm_mark_endpoints_dirty(struct snd_soc_card *card)
 }
 EXPORT_SYMBOL_GPL(dapm_mark_endpoints_dirty);
 
+/*
+ * DAPM private widget state.  Every widget is allocated by
+ * dapm_cnew_widget() so this can trail the public structure; the widget
+ * must stay the first member since it is released with kfree(w).
+ */
+struct dapm_widget_priv {
+	struct snd_soc_dapm_widget w;
+	struct list_head powered;	/* P: dapm_powered_lock */
+};
+
+/*
+ * Widgets with power set, for all cards.  Lets dapm_power_widgets()
+ * derive the bias levels without walking every widget of the card.
+ */
+static LIST_HEAD(dapm_powered);
+static DEFINE_SPINLOCK(dapm_powered_lock);
+
+static inline struct dapm_widget_priv *
+dapm_widget_priv(struct snd_soc_dapm_widget *w)
+{
+	return container_of(w, struct dapm_widget_priv, w);
+}
+
+static void dapm_widget_update_powered(struct snd_soc_dapm_widget *w)
+{
+	struct dapm_widget_priv *priv = dapm_widget_priv(w);
+
+	spin_lock(&dapm_powered_lock);
+	if (w->power && list_empty(&priv->powered))
+		list_add_tail(&priv->powered, &dapm_powered);
+	else if (!w->power)
+		list_del_init(&priv->powered);
+	spin_unlock(&dapm_powered_lock);
+}
+
 /* create a new dapm widget */
 static inline struct snd_soc_dapm_widget *dapm_cnew_widget(
 	const struct snd_soc_dapm_widget *_widget)
 {
-	return kmemdup(_widget, sizeof(*_widget), GFP_KERNEL);
+	struct dapm_widget_priv *priv;
+
+	priv = kzalloc(sizeof(*priv), GFP_KERNEL);
+	if (!priv)
+		return NULL;
+
+	priv->w = *_widget;
+	INIT_LIST_HEAD(&priv->powered);
+
+	return &priv->w;
 }
 
 struct dapm_kcontrol_data {
@@ -590,6 +635,11 @@ struct snd_soc_dapm_context *snd_soc_dapm_kcontrol_dapm(
 }
 EXPORT_SYMBOL_GPL(snd_soc_dapm_kcontrol_dapm);
 
+/*
+ * Only widgets on the dirty list are ever power checked and they are
+ * reset as they leave it at the end of dapm_power_widgets(), so all
+ * others already have power_checked clear and new_power == power.
+ */
 static void dapm_reset(struct snd_soc_card *card)
 {
 	struct snd_soc_dapm_widget *w;
@@ -598,10 +648,8 @@ static void dapm_reset(struct snd_soc_card *card)
 
 	memset(&card->dapm_stats, 0, sizeof(card->dapm_stats));
 
-	list_for_each_entry(w, &card->widgets, list) {
+	list_for_each_entry(w, &card->dapm_dirty, dirty)
 		w->new_power = w->power;
-		w->power_checked = false;
-	}
 }
 
 static const char *soc_dapm_prefix(struct snd_soc_dapm_context *dapm)
@@ -1372,6 +1420,12 @@ static int dapm_widget_power_check(struct snd_soc_dapm_widget *w)
 
 	w->power_checked = true;
 
+	/*
+	 * Supplies check their sinks, which may not be dirty themselves.
+	 * Queue them so the result is applied and power_checked cleared.
+	 */
+	dapm_mark_dirty(w, "power checked");
+
 	return w->new_power;
 }
 
@@ -1529,6 +1583,7 @@ static void dapm_seq_run_coalesced(struct snd_soc_card *card,
 	list_for_each_entry(w, pending, power_list) {
 		WARN_ON(reg != w->reg || dapm != w->dapm);
 		w->power = w->new_power;
+		dapm_widget_update_powered(w);
 
 		mask |= w->mask << w->shift;
 		if (w->power)
@@ -1898,10 +1953,41 @@ static bool dapm_idle_bias_off(struct snd_soc_dapm_context *dapm)
  *  o Input pin to Output pin (bypass, sidetone)
  *  o DAC to ADC (loopback).
  */
+static void dapm_raise_target_bias(struct snd_soc_dapm_widget *w)
+{
+	struct snd_soc_dapm_context *d = w->dapm;
+
+	/* Supplies and micbiases only bring the
+	 * context up to STANDBY as unless something
+	 * else is active and passing audio they
+	 * generally don't require full power.  Signal
+	 * generators are virtual pins and have no
+	 * power impact themselves.
+	 */
+	switch (w->id) {
+	case snd_soc_dapm_siggen:
+	case snd_soc_dapm_vmid:
+		break;
+	case snd_soc_dapm_supply:
+	case snd_soc_dapm_regulator_supply:
+	case snd_soc_dapm_clock_supply:
+	case snd_soc_dapm_micbias:
+		if (d->target_bias_level < SND_SOC_BIAS_STANDBY)
+			d->target_bias_level = SND_SOC_BIAS_STANDBY;
+		break;
+	default:
+		d->target_bias_level = SND_SOC_BIAS_ON;
+		break;
+	}
+}
+
 static int dapm_power_widgets(struct snd_soc_card *card, int event)
 {
-	struct snd_soc_dapm_widget *w;
+	struct snd_soc_dapm_widget *w, *n;
+	struct dapm_widget_priv *priv;
 	struct snd_soc_dapm_context *d;
+	ktime_t start, walk_end;
+	int nr_checked = 0;
 	LIST_HEAD(up_list);
 	LIST_HEAD(down_list);
 	ASYNC_DOMAIN_EXCLUSIVE(async_domain);
@@ -1913,6 +1999,7 @@ static int dapm_power_widgets(struct snd_soc_card *card, int event)
 
 	trace_snd_soc_dapm_start(card);
 	mutex_lock(&card->dapm_power_mutex);
+	start = ktime_get();
 
 	list_for_each_entry(d, &card->dapm_list, list) {
 		if (dapm_idle_bias_off(d))
@@ -1933,7 +2020,21 @@ static int dapm_power_widgets(struct snd_soc_card *card, int event)
 		dapm_power_one_widget(w, &up_list, &down_list);
 	}
 
-	list_for_each_entry(w, &card->widgets, list) {
+	walk_end = ktime_get();
+
+	/*
+	 * Widgets that were not rechecked keep their power state, so only
+	 * the powered ones and the dirty ones can raise the bias level.
+	 */
+	spin_lock(&dapm_powered_lock);
+	list_for_each_entry(priv, &dapm_powered, powered) {
+		w = &priv->w;
+		if (w->dapm->card == card && !dapm_dirty_widget(w))
+			dapm_raise_target_bias(w);
+	}
+	spin_unlock(&dapm_powered_lock);
+
+	list_for_each_entry_safe(w, n, &card->dapm_dirty, dirty) {
 		switch (w->id) {
 		case snd_soc_dapm_pre:
 		case snd_soc_dapm_post:
@@ -1941,36 +2042,13 @@ static int dapm_power_widgets(struct snd_soc_card *card, int event)
 			break;
 		default:
 			list_del_init(&w->dirty);
+			w->power_checked = false;
 			break;
 		}
 
-		if (w->new_power) {
-			d = w->dapm;
-
-			/* Supplies and micbiases only bring the
-			 * context up to STANDBY as unless something
-			 * else is active and passing audio they
-			 * generally don't require full power.  Signal
-			 * generators are virtual pins and have no
-			 * power impact themselves.
-			 */
-			switch (w->id) {
-			case snd_soc_dapm_siggen:
-			case snd_soc_dapm_vmid:
-				break;
-			case snd_soc_dapm_supply:
-			case snd_soc_dapm_regulator_supply:
-			case snd_soc_dapm_clock_supply:
-			case snd_soc_dapm_micbias:
-				if (d->target_bias_level < SND_SOC_BIAS_STANDBY)
-					d->target_bias_level = SND_SOC_BIAS_STANDBY;
-				break;
-			default:
-				d->target_bias_level = SND_SOC_BIAS_ON;
-				break;
-			}
-		}
-
+		if (w->new_power)
+			dapm_raise_target_bias(w);
+		nr_checked++;
 	}
 
 	/* Force all contexts in the card to the same bias state if
@@ -2035,6 +2113,10 @@ static int dapm_power_widgets(struct snd_soc_card *card, int event)
 	pop_dbg(card->dev, card->pop_time,
 		"DAPM sequencing finished, waiting %dms\n", card->pop_time);
 	pop_wait(card->pop_time);
+
+	trace_snd_soc_dapm_update_latency(card, event, nr_checked,
+		ktime_to_ns(ktime_sub(walk_end, start)),
+		ktime_to_ns(ktime_sub(ktime_get(), start)));
 	mutex_unlock(&card->dapm_power_mutex);
 
 	trace_snd_soc_dapm_done(card);
@@ -2451,6 +2533,11 @@ void snd_soc_dapm_free_widget(struct snd_soc_dapm_widget *w)
 	enum snd_soc_dapm_direction dir;
 
 	list_del(&w->list);
+
+	spin_lock(&dapm_powered_lock);
+	list_del(&dapm_widget_priv(w)->powered);
+	spin_unlock(&dapm_powered_lock);
+
 	/*
 	 * remove source and sink paths associated to this widget.
 	 * While removing the path, remove reference to it from both
@@ -3126,8 +3213,10 @@ int snd_soc_dapm_new_widgets(struct snd_soc_card *card)
 			soc_dapm_read(w->dapm, w->reg, &val);
 			val = val >> w->shift;
 			val &= w->mask;
-			if (val == w->on_val)
+			if (val == w->on_val) {
 				w->power = 1;
+				dapm_widget_update_powered(w);
+			}
 		}
 
 		w->new = 1;
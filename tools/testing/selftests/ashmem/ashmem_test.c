@@ -0,0 +1,272 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * ashmem pin/unpin semantics and pin/unpin scalability.
+ *
+ * The functional part walks the interval cases of ASHMEM_PIN/ASHMEM_UNPIN
+ * (merge, split, subsume) and checks ASHMEM_GET_PIN_STATUS. The benchmark
+ * part runs unpin/pin loops from many threads, each on a private region
+ * and then all on one shared region, and reports the aggregate rate so
+ * per-region scaling is visible next to the single-region contention case.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "../kselftest.h"
+
+/* The ashmem uapi lives in drivers/staging and is not exported */
+#define ASHMEM_NAME_LEN		256
+#define ASHMEM_NOT_PURGED	0
+#define ASHMEM_WAS_PURGED	1
+#define ASHMEM_IS_UNPINNED	0
+#define ASHMEM_IS_PINNED	1
+
+struct ashmem_pin {
+	uint32_t offset;
+	uint32_t len;
+};
+
+#define __ASHMEMIOC		0x77
+#define ASHMEM_SET_NAME		_IOW(__ASHMEMIOC, 1, char[ASHMEM_NAME_LEN])
+#define ASHMEM_SET_SIZE		_IOW(__ASHMEMIOC, 3, size_t)
+#define ASHMEM_PIN		_IOW(__ASHMEMIOC, 7, struct ashmem_pin)
+#define ASHMEM_UNPIN		_IOW(__ASHMEMIOC, 8, struct ashmem_pin)
+#define ASHMEM_GET_PIN_STATUS	_IO(__ASHMEMIOC, 9)
+#define ASHMEM_PURGE_ALL_CACHES	_IO(__ASHMEMIOC, 10)
+
+#define NR_PAGES		64
+#define BENCH_ITERS		20000
+#define MAX_THREADS		64
+
+static long page_size;
+static int failures;
+
+static int region_create(size_t size, void **addr)
+{
+	int fd;
+
+	fd = open("/dev/ashmem", O_RDWR);
+	if (fd < 0)
+		return -1;
+
+	if (ioctl(fd, ASHMEM_SET_NAME, "ashmem_test") < 0 ||
+	    ioctl(fd, ASHMEM_SET_SIZE, size) < 0)
+		goto err;
+
+	*addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (*addr == MAP_FAILED)
+		goto err;
+
+	return fd;
+err:
+	close(fd);
+	return -1;
+}
+
+static int pin_op(int fd, unsigned long cmd, unsigned int pgoff,
+		  unsigned int npages)
+{
+	struct ashmem_pin pin = {
+		.offset = pgoff * page_size,
+		.len = npages * page_size,
+	};
+
+	return ioctl(fd, cmd, &pin);
+}
+
+static void expect(const char *what, int got, int want)
+{
+	if (got == want)
+		return;
+	printf("FAIL: %s: got %d, want %d\n", what, got, want);
+	failures++;
+}
+
+static void test_pin_semantics(void)
+{
+	void *addr;
+	int fd;
+
+	fd = region_create(NR_PAGES * page_size, &addr);
+	if (fd < 0) {
+		printf("FAIL: create region: %s\n", strerror(errno));
+		failures++;
+		return;
+	}
+
+	memset(addr, 0x5a, NR_PAGES * page_size);
+
+	expect("status of fresh region",
+	       pin_op(fd, ASHMEM_GET_PIN_STATUS, 0, NR_PAGES),
+	       ASHMEM_IS_PINNED);
+
+	/* two disjoint ranges, then one bridging both merges all three */
+	expect("unpin [2,5]", pin_op(fd, ASHMEM_UNPIN, 2, 4), 0);
+	expect("unpin [10,13]", pin_op(fd, ASHMEM_UNPIN, 10, 4), 0);
+	expect("status [6,9]", pin_op(fd, ASHMEM_GET_PIN_STATUS, 6, 4),
+	       ASHMEM_IS_PINNED);
+	expect("unpin [4,11]", pin_op(fd, ASHMEM_UNPIN, 4, 8), 0);
+	expect("status [6,9] merged",
+	       pin_op(fd, ASHMEM_GET_PIN_STATUS, 6, 4), ASHMEM_IS_UNPINNED);
+
+	/* unpinning inside an unpinned range is a no-op */
+	expect("unpin [3,4]", pin_op(fd, ASHMEM_UNPIN, 3, 2), 0);
+
+	/* punch a hole in the middle, both sides stay unpinned */
+	expect("pin [7,8]", pin_op(fd, ASHMEM_PIN, 7, 2), ASHMEM_NOT_PURGED);
+	expect("status [7,8]", pin_op(fd, ASHMEM_GET_PIN_STATUS, 7, 2),
+	       ASHMEM_IS_PINNED);
+	expect("status [2,6]", pin_op(fd, ASHMEM_GET_PIN_STATUS, 2, 5),
+	       ASHMEM_IS_UNPINNED);
+	expect("status [9,13]", pin_op(fd, ASHMEM_GET_PIN_STATUS, 9, 5),
+	       ASHMEM_IS_UNPINNED);
+
+	/* trim both ends, then pin across everything */
+	expect("pin [0,3]", pin_op(fd, ASHMEM_PIN, 0, 4), ASHMEM_NOT_PURGED);
+	expect("pin [12,20]", pin_op(fd, ASHMEM_PIN, 12, 9),
+	       ASHMEM_NOT_PURGED);
+	expect("status [4,6]", pin_op(fd, ASHMEM_GET_PIN_STATUS, 4, 3),
+	       ASHMEM_IS_UNPINNED);
+	expect("pin all", pin_op(fd, ASHMEM_PIN, 0, NR_PAGES),
+	       ASHMEM_NOT_PURGED);
+	expect("status all", pin_op(fd, ASHMEM_GET_PIN_STATUS, 0, NR_PAGES),
+	       ASHMEM_IS_PINNED);
+
+	/* purging needs CAP_SYS_ADMIN */
+	if (geteuid() == 0) {
+		expect("unpin all", pin_op(fd, ASHMEM_UNPIN, 0, NR_PAGES), 0);
+		ioctl(fd, ASHMEM_PURGE_ALL_CACHES);
+		expect("pin after purge", pin_op(fd, ASHMEM_PIN, 0, NR_PAGES),
+		       ASHMEM_WAS_PURGED);
+		expect("purged page reads zero", ((char *)addr)[0], 0);
+	}
+
+	munmap(addr, NR_PAGES * page_size);
+	close(fd);
+}
+
+struct bench_thread {
+	pthread_t thread;
+	int fd;
+	unsigned int pgoff;
+};
+
+static pthread_barrier_t bench_barrier;
+
+static void *bench_fn(void *arg)
+{
+	struct bench_thread *t = arg;
+	int i;
+
+	pthread_barrier_wait(&bench_barrier);
+	for (i = 0; i < BENCH_ITERS; i++) {
+		pin_op(t->fd, ASHMEM_UNPIN, t->pgoff, 1);
+		pin_op(t->fd, ASHMEM_PIN, t->pgoff, 1);
+	}
+
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Returns the aggregate unpin+pin pairs per second, or -1 */
+static double bench(int nthreads, int shared)
+{
+	struct bench_thread threads[MAX_THREADS];
+	void *addr[MAX_THREADS];
+	double start, elapsed;
+	int i, shared_fd = -1;
+
+	if (shared) {
+		shared_fd = region_create(MAX_THREADS * page_size, &addr[0]);
+		if (shared_fd < 0)
+			return -1;
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		if (shared) {
+			threads[i].fd = shared_fd;
+			threads[i].pgoff = i;
+		} else {
+			threads[i].fd = region_create(page_size, &addr[i]);
+			threads[i].pgoff = 0;
+			if (threads[i].fd < 0)
+				return -1;
+		}
+	}
+
+	pthread_barrier_init(&bench_barrier, NULL, nthreads + 1);
+	for (i = 0; i < nthreads; i++)
+		pthread_create(&threads[i].thread, NULL, bench_fn, &threads[i]);
+
+	start = now();
+	pthread_barrier_wait(&bench_barrier);
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i].thread, NULL);
+	elapsed = now() - start;
+	pthread_barrier_destroy(&bench_barrier);
+
+	if (shared) {
+		munmap(addr[0], MAX_THREADS * page_size);
+		close(shared_fd);
+	} else {
+		for (i = 0; i < nthreads; i++) {
+			munmap(addr[i], page_size);
+			close(threads[i].fd);
+		}
+	}
+
+	return nthreads * (double)BENCH_ITERS / elapsed;
+}
+
+static void test_scalability(void)
+{
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int nthreads;
+
+	if (ncpus > MAX_THREADS)
+		ncpus = MAX_THREADS;
+
+	printf("%8s %20s %20s\n", "threads", "private (pairs/s)",
+	       "shared (pairs/s)");
+	for (nthreads = 1; nthreads <= ncpus; nthreads *= 2)
+		printf("%8d %20.0f %20.0f\n", nthreads, bench(nthreads, 0),
+		       bench(nthreads, 1));
+}
+
+int main(void)
+{
+	int fd;
+
+	page_size = sysconf(_SC_PAGESIZE);
+
+	fd = open("/dev/ashmem", O_RDWR);
+	if (fd < 0) {
+		printf("No /dev/ashmem, skipping\n");
+		return KSFT_SKIP;
+	}
+	close(fd);
+
+	test_pin_semantics();
+	test_scalability();
+
+	if (failures)
+		return ksft_exit_fail();
+	printf("ashmem_test: PASS\n");
+	return ksft_exit_pass();
+}
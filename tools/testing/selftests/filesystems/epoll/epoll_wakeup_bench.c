@@ -0,0 +1,190 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Many producer threads signal eventfds registered in one epoll set while
+ * consumer threads drain it with epoll_wait().  Every ep_poll_callback()
+ * targets the same epoll instance, which is what contends on ep->lock and
+ * on the wakeups of ep->wq.  Reports delivered events/s and checks that the
+ * consumers read back exactly what the producers wrote.
+ *
+ * Usage: epoll_wakeup_bench [-p producers] [-c consumers] [-f fds/producer]
+ *                           [-t seconds]
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "../../kselftest.h"
+
+#define MAX_EVENTS	64
+
+static int nr_producers = 8;
+static int nr_consumers = 2;
+static int nr_fds = 16;
+static int runtime = 2;
+
+static int epfd;
+static int *efds;
+static volatile int stop_producers;
+static volatile int producers_done;
+
+struct worker {
+	pthread_t thread;
+	int idx;
+	uint64_t count;		/* writes (producer) or value read (consumer) */
+	uint64_t events;	/* consumer: events returned by epoll_wait() */
+};
+
+static void *producer_fn(void *arg)
+{
+	struct worker *w = arg;
+	uint64_t one = 1;
+	int i;
+
+	while (!stop_producers) {
+		for (i = 0; i < nr_fds; i++) {
+			if (write(efds[w->idx * nr_fds + i], &one,
+				  sizeof(one)) == sizeof(one))
+				w->count++;
+		}
+	}
+	return NULL;
+}
+
+static void *consumer_fn(void *arg)
+{
+	struct epoll_event ev[MAX_EVENTS];
+	struct worker *w = arg;
+	uint64_t val;
+	int i, n;
+
+	for (;;) {
+		/* once the producers are done, drain until a quiet period */
+		n = epoll_wait(epfd, ev, MAX_EVENTS, producers_done ? 100 : 1000);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0) {
+			perror("epoll_wait");
+			break;
+		}
+		if (!n && producers_done)
+			break;
+
+		w->events += n;
+		for (i = 0; i < n; i++) {
+			if (read(ev[i].data.fd, &val, sizeof(val)) == sizeof(val))
+				w->count += val;
+		}
+	}
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	struct worker *prod, *cons;
+	uint64_t written = 0, read_back = 0, events = 0;
+	struct epoll_event ev;
+	double start, elapsed;
+	int i, c, total_fds;
+
+	while ((c = getopt(argc, argv, "p:c:f:t:")) != -1) {
+		switch (c) {
+		case 'p':
+			nr_producers = atoi(optarg);
+			break;
+		case 'c':
+			nr_consumers = atoi(optarg);
+			break;
+		case 'f':
+			nr_fds = atoi(optarg);
+			break;
+		case 't':
+			runtime = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-p producers] [-c consumers] [-f fds/producer] [-t seconds]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (nr_producers <= 0 || nr_consumers <= 0 || nr_fds <= 0 ||
+	    runtime <= 0)
+		ksft_exit_fail_msg("invalid arguments\n");
+
+	ksft_print_header();
+
+	epfd = epoll_create1(0);
+	if (epfd < 0)
+		ksft_exit_fail_msg("epoll_create1: %s\n", strerror(errno));
+
+	total_fds = nr_producers * nr_fds;
+	efds = calloc(total_fds, sizeof(*efds));
+	prod = calloc(nr_producers, sizeof(*prod));
+	cons = calloc(nr_consumers, sizeof(*cons));
+	if (!efds || !prod || !cons)
+		ksft_exit_fail_msg("out of memory\n");
+
+	for (i = 0; i < total_fds; i++) {
+		efds[i] = eventfd(0, EFD_NONBLOCK);
+		if (efds[i] < 0)
+			ksft_exit_fail_msg("eventfd: %s\n", strerror(errno));
+		ev.events = EPOLLIN;
+		ev.data.fd = efds[i];
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, efds[i], &ev))
+			ksft_exit_fail_msg("epoll_ctl: %s\n", strerror(errno));
+	}
+
+	start = now();
+	for (i = 0; i < nr_consumers; i++) {
+		cons[i].idx = i;
+		if (pthread_create(&cons[i].thread, NULL, consumer_fn, &cons[i]))
+			ksft_exit_fail_msg("pthread_create failed\n");
+	}
+	for (i = 0; i < nr_producers; i++) {
+		prod[i].idx = i;
+		if (pthread_create(&prod[i].thread, NULL, producer_fn, &prod[i]))
+			ksft_exit_fail_msg("pthread_create failed\n");
+	}
+
+	sleep(runtime);
+	stop_producers = 1;
+	for (i = 0; i < nr_producers; i++) {
+		pthread_join(prod[i].thread, NULL);
+		written += prod[i].count;
+	}
+	elapsed = now() - start;
+	producers_done = 1;
+	for (i = 0; i < nr_consumers; i++) {
+		pthread_join(cons[i].thread, NULL);
+		read_back += cons[i].count;
+		events += cons[i].events;
+	}
+
+	ksft_print_msg("%d producers x %d fds, %d consumers: %.0f writes/s, %.0f events/s\n",
+		       nr_producers, nr_fds, nr_consumers, written / elapsed,
+		       events / elapsed);
+
+	if (read_back != written) {
+		ksft_test_result_fail("read back %llu of %llu writes\n",
+				      (unsigned long long)read_back,
+				      (unsigned long long)written);
+		return ksft_exit_fail();
+	}
+	ksft_test_result_pass("all %llu writes delivered\n",
+			      (unsigned long long)written);
+	return ksft_exit_pass();
+}
@@ -0,0 +1,222 @@
+// SPDX-License-Identifier: GPL-2.0
+/******************************************************************************
+ *
+ * DESCRIPTION
+ *      Hash bucket throughput in the style of "perf bench futex hash": each
+ *      thread issues FUTEX_WAIT on its own private futexes with a value that
+ *      never matches, so every call hashes the key, takes the bucket lock and
+ *      returns EAGAIN.  Runs once on the global hash and once with a
+ *      per-process hash (PR_SET_FUTEX_HASH), and checks that a wait/wake
+ *      pair still works with the private hash.
+ *
+ *****************************************************************************/
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include "futextest.h"
+#include "logging.h"
+
+#define TEST_NAME "futex-hash-bench"
+
+#ifndef PR_SET_FUTEX_HASH
+#define PR_SET_FUTEX_HASH	0x46485401
+#define PR_GET_FUTEX_HASH	0x46485402
+#endif
+
+static int nthreads = 8;
+static int nfutexes = 1024;
+static int runtime = 2;
+
+static volatile int done;
+
+struct worker {
+	pthread_t thread;
+	futex_t *futexes;
+	unsigned long ops;
+};
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -c	Use color\n");
+	printf("  -f N	Futexes per thread (default: %d)\n", nfutexes);
+	printf("  -h	Display this help message\n");
+	printf("  -r N	Seconds per run (default: %d)\n", runtime);
+	printf("  -t N	Threads (default: %d)\n", nthreads);
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+}
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	int i;
+
+	while (!done) {
+		for (i = 0; i < nfutexes; i++)
+			futex_wait(&w->futexes[i], 1234, NULL,
+				   FUTEX_PRIVATE_FLAG);
+		w->ops += nfutexes;
+	}
+	return NULL;
+}
+
+static void *waiter_fn(void *arg)
+{
+	futex_t *f = arg;
+	struct timespec to = { .tv_sec = 5 };
+
+	if (futex_wait(f, 0, &to, FUTEX_PRIVATE_FLAG) && errno == ETIMEDOUT)
+		return (void *)1;
+	return NULL;
+}
+
+/* Wake a sleeping waiter through whichever table the process uses. */
+static int check_wake(void)
+{
+	futex_t f = 0;
+	pthread_t t;
+	void *timedout;
+	int i;
+
+	if (pthread_create(&t, NULL, waiter_fn, (void *)&f))
+		return RET_ERROR;
+	/* keep waking until the waiter has gone to sleep and been woken */
+	for (i = 0; i < 1000; i++) {
+		usleep(1000);
+		if (futex_wake(&f, 1, FUTEX_PRIVATE_FLAG) == 1)
+			break;
+	}
+	pthread_join(t, &timedout);
+	return timedout ? RET_FAIL : RET_PASS;
+}
+
+/* Runs in a child so that each mode starts single threaded. */
+static int run(int private)
+{
+	unsigned long total = 0;
+	struct worker *w;
+	int i, ret;
+
+	if (private && prctl(PR_SET_FUTEX_HASH, nthreads, 0, 0, 0)) {
+		error("PR_SET_FUTEX_HASH failed\n", errno);
+		return RET_ERROR;
+	}
+
+	ret = check_wake();
+	if (ret) {
+		fail("waiter was not woken\n");
+		return ret;
+	}
+
+	w = calloc(nthreads, sizeof(*w));
+	if (!w)
+		return RET_ERROR;
+	for (i = 0; i < nthreads; i++) {
+		w[i].futexes = calloc(nfutexes, sizeof(futex_t));
+		if (!w[i].futexes ||
+		    pthread_create(&w[i].thread, NULL, worker_fn, &w[i])) {
+			error("thread setup failed\n", errno);
+			return RET_ERROR;
+		}
+	}
+
+	sleep(runtime);
+	done = 1;
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(w[i].thread, NULL);
+		total += w[i].ops;
+	}
+
+	if (private)
+		ksft_print_msg("private hash (%d buckets): %lu ops/sec\n",
+			       prctl(PR_GET_FUTEX_HASH, 0, 0, 0, 0),
+			       total / runtime);
+	else
+		ksft_print_msg("global hash: %lu ops/sec\n", total / runtime);
+	return RET_PASS;
+}
+
+static int run_child(int private)
+{
+	int status;
+	pid_t pid;
+
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0) {
+		error("fork failed\n", errno);
+		return RET_ERROR;
+	}
+	if (!pid) {
+		status = -run(private);
+		fflush(stdout);
+		_exit(status);
+	}
+
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+		return RET_ERROR;
+	return -WEXITSTATUS(status);
+}
+
+int main(int argc, char *argv[])
+{
+	int ret;
+	int c;
+
+	while ((c = getopt(argc, argv, "cf:hr:t:v:")) != -1) {
+		switch (c) {
+		case 'c':
+			log_color(1);
+			break;
+		case 'f':
+			nfutexes = atoi(optarg);
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'r':
+			runtime = atoi(optarg);
+			break;
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+	if (nthreads <= 0 || nfutexes <= 0 || runtime <= 0) {
+		usage(basename(argv[0]));
+		exit(1);
+	}
+
+	ksft_print_header();
+	ksft_print_msg("%s: futex hash bucket throughput\n",
+		       basename(argv[0]));
+	ksft_print_msg("\tArguments: threads=%d futexes=%d runtime=%ds\n",
+		       nthreads, nfutexes, runtime);
+
+	ret = run_child(0);
+	if (ret == RET_PASS) {
+		if (prctl(PR_GET_FUTEX_HASH, 0, 0, 0, 0) < 0)
+			ksft_print_msg("PR_SET_FUTEX_HASH not supported, skipping private run\n");
+		else
+			ret = run_child(1);
+	}
+
+	print_result(TEST_NAME, ret);
+	return ret;
+}
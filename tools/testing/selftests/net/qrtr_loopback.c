@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Datagrams between two AF_QIPCRTR sockets of the local node, while
+ * another process keeps binding and closing sockets.  Checks that every
+ * datagram arrives in order and reports what a bind/close cycle costs,
+ * which must not include an RCU grace period.
+ *
+ * Needs CONFIG_QRTR, skipped without it.
+ */
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <linux/qrtr.h>
+
+#ifndef AF_QIPCRTR
+#define AF_QIPCRTR	42
+#endif
+
+#define NR_MSGS		20000
+#define NR_CYCLES	2000
+#define KSFT_SKIP	4
+
+static int open_bound(struct sockaddr_qrtr *sq)
+{
+	socklen_t len = sizeof(*sq);
+	int fd;
+
+	fd = socket(AF_QIPCRTR, SOCK_DGRAM, 0);
+	if (fd < 0)
+		return -1;
+
+	/* learn the local node, then bind an ephemeral port on it */
+	if (getsockname(fd, (struct sockaddr *)sq, &len) < 0)
+		goto err;
+	sq->sq_port = 0;
+	if (bind(fd, (struct sockaddr *)sq, sizeof(*sq)) < 0)
+		goto err;
+	len = sizeof(*sq);
+	if (getsockname(fd, (struct sockaddr *)sq, &len) < 0)
+		goto err;
+	return fd;
+err:
+	close(fd);
+	return -1;
+}
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* Bind and close sockets so that ports come and go during the lookups. */
+static int churn(void)
+{
+	struct sockaddr_qrtr sq;
+	double start;
+	int i, fd;
+
+	start = now_us();
+	for (i = 0; i < NR_CYCLES; i++) {
+		fd = open_bound(&sq);
+		if (fd < 0) {
+			perror("churn socket");
+			return 1;
+		}
+		close(fd);
+	}
+	printf("bind/close: %.1f us per cycle\n", (now_us() - start) / i);
+	return 0;
+}
+
+/* Receive what is queued on @rx, all of it when @wait is set. */
+static int drain(int rx, uint32_t *expect, int wait)
+{
+	struct pollfd pfd = { .fd = rx, .events = POLLIN };
+	uint32_t msg;
+
+	while (*expect < NR_MSGS) {
+		if (recv(rx, &msg, sizeof(msg), MSG_DONTWAIT) != sizeof(msg)) {
+			if (errno != EAGAIN) {
+				perror("recv");
+				return -1;
+			}
+			if (!wait)
+				return 0;
+			if (poll(&pfd, 1, 1000) <= 0) {
+				fprintf(stderr, "timeout after %u of %u datagrams\n",
+					*expect, NR_MSGS);
+				return -1;
+			}
+			continue;
+		}
+		if (msg != *expect) {
+			fprintf(stderr, "got %u, expected %u\n", msg, *expect);
+			return -1;
+		}
+		(*expect)++;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	struct sockaddr_qrtr rx_addr, tx_addr;
+	uint32_t seq, expect = 0;
+	int rx, tx, status, ret = 1;
+	pid_t pid;
+
+	rx = open_bound(&rx_addr);
+	if (rx < 0) {
+		if (errno == EAFNOSUPPORT) {
+			fprintf(stderr, "SKIP: no AF_QIPCRTR support\n");
+			return KSFT_SKIP;
+		}
+		perror("rx socket");
+		return 1;
+	}
+	tx = open_bound(&tx_addr);
+	if (tx < 0) {
+		perror("tx socket");
+		return 1;
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return 1;
+	}
+	if (!pid)
+		_exit(churn());
+
+	for (seq = 0; seq < NR_MSGS; seq++) {
+		/* a full receive queue refuses the datagram, make room */
+		while (sendto(tx, &seq, sizeof(seq), MSG_DONTWAIT,
+			      (struct sockaddr *)&rx_addr,
+			      sizeof(rx_addr)) < 0) {
+			if (errno != EAGAIN && errno != ENOSPC) {
+				perror("sendto");
+				goto out;
+			}
+			if (drain(rx, &expect, 0))
+				goto out;
+			usleep(100);
+		}
+		if (drain(rx, &expect, 0))
+			goto out;
+	}
+	if (drain(rx, &expect, 1))
+		goto out;
+	ret = 0;
+out:
+	if (ret)
+		kill(pid, SIGKILL);
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+	    WEXITSTATUS(status))
+		ret = 1;
+	close(tx);
+	close(rx);
+
+	printf("%s: %u datagrams in order\n", ret ? "FAIL" : "PASS", expect);
+	return ret;
+}
@@ -0,0 +1,197 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Periodic sleepers in a timer_slack cgroup, run once without and once with
+ * timer_slack.min_slack_ns/coalesce_ns set.  Reports the timer wakeups the
+ * cgroup saw and the timer interrupts of the whole system for each run, and
+ * checks that the coalescing run actually moved timers onto boundaries.
+ * Meant for an otherwise idle machine, e.g. QEMU.
+ *
+ * Usage: timer-slack-cgroup [timer_slack cgroup mount] [seconds] [sleepers]
+ * The default mount point is /sys/fs/cgroup/timer_slack.  Needs root.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "../kselftest.h"
+
+#define COALESCE_NS	16000000ULL
+
+struct sample {
+	unsigned long long wakeups;
+	unsigned long long idle_wakeups;
+	unsigned long long coalesced;
+	unsigned long long timer_irqs;
+};
+
+static char cg[4096];
+
+static int write_file(const char *name, unsigned long long val)
+{
+	char path[4200], buf[32];
+	int fd, len, ret;
+
+	snprintf(path, sizeof(path), "%s/%s", cg, name);
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -1;
+	len = snprintf(buf, sizeof(buf), "%llu\n", val);
+	ret = write(fd, buf, len) == len ? 0 : -1;
+	close(fd);
+	return ret;
+}
+
+/* Sum the per-CPU counts of the local timer interrupt lines. */
+static unsigned long long timer_irqs(void)
+{
+	unsigned long long sum = 0, v;
+	char line[4096], *p, *end;
+	FILE *f;
+
+	f = fopen("/proc/interrupts", "r");
+	if (!f)
+		return 0;
+	while (fgets(line, sizeof(line), f)) {
+		if (!strstr(line, "arch_timer") && !strstr(line, "LOC:"))
+			continue;
+		p = strchr(line, ':');
+		if (!p)
+			continue;
+		for (p++; ; p = end) {
+			v = strtoull(p, &end, 10);
+			if (end == p)
+				break;
+			sum += v;
+		}
+	}
+	fclose(f);
+	return sum;
+}
+
+static int read_sample(struct sample *s)
+{
+	char path[4200], key[32];
+	unsigned long long val;
+	FILE *f;
+
+	memset(s, 0, sizeof(*s));
+	snprintf(path, sizeof(path), "%s/timer_slack.stats", cg);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	while (fscanf(f, "%31s %llu", key, &val) == 2) {
+		if (!strcmp(key, "wakeups"))
+			s->wakeups = val;
+		else if (!strcmp(key, "idle_wakeups"))
+			s->idle_wakeups = val;
+		else if (!strcmp(key, "coalesced"))
+			s->coalesced = val;
+	}
+	fclose(f);
+	s->timer_irqs = timer_irqs();
+	return 0;
+}
+
+static void sleeper(int idx, int seconds)
+{
+	/* staggered periods so that the sleepers never line up on their own */
+	struct timespec ts = { 0, 10000000 + idx * 1300000 };
+	time_t end = time(NULL) + seconds;
+
+	if (write_file("cgroup.procs", getpid()))
+		_exit(1);
+	while (time(NULL) < end)
+		nanosleep(&ts, NULL);
+	_exit(0);
+}
+
+static int run(int seconds, int nr, struct sample *delta)
+{
+	struct sample before, after;
+	int i, status, ret = 0;
+	pid_t pid;
+
+	if (read_sample(&before))
+		return -1;
+	for (i = 0; i < nr; i++) {
+		pid = fork();
+		if (pid < 0)
+			return -1;
+		if (!pid)
+			sleeper(i, seconds);
+	}
+	for (i = 0; i < nr; i++) {
+		if (wait(&status) < 0 || !WIFEXITED(status) ||
+		    WEXITSTATUS(status))
+			ret = -1;
+	}
+	if (read_sample(&after))
+		return -1;
+
+	delta->wakeups = after.wakeups - before.wakeups;
+	delta->idle_wakeups = after.idle_wakeups - before.idle_wakeups;
+	delta->coalesced = after.coalesced - before.coalesced;
+	delta->timer_irqs = after.timer_irqs - before.timer_irqs;
+	return ret;
+}
+
+static void report(const char *what, struct sample *s)
+{
+	ksft_print_msg("%-10s: %llu wakeups (%llu from idle), %llu coalesced, %llu timer irqs\n",
+		       what, s->wakeups, s->idle_wakeups, s->coalesced,
+		       s->timer_irqs);
+}
+
+int main(int argc, char **argv)
+{
+	const char *root = argc > 1 ? argv[1] : "/sys/fs/cgroup/timer_slack";
+	int seconds = argc > 2 ? atoi(argv[2]) : 5;
+	int nr = argc > 3 ? atoi(argv[3]) : 8;
+	struct sample exact, coalesced;
+	struct stat st;
+	int ret;
+
+	if (seconds <= 0 || nr <= 0) {
+		fprintf(stderr, "usage: %s [cgroup mount] [seconds] [sleepers]\n",
+			argv[0]);
+		return 1;
+	}
+
+	ksft_print_header();
+
+	snprintf(cg, sizeof(cg), "%s/timer_slack.stats", root);
+	if (stat(cg, &st))
+		return ksft_exit_skip("no timer_slack cgroup at %s\n", root);
+
+	snprintf(cg, sizeof(cg), "%s/ksft_timer_slack", root);
+	if (mkdir(cg, 0755) && errno != EEXIST)
+		ksft_exit_fail_msg("mkdir %s: %s\n", cg, strerror(errno));
+
+	ret = write_file("timer_slack.min_slack_ns", 0) ||
+	      write_file("timer_slack.coalesce_ns", 0) ||
+	      run(seconds, nr, &exact);
+	if (!ret)
+		ret = write_file("timer_slack.min_slack_ns", COALESCE_NS) ||
+		      write_file("timer_slack.coalesce_ns", COALESCE_NS) ||
+		      run(seconds, nr, &coalesced);
+	rmdir(cg);
+	if (ret)
+		ksft_exit_fail_msg("cgroup setup or sleepers failed\n");
+
+	report("exact", &exact);
+	report("coalesced", &coalesced);
+
+	if (!coalesced.coalesced) {
+		ksft_test_result_fail("no timer was coalesced\n");
+		return ksft_exit_fail();
+	}
+	ksft_test_result_pass("%llu of %llu wakeups coalesced\n",
+			      coalesced.coalesced, coalesced.wakeups);
+	return ksft_exit_pass();
+}
@@ -0,0 +1,173 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Measure fork() latency with a large, populated, private file mapping in
+ * the parent, with and without PR_SET_LAZY_FORK, and check that the child
+ * sees the same contents either way.
+ *
+ * Usage: lazy_fork [size_mb] [iterations]
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include "../kselftest.h"
+
+#ifndef PR_SET_LAZY_FORK
+#define PR_SET_LAZY_FORK	0x4c5a4601
+#define PR_GET_LAZY_FORK	0x4c5a4602
+#endif
+
+#define DIRTY_STRIDE	64	/* dirty (COW) one page in this many */
+
+static unsigned long page_size;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static char expected(unsigned long pg)
+{
+	return pg % DIRTY_STRIDE ? (char)(pg & 0x7f) : (char)0xa5;
+}
+
+/* Runs in the child: every page must read back what the parent saw. */
+static int check_pages(char *map, unsigned long pages)
+{
+	unsigned long pg;
+
+	for (pg = 0; pg < pages; pg++) {
+		if (map[pg * page_size] != expected(pg)) {
+			fprintf(stderr, "page %lu: got %#x expected %#x\n",
+				pg, map[pg * page_size] & 0xff,
+				expected(pg) & 0xff);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int time_forks(char *map, unsigned long pages, int iters,
+		      unsigned long long *avg_ns)
+{
+	unsigned long long total = 0, start;
+	int i, status;
+	pid_t pid;
+
+	for (i = 0; i < iters; i++) {
+		start = now_ns();
+		pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			return 1;
+		}
+		if (!pid)
+			_exit(check_pages(map, pages));
+		total += now_ns() - start;
+
+		if (waitpid(pid, &status, 0) != pid) {
+			perror("waitpid");
+			return 1;
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+			fprintf(stderr, "child saw wrong contents\n");
+			return 1;
+		}
+	}
+	*avg_ns = total / iters;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long size_mb = argc > 1 ? strtoul(argv[1], NULL, 0) : 1024;
+	int iters = argc > 2 ? atoi(argv[2]) : 10;
+	unsigned long long eager_ns, lazy_ns;
+	char path[] = "/tmp/lazy_fork.XXXXXX";
+	unsigned long pages, pg;
+	char *map, *buf;
+	size_t size;
+	int fd, ret = 1;
+
+	page_size = sysconf(_SC_PAGESIZE);
+	size = size_mb << 20;
+	pages = size / page_size;
+	if (!pages || iters <= 0) {
+		fprintf(stderr, "usage: %s [size_mb] [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	if (prctl(PR_GET_LAZY_FORK, 0, 0, 0, 0) < 0) {
+		printf("PR_GET_LAZY_FORK not supported, skipping\n");
+		return KSFT_SKIP;
+	}
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		return 1;
+	}
+	unlink(path);
+
+	buf = malloc(page_size);
+	if (!buf)
+		goto out_close;
+	for (pg = 0; pg < pages; pg++) {
+		memset(buf, pg & 0x7f, page_size);
+		if (write(fd, buf, page_size) != (ssize_t)page_size) {
+			perror("write");
+			goto out_free;
+		}
+	}
+
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		goto out_free;
+	}
+
+	/* Fault in every page, then COW a fraction of them. */
+	for (pg = 0; pg < pages; pg++) {
+		volatile char c = map[pg * page_size];
+
+		(void)c;
+		if (!(pg % DIRTY_STRIDE))
+			map[pg * page_size] = expected(pg);
+	}
+
+	if (time_forks(map, pages, iters, &eager_ns))
+		goto out_unmap;
+
+	if (prctl(PR_SET_LAZY_FORK, 1, 0, 0, 0)) {
+		perror("PR_SET_LAZY_FORK");
+		goto out_unmap;
+	}
+	if (prctl(PR_GET_LAZY_FORK, 0, 0, 0, 0) != 1) {
+		fprintf(stderr, "PR_GET_LAZY_FORK does not report the mode\n");
+		goto out_unmap;
+	}
+
+	if (time_forks(map, pages, iters, &lazy_ns))
+		goto out_unmap;
+
+	printf("%lu MB mapped, %d forks: eager %llu us, lazy %llu us\n",
+	       size_mb, iters, eager_ns / 1000, lazy_ns / 1000);
+	ret = 0;
+
+out_unmap:
+	munmap(map, size);
+out_free:
+	free(buf);
+out_close:
+	close(fd);
+	return ret;
+}
@@ -0,0 +1,196 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Host to device file transfers through the MTP gadget function
+ *
+ * Runs both ends on one machine: a child calls MTP_RECEIVE_FILE on
+ * /dev/mtp_usb while the parent writes a known pattern to the bulk OUT
+ * endpoint of the gadget through usbdevfs, typically with dummy_hcd
+ * connecting the two (see mtp-rx-test.sh).  Each transfer is checked
+ * byte for byte, and must not disturb the transfer after it.
+ *
+ * Usage: mtp-rx-test /dev/bus/usb/BBB/DDD
+ */
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <linux/usb/ch9.h>
+#include <linux/usbdevice_fs.h>
+#include <linux/usb/f_mtp.h>
+
+#define CHUNK		16384
+#define TIMEOUT_MS	5000
+
+static int usb_fd, ep_out, maxpacket;
+
+static unsigned char pattern(int64_t off, unsigned int seed)
+{
+	return (unsigned char)(off * 131 + seed + (off >> 12));
+}
+
+/* Find the bulk OUT endpoint of interface 0 in the device's descriptors. */
+static int find_ep_out(void)
+{
+	unsigned char desc[4096], *p;
+	ssize_t len;
+
+	len = read(usb_fd, desc, sizeof(desc));
+	if (len < 0)
+		return -1;
+
+	for (p = desc; p + 2 <= desc + len && p[0]; p += p[0]) {
+		struct usb_endpoint_descriptor *ep = (void *)p;
+
+		if (p[1] != USB_DT_ENDPOINT || p[0] < USB_DT_ENDPOINT_SIZE)
+			continue;
+		if (usb_endpoint_is_bulk_out(ep)) {
+			ep_out = ep->bEndpointAddress;
+			maxpacket = le16toh(ep->wMaxPacketSize);
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static int bulk_out(void *buf, unsigned int len)
+{
+	struct usbdevfs_bulktransfer bulk = {
+		.ep = ep_out,
+		.len = len,
+		.timeout = TIMEOUT_MS,
+		.data = buf,
+	};
+
+	return ioctl(usb_fd, USBDEVFS_BULK, &bulk) == (int)len ? 0 : -1;
+}
+
+static int host_send(int64_t len, unsigned int seed)
+{
+	unsigned char buf[CHUNK];
+	int64_t off = 0, n, i;
+
+	while (off < len) {
+		n = len - off < CHUNK ? len - off : CHUNK;
+		for (i = 0; i < n; i++)
+			buf[i] = pattern(off + i, seed);
+		if (bulk_out(buf, n)) {
+			perror("bulk out");
+			return -1;
+		}
+		off += n;
+	}
+	return 0;
+}
+
+/* Gadget side: receive @len bytes into @fd at offset 0. */
+static pid_t device_receive(int mtp_fd, int fd, int64_t len)
+{
+	struct mtp_file_range mfr = { .fd = fd, .offset = 0, .length = len };
+	pid_t pid;
+
+	pid = fork();
+	if (pid)
+		return pid;
+	_exit(ioctl(mtp_fd, MTP_RECEIVE_FILE, &mfr) ? 1 : 0);
+}
+
+static int check_file(int fd, int64_t len, unsigned int seed)
+{
+	unsigned char buf[CHUNK];
+	int64_t off = 0, i;
+	ssize_t n;
+
+	while (off < len) {
+		n = pread(fd, buf, sizeof(buf), off);
+		if (n <= 0) {
+			fprintf(stderr, "short file at %lld\n", (long long)off);
+			return -1;
+		}
+		for (i = 0; i < n; i++) {
+			if (buf[i] != pattern(off + i, seed)) {
+				fprintf(stderr, "mismatch at %lld\n",
+					(long long)(off + i));
+				return -1;
+			}
+		}
+		off += n;
+	}
+	return 0;
+}
+
+static int transfer(int mtp_fd, int64_t len, unsigned int seed)
+{
+	char name[] = "/tmp/mtp-rx-XXXXXX";
+	int fd, status, ret = -1;
+	pid_t pid;
+
+	fd = mkstemp(name);
+	if (fd < 0)
+		return -1;
+	unlink(name);
+
+	pid = device_receive(mtp_fd, fd, len);
+	if (pid < 0)
+		goto out;
+	if (host_send(len, seed)) {
+		kill(pid, SIGKILL);
+		waitpid(pid, &status, 0);
+		goto out;
+	}
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+	    WEXITSTATUS(status)) {
+		fprintf(stderr, "MTP_RECEIVE_FILE failed\n");
+		goto out;
+	}
+	ret = check_file(fd, len, seed);
+out:
+	close(fd);
+	printf("%-4s %lld bytes\n", ret ? "FAIL" : "ok", (long long)len);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	/* whole requests, a short last packet, and a single short request */
+	static const int64_t lens[] = { 64 * CHUNK, 1000000, 12345 };
+	unsigned int i, intf = 0;
+	int mtp_fd, ret = 0;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s /dev/bus/usb/BBB/DDD\n", argv[0]);
+		return 1;
+	}
+
+	mtp_fd = open("/dev/mtp_usb", O_RDWR);
+	if (mtp_fd < 0) {
+		perror("/dev/mtp_usb");
+		return 1;
+	}
+	usb_fd = open(argv[1], O_RDWR);
+	if (usb_fd < 0) {
+		perror(argv[1]);
+		return 1;
+	}
+	if (find_ep_out() || ioctl(usb_fd, USBDEVFS_CLAIMINTERFACE, &intf)) {
+		fprintf(stderr, "no bulk OUT endpoint on interface 0\n");
+		return 1;
+	}
+
+	for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+		/* lengths ending on a full packet would need a ZLP */
+		if (lens[i] % CHUNK && !(lens[i] % maxpacket))
+			continue;
+		if (transfer(mtp_fd, lens[i], i))
+			ret = 1;
+	}
+
+	return ret;
+}
@@ -0,0 +1,60 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0
+#
+# Run mtp-rx-test against the MTP gadget function connected to the local
+# host through dummy_hcd.  Needs root, configfs, CONFIG_USB_DUMMY_HCD and
+# CONFIG_USB_CONFIGFS_F_MTP.  Extra arguments are module parameters for
+# the MTP function, e.g. mtp_rx_reqs=1 to compare against a single
+# outstanding OUT request.
+
+VID=0x18d1
+PID=0x4ee1
+G=/sys/kernel/config/usb_gadget/mtp_rx_test
+
+for p in "$@"; do
+	echo "${p#*=}" > /sys/module/usb_f_mtp/parameters/"${p%%=*}" ||
+		echo "cannot set $p" >&2
+done
+
+modprobe dummy_hcd 2>/dev/null
+mountpoint -q /sys/kernel/config || mount -t configfs none /sys/kernel/config
+UDC=$(ls /sys/class/udc | grep dummy_udc | head -n 1)
+if [ -z "$UDC" ]; then
+	echo "no dummy_udc, skipping" >&2
+	exit 4
+fi
+
+cleanup() {
+	echo "" > $G/UDC 2>/dev/null
+	rm -f $G/configs/c.1/mtp.gs0
+	rmdir $G/configs/c.1/strings/0x409 $G/configs/c.1 \
+	      $G/functions/mtp.gs0 $G/strings/0x409 $G 2>/dev/null
+}
+trap cleanup EXIT
+
+mkdir -p $G/strings/0x409 $G/configs/c.1/strings/0x409 || exit 1
+echo $VID > $G/idVendor
+echo $PID > $G/idProduct
+echo mtp-rx-test > $G/strings/0x409/product
+echo mtp > $G/configs/c.1/strings/0x409/configuration
+mkdir $G/functions/mtp.gs0 || exit 1
+ln -s $G/functions/mtp.gs0 $G/configs/c.1/
+echo "$UDC" > $G/UDC || exit 1
+
+# wait for the host side to enumerate the gadget
+for i in $(seq 50); do
+	for d in /sys/bus/usb/devices/*; do
+		[ "$(cat $d/idVendor 2>/dev/null)" = "${VID#0x}" ] &&
+		[ "$(cat $d/idProduct 2>/dev/null)" = "${PID#0x}" ] &&
+			DEV=$(printf /dev/bus/usb/%03d/%03d \
+				$(cat $d/busnum) $(cat $d/devnum))
+	done
+	[ -n "$DEV" ] && break
+	sleep 0.1
+done
+if [ -z "$DEV" ]; then
+	echo "gadget did not enumerate" >&2
+	exit 1
+fi
+
+"$(dirname "$0")"/mtp-rx-test "$DEV"